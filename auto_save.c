@@ -37,6 +37,16 @@ bool should_auto_save(AutoSave *auto_save, bool is_modified)
     return (current_time - auto_save->last_save_time) >= auto_save->save_interval;
 }
 
+uint32_t auto_save_wait(const AutoSave *auto_save, bool is_modified)
+{
+    if (!auto_save->enabled || !is_modified) {
+        return UINT32_MAX;
+    }
+
+    uint32_t elapsed = SDL_GetTicks() - auto_save->last_save_time;
+    return elapsed >= auto_save->save_interval ? 0 : auto_save->save_interval - elapsed;
+}
+
 void mark_for_auto_save(AutoSave *auto_save)
 {
     auto_save->needs_save = true;
@@ -48,9 +58,14 @@ void reset_auto_save_timer(AutoSave *auto_save)
     auto_save->needs_save = false;
 }
 
-bool perform_auto_save(AutoSave *auto_save, DocumentState *doc, const char *text)
+bool perform_auto_save(AutoSave *auto_save, DocumentState *doc, const PieceTable *buffer)
 {
-    if (!auto_save->enabled || !doc->filename) {
+    if (!auto_save->enabled) {
+        return false;
+    }
+    if (!doc->filename) {
+        // Nowhere to save yet; check again after another interval
+        reset_auto_save_timer(auto_save);
         return false;
     }
 
@@ -58,12 +73,14 @@ bool perform_auto_save(AutoSave *auto_save, DocumentState *doc, const char *text
     char auto_save_path[512];
     snprintf(auto_save_path, sizeof(auto_save_path), "%s.autosave", doc->filename);
 
-    if (save_file(auto_save_path, text)) {
+    if (save_file(auto_save_path, buffer)) {
         reset_auto_save_timer(auto_save);
         debug_print(L"Auto-saved to %s\n", auto_save_path);
         return true;
     }
 
+    // Retry after another interval rather than on every pass of the event loop
+    reset_auto_save_timer(auto_save);
     debug_print(L"Auto-save failed for %s\n", auto_save_path);
     return false;
 }
@@ -19,8 +19,10 @@ void set_auto_save_interval(AutoSave *auto_save, uint32_t interval_ms);
 
 // Check and perform auto-save
 bool should_auto_save(AutoSave *auto_save, bool is_modified);
+// Milliseconds until should_auto_save turns true, UINT32_MAX when no auto-save is pending
+uint32_t auto_save_wait(const AutoSave *auto_save, bool is_modified);
 void mark_for_auto_save(AutoSave *auto_save);
 void reset_auto_save_timer(AutoSave *auto_save);
-bool perform_auto_save(AutoSave *auto_save, DocumentState *doc, const char *text);
+bool perform_auto_save(AutoSave *auto_save, DocumentState *doc, const PieceTable *buffer);
 
 #endif
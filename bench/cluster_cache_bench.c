@@ -5,7 +5,7 @@
 #include <sys/time.h>
 #include <time.h>
 
-#include "bench_text_renderer_shim.h"
+#include "cluster_cache.h"
 
 // Generate a test string: 'e' followed by N combining acute accents (U+0301)
 // UTF-8 for U+0301 is 0xCC 0x81 (2 bytes). Base 'e' = 0x65.
@@ -52,27 +52,38 @@ int main(int argc, char **argv)
     printf("Generated text: base + %zu combining marks -> clusters=%zu, bytes=%zu\n", combining,
            clusters, strlen(text));
 
-    RenderData rd;
-    memset(&rd, 0, sizeof(rd));
-    rd.lazy_mode = 1;
-    rd.cluster_block_size = 1024;
-    rd.cluster_cache_blocks = 32; // keep cache moderately large for benchmark
-    rd.cluster_block_cache = NULL;
+    // Block size and cache size match the old shim configuration
+    ClusterBlockCache *cache = create_cluster_block_cache(1024, 32);
+    if (!cache) {
+        fprintf(stderr, "Failed to allocate cluster cache\n");
+        return 2;
+    }
+
+    // One pass builds the checkpoint table, as update_render_data does per layout
+    size_t text_len = strlen(text);
+    double t0 = now_sec();
+    if (!cluster_cache_reset(cache, text, text_len)) {
+        fprintf(stderr, "Failed to build checkpoints\n");
+        return 2;
+    }
+    double t1 = now_sec();
+    printf("Indexed %d clusters into %d checkpoints in %.3fs\n", cache->num_clusters,
+           cache->num_checkpoints, t1 - t0);
 
     // Warm-up: perform sequential accesses to populate a few blocks
     size_t probes = 10000;
     unsigned int seed = (unsigned int) time(NULL);
-    double t0 = now_sec();
+    t0 = now_sec();
     for (size_t i = 0; i < probes; i++) {
         // random cluster within full range
         int idx = (int) (rand_r(&seed) % clusters);
-        int off = get_cluster_byte_offset(&rd, text, idx);
+        int off = cluster_cache_byte_offset(cache, text, idx);
         if (off < 0) {
             fprintf(stderr, "Error computing offset for idx %d\n", idx);
             break;
         }
     }
-    double t1 = now_sec();
+    t1 = now_sec();
 
     struct rusage ru;
     getrusage(RUSAGE_SELF, &ru);
@@ -83,7 +94,7 @@ int main(int argc, char **argv)
     t0 = now_sec();
     for (size_t i = 0; i < measured_probes; i++) {
         int idx = (int) (rand_r(&seed) % clusters);
-        int off = get_cluster_byte_offset(&rd, text, idx);
+        int off = cluster_cache_byte_offset(cache, text, idx);
         if (off < 0) {
             fprintf(stderr, "Error computing offset for idx %d\n", idx);
             break;
@@ -94,9 +105,13 @@ int main(int argc, char **argv)
     printf("Measured %zu probes in %.3fs (%.3f us/probe), maxrss=%ld KB\n", measured_probes,
            t1 - t0, (t1 - t0) * 1e6 / measured_probes, ru.ru_maxrss);
 
+    printf("Cache: %llu hits, %llu misses (%llu ghost hits), %llu evictions\n",
+           (unsigned long long) cache->stats.hits, (unsigned long long) cache->stats.misses,
+           (unsigned long long) cache->stats.ghost_hits,
+           (unsigned long long) cache->stats.evictions);
+
     // Clean up
-    invalidate_cluster_blocks_after(&rd, 0);
-    cleanup_render_data(&rd);
+    destroy_cluster_block_cache(cache);
     free(text);
     return 0;
 }
@@ -7,7 +7,7 @@ CFLAGS="-O2 -g"
 INCLUDES="-I.."
 LDLIBS=""
 
-$CC $CFLAGS $INCLUDES cluster_cache_bench.c -o cluster_cache_bench
+$CC $CFLAGS $INCLUDES cluster_cache_bench.c ../cluster_cache.c ../utf8_simd.c ../debug.c -o cluster_cache_bench
 
 echo "Running benchmark (1M combining marks)..."
 ./cluster_cache_bench 1000000
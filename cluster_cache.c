@@ -0,0 +1,711 @@
+#include "cluster_cache.h"
+#include "debug.h"
+#include "utf8_simd.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Hash a block index into the bucket table
+static unsigned bucket_of(const ClusterBlockCache *cache, int block_index)
+{
+    uint32_t h = (uint32_t) block_index * 2654435761u;
+    return (h ^ (h >> 16)) & cache->bucket_mask;
+}
+
+static void list_remove(ClusterBlockCache *cache, int e)
+{
+    ClusterBlock *b = &cache->blocks[e];
+    if (b->prev >= 0)
+        cache->blocks[b->prev].next = b->next;
+    else
+        cache->list_head[b->list] = b->next;
+    if (b->next >= 0)
+        cache->blocks[b->next].prev = b->prev;
+    else
+        cache->list_tail[b->list] = b->prev;
+    cache->list_size[b->list]--;
+}
+
+// Link e at the most recently used end of list
+static void list_push(ClusterBlockCache *cache, int list, int e)
+{
+    ClusterBlock *b = &cache->blocks[e];
+    b->list = list;
+    b->prev = -1;
+    b->next = cache->list_head[list];
+    if (b->next >= 0)
+        cache->blocks[b->next].prev = e;
+    else
+        cache->list_tail[list] = e;
+    cache->list_head[list] = e;
+    cache->list_size[list]++;
+}
+
+static int hash_find(const ClusterBlockCache *cache, int block_index)
+{
+    int e = cache->buckets[bucket_of(cache, block_index)];
+    while (e >= 0 && cache->blocks[e].block_index != block_index)
+        e = cache->blocks[e].hash_next;
+    return e;
+}
+
+static void hash_insert(ClusterBlockCache *cache, int e)
+{
+    unsigned bucket = bucket_of(cache, cache->blocks[e].block_index);
+    cache->blocks[e].hash_next = cache->buckets[bucket];
+    cache->buckets[bucket] = e;
+}
+
+static void hash_remove(ClusterBlockCache *cache, int e)
+{
+    int *link = &cache->buckets[bucket_of(cache, cache->blocks[e].block_index)];
+    while (*link != e)
+        link = &cache->blocks[*link].hash_next;
+    *link = cache->blocks[e].hash_next;
+}
+
+// Turn a resident block into a ghost on the given list, freeing its offsets
+static void demote_block(ClusterBlockCache *cache, int e, int ghost_list)
+{
+    ClusterBlock *b = &cache->blocks[e];
+    list_remove(cache, e);
+    cache->free_slots[cache->num_free_slots++] = b->slot;
+    b->slot = -1;
+    list_push(cache, ghost_list, e);
+}
+
+// Forget an entry entirely, resident or ghost
+static void drop_block(ClusterBlockCache *cache, int e)
+{
+    ClusterBlock *b = &cache->blocks[e];
+    if (b->slot >= 0)
+        cache->free_slots[cache->num_free_slots++] = b->slot;
+    b->slot = -1;
+    hash_remove(cache, e);
+    list_remove(cache, e);
+    list_push(cache, CLUSTER_LIST_FREE, e);
+}
+
+// Forget every cached block and ghost
+static void clear_blocks(ClusterBlockCache *cache)
+{
+    int entries = 2 * cache->num_blocks_cached;
+    for (int list = 0; list < CLUSTER_LIST_COUNT; list++) {
+        cache->list_head[list] = -1;
+        cache->list_tail[list] = -1;
+        cache->list_size[list] = 0;
+    }
+    for (int e = 0; e < entries; e++) {
+        cache->blocks[e].slot = -1;
+        list_push(cache, CLUSTER_LIST_FREE, e);
+    }
+    for (unsigned i = 0; i <= cache->bucket_mask; i++)
+        cache->buckets[i] = -1;
+    cache->num_free_slots = cache->num_blocks_cached;
+    for (int i = 0; i < cache->num_free_slots; i++)
+        cache->free_slots[i] = i;
+    cache->target_recent = 0;
+}
+
+bool cluster_cache_configure(ClusterBlockCache *cache, int block_size, int num_blocks)
+{
+    if (block_size <= 0)
+        block_size = CLUSTER_BLOCK_SIZE;
+    if (num_blocks <= 0)
+        num_blocks = CLUSTER_CACHE_BLOCKS;
+    if (cache->blocks && block_size == cache->block_size && num_blocks == cache->num_blocks_cached)
+        return true;
+
+    // A power of two with at least two buckets per entry keeps chains short
+    unsigned buckets = 16;
+    while (buckets < 4u * (unsigned) num_blocks)
+        buckets *= 2;
+    ClusterBlock *blocks = malloc(2 * (size_t) num_blocks * sizeof(ClusterBlock));
+    int *offsets = malloc((size_t) num_blocks * block_size * sizeof(int));
+    int *free_slots = malloc((size_t) num_blocks * sizeof(int));
+    int *bucket_heads = malloc(buckets * sizeof(int));
+    if (!blocks || !offsets || !free_slots || !bucket_heads) {
+        free(blocks);
+        free(offsets);
+        free(free_slots);
+        free(bucket_heads);
+        debug_print(L"[ERROR] Failed to allocate cluster block cache (%d x %d)\n", num_blocks,
+                    block_size);
+        return false;
+    }
+
+    free(cache->blocks);
+    free(cache->offsets);
+    free(cache->free_slots);
+    free(cache->buckets);
+    cache->blocks = blocks;
+    cache->offsets = offsets;
+    cache->free_slots = free_slots;
+    cache->buckets = bucket_heads;
+    cache->bucket_mask = buckets - 1;
+    cache->block_size = block_size;
+    cache->num_blocks_cached = num_blocks;
+    clear_blocks(cache);
+    return true;
+}
+
+ClusterBlockCache *create_cluster_block_cache(int block_size, int num_blocks)
+{
+    ClusterBlockCache *cache = calloc(1, sizeof(ClusterBlockCache));
+    if (!cache)
+        return NULL;
+    if (!cluster_cache_configure(cache, block_size, num_blocks)) {
+        free(cache);
+        return NULL;
+    }
+    return cache;
+}
+
+void destroy_cluster_block_cache(ClusterBlockCache *cache)
+{
+    if (!cache)
+        return;
+    free(cache->blocks);
+    free(cache->offsets);
+    free(cache->free_slots);
+    free(cache->buckets);
+    free(cache->checkpoints);
+    free(cache);
+}
+
+static bool push_checkpoint(ClusterCheckpoint **items, int *count, int *capacity, int cluster,
+                            size_t byte_offset)
+{
+    if (*count == *capacity) {
+        int new_capacity = *capacity ? *capacity * 2 : 16;
+        ClusterCheckpoint *grown = realloc(*items, new_capacity * sizeof(ClusterCheckpoint));
+        if (!grown)
+            return false;
+        *items = grown;
+        *capacity = new_capacity;
+    }
+    (*items)[*count].cluster = cluster;
+    (*items)[*count].byte_offset = byte_offset;
+    (*count)++;
+    return true;
+}
+
+static bool is_continuation(char c)
+{
+    return ((unsigned char) c & 0xC0) == 0x80;
+}
+
+// The utf8_simd counts take the first byte of each chunk as a codepoint
+// start; past the first chunk of a range a continuation byte there is not one
+size_t count_codepoints_in(const PieceTable *text, size_t from, size_t to)
+{
+    PieceIterator it;
+    piece_iterator_init(&it, text, from, to);
+    const char *data;
+    size_t len, count = 0;
+    bool first = true;
+    while (piece_iterator_next(&it, &data, &len)) {
+        count += utf8_count_codepoints(data, len);
+        if (!first && is_continuation(data[0]))
+            count--;
+        first = false;
+    }
+    return count;
+}
+
+size_t codepoint_offset_in(const PieceTable *text, size_t from, size_t to, size_t n)
+{
+    PieceIterator it;
+    piece_iterator_init(&it, text, from, to);
+    const char *data;
+    size_t len, pos = from;
+    bool first = true;
+    while (piece_iterator_next(&it, &data, &len)) {
+        size_t extra = !first && is_continuation(data[0]) ? 1 : 0;
+        size_t off = utf8_codepoint_offset(data, len, n + extra);
+        if (off < len)
+            return pos + off;
+        n -= utf8_count_codepoints(data, len) - extra;
+        pos += len;
+        first = false;
+    }
+    return to;
+}
+
+// Count the clusters in text[from, to), where from starts cluster first, and
+// append a checkpoint for every CLUSTER_CHECKPOINT_INTERVAL-th cluster after
+// from. Returns the count, or -1 if a checkpoint could not be stored.
+static int scan_span(const PieceTable *text, size_t from, size_t to, int first,
+                     ClusterCheckpoint **items, int *count, int *capacity)
+{
+    size_t pos = from;
+    int clusters = 0;
+    for (;;) {
+        size_t next = codepoint_offset_in(text, pos, to, CLUSTER_CHECKPOINT_INTERVAL);
+        if (next >= to)
+            return clusters + (int) count_codepoints_in(text, pos, to);
+        pos = next;
+        clusters += CLUSTER_CHECKPOINT_INTERVAL;
+        if (!push_checkpoint(items, count, capacity, first + clusters, pos))
+            return -1;
+    }
+}
+
+// Last checkpoint at or before cluster
+static const ClusterCheckpoint *checkpoint_for_cluster(const ClusterBlockCache *cache, int cluster)
+{
+    int lo = 0, hi = cache->num_checkpoints - 1;
+    while (lo < hi) {
+        int mid = lo + (hi - lo + 1) / 2;
+        if (cache->checkpoints[mid].cluster <= cluster)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return &cache->checkpoints[lo];
+}
+
+// Number of checkpoints whose byte offset is at most byte (at least 1)
+static int checkpoints_through_byte(const ClusterBlockCache *cache, size_t byte)
+{
+    int lo = 1, hi = cache->num_checkpoints;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (cache->checkpoints[mid].byte_offset <= byte)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    return lo;
+}
+
+void cluster_cache_invalidate_after(ClusterBlockCache *cache, int cluster)
+{
+    if (!cache)
+        return;
+    if (cluster <= 0) {
+        clear_blocks(cache);
+        return;
+    }
+    int cutoff = cluster / cache->block_size;
+    for (int e = 0; e < 2 * cache->num_blocks_cached; e++) {
+        ClusterBlock *b = &cache->blocks[e];
+        if (b->list != CLUSTER_LIST_FREE && b->block_index >= cutoff)
+            drop_block(cache, e);
+    }
+}
+
+bool cluster_cache_reset(ClusterBlockCache *cache, const PieceTable *text)
+{
+    size_t len = piece_table_length(text);
+    cluster_cache_invalidate_after(cache, 0);
+    cache->synced = false;
+    cache->num_checkpoints = 0;
+    if (!push_checkpoint(&cache->checkpoints, &cache->num_checkpoints,
+                         &cache->checkpoint_capacity, 0, 0))
+        return false;
+    int clusters = scan_span(text, 0, len, 0, &cache->checkpoints, &cache->num_checkpoints,
+                             &cache->checkpoint_capacity);
+    if (clusters < 0) {
+        debug_print(L"[ERROR] Failed to allocate cluster checkpoints\n");
+        return false;
+    }
+    cache->num_clusters = clusters;
+    cache->text_length = len;
+    cache->synced = true;
+    return true;
+}
+
+// Make room for one resident block by demoting the LRU block of RECENT or
+// FREQUENT to its ghost list, whichever is over its adaptive target
+static void replace_block(ClusterBlockCache *cache, bool ghost_frequent_hit)
+{
+    int recent = cache->list_size[CLUSTER_LIST_RECENT];
+    if (recent > 0 && (recent > cache->target_recent ||
+                       (ghost_frequent_hit && recent == cache->target_recent) ||
+                       cache->list_size[CLUSTER_LIST_FREQUENT] == 0))
+        demote_block(cache, cache->list_tail[CLUSTER_LIST_RECENT], CLUSTER_LIST_GHOST_RECENT);
+    else
+        demote_block(cache, cache->list_tail[CLUSTER_LIST_FREQUENT], CLUSTER_LIST_GHOST_FREQUENT);
+    cache->stats.evictions++;
+}
+
+static bool cache_full(const ClusterBlockCache *cache)
+{
+    return cache->num_free_slots == 0;
+}
+
+// Return the resident block block_idx, running one ARC request. *created is
+// set when the block was not resident and its offsets must be filled.
+static ClusterBlock *get_or_create_block(ClusterBlockCache *cache, int block_idx, bool *created)
+{
+    int c = cache->num_blocks_cached;
+    int e = hash_find(cache, block_idx);
+    *created = false;
+    if (e >= 0 && cache->blocks[e].slot >= 0) {
+        // Hit: a second reference promotes the block to FREQUENT
+        cache->stats.hits++;
+        list_remove(cache, e);
+        list_push(cache, CLUSTER_LIST_FREQUENT, e);
+        return &cache->blocks[e];
+    }
+
+    cache->stats.misses++;
+    int *size = cache->list_size;
+    int target = CLUSTER_LIST_RECENT;
+    if (e >= 0) {
+        // Ghost hit: grow the list that would have kept this block
+        cache->stats.ghost_hits++;
+        bool frequent = cache->blocks[e].list == CLUSTER_LIST_GHOST_FREQUENT;
+        if (frequent) {
+            int step = size[CLUSTER_LIST_GHOST_RECENT] / size[CLUSTER_LIST_GHOST_FREQUENT];
+            cache->target_recent -= step > 1 ? step : 1;
+            if (cache->target_recent < 0)
+                cache->target_recent = 0;
+        } else {
+            int step = size[CLUSTER_LIST_GHOST_FREQUENT] / size[CLUSTER_LIST_GHOST_RECENT];
+            cache->target_recent += step > 1 ? step : 1;
+            if (cache->target_recent > c)
+                cache->target_recent = c;
+        }
+        list_remove(cache, e);
+        if (cache_full(cache))
+            replace_block(cache, frequent);
+        target = CLUSTER_LIST_FREQUENT;
+    } else {
+        // Complete miss: keep the ghost lists within the ARC bounds
+        int recent_total = size[CLUSTER_LIST_RECENT] + size[CLUSTER_LIST_GHOST_RECENT];
+        int total = recent_total + size[CLUSTER_LIST_FREQUENT] + size[CLUSTER_LIST_GHOST_FREQUENT];
+        if (recent_total >= c && size[CLUSTER_LIST_GHOST_RECENT] > 0) {
+            drop_block(cache, cache->list_tail[CLUSTER_LIST_GHOST_RECENT]);
+        } else if (recent_total >= c) {
+            drop_block(cache, cache->list_tail[CLUSTER_LIST_RECENT]);
+            cache->stats.evictions++;
+        } else if (total >= 2 * c && size[CLUSTER_LIST_GHOST_FREQUENT] > 0) {
+            drop_block(cache, cache->list_tail[CLUSTER_LIST_GHOST_FREQUENT]);
+        }
+        if (cache_full(cache))
+            replace_block(cache, false);
+        e = cache->list_tail[CLUSTER_LIST_FREE];
+        list_remove(cache, e);
+        cache->blocks[e].block_index = block_idx;
+        hash_insert(cache, e);
+    }
+
+    ClusterBlock *b = &cache->blocks[e];
+    b->slot = cache->free_slots[--cache->num_free_slots];
+    list_push(cache, target, e);
+    *created = true;
+    return b;
+}
+
+static int *block_offsets(const ClusterBlockCache *cache, const ClusterBlock *b)
+{
+    return cache->offsets + (size_t) b->slot * cache->block_size;
+}
+
+// Byte offset of cluster, seeking from the nearest checkpoint before it
+static size_t seek_cluster(const ClusterBlockCache *cache, const PieceTable *text, int cluster)
+{
+    const ClusterCheckpoint *cp = checkpoint_for_cluster(cache, cluster);
+    return codepoint_offset_in(text, cp->byte_offset, cache->text_length,
+                               (size_t) (cluster - cp->cluster));
+}
+
+// Record the block's offsets, reading the pieces from its first cluster on
+static void fill_block(const ClusterBlockCache *cache, const PieceTable *text, ClusterBlock *b)
+{
+    int *offsets = block_offsets(cache, b);
+    int first = b->block_index * cache->block_size;
+    int count = cache->num_clusters - first;
+    if (count > cache->block_size)
+        count = cache->block_size;
+    int k = 0;
+    if (count > 0) {
+        size_t pos = seek_cluster(cache, text, first);
+        offsets[k++] = (int) pos;
+        PieceIterator it;
+        piece_iterator_init(&it, text, pos + 1, cache->text_length);
+        const char *data;
+        size_t len, at = pos + 1;
+        while (k < count && piece_iterator_next(&it, &data, &len)) {
+            for (size_t i = 0; i < len && k < count; i++) {
+                if (!is_continuation(data[i]))
+                    offsets[k++] = (int) (at + i);
+            }
+            at += len;
+        }
+    }
+    for (; k < cache->block_size; k++)
+        offsets[k] = -1;
+}
+
+// Document bytes around the last one read, copied a window at a time for
+// the byte steps of rebase_blocks
+#define TEXT_WINDOW_SIZE 4096
+
+typedef struct {
+    const PieceTable *text;
+    size_t start; // document offset of data[0]
+    size_t len;
+    char data[TEXT_WINDOW_SIZE];
+} TextWindow;
+
+// Byte at pos, which must lie inside the document
+static char window_byte(TextWindow *w, size_t pos)
+{
+    if (pos < w->start || pos - w->start >= w->len) {
+        // Centred, so steps in either direction stay inside for a while
+        w->start = pos > TEXT_WINDOW_SIZE / 2 ? pos - TEXT_WINDOW_SIZE / 2 : 0;
+        w->len = piece_table_copy(w->text, w->start, TEXT_WINDOW_SIZE, w->data);
+    }
+    return w->data[pos - w->start];
+}
+
+// Clusters starting in text[from, to); byte 0 always starts one
+static int count_starts(const PieceTable *text, size_t from, size_t to)
+{
+    if (from >= to)
+        return 0;
+    int count = (int) count_codepoints_in(text, from, to);
+    return from > 0 && is_continuation(piece_table_byte_at(text, from)) ? count - 1 : count;
+}
+
+typedef struct {
+    int block_index; // index before the edit
+    int entry;
+} MovedBlock;
+
+static int compare_moved_blocks(const void *a, const void *b)
+{
+    int x = ((const MovedBlock *) a)->block_index, y = ((const MovedBlock *) b)->block_index;
+    return (x > y) - (x < y);
+}
+
+// Byte offset cached before the edit for old cluster, or -2 if not cached
+static int saved_offset(const MovedBlock *moved, const int *saved, int n, int bs, int cluster)
+{
+    int lo = 0, hi = n;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (moved[mid].block_index < cluster / bs)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo == n || moved[lo].block_index != cluster / bs)
+        return -2;
+    return saved[(size_t) lo * bs + cluster % bs];
+}
+
+// Move resident blocks at or after the edit to their new cluster range.
+// Clusters before edit are unchanged, old clusters [edit, old_end) were
+// replaced, and later ones moved by delta clusters and shift bytes. A block
+// keeps its ARC position and takes the block index where most of its
+// surviving clusters land. Its offsets are assembled from the old blocks, and
+// only the clusters no resident block covered (the inserted text, or a
+// neighbour that was not cached) are scanned, starting next to a known offset.
+static bool rebase_blocks(ClusterBlockCache *cache, const PieceTable *text, int edit,
+                          int old_end, int delta, long long shift)
+{
+    int bs = cache->block_size;
+    int first_block = edit / bs;
+    MovedBlock *moved = malloc(cache->num_blocks_cached * sizeof(MovedBlock));
+    int *saved = malloc((size_t) cache->num_blocks_cached * bs * sizeof(int));
+    if (!moved || !saved) {
+        free(moved);
+        free(saved);
+        return false;
+    }
+
+    // Ghosts past the edit name blocks that no longer line up; forget them
+    int n = 0;
+    for (int e = 0; e < 2 * cache->num_blocks_cached; e++) {
+        ClusterBlock *b = &cache->blocks[e];
+        if (b->list == CLUSTER_LIST_FREE || b->block_index < first_block)
+            continue;
+        if (b->slot < 0) {
+            drop_block(cache, e);
+            continue;
+        }
+        moved[n].block_index = b->block_index;
+        moved[n].entry = e;
+        n++;
+    }
+    qsort(moved, n, sizeof(MovedBlock), compare_moved_blocks);
+    for (int i = 0; i < n; i++) {
+        ClusterBlock *b = &cache->blocks[moved[i].entry];
+        memcpy(saved + (size_t) i * bs, block_offsets(cache, b), bs * sizeof(int));
+        hash_remove(cache, moved[i].entry);
+    }
+
+    // Re-key in old order so the block holding the edit keeps its index
+    for (int i = 0; i < n; i++) {
+        ClusterBlock *b = &cache->blocks[moved[i].entry];
+        int old_first = moved[i].block_index * bs;
+        int key = moved[i].block_index;
+        if (old_first >= edit) {
+            int start = old_first > old_end ? old_first : old_end;
+            int end = old_first + bs;
+            key = start < end ? ((start + end - 1) / 2 + delta) / bs : -1;
+        }
+        if (key < 0 || key * bs >= cache->num_clusters || hash_find(cache, key) >= 0) {
+            cache->free_slots[cache->num_free_slots++] = b->slot;
+            b->slot = -1;
+            list_remove(cache, moved[i].entry);
+            list_push(cache, CLUSTER_LIST_FREE, moved[i].entry);
+            continue;
+        }
+        b->block_index = key;
+        hash_insert(cache, moved[i].entry);
+    }
+
+    size_t len = cache->text_length;
+    TextWindow window = {.text = text};
+    for (int i = 0; i < n; i++) {
+        ClusterBlock *b = &cache->blocks[moved[i].entry];
+        if (b->slot < 0)
+            continue;
+        int *offsets = block_offsets(cache, b);
+        int first = b->block_index * bs;
+        int known = -1;
+        for (int k = 0; k < bs; k++) {
+            int x = first + k;
+            int off = -2;
+            if (x >= cache->num_clusters)
+                off = -1;
+            else if (x < edit)
+                off = saved_offset(moved, saved, n, bs, x);
+            else if (x >= old_end + delta) {
+                off = saved_offset(moved, saved, n, bs, x - delta);
+                if (off >= 0)
+                    off = (int) (off + shift);
+            }
+            offsets[k] = off;
+            if (off >= 0 && known < 0)
+                known = k;
+        }
+        if (known < 0) {
+            fill_block(cache, text, b);
+            continue;
+        }
+        // Step backwards and forwards from the known offsets over the gaps
+        for (int k = known - 1; k >= 0; k--) {
+            size_t pos = (size_t) offsets[k + 1] - 1;
+            while (pos > 0 && is_continuation(window_byte(&window, pos)))
+                pos--;
+            offsets[k] = (int) pos;
+        }
+        for (int k = known + 1; k < bs; k++) {
+            if (offsets[k] != -2)
+                continue;
+            size_t pos = (size_t) offsets[k - 1] + 1;
+            while (pos < len && is_continuation(window_byte(&window, pos)))
+                pos++;
+            offsets[k] = (int) pos;
+        }
+    }
+
+    free(moved);
+    free(saved);
+    return true;
+}
+
+bool cluster_cache_apply_edit(ClusterBlockCache *cache, const PieceTable *text, size_t pos,
+                              size_t removed, size_t inserted)
+{
+    size_t len = piece_table_length(text);
+    size_t old_len = cache->text_length;
+    if (!cache->synced || pos > old_len || removed > old_len - pos ||
+        len != old_len - removed + inserted)
+        return cluster_cache_reset(cache, text);
+
+    // Whether a byte starts a cluster does not depend on its neighbours, so
+    // only the span between the checkpoints around the edit needs a rescan.
+    // The first checkpoint (0, 0) stays valid whatever is inserted before it.
+    int lo = pos > 0 ? checkpoints_through_byte(cache, pos - 1) - 1 : 0;
+    int hi = checkpoints_through_byte(cache, pos + removed);
+    int count = cache->num_checkpoints;
+    const ClusterCheckpoint start = cache->checkpoints[lo];
+    size_t span_end = hi < count ? cache->checkpoints[hi].byte_offset - removed + inserted : len;
+    int old_clusters = (hi < count ? cache->checkpoints[hi].cluster : cache->num_clusters) -
+                       start.cluster;
+
+    ClusterCheckpoint *fresh = NULL;
+    int fresh_count = 0, fresh_capacity = 0;
+    int clusters = scan_span(text, start.byte_offset, span_end, start.cluster, &fresh,
+                             &fresh_count, &fresh_capacity);
+    int tail = count - hi;
+    int new_count = lo + 1 + fresh_count + tail;
+    if (clusters >= 0 && new_count > cache->checkpoint_capacity) {
+        ClusterCheckpoint *grown =
+            realloc(cache->checkpoints, new_count * sizeof(ClusterCheckpoint));
+        if (grown) {
+            cache->checkpoints = grown;
+            cache->checkpoint_capacity = new_count;
+        } else {
+            clusters = -1;
+        }
+    }
+    if (clusters < 0) {
+        free(fresh);
+        cluster_cache_invalidate_after(cache, 0);
+        cache->synced = false;
+        debug_print(L"[ERROR] Failed to update cluster checkpoints\n");
+        return false;
+    }
+
+    // Replace the checkpoints inside the span and shift the ones after it
+    int delta = clusters - old_clusters;
+    ClusterCheckpoint *cp = cache->checkpoints;
+    memmove(cp + lo + 1 + fresh_count, cp + hi, tail * sizeof(ClusterCheckpoint));
+    if (fresh_count > 0)
+        memcpy(cp + lo + 1, fresh, fresh_count * sizeof(ClusterCheckpoint));
+    free(fresh);
+    for (int i = new_count - tail; i < new_count; i++) {
+        cp[i].cluster += delta;
+        cp[i].byte_offset = cp[i].byte_offset - removed + inserted;
+    }
+    cache->num_checkpoints = new_count;
+    cache->num_clusters += delta;
+    cache->text_length = len;
+
+    // Clusters that start before pos keep their index and offset. At the very
+    // start of the text a continuation byte counts as a cluster, so a byte
+    // moving to or from offset 0 can change whether it starts one.
+    int edit_cluster = start.cluster + (int) count_codepoints_in(text, start.byte_offset, pos);
+    if (pos == 0 && inserted < len && is_continuation(piece_table_byte_at(text, inserted))) {
+        cluster_cache_invalidate_after(cache, 0);
+        return true;
+    }
+    // Old clusters from old_end on survived the edit, delta clusters later
+    int old_end = edit_cluster + count_starts(text, pos, pos + inserted) - delta;
+    if (!rebase_blocks(cache, text, edit_cluster, old_end, delta,
+                       (long long) inserted - (long long) removed))
+        cluster_cache_invalidate_after(cache, edit_cluster);
+    return true;
+}
+
+int cluster_cache_byte_offset(ClusterBlockCache *cache, const PieceTable *text, int cluster)
+{
+    if (!cache || !cache->synced || !text || cluster < 0 || cluster > cache->num_clusters)
+        return -1;
+    if (cluster == cache->num_clusters)
+        return (int) cache->text_length;
+
+    bool created;
+    ClusterBlock *b = get_or_create_block(cache, cluster / cache->block_size, &created);
+    if (created)
+        fill_block(cache, text, b);
+    return block_offsets(cache, b)[cluster % cache->block_size];
+}
+
+int cluster_cache_cluster_at(const ClusterBlockCache *cache, const PieceTable *text, size_t byte)
+{
+    if (!cache || !cache->synced || !text)
+        return 0;
+    if (byte >= cache->text_length)
+        return cache->num_clusters;
+    const ClusterCheckpoint *cp = &cache->checkpoints[checkpoints_through_byte(cache, byte) - 1];
+    // The cluster containing byte is the last one starting at or before it
+    return cp->cluster + (int) count_codepoints_in(text, cp->byte_offset, byte + 1) - 1;
+}
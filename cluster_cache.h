@@ -0,0 +1,121 @@
+#ifndef CLUSTER_CACHE_H
+#define CLUSTER_CACHE_H
+
+#include "piece_table.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Lazy cluster -> byte offset lookup for large documents. Byte offsets are
+// computed a block of clusters at a time and kept in a small block cache.
+//
+// A sparse checkpoint table records the byte offset of roughly every
+// CLUSTER_CHECKPOINT_INTERVAL-th cluster. It is built in one pass per layout
+// and patched on edit, so a block miss seeks from the nearest checkpoint
+// instead of from the start of the text. The text is read from the piece
+// table in place, never flattened, and only from the checkpoint being used.
+//
+// Blocks are found through a hash map and evicted with ARC (adaptive
+// replacement cache). Blocks seen once and blocks seen repeatedly live on
+// separate lists, and ghost entries for recently evicted blocks steer how
+// much room each list gets. A long scroll through the document therefore
+// cannot flush the blocks that are revisited often, as it would with LRU.
+
+// Default number of clusters per block
+#define CLUSTER_BLOCK_SIZE 1024
+// Default number of blocks kept cached at once
+#define CLUSTER_CACHE_BLOCKS 8
+// Clusters between checkpoints
+#define CLUSTER_CHECKPOINT_INTERVAL 65536
+
+// ARC lists. Resident blocks are on RECENT (seen once) or FREQUENT (seen
+// again while cached). The GHOST lists remember evicted block indices only.
+enum {
+    CLUSTER_LIST_FREE,
+    CLUSTER_LIST_RECENT,
+    CLUSTER_LIST_FREQUENT,
+    CLUSTER_LIST_GHOST_RECENT,
+    CLUSTER_LIST_GHOST_FREQUENT,
+    CLUSTER_LIST_COUNT
+};
+
+// Block cache entry; entries are linked by array index, -1 ends a chain
+typedef struct {
+    int block_index; // which block (0..)
+    int slot;        // offsets slot for resident blocks, -1 for ghosts
+    int list;        // CLUSTER_LIST_* this entry is on
+    int prev;        // towards the most recently used end of the list
+    int next;        // towards the least recently used end of the list
+    int hash_next;   // next entry in the same hash bucket
+} ClusterBlock;
+
+typedef struct {
+    uint64_t hits;       // lookups served from a resident block
+    uint64_t misses;     // lookups that had to fill a block
+    uint64_t ghost_hits; // misses on a recently evicted block
+    uint64_t evictions;  // resident blocks dropped to make room
+} ClusterCacheStats;
+
+typedef struct {
+    int cluster;        // cluster index
+    size_t byte_offset; // byte offset where that cluster starts
+} ClusterCheckpoint;
+
+typedef struct {
+    int block_size;
+    int num_blocks_cached; // resident capacity
+    ClusterBlock *blocks;  // 2 * num_blocks_cached entries (resident and ghost)
+    int *offsets;          // num_blocks_cached slots of block_size byte offsets
+    int *free_slots;
+    int num_free_slots;
+    int *buckets; // hash map from block index to entry
+    unsigned bucket_mask;
+    int list_head[CLUSTER_LIST_COUNT]; // most recently used entry
+    int list_tail[CLUSTER_LIST_COUNT]; // least recently used entry
+    int list_size[CLUSTER_LIST_COUNT];
+    int target_recent; // adaptive share of the capacity for the RECENT list
+    ClusterCacheStats stats;
+
+    // Checkpoints sorted by cluster; the first one is always (0, 0)
+    ClusterCheckpoint *checkpoints;
+    int num_checkpoints;
+    int checkpoint_capacity;
+    int num_clusters;   // clusters in the indexed text
+    size_t text_length; // bytes in the indexed text
+    bool synced;        // checkpoints describe the current text
+} ClusterBlockCache;
+
+// Create and destroy. Non-positive sizes select the defaults.
+ClusterBlockCache *create_cluster_block_cache(int block_size, int num_blocks);
+void destroy_cluster_block_cache(ClusterBlockCache *cache);
+
+// Change the block size and capacity. Cached blocks are dropped when either
+// changes; the checkpoints are kept. Returns false (and keeps the old
+// configuration) if the new storage cannot be allocated.
+bool cluster_cache_configure(ClusterBlockCache *cache, int block_size, int num_blocks);
+
+// Rebuild the checkpoint table for text and drop all cached blocks
+bool cluster_cache_reset(ClusterBlockCache *cache, const PieceTable *text);
+
+// Patch the checkpoint table after bytes [pos, pos + removed) were replaced by
+// inserted bytes. text is the document after the edit.
+bool cluster_cache_apply_edit(ClusterBlockCache *cache, const PieceTable *text, size_t pos,
+                              size_t removed, size_t inserted);
+
+// Byte offset of cluster (text length for the end position), or -1
+int cluster_cache_byte_offset(ClusterBlockCache *cache, const PieceTable *text, int cluster);
+
+// Index of the cluster containing byte, or num_clusters at or past the end
+int cluster_cache_cluster_at(const ClusterBlockCache *cache, const PieceTable *text, size_t byte);
+
+// Codepoints starting in text[from, to), counting a continuation byte at from
+size_t count_codepoints_in(const PieceTable *text, size_t from, size_t to);
+
+// Offset of codepoint n (0-based) of text[from, to), counting as above, or
+// to if the range holds n or fewer codepoints
+size_t codepoint_offset_in(const PieceTable *text, size_t from, size_t to, size_t n);
+
+// Drop cached blocks holding clusters at or after cluster
+void cluster_cache_invalidate_after(ClusterBlockCache *cache, int cluster);
+
+#endif // CLUSTER_CACHE_H
@@ -0,0 +1,126 @@
+#include "damage.h"
+#include "debug.h"
+
+void init_window_damage(WindowDamage *damage)
+{
+    *damage = (WindowDamage){0};
+    damage->all = true;
+}
+
+void cleanup_window_damage(WindowDamage *damage)
+{
+    if (damage->frame)
+        SDL_DestroyTexture(damage->frame);
+    init_window_damage(damage);
+}
+
+static bool rects_touch(const SDL_Rect *a, const SDL_Rect *b)
+{
+    return a->x <= b->x + b->w && b->x <= a->x + a->w && a->y <= b->y + b->h &&
+           b->y <= a->y + a->h;
+}
+
+void damage_rect(WindowDamage *damage, SDL_Rect rect)
+{
+    if (damage->all || rect.w <= 0 || rect.h <= 0)
+        return;
+
+    // Absorb every rectangle the new one touches; the bounds may now touch
+    // rectangles that were apart before, so repeat until nothing merges
+    bool merged = true;
+    while (merged) {
+        merged = false;
+        for (int i = 0; i < damage->count; i++) {
+            if (!rects_touch(&rect, &damage->rects[i]))
+                continue;
+            SDL_UnionRect(&rect, &damage->rects[i], &rect);
+            damage->rects[i] = damage->rects[--damage->count];
+            merged = true;
+            break;
+        }
+    }
+
+    if (damage->count == DAMAGE_MAX_RECTS) {
+        // Out of room: keep one rectangle bounding everything
+        for (int i = 0; i < damage->count; i++)
+            SDL_UnionRect(&rect, &damage->rects[i], &rect);
+        damage->count = 0;
+    }
+    damage->rects[damage->count++] = rect;
+}
+
+void damage_all(WindowDamage *damage)
+{
+    damage->all = true;
+    damage->count = 0;
+}
+
+bool damage_pending(const WindowDamage *damage)
+{
+    return damage->all || damage->count > 0;
+}
+
+// Make frame a width x height target texture. A new texture holds nothing
+// yet, so the whole window has to be drawn into it.
+static bool ensure_frame(WindowDamage *damage, SDL_Renderer *renderer, int width, int height)
+{
+    if (damage->frame && damage->width == width && damage->height == height)
+        return true;
+    if (damage->frame)
+        SDL_DestroyTexture(damage->frame);
+    damage->frame = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
+                                      SDL_TEXTUREACCESS_TARGET, width, height);
+    if (!damage->frame) {
+        debug_print(L"[DAMAGE] Failed to create %dx%d frame: %hs\n", width, height,
+                    SDL_GetError());
+        return false;
+    }
+    SDL_SetTextureBlendMode(damage->frame, SDL_BLENDMODE_NONE);
+    damage->width = width;
+    damage->height = height;
+    damage_all(damage);
+    return true;
+}
+
+bool begin_damage_frame(WindowDamage *damage, SDL_Renderer *renderer, int width, int height)
+{
+    if (!damage_pending(damage) || width <= 0 || height <= 0)
+        return false;
+
+    // The frame copy is drawn in the same coordinates as the window
+    int logical_width = 0, logical_height = 0;
+    SDL_RenderGetLogicalSize(renderer, &logical_width, &logical_height);
+    if (logical_width > 0 && logical_height > 0) {
+        width = logical_width;
+        height = logical_height;
+    }
+
+    if (!damage->unsupported && !SDL_RenderTargetSupported(renderer))
+        damage->unsupported = true;
+    if (!damage->unsupported && !ensure_frame(damage, renderer, width, height))
+        damage->unsupported = true;
+    if (!damage->unsupported && SDL_SetRenderTarget(renderer, damage->frame) != 0) {
+        debug_print(L"[DAMAGE] Cannot draw into the frame: %hs\n", SDL_GetError());
+        damage->unsupported = true;
+    }
+    if (damage->unsupported)
+        damage_all(damage);
+
+    if (damage->all) {
+        damage->rects[0] = (SDL_Rect){0, 0, width, height};
+        damage->count = 1;
+    }
+    return true;
+}
+
+void end_damage_frame(WindowDamage *damage, SDL_Renderer *renderer)
+{
+    SDL_RenderSetClipRect(renderer, NULL);
+    if (!damage->unsupported) {
+        SDL_SetRenderTarget(renderer, NULL);
+        SDL_RenderCopy(renderer, damage->frame, NULL, NULL);
+    }
+    SDL_RenderPresent(renderer);
+    damage->all = false;
+    damage->count = 0;
+}
@@ -0,0 +1,48 @@
+#ifndef DAMAGE_H
+#define DAMAGE_H
+
+#include "platform_sdl.h"
+#include <SDL.h>
+#include <stdbool.h>
+
+// Damage tracking for the editor window. The parts of the window that changed
+// since the last present are recorded as dirty rectangles. A frame redraws
+// only those, each clipped to its rectangle, into an offscreen copy of the
+// window, and presents the copy. When nothing is dirty the frame is neither
+// drawn nor presented, so an idle window costs no rendering at all.
+//
+// Renderers that cannot render to textures lose the back buffer contents on
+// every present, so there the whole window is redrawn whenever anything is
+// dirty.
+
+// Rectangles kept apart; beyond that they are merged into their bounds
+#define DAMAGE_MAX_RECTS 8
+
+typedef struct {
+    SDL_Rect rects[DAMAGE_MAX_RECTS];
+    int count;
+    bool all;           // the whole window is dirty
+    SDL_Texture *frame; // the window as last drawn
+    int width;          // size of frame
+    int height;
+    bool unsupported; // no render targets: redraw everything
+} WindowDamage;
+
+void init_window_damage(WindowDamage *damage);
+void cleanup_window_damage(WindowDamage *damage);
+
+// Mark rect dirty; overlapping rectangles are merged
+void damage_rect(WindowDamage *damage, SDL_Rect rect);
+// Mark the whole window dirty
+void damage_all(WindowDamage *damage);
+bool damage_pending(const WindowDamage *damage);
+
+// Start a frame of width x height (logical) pixels. Returns false if nothing
+// is dirty: draw nothing and do not present. Otherwise the dirty rectangles
+// are in damage->rects; draw the window once per rectangle with the renderer
+// clipped to it, then call end_damage_frame.
+bool begin_damage_frame(WindowDamage *damage, SDL_Renderer *renderer, int width, int height);
+// Show the frame and clear the damage
+void end_damage_frame(WindowDamage *damage, SDL_Renderer *renderer);
+
+#endif // DAMAGE_H
@@ -12,7 +12,8 @@ static struct {
     SDL_Renderer *renderer;
     TTF_Font *font;
     SDL_Window *window;
-} dialog_ctx = {NULL, NULL, NULL};
+    bool drew; // a dialog has drawn over the window since the last check
+} dialog_ctx = {NULL, NULL, NULL, false};
 
 void set_dialog_context(SDL_Renderer *renderer, TTF_Font *font, SDL_Window *window)
 {
@@ -21,6 +22,13 @@ void set_dialog_context(SDL_Renderer *renderer, TTF_Font *font, SDL_Window *wind
     dialog_ctx.window = window;
 }
 
+bool dialog_covered_window(void)
+{
+    bool drew = dialog_ctx.drew;
+    dialog_ctx.drew = false;
+    return drew;
+}
+
 // Helper function to draw a centered dialog box
 static SDL_Rect draw_dialog_background(int dialog_width, int dialog_height, const char *title)
 {
@@ -34,6 +42,7 @@ static SDL_Rect draw_dialog_background(int dialog_width, int dialog_height, cons
     int y = (window_height - dialog_height) / 2;
 
     SDL_Rect dialog_rect = {x, y, dialog_width, dialog_height};
+    dialog_ctx.drew = true;
 
     // Draw semi-transparent overlay
     SDL_SetRenderDrawBlendMode(dialog_ctx.renderer, SDL_BLENDMODE_BLEND);
@@ -16,5 +16,7 @@ char *show_open_dialog(void);
 
 // Internal dialog rendering functions
 void set_dialog_context(SDL_Renderer *renderer, TTF_Font *font, SDL_Window *window);
+// True once after a dialog has drawn over the window, which then needs a full redraw
+bool dialog_covered_window(void);
 
 #endif
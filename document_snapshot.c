@@ -0,0 +1,126 @@
+#include "document_snapshot.h"
+#include "debug.h"
+#include <stdlib.h>
+
+static void free_snapshot(DocumentSnapshot *snapshot)
+{
+    cleanup_piece_table(&snapshot->text);
+    free(snapshot);
+}
+
+void init_snapshot_manager(SnapshotManager *manager)
+{
+    atomic_init(&manager->current, NULL);
+    atomic_init(&manager->epoch, 1);
+    for (int i = 0; i < SNAPSHOT_MAX_READERS; i++) {
+        atomic_init(&manager->reader_epochs[i], 0);
+        atomic_init(&manager->reader_slots[i], false);
+    }
+    manager->retired = NULL;
+}
+
+void cleanup_snapshot_manager(SnapshotManager *manager)
+{
+    DocumentSnapshot *current = atomic_exchange(&manager->current, NULL);
+    if (current)
+        free_snapshot(current);
+
+    while (manager->retired) {
+        DocumentSnapshot *next = manager->retired->next_retired;
+        free_snapshot(manager->retired);
+        manager->retired = next;
+    }
+}
+
+bool publish_document_snapshot(SnapshotManager *manager, const PieceTable *buffer)
+{
+    DocumentSnapshot *current = atomic_load(&manager->current);
+    if (current && current->text.version == piece_table_version(buffer)) {
+        reclaim_document_snapshots(manager);
+        return true;
+    }
+
+    DocumentSnapshot *snapshot = malloc(sizeof(DocumentSnapshot));
+    if (!snapshot)
+        return false;
+    if (!piece_table_snapshot(buffer, &snapshot->text)) {
+        free(snapshot);
+        debug_print(L"[ERROR] Failed to create document snapshot\n");
+        return false;
+    }
+    snapshot->retire_epoch = 0;
+    snapshot->next_retired = NULL;
+
+    // Unlink the old version, then advance the epoch. Readers that announce
+    // the new epoch are guaranteed to load the new pointer.
+    DocumentSnapshot *old = atomic_exchange(&manager->current, snapshot);
+    if (old) {
+        old->retire_epoch = atomic_fetch_add(&manager->epoch, 1);
+        old->next_retired = manager->retired;
+        manager->retired = old;
+    }
+
+    reclaim_document_snapshots(manager);
+    return true;
+}
+
+void reclaim_document_snapshots(SnapshotManager *manager)
+{
+    if (!manager->retired)
+        return;
+
+    // Oldest epoch any reader may still be using
+    uint64_t oldest = UINT64_MAX;
+    for (int i = 0; i < SNAPSHOT_MAX_READERS; i++) {
+        uint64_t reader_epoch = atomic_load(&manager->reader_epochs[i]);
+        if (reader_epoch != 0 && reader_epoch < oldest)
+            oldest = reader_epoch;
+    }
+
+    DocumentSnapshot **link = &manager->retired;
+    while (*link) {
+        DocumentSnapshot *snapshot = *link;
+        if (snapshot->retire_epoch < oldest) {
+            *link = snapshot->next_retired;
+            free_snapshot(snapshot);
+        } else {
+            link = &snapshot->next_retired;
+        }
+    }
+}
+
+int register_snapshot_reader(SnapshotManager *manager)
+{
+    for (int i = 0; i < SNAPSHOT_MAX_READERS; i++) {
+        bool expected = false;
+        if (atomic_compare_exchange_strong(&manager->reader_slots[i], &expected, true))
+            return i;
+    }
+    debug_print(L"[ERROR] No free document snapshot reader slots\n");
+    return -1;
+}
+
+void unregister_snapshot_reader(SnapshotManager *manager, int reader)
+{
+    if (reader < 0 || reader >= SNAPSHOT_MAX_READERS)
+        return;
+    atomic_store(&manager->reader_epochs[reader], 0);
+    atomic_store(&manager->reader_slots[reader], false);
+}
+
+DocumentSnapshot *acquire_document_snapshot(SnapshotManager *manager, int reader)
+{
+    if (reader < 0 || reader >= SNAPSHOT_MAX_READERS)
+        return NULL;
+    // Announce the epoch before reading the pointer (both sequentially
+    // consistent) so the publisher cannot miss this reader.
+    atomic_store(&manager->reader_epochs[reader], atomic_load(&manager->epoch));
+    return atomic_load(&manager->current);
+}
+
+void release_document_snapshot(SnapshotManager *manager, int reader)
+{
+    if (reader < 0 || reader >= SNAPSHOT_MAX_READERS)
+        return;
+    atomic_store(&manager->reader_epochs[reader], 0);
+}
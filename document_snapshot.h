@@ -0,0 +1,52 @@
+#ifndef DOCUMENT_SNAPSHOT_H
+#define DOCUMENT_SNAPSHOT_H
+
+#include "piece_table.h"
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Immutable document versions for readers on other threads (the continuous
+// resize render thread). The editing thread publishes a snapshot after it
+// changes the buffer. Readers pin the current snapshot without taking a lock
+// and never see a half-applied edit.
+//
+// Old snapshots are reclaimed with epoch-based reclamation. A reader announces
+// the global epoch before loading the current pointer. A snapshot retired at
+// epoch e is freed once every active reader has announced an epoch after e.
+
+#define SNAPSHOT_MAX_READERS 4
+
+typedef struct DocumentSnapshot {
+    PieceTable text; // frozen copy of the document; read-only
+    uint64_t retire_epoch;
+    struct DocumentSnapshot *next_retired;
+} DocumentSnapshot;
+
+typedef struct {
+    _Atomic(DocumentSnapshot *) current;
+    atomic_uint_fast64_t epoch;
+    atomic_uint_fast64_t reader_epochs[SNAPSHOT_MAX_READERS]; // 0 when not reading
+    atomic_bool reader_slots[SNAPSHOT_MAX_READERS];
+    DocumentSnapshot *retired; // owned by the publishing thread
+} SnapshotManager;
+
+// Initialize and cleanup. Cleanup requires that no reader is still active.
+void init_snapshot_manager(SnapshotManager *manager);
+void cleanup_snapshot_manager(SnapshotManager *manager);
+
+// Publishing thread. publish_document_snapshot does nothing when the current
+// snapshot already matches the buffer version; it also reclaims old snapshots.
+bool publish_document_snapshot(SnapshotManager *manager, const PieceTable *buffer);
+void reclaim_document_snapshots(SnapshotManager *manager);
+
+// Reader threads. Each reader registers once for a slot, then brackets every
+// use of a snapshot with acquire/release. Acquire may return NULL before the
+// first publish. A snapshot builds its flat view (piece_table_text) lazily and
+// without locking, so only one reader should call it.
+int register_snapshot_reader(SnapshotManager *manager);
+void unregister_snapshot_reader(SnapshotManager *manager, int reader);
+DocumentSnapshot *acquire_document_snapshot(SnapshotManager *manager, int reader);
+void release_document_snapshot(SnapshotManager *manager, int reader);
+
+#endif // DOCUMENT_SNAPSHOT_H
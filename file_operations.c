@@ -62,9 +62,9 @@ bool file_exists(const char *filepath)
     return (stat(filepath, &st) == 0);
 }
 
-bool open_file(const char *filepath, char **content)
+bool open_file(const char *filepath, PieceTable *buffer)
 {
-    if (!filepath || !content)
+    if (!filepath || !buffer)
         return false;
 
     FILE *file = fopen(filepath, "r");
@@ -79,25 +79,33 @@ bool open_file(const char *filepath, char **content)
     rewind(file);
 
     // Allocate buffer
-    *content = malloc(file_size + 1);
-    if (!*content) {
+    char *content = malloc(file_size + 1);
+    if (!content) {
         fclose(file);
         debug_print(L"Failed to allocate memory for file content\n");
         return false;
     }
 
     // Read file
-    size_t bytes_read = fread(*content, 1, file_size, file);
-    (*content)[bytes_read] = '\0';
+    size_t bytes_read = fread(content, 1, file_size, file);
+    content[bytes_read] = '\0';
 
     fclose(file);
+
+    // The piece table adopts the read buffer as its original text (no copy)
+    if (!piece_table_load(buffer, content, bytes_read)) {
+        free(content);
+        debug_print(L"Failed to load file content into document buffer\n");
+        return false;
+    }
+
     debug_print(L"Successfully opened file: %s (%ld bytes)\n", filepath, file_size);
     return true;
 }
 
-bool save_file(const char *filepath, const char *content)
+bool save_file(const char *filepath, const PieceTable *buffer)
 {
-    if (!filepath || !content)
+    if (!filepath || !buffer)
         return false;
 
     FILE *file = fopen(filepath, "w");
@@ -106,8 +114,19 @@ bool save_file(const char *filepath, const char *content)
         return false;
     }
 
-    size_t content_len = strlen(content);
-    size_t bytes_written = fwrite(content, 1, content_len, file);
+    // Write the document piece by piece; no contiguous copy is needed
+    size_t content_len = piece_table_length(buffer);
+    size_t bytes_written = 0;
+    PieceIterator it;
+    const char *chunk;
+    size_t chunk_len;
+    piece_iterator_init(&it, buffer, 0, content_len);
+    while (piece_iterator_next(&it, &chunk, &chunk_len)) {
+        size_t written = fwrite(chunk, 1, chunk_len, file);
+        bytes_written += written;
+        if (written != chunk_len)
+            break;
+    }
 
     fclose(file);
 
@@ -120,9 +139,9 @@ bool save_file(const char *filepath, const char *content)
     return true;
 }
 
-bool save_file_as(const char *filepath, const char *content)
+bool save_file_as(const char *filepath, const PieceTable *buffer)
 {
-    return save_file(filepath, content);
+    return save_file(filepath, buffer);
 }
 
 // Simple file dialog implementation using system calls
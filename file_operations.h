@@ -1,6 +1,7 @@
 #ifndef FILE_OPERATIONS_H
 #define FILE_OPERATIONS_H
 
+#include "piece_table.h"
 #include <stdbool.h>
 
 // File operations structure to track document state
@@ -12,9 +13,9 @@ typedef struct {
 } DocumentState;
 
 // File operation functions
-bool open_file(const char *filepath, char **content);
-bool save_file(const char *filepath, const char *content);
-bool save_file_as(const char *filepath, const char *content);
+bool open_file(const char *filepath, PieceTable *buffer);
+bool save_file(const char *filepath, const PieceTable *buffer);
+bool save_file_as(const char *filepath, const PieceTable *buffer);
 char *get_file_dialog(bool is_save);
 void init_document_state(DocumentState *doc);
 void cleanup_document_state(DocumentState *doc);
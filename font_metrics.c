@@ -0,0 +1,171 @@
+#include "font_metrics.h"
+#include "grapheme.h"
+#include <limits.h>
+#include <stdlib.h>
+
+// Marks a direct slot whose advance has not been looked up yet
+#define ADVANCE_UNKNOWN INT_MIN
+
+static unsigned metrics_hash(uint64_t key)
+{
+    key ^= key >> 33;
+    key *= 0xFF51AFD7ED558CCDull;
+    key ^= key >> 33;
+    return (unsigned) key;
+}
+
+static bool table_init(FontMetricsTable *table, int capacity)
+{
+    table->entries = malloc(capacity * sizeof(FontMetricsEntry));
+    table->buckets = malloc(capacity * sizeof(int));
+    if (!table->entries || !table->buckets)
+        return false;
+    table->capacity = capacity;
+    table->count = 0;
+    for (int i = 0; i < capacity; i++)
+        table->buckets[i] = -1;
+    return true;
+}
+
+static void table_cleanup(FontMetricsTable *table)
+{
+    free(table->entries);
+    free(table->buckets);
+    table->entries = NULL;
+    table->buckets = NULL;
+    table->count = table->capacity = 0;
+}
+
+static const FontMetricsEntry *table_find(const FontMetricsTable *table, uint64_t key)
+{
+    unsigned mask = (unsigned) (table->capacity - 1);
+    for (int i = table->buckets[metrics_hash(key) & mask]; i >= 0; i = table->entries[i].hash_next)
+        if (table->entries[i].key == key)
+            return &table->entries[i];
+    return NULL;
+}
+
+// Double the table; false leaves it unchanged
+static bool table_grow(FontMetricsTable *table)
+{
+    int capacity = table->capacity * 2;
+    FontMetricsEntry *entries = realloc(table->entries, capacity * sizeof(FontMetricsEntry));
+    if (!entries)
+        return false;
+    table->entries = entries;
+    int *buckets = realloc(table->buckets, capacity * sizeof(int));
+    if (!buckets)
+        return false;
+    table->buckets = buckets;
+    table->capacity = capacity;
+    for (int i = 0; i < capacity; i++)
+        buckets[i] = -1;
+    for (int i = 0; i < table->count; i++) {
+        unsigned b = metrics_hash(entries[i].key) & (unsigned) (capacity - 1);
+        entries[i].hash_next = buckets[b];
+        buckets[b] = i;
+    }
+    return true;
+}
+
+// Remember key -> value; a full table that cannot grow just forgets it
+static void table_insert(FontMetricsTable *table, uint64_t key, int value)
+{
+    if (table->count == table->capacity && !table_grow(table))
+        return;
+    unsigned b = metrics_hash(key) & (unsigned) (table->capacity - 1);
+    FontMetricsEntry *entry = &table->entries[table->count];
+    entry->key = key;
+    entry->value = value;
+    entry->hash_next = table->buckets[b];
+    table->buckets[b] = table->count++;
+}
+
+FontMetrics *create_font_metrics(TTF_Font *font)
+{
+    if (!font)
+        return NULL;
+    FontMetrics *metrics = calloc(1, sizeof(FontMetrics));
+    if (!metrics)
+        return NULL;
+    if (!table_init(&metrics->advances, 256) || !table_init(&metrics->kerning_pairs, 1024)) {
+        destroy_font_metrics(metrics);
+        return NULL;
+    }
+    metrics->font = font;
+    metrics->kerning = TTF_GetFontKerning(font) != 0;
+    for (int i = 0; i < FONT_METRICS_DIRECT; i++)
+        metrics->direct[i] = ADVANCE_UNKNOWN;
+    return metrics;
+}
+
+void destroy_font_metrics(FontMetrics *metrics)
+{
+    if (!metrics)
+        return;
+    table_cleanup(&metrics->advances);
+    table_cleanup(&metrics->kerning_pairs);
+    free(metrics);
+}
+
+static int query_advance(FontMetrics *metrics, uint32_t codepoint)
+{
+    int minx, maxx, miny, maxy, advance;
+    metrics->stats.ttf_calls++;
+    if (TTF_GlyphMetrics32(metrics->font, codepoint, &minx, &maxx, &miny, &maxy, &advance) != 0)
+        return 0;
+    return advance;
+}
+
+int font_metrics_advance(FontMetrics *metrics, uint32_t codepoint)
+{
+    metrics->stats.lookups++;
+    if (codepoint < FONT_METRICS_DIRECT) {
+        if (metrics->direct[codepoint] == ADVANCE_UNKNOWN)
+            metrics->direct[codepoint] = query_advance(metrics, codepoint);
+        return metrics->direct[codepoint];
+    }
+    const FontMetricsEntry *entry = table_find(&metrics->advances, codepoint);
+    if (entry)
+        return entry->value;
+    int advance = query_advance(metrics, codepoint);
+    table_insert(&metrics->advances, codepoint, advance);
+    return advance;
+}
+
+int font_metrics_kerning(FontMetrics *metrics, uint32_t prev, uint32_t codepoint)
+{
+    if (!metrics->kerning || !prev)
+        return 0;
+    metrics->stats.lookups++;
+    uint64_t key = (uint64_t) prev << 32 | codepoint;
+    const FontMetricsEntry *entry = table_find(&metrics->kerning_pairs, key);
+    if (entry)
+        return entry->value;
+    metrics->stats.ttf_calls++;
+    int kerning = TTF_GetFontKerningSizeGlyphs32(metrics->font, prev, codepoint);
+    table_insert(&metrics->kerning_pairs, key, kerning);
+    return kerning;
+}
+
+int font_metrics_measure(FontMetrics *metrics, const char *s, size_t len, uint32_t *prev)
+{
+    int width = 0;
+    uint32_t last = prev ? *prev : 0;
+    size_t i = 0;
+    while (i < len) {
+        uint32_t cp;
+        if ((unsigned char) s[i] < 0x80) {
+            cp = (unsigned char) s[i++];
+        } else {
+            i += grapheme_decode(s + i, len - i, &cp);
+        }
+        if (cp == '\n' || cp == '\r')
+            continue;
+        width += font_metrics_kerning(metrics, last, cp) + font_metrics_advance(metrics, cp);
+        last = cp;
+    }
+    if (prev)
+        *prev = last;
+    return width;
+}
@@ -0,0 +1,63 @@
+#ifndef FONT_METRICS_H
+#define FONT_METRICS_H
+
+#include <SDL_ttf.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Per-font cache of glyph advances and kerning pairs, so measuring text is a
+// table lookup per codepoint instead of an SDL_ttf call.
+//
+// Advances of codepoints below FONT_METRICS_DIRECT (ASCII, Latin-1 and Latin
+// Extended-A/B) live in a direct-mapped array; other codepoints and kerning
+// pairs are kept in hash tables that grow as needed. A TTF_Font is opened at
+// one size, so one cache describes exactly one font handle.
+
+// Codepoints with a direct-mapped advance slot
+#define FONT_METRICS_DIRECT 0x250
+
+typedef struct {
+    uint64_t key;  // codepoint, or the two codepoints of a kerning pair
+    int value;     // advance or kerning in pixels
+    int hash_next; // next entry in the same hash bucket, -1 ends the chain
+} FontMetricsEntry;
+
+// Chained hash table from key to value; the bucket count equals the capacity
+typedef struct {
+    FontMetricsEntry *entries;
+    int count;
+    int capacity;
+    int *buckets;
+} FontMetricsTable;
+
+typedef struct {
+    uint64_t lookups;   // advance and kerning queries
+    uint64_t ttf_calls; // queries that had to ask SDL_ttf
+} FontMetricsStats;
+
+typedef struct {
+    TTF_Font *font;
+    bool kerning; // the font has kerning enabled
+    int direct[FONT_METRICS_DIRECT];
+    FontMetricsTable advances; // codepoints >= FONT_METRICS_DIRECT
+    FontMetricsTable kerning_pairs;
+    FontMetricsStats stats;
+} FontMetrics;
+
+FontMetrics *create_font_metrics(TTF_Font *font);
+void destroy_font_metrics(FontMetrics *metrics);
+
+// Pen advance of codepoint in pixels (0 if the font has no metrics for it)
+int font_metrics_advance(FontMetrics *metrics, uint32_t codepoint);
+
+// Kerning adjustment between prev and codepoint (0 when kerning is off)
+int font_metrics_kerning(FontMetrics *metrics, uint32_t prev, uint32_t codepoint);
+
+// Width of the UTF-8 run s[0, len) as the glyph atlas draws it: advances plus
+// kerning, with kerning against *prev (0 for none) applied to the first
+// codepoint. *prev receives the last codepoint measured. Newlines take no
+// space and do not kern.
+int font_metrics_measure(FontMetrics *metrics, const char *s, size_t len, uint32_t *prev);
+
+#endif // FONT_METRICS_H
@@ -0,0 +1,415 @@
+#include "glyph_atlas.h"
+#include "debug.h"
+#include <stdlib.h>
+#include <string.h>
+
+// Transparent gap around packed glyphs so neighbours never bleed into a quad
+#define GLYPH_PADDING 1
+
+static unsigned glyph_hash(const TTF_Font *font, uint32_t codepoint)
+{
+    uintptr_t f = (uintptr_t) font >> 4;
+    uint32_t h = (uint32_t) f * 2654435761u ^ codepoint * 2246822519u;
+    return h ^ (h >> 15);
+}
+
+static bool create_atlas_texture(GlyphAtlas *atlas, int size)
+{
+    SDL_Texture *texture = SDL_CreateTexture(atlas->renderer, SDL_PIXELFORMAT_ARGB8888,
+                                             SDL_TEXTUREACCESS_STATIC, size, size);
+    if (!texture) {
+        debug_print(L"[ATLAS] Failed to create %dx%d texture: %hs\n", size, size,
+                    SDL_GetError());
+        return false;
+    }
+    SDL_SetTextureBlendMode(texture, SDL_BLENDMODE_BLEND);
+    if (atlas->texture)
+        SDL_DestroyTexture(atlas->texture);
+    atlas->texture = texture;
+    atlas->width = size;
+    atlas->height = size;
+    return true;
+}
+
+// Forget every glyph; growing doubles the texture edge when allowed
+static void reset_atlas(GlyphAtlas *atlas, bool grow)
+{
+    if (grow && atlas->width < GLYPH_ATLAS_MAX_SIZE)
+        create_atlas_texture(atlas, atlas->width * 2);
+    atlas->shelf_x = 0;
+    atlas->shelf_y = 0;
+    atlas->shelf_h = 0;
+    atlas->num_glyphs = 0;
+    atlas->solid = (SDL_Rect){0, 0, 0, 0};
+    for (int i = 0; i < atlas->glyph_capacity; i++)
+        atlas->buckets[i] = -1;
+    atlas->generation++;
+    debug_print(L"[ATLAS] Cleared (generation %u, %dx%d)\n", (unsigned) atlas->generation,
+                atlas->width, atlas->height);
+}
+
+GlyphAtlas *create_glyph_atlas(SDL_Renderer *renderer)
+{
+    GlyphAtlas *atlas = calloc(1, sizeof(GlyphAtlas));
+    if (!atlas)
+        return NULL;
+    atlas->renderer = renderer;
+    atlas->glyph_capacity = 256;
+    atlas->glyphs = malloc(atlas->glyph_capacity * sizeof(AtlasGlyph));
+    atlas->buckets = malloc(atlas->glyph_capacity * sizeof(int));
+    if (!atlas->glyphs || !atlas->buckets || !create_atlas_texture(atlas, GLYPH_ATLAS_SIZE)) {
+        destroy_glyph_atlas(atlas);
+        return NULL;
+    }
+    for (int i = 0; i < atlas->glyph_capacity; i++)
+        atlas->buckets[i] = -1;
+    return atlas;
+}
+
+void destroy_glyph_atlas(GlyphAtlas *atlas)
+{
+    if (!atlas)
+        return;
+    if (atlas->texture)
+        SDL_DestroyTexture(atlas->texture);
+    free(atlas->glyphs);
+    free(atlas->buckets);
+    free(atlas);
+}
+
+// Double the glyph table; the bucket count always equals the capacity
+static bool grow_glyph_table(GlyphAtlas *atlas)
+{
+    int capacity = atlas->glyph_capacity * 2;
+    AtlasGlyph *glyphs = realloc(atlas->glyphs, capacity * sizeof(AtlasGlyph));
+    if (!glyphs)
+        return false;
+    atlas->glyphs = glyphs;
+    int *buckets = realloc(atlas->buckets, capacity * sizeof(int));
+    if (!buckets)
+        return false;
+    atlas->buckets = buckets;
+    atlas->glyph_capacity = capacity;
+    for (int i = 0; i < capacity; i++)
+        buckets[i] = -1;
+    for (int i = 0; i < atlas->num_glyphs; i++) {
+        unsigned b = glyph_hash(glyphs[i].font, glyphs[i].codepoint) & (unsigned) (capacity - 1);
+        glyphs[i].hash_next = buckets[b];
+        buckets[b] = i;
+    }
+    return true;
+}
+
+// Reserve a w x h area on the shelves; false when the texture is full
+static bool pack_rect(GlyphAtlas *atlas, int w, int h, SDL_Rect *out)
+{
+    if (atlas->shelf_x + w + GLYPH_PADDING > atlas->width) {
+        atlas->shelf_y += atlas->shelf_h;
+        atlas->shelf_x = 0;
+        atlas->shelf_h = 0;
+    }
+    if (w + GLYPH_PADDING > atlas->width ||
+        atlas->shelf_y + h + GLYPH_PADDING > atlas->height)
+        return false;
+    *out = (SDL_Rect){atlas->shelf_x, atlas->shelf_y, w, h};
+    atlas->shelf_x += w + GLYPH_PADDING;
+    if (h + GLYPH_PADDING > atlas->shelf_h)
+        atlas->shelf_h = h + GLYPH_PADDING;
+    return true;
+}
+
+// Copy surface into the texture at rect, with a transparent right and bottom
+// padding edge so nothing left from an earlier generation shows through
+static bool upload_glyph(GlyphAtlas *atlas, SDL_Surface *surface, const SDL_Rect *rect)
+{
+    int w = rect->w + GLYPH_PADDING;
+    int h = rect->h + GLYPH_PADDING;
+    Uint32 *pixels = calloc((size_t) w * h, sizeof(Uint32));
+    if (!pixels)
+        return false;
+    const Uint8 *src = surface->pixels;
+    for (int y = 0; y < rect->h; y++)
+        memcpy(pixels + (size_t) y * w, src + (size_t) y * surface->pitch,
+               (size_t) rect->w * sizeof(Uint32));
+    SDL_Rect dst = {rect->x, rect->y, w, h};
+    int rc = SDL_UpdateTexture(atlas->texture, &dst, pixels, w * (int) sizeof(Uint32));
+    free(pixels);
+    return rc == 0;
+}
+
+// Pack an ARGB8888 surface into the texture and point glyph at it. A full
+// texture is reset (and grown) once; false if the surface still does not fit.
+static bool place_surface(GlyphAtlas *atlas, SDL_Surface *surface, AtlasGlyph *glyph)
+{
+    SDL_Rect rect;
+    bool packed = pack_rect(atlas, surface->w, surface->h, &rect);
+    if (!packed) {
+        reset_atlas(atlas, true);
+        packed = pack_rect(atlas, surface->w, surface->h, &rect);
+    }
+    if (packed && SDL_LockSurface(surface) == 0) {
+        if (upload_glyph(atlas, surface, &rect))
+            glyph->rect = rect;
+        SDL_UnlockSurface(surface);
+    }
+    return packed;
+}
+
+// Make sure the opaque block placeholders are drawn from is in the texture
+static bool reserve_solid(GlyphAtlas *atlas)
+{
+    enum { SOLID = 4 };
+    if (atlas->solid.w > 0)
+        return true;
+    SDL_Rect rect;
+    if (!pack_rect(atlas, SOLID, SOLID, &rect))
+        return false;
+    Uint32 pixels[SOLID * SOLID];
+    for (int i = 0; i < SOLID * SOLID; i++)
+        pixels[i] = 0xFFFFFFFFu;
+    if (SDL_UpdateTexture(atlas->texture, &rect, pixels, SOLID * (int) sizeof(Uint32)) != 0)
+        return false;
+    atlas->solid = rect;
+    return true;
+}
+
+// Rasterize codepoint in white and place it in the texture. Glyphs with no
+// pixels (spaces, unknown metrics) are stored blank.
+static bool rasterize_glyph(GlyphAtlas *atlas, TTF_Font *font, uint32_t codepoint,
+                            AtlasGlyph *glyph)
+{
+    int minx = 0, maxx = 0, miny = 0, maxy = 0, advance = 0;
+    if (TTF_GlyphMetrics32(font, codepoint, &minx, &maxx, &miny, &maxy, &advance) != 0)
+        advance = 0;
+    glyph->advance = advance;
+    // The rendered surface starts at the leftmost ink or the pen, whichever
+    // comes first, and spans the font height from the top of the line
+    glyph->x_offset = minx < 0 ? minx : 0;
+    glyph->rect = (SDL_Rect){0, 0, 0, 0};
+    if (maxx <= minx)
+        return true;
+
+    // Leave the pixels to a worker and show the ink box until they arrive
+    if (atlas->pool && raster_pool_font(atlas->pool) == font && reserve_solid(atlas) &&
+        raster_pool_submit(atlas->pool, codepoint)) {
+        glyph->pending = true;
+        glyph->x_offset = minx;
+        glyph->rect = (SDL_Rect){0, TTF_FontAscent(font) - maxy, maxx - minx, maxy - miny};
+        return true;
+    }
+
+    SDL_Color white = {255, 255, 255, 255};
+    SDL_Surface *surface = TTF_RenderGlyph32_Blended(font, codepoint, white);
+    if (!surface)
+        return true;
+    if (surface->format->format != SDL_PIXELFORMAT_ARGB8888) {
+        SDL_Surface *converted = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_ARGB8888, 0);
+        SDL_FreeSurface(surface);
+        if (!converted)
+            return true;
+        surface = converted;
+    }
+    bool packed = place_surface(atlas, surface, glyph);
+    SDL_FreeSurface(surface);
+    return packed;
+}
+
+static AtlasGlyph *find_glyph(GlyphAtlas *atlas, TTF_Font *font, uint32_t codepoint)
+{
+    unsigned mask = (unsigned) (atlas->glyph_capacity - 1);
+    for (int i = atlas->buckets[glyph_hash(font, codepoint) & mask]; i >= 0;
+         i = atlas->glyphs[i].hash_next) {
+        if (atlas->glyphs[i].codepoint == codepoint && atlas->glyphs[i].font == font)
+            return &atlas->glyphs[i];
+    }
+    return NULL;
+}
+
+static AtlasGlyph *insert_glyph(GlyphAtlas *atlas, const AtlasGlyph *glyph)
+{
+    if (atlas->num_glyphs == atlas->glyph_capacity && !grow_glyph_table(atlas))
+        return NULL;
+    unsigned b = glyph_hash(glyph->font, glyph->codepoint) & (unsigned) (atlas->glyph_capacity - 1);
+    AtlasGlyph *slot = &atlas->glyphs[atlas->num_glyphs];
+    *slot = *glyph;
+    slot->hash_next = atlas->buckets[b];
+    atlas->buckets[b] = atlas->num_glyphs++;
+    return slot;
+}
+
+const AtlasGlyph *glyph_atlas_get(GlyphAtlas *atlas, TTF_Font *font, uint32_t codepoint)
+{
+    if (!atlas || !font)
+        return NULL;
+    const AtlasGlyph *found = find_glyph(atlas, font, codepoint);
+    if (found)
+        return found;
+
+    AtlasGlyph glyph = {.font = font, .codepoint = codepoint};
+    if (!rasterize_glyph(atlas, font, codepoint, &glyph))
+        debug_print(L"[ATLAS] No room for U+%04X\n", (unsigned) codepoint);
+    // Rasterizing may have reset the table, so insert only afterwards
+    return insert_glyph(atlas, &glyph);
+}
+
+int glyph_atlas_collect(GlyphAtlas *atlas)
+{
+    if (!atlas || !atlas->pool)
+        return 0;
+    TTF_Font *font = raster_pool_font(atlas->pool);
+    RasterResult results[64];
+    int replaced = 0, n;
+    while ((n = raster_pool_collect(atlas->pool, results, 64)) > 0) {
+        for (int i = 0; i < n; i++) {
+            RasterResult *result = &results[i];
+            AtlasGlyph *glyph = find_glyph(atlas, font, result->codepoint);
+            // Requests from before a reset arrive with no placeholder left
+            if (glyph && !glyph->pending) {
+                SDL_FreeSurface(result->surface);
+                continue;
+            }
+            AtlasGlyph ready = {.font = font,
+                                .codepoint = result->codepoint,
+                                .x_offset = result->minx < 0 ? result->minx : 0,
+                                .advance = result->advance};
+            uint32_t generation = atlas->generation;
+            if (result->surface) {
+                if (!place_surface(atlas, result->surface, &ready))
+                    debug_print(L"[ATLAS] No room for U+%04X\n", (unsigned) result->codepoint);
+                SDL_FreeSurface(result->surface);
+            }
+            // Packing may have reset the table and dropped the placeholder
+            if (atlas->generation != generation)
+                glyph = find_glyph(atlas, font, result->codepoint);
+            if (glyph) {
+                ready.hash_next = glyph->hash_next;
+                *glyph = ready;
+                replaced++;
+            } else {
+                insert_glyph(atlas, &ready);
+            }
+        }
+    }
+    // Quads built with the placeholders are out of date
+    if (replaced > 0)
+        atlas->generation++;
+    return replaced;
+}
+
+void glyph_batch_clear(GlyphBatch *batch)
+{
+    batch->num_vertices = 0;
+    batch->num_indices = 0;
+    batch->placeholders = 0;
+}
+
+static bool reserve_quads(GlyphBatch *batch, int quads)
+{
+    if (batch->num_vertices + 4 * quads > batch->vertex_capacity) {
+        int capacity = batch->vertex_capacity ? batch->vertex_capacity * 2 : 1024;
+        while (capacity < batch->num_vertices + 4 * quads)
+            capacity *= 2;
+        SDL_Vertex *vertices = realloc(batch->vertices, capacity * sizeof(SDL_Vertex));
+        if (!vertices)
+            return false;
+        batch->vertices = vertices;
+        batch->vertex_capacity = capacity;
+    }
+    if (batch->num_indices + 6 * quads > batch->index_capacity) {
+        int capacity = batch->index_capacity ? batch->index_capacity * 2 : 1536;
+        while (capacity < batch->num_indices + 6 * quads)
+            capacity *= 2;
+        int *indices = realloc(batch->indices, capacity * sizeof(int));
+        if (!indices)
+            return false;
+        batch->indices = indices;
+        batch->index_capacity = capacity;
+    }
+    return true;
+}
+
+bool glyph_batch_add(GlyphBatch *batch, const GlyphAtlas *atlas, const AtlasGlyph *glyph, float x,
+                     float y, SDL_Color color)
+{
+    if (glyph->rect.w <= 0)
+        return true;
+    if (!reserve_quads(batch, 1))
+        return false;
+
+    float x0 = x + (float) glyph->x_offset;
+    float y0 = y;
+    float x1 = x0 + (float) glyph->rect.w;
+    float y1 = y0 + (float) glyph->rect.h;
+    float u0 = (float) glyph->rect.x / (float) atlas->width;
+    float v0 = (float) glyph->rect.y / (float) atlas->height;
+    float u1 = (float) (glyph->rect.x + glyph->rect.w) / (float) atlas->width;
+    float v1 = (float) (glyph->rect.y + glyph->rect.h) / (float) atlas->height;
+    if (glyph->pending) {
+        // A faint ink box, sampled from the middle of the solid block
+        if (atlas->solid.w <= 0)
+            return true;
+        y0 = y + (float) glyph->rect.y;
+        y1 = y0 + (float) glyph->rect.h;
+        u0 = u1 = ((float) atlas->solid.x + (float) atlas->solid.w / 2) / (float) atlas->width;
+        v0 = v1 = ((float) atlas->solid.y + (float) atlas->solid.h / 2) / (float) atlas->height;
+        color.a /= 4;
+        batch->placeholders++;
+    }
+
+    int base = batch->num_vertices;
+    SDL_Vertex *v = batch->vertices + base;
+    v[0] = (SDL_Vertex){{x0, y0}, color, {u0, v0}};
+    v[1] = (SDL_Vertex){{x1, y0}, color, {u1, v0}};
+    v[2] = (SDL_Vertex){{x1, y1}, color, {u1, v1}};
+    v[3] = (SDL_Vertex){{x0, y1}, color, {u0, v1}};
+    batch->num_vertices += 4;
+
+    int *idx = batch->indices + batch->num_indices;
+    idx[0] = base;
+    idx[1] = base + 1;
+    idx[2] = base + 2;
+    idx[3] = base;
+    idx[4] = base + 2;
+    idx[5] = base + 3;
+    batch->num_indices += 6;
+    return true;
+}
+
+bool glyph_batch_append(GlyphBatch *dst, const GlyphBatch *src, float dx, float dy)
+{
+    if (src->num_vertices == 0)
+        return true;
+    if (!reserve_quads(dst, src->num_vertices / 4))
+        return false;
+
+    int base = dst->num_vertices;
+    SDL_Vertex *v = dst->vertices + base;
+    for (int i = 0; i < src->num_vertices; i++) {
+        v[i] = src->vertices[i];
+        v[i].position.x += dx;
+        v[i].position.y += dy;
+    }
+    dst->num_vertices += src->num_vertices;
+
+    int *idx = dst->indices + dst->num_indices;
+    for (int i = 0; i < src->num_indices; i++)
+        idx[i] = src->indices[i] + base;
+    dst->num_indices += src->num_indices;
+    dst->placeholders += src->placeholders;
+    return true;
+}
+
+int glyph_batch_draw(SDL_Renderer *renderer, const GlyphAtlas *atlas, const GlyphBatch *batch)
+{
+    if (!renderer || !atlas || !batch || batch->num_indices == 0)
+        return 0;
+    return SDL_RenderGeometry(renderer, atlas->texture, batch->vertices, batch->num_vertices,
+                              batch->indices, batch->num_indices);
+}
+
+void cleanup_glyph_batch(GlyphBatch *batch)
+{
+    free(batch->vertices);
+    free(batch->indices);
+    memset(batch, 0, sizeof(*batch));
+}
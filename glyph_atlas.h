@@ -0,0 +1,88 @@
+#ifndef GLYPH_ATLAS_H
+#define GLYPH_ATLAS_H
+
+#include "raster_pool.h"
+#include <SDL.h>
+#include <SDL_ttf.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Glyph atlas: every glyph is rasterized once, in white, and packed into a
+// single texture on horizontal shelves. Text is drawn as textured quads whose
+// vertex color tints the glyphs, so a whole screen of text is one
+// SDL_RenderGeometry call and an edit re-rasterizes nothing that is cached.
+//
+// Glyphs are keyed by font and codepoint; a TTF_Font is opened at one size,
+// so the font handle also identifies the size. When the texture fills up the
+// atlas is cleared (and grown, up to GLYPH_ATLAS_MAX_SIZE) and its generation
+// is bumped: batches built against an older generation must be rebuilt.
+//
+// With a raster pool attached, glyphs of the pool's font are rasterized by
+// worker threads. Until glyph_atlas_collect uploads its pixels such a glyph is
+// pending and drawn as a faint box over its ink bounds.
+
+// Initial and largest atlas texture edge in pixels
+#define GLYPH_ATLAS_SIZE 512
+#define GLYPH_ATLAS_MAX_SIZE 4096
+
+typedef struct {
+    TTF_Font *font;
+    uint32_t codepoint;
+    SDL_Rect rect; // location in the atlas texture; w == 0 for blank glyphs
+    int x_offset;  // left edge of rect relative to the pen position
+    int advance;   // pen advance in pixels
+    int hash_next; // next entry in the same hash bucket, -1 ends the chain
+    bool pending;  // a worker is rasterizing it; rect is the ink box to fill
+} AtlasGlyph;
+
+typedef struct {
+    SDL_Renderer *renderer;
+    SDL_Texture *texture;
+    int width;
+    int height;
+    int shelf_x; // next free column on the current shelf
+    int shelf_y; // top of the current shelf
+    int shelf_h; // height of the current shelf
+    AtlasGlyph *glyphs;
+    int num_glyphs;
+    int glyph_capacity;
+    int *buckets; // glyph_capacity chains indexed by key hash
+    uint32_t generation;
+    RasterPool *pool; // rasterizes glyphs off the main thread, or NULL
+    SDL_Rect solid;   // opaque block placeholders are drawn from; w == 0 if none
+} GlyphAtlas;
+
+// Textured quads waiting to be drawn from one atlas
+typedef struct {
+    SDL_Vertex *vertices;
+    int num_vertices;
+    int vertex_capacity;
+    int *indices;
+    int num_indices;
+    int index_capacity;
+    int placeholders; // quads standing in for pending glyphs
+} GlyphBatch;
+
+GlyphAtlas *create_glyph_atlas(SDL_Renderer *renderer);
+void destroy_glyph_atlas(GlyphAtlas *atlas);
+
+// Look up a glyph, rasterizing and packing it on first use. Returns NULL if
+// the glyph cannot be stored. May clear the atlas (see generation). The
+// pointer is valid until the next call.
+const AtlasGlyph *glyph_atlas_get(GlyphAtlas *atlas, TTF_Font *font, uint32_t codepoint);
+
+// Upload the glyphs the raster pool finished. Returns how many placeholders
+// were replaced; if any were, the generation is bumped.
+int glyph_atlas_collect(GlyphAtlas *atlas);
+
+void glyph_batch_clear(GlyphBatch *batch);
+// Queue glyph with its pen position at (x, y), the top of the line
+bool glyph_batch_add(GlyphBatch *batch, const GlyphAtlas *atlas, const AtlasGlyph *glyph, float x,
+                     float y, SDL_Color color);
+// Queue every quad of src moved by (dx, dy)
+bool glyph_batch_append(GlyphBatch *dst, const GlyphBatch *src, float dx, float dy);
+// Draw all queued quads. Returns 0 on success.
+int glyph_batch_draw(SDL_Renderer *renderer, const GlyphAtlas *atlas, const GlyphBatch *batch);
+void cleanup_glyph_batch(GlyphBatch *batch);
+
+#endif // GLYPH_ATLAS_H
@@ -0,0 +1,250 @@
+#include "grapheme.h"
+#include "grapheme_tables.h"
+#include <stdbool.h>
+
+// Combining marks kept per cluster for display
+static int combining_mark_cap = MAX_COMBINING_PER_CLUSTER;
+
+void set_combining_mark_cap(int cap)
+{
+    combining_mark_cap = cap > 0 ? cap : MAX_COMBINING_PER_CLUSTER;
+}
+
+int get_combining_mark_cap(void)
+{
+    return combining_mark_cap;
+}
+
+GraphemeBreak grapheme_break_property(uint32_t cp)
+{
+    if (cp >= 0x110000)
+        return GRAPHEME_OTHER;
+    unsigned block = grapheme_stage1[cp >> GRAPHEME_BLOCK_SHIFT];
+    return (GraphemeBreak)
+        grapheme_stage2[(block << GRAPHEME_BLOCK_SHIFT) | (cp & GRAPHEME_BLOCK_MASK)];
+}
+
+static inline bool is_continuation(unsigned char c)
+{
+    return (c & 0xC0) == 0x80;
+}
+
+size_t grapheme_decode(const char *s, size_t len, uint32_t *cp)
+{
+    const unsigned char *p = (const unsigned char *) s;
+    unsigned char c = p[0];
+    if (c < 0x80) {
+        *cp = c;
+        return 1;
+    }
+
+    size_t n;
+    uint32_t value;
+    if (c >= 0xC2 && c <= 0xDF) {
+        n = 2;
+        value = c & 0x1F;
+    } else if (c >= 0xE0 && c <= 0xEF) {
+        n = 3;
+        value = c & 0x0F;
+    } else if (c >= 0xF0 && c <= 0xF4) {
+        n = 4;
+        value = c & 0x07;
+    } else {
+        *cp = 0xFFFD;
+        return 1;
+    }
+    if (n > len) {
+        *cp = 0xFFFD;
+        return 1;
+    }
+    for (size_t i = 1; i < n; i++) {
+        if (!is_continuation(p[i])) {
+            *cp = 0xFFFD;
+            return 1;
+        }
+        value = (value << 6) | (p[i] & 0x3F);
+    }
+    *cp = value;
+    return n;
+}
+
+// Start of the codepoint ending at pos (pos > 0), agreeing with how the
+// forward decoder splits malformed sequences
+static size_t prev_codepoint(const char *s, size_t len, size_t pos)
+{
+    size_t start = pos - 1;
+    while (start > 0 && pos - start < 4 && is_continuation((unsigned char) s[start]))
+        start--;
+    uint32_t cp;
+    if (start + grapheme_decode(s + start, len - start, &cp) == pos)
+        return start;
+    return pos - 1;
+}
+
+static GraphemeBreak property_at(const char *s, size_t len, size_t pos, size_t *char_len)
+{
+    uint32_t cp;
+    *char_len = grapheme_decode(s + pos, len - pos, &cp);
+    return grapheme_break_property(cp);
+}
+
+// GB11 progress: an Extended_Pictographic followed by Extend* (SEEN), then ZWJ
+enum { PICT_NONE, PICT_SEEN, PICT_ZWJ };
+
+typedef struct {
+    GraphemeBreak prev; // property of the last codepoint
+    int ri_count;       // regional indicators in a row ending at prev
+    int pict;           // GB11 progress
+} SegmentState;
+
+static void state_begin(SegmentState *st, GraphemeBreak prop)
+{
+    st->prev = prop;
+    st->ri_count = prop == GRAPHEME_REGIONAL_INDICATOR;
+    st->pict = prop == GRAPHEME_EXTENDED_PICTOGRAPHIC ? PICT_SEEN : PICT_NONE;
+}
+
+static void state_advance(SegmentState *st, GraphemeBreak prop)
+{
+    st->ri_count = prop == GRAPHEME_REGIONAL_INDICATOR ? st->ri_count + 1 : 0;
+    if (prop == GRAPHEME_EXTENDED_PICTOGRAPHIC)
+        st->pict = PICT_SEEN;
+    else if (prop == GRAPHEME_ZWJ && st->pict == PICT_SEEN)
+        st->pict = PICT_ZWJ;
+    else if (!(prop == GRAPHEME_EXTEND && st->pict == PICT_SEEN))
+        st->pict = PICT_NONE;
+    st->prev = prop;
+}
+
+// Whether next continues the cluster ending in st->prev (GB3 to GB999)
+static bool joins(const SegmentState *st, GraphemeBreak next)
+{
+    GraphemeBreak prev = st->prev;
+    if (prev == GRAPHEME_CR && next == GRAPHEME_LF)
+        return true; // GB3
+    if (prev == GRAPHEME_CR || prev == GRAPHEME_LF || prev == GRAPHEME_CONTROL)
+        return false; // GB4
+    if (next == GRAPHEME_CR || next == GRAPHEME_LF || next == GRAPHEME_CONTROL)
+        return false; // GB5
+
+    switch (prev) {
+    case GRAPHEME_L: // GB6
+        if (next == GRAPHEME_L || next == GRAPHEME_V || next == GRAPHEME_LV ||
+            next == GRAPHEME_LVT)
+            return true;
+        break;
+    case GRAPHEME_LV:
+    case GRAPHEME_V: // GB7
+        if (next == GRAPHEME_V || next == GRAPHEME_T)
+            return true;
+        break;
+    case GRAPHEME_LVT:
+    case GRAPHEME_T: // GB8
+        if (next == GRAPHEME_T)
+            return true;
+        break;
+    default:
+        break;
+    }
+
+    if (next == GRAPHEME_EXTEND || next == GRAPHEME_ZWJ || next == GRAPHEME_SPACING_MARK)
+        return true; // GB9, GB9a
+    if (prev == GRAPHEME_PREPEND)
+        return true; // GB9b
+    if (prev == GRAPHEME_ZWJ && next == GRAPHEME_EXTENDED_PICTOGRAPHIC && st->pict == PICT_ZWJ)
+        return true; // GB11
+    if (prev == GRAPHEME_REGIONAL_INDICATOR && next == GRAPHEME_REGIONAL_INDICATOR)
+        return st->ri_count % 2 == 1; // GB12, GB13
+    return false;                     // GB999
+}
+
+size_t grapheme_next_break(const char *s, size_t len, size_t pos)
+{
+    if (!s || pos >= len)
+        return len;
+
+    // ASCII other than CR never joins with a following ASCII byte
+    unsigned char c = (unsigned char) s[pos];
+    if (c < 0x80 && c != '\r' && (pos + 1 == len || (unsigned char) s[pos + 1] < 0x80))
+        return pos + 1;
+
+    size_t char_len;
+    SegmentState st;
+    state_begin(&st, property_at(s, len, pos, &char_len));
+    pos += char_len;
+    while (pos < len) {
+        GraphemeBreak prop = property_at(s, len, pos, &char_len);
+        if (!joins(&st, prop))
+            break;
+        state_advance(&st, prop);
+        pos += char_len;
+    }
+    return pos;
+}
+
+size_t grapheme_anchor(const char *s, size_t len, size_t pos)
+{
+    if (!s || pos == 0)
+        return 0;
+    if (pos > len)
+        pos = len;
+
+    // The pair rules break there and the right side is neither a regional
+    // indicator (GB12/13 count pairs) nor a pictograph (GB11 looks back
+    // through the sequence)
+    size_t start = prev_codepoint(s, len, pos);
+    while (start > 0) {
+        size_t before = prev_codepoint(s, len, start);
+        size_t char_len;
+        GraphemeBreak left = property_at(s, len, before, &char_len);
+        GraphemeBreak right = property_at(s, len, start, &char_len);
+        if (right != GRAPHEME_REGIONAL_INDICATOR && right != GRAPHEME_EXTENDED_PICTOGRAPHIC) {
+            SegmentState st;
+            state_begin(&st, left);
+            if (!joins(&st, right))
+                break;
+        }
+        start = before;
+    }
+    return start;
+}
+
+size_t grapheme_prev_break(const char *s, size_t len, size_t pos)
+{
+    if (!s || pos == 0)
+        return 0;
+    if (pos > len)
+        pos = len;
+
+    // Walk back to a boundary that holds regardless of context, then segment
+    // forward up to pos
+    size_t start = grapheme_anchor(s, len, pos);
+    for (;;) {
+        size_t next = grapheme_next_break(s, len, start);
+        if (next >= pos)
+            return start;
+        start = next;
+    }
+}
+
+size_t grapheme_count(const char *s, size_t len)
+{
+    size_t count = 0;
+    for (size_t pos = 0; pos < len; pos = grapheme_next_break(s, len, pos))
+        count++;
+    return count;
+}
+
+size_t grapheme_visible_length(const char *s, size_t len)
+{
+    int marks = 0;
+    size_t pos = 0;
+    while (pos < len) {
+        uint32_t cp;
+        size_t char_len = grapheme_decode(s + pos, len - pos, &cp);
+        if (grapheme_break_property(cp) == GRAPHEME_EXTEND && ++marks > combining_mark_cap)
+            return pos;
+        pos += char_len;
+    }
+    return len;
+}
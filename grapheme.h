@@ -0,0 +1,70 @@
+#ifndef GRAPHEME_H
+#define GRAPHEME_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Extended grapheme cluster segmentation (UAX #29) over UTF-8 text. The
+// Grapheme_Cluster_Break property comes from a two-stage lookup table
+// generated by scripts/gen_grapheme_tables.py into grapheme_tables.h.
+//
+// Malformed UTF-8 is segmented one byte at a time, so every offset returned
+// is in range and the scan never reads past len.
+//
+// Pathological mark stacks ("Zalgo" text) are clamped for display: only the
+// first few combining marks of a cluster are laid out and drawn. The cluster
+// itself keeps all of its bytes, so editing and cursor movement are exact.
+
+// Default number of combining marks kept per cluster
+#define MAX_COMBINING_PER_CLUSTER 5
+
+// Grapheme_Cluster_Break values; the generator emits these numbers
+typedef enum {
+    GRAPHEME_OTHER,
+    GRAPHEME_CR,
+    GRAPHEME_LF,
+    GRAPHEME_CONTROL,
+    GRAPHEME_EXTEND,
+    GRAPHEME_ZWJ,
+    GRAPHEME_REGIONAL_INDICATOR,
+    GRAPHEME_PREPEND,
+    GRAPHEME_SPACING_MARK,
+    GRAPHEME_L,
+    GRAPHEME_V,
+    GRAPHEME_T,
+    GRAPHEME_LV,
+    GRAPHEME_LVT,
+    GRAPHEME_EXTENDED_PICTOGRAPHIC
+} GraphemeBreak;
+
+// Grapheme_Cluster_Break property of a codepoint
+GraphemeBreak grapheme_break_property(uint32_t cp);
+
+// Decode the codepoint at s[0, len) into *cp and return its byte length.
+// Malformed sequences decode to U+FFFD with length 1. len must be > 0.
+size_t grapheme_decode(const char *s, size_t len, uint32_t *cp);
+
+// First cluster boundary after pos in s[0, len) (len at the end). pos must be
+// a cluster boundary.
+size_t grapheme_next_break(const char *s, size_t len, size_t pos);
+
+// Last boundary before pos in s[0, len) that is a cluster boundary whatever
+// precedes s, or 0 if there is none
+size_t grapheme_anchor(const char *s, size_t len, size_t pos);
+
+// Last cluster boundary before pos in s[0, len) (0 at the start). pos must
+// be a codepoint boundary.
+size_t grapheme_prev_break(const char *s, size_t len, size_t pos);
+
+// Number of clusters in s[0, len)
+size_t grapheme_count(const char *s, size_t len);
+
+// Set the combining mark cap; non-positive values select the default
+void set_combining_mark_cap(int cap);
+int get_combining_mark_cap(void);
+
+// Bytes of the cluster s[0, len) that are displayed: everything up to the
+// first combining mark past the cap
+size_t grapheme_visible_length(const char *s, size_t len);
+
+#endif // GRAPHEME_H
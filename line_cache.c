@@ -0,0 +1,156 @@
+#include "line_cache.h"
+#include <stdlib.h>
+#include <string.h>
+
+static unsigned bucket_of(const LineCache *cache, uint64_t hash)
+{
+    return (unsigned) (hash ^ (hash >> 32)) & cache->bucket_mask;
+}
+
+static void list_remove(LineCache *cache, int e)
+{
+    LineCacheEntry *entry = &cache->entries[e];
+    if (entry->prev >= 0)
+        cache->entries[entry->prev].next = entry->next;
+    else
+        cache->head = entry->next;
+    if (entry->next >= 0)
+        cache->entries[entry->next].prev = entry->prev;
+    else
+        cache->tail = entry->prev;
+}
+
+static void list_push(LineCache *cache, int e)
+{
+    LineCacheEntry *entry = &cache->entries[e];
+    entry->prev = -1;
+    entry->next = cache->head;
+    if (entry->next >= 0)
+        cache->entries[entry->next].prev = e;
+    else
+        cache->tail = e;
+    cache->head = e;
+}
+
+static void hash_remove(LineCache *cache, int e)
+{
+    int *link = &cache->buckets[bucket_of(cache, cache->entries[e].hash)];
+    while (*link != e)
+        link = &cache->entries[*link].hash_next;
+    *link = cache->entries[e].hash_next;
+}
+
+LineCache *create_line_cache(int capacity)
+{
+    if (capacity <= 0)
+        capacity = LINE_CACHE_ENTRIES;
+    LineCache *cache = calloc(1, sizeof(LineCache));
+    if (!cache)
+        return NULL;
+    unsigned buckets = 1;
+    while (buckets < (unsigned) capacity * 2)
+        buckets <<= 1;
+    cache->entries = calloc(capacity, sizeof(LineCacheEntry));
+    cache->buckets = malloc(buckets * sizeof(int));
+    if (!cache->entries || !cache->buckets) {
+        destroy_line_cache(cache);
+        return NULL;
+    }
+    cache->capacity = capacity;
+    cache->bucket_mask = buckets - 1;
+    for (unsigned i = 0; i < buckets; i++)
+        cache->buckets[i] = -1;
+    cache->head = cache->tail = -1;
+    return cache;
+}
+
+void destroy_line_cache(LineCache *cache)
+{
+    if (!cache)
+        return;
+    if (cache->entries) {
+        for (int i = 0; i < cache->capacity; i++) {
+            free(cache->entries[i].text);
+            cleanup_glyph_batch(&cache->entries[i].quads);
+        }
+    }
+    free(cache->entries);
+    free(cache->buckets);
+    free(cache);
+}
+
+uint64_t line_cache_hash(const char *text, size_t len)
+{
+    uint64_t h = 0x9E3779B97F4A7C15ull ^ len;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t w;
+        memcpy(&w, text + i, sizeof(w));
+        h = (h ^ w) * 0xFF51AFD7ED558CCDull;
+        h ^= h >> 32;
+    }
+    for (; i < len; i++)
+        h = (h ^ (unsigned char) text[i]) * 0x100000001B3ull;
+    return h ^ (h >> 29);
+}
+
+const GlyphBatch *line_cache_find(LineCache *cache, uint64_t hash, const char *text, size_t len,
+                                  int max_width, const TTF_Font *font, uint32_t generation)
+{
+    for (int e = cache->buckets[bucket_of(cache, hash)]; e >= 0;
+         e = cache->entries[e].hash_next) {
+        LineCacheEntry *entry = &cache->entries[e];
+        if (entry->hash == hash && entry->len == len && entry->max_width == max_width &&
+            entry->font == font && entry->generation == generation &&
+            memcmp(entry->text, text, len) == 0) {
+            if (cache->head != e) {
+                list_remove(cache, e);
+                list_push(cache, e);
+            }
+            cache->stats.hits++;
+            return &entry->quads;
+        }
+    }
+    cache->stats.misses++;
+    return NULL;
+}
+
+GlyphBatch *line_cache_insert(LineCache *cache, uint64_t hash, const char *text, size_t len,
+                              int max_width, const TTF_Font *font, uint32_t generation)
+{
+    // Use a fresh slot while there are any, then the least recently used one
+    int e = cache->count < cache->capacity ? cache->count : cache->tail;
+    LineCacheEntry *entry = &cache->entries[e];
+
+    // Grow the text copy first: on failure the slot keeps its old line intact
+    if (!entry->text || len > entry->text_capacity) {
+        size_t capacity = len ? len : 1;
+        char *grown = realloc(entry->text, capacity);
+        if (!grown)
+            return NULL;
+        entry->text = grown;
+        entry->text_capacity = capacity;
+    }
+
+    if (e == cache->count) {
+        cache->count++;
+    } else {
+        list_remove(cache, e);
+        hash_remove(cache, e);
+        cache->stats.evictions++;
+    }
+
+    memcpy(entry->text, text, len);
+    entry->hash = hash;
+    entry->len = len;
+    entry->max_width = max_width;
+    entry->font = font;
+    entry->generation = generation;
+    glyph_batch_clear(&entry->quads);
+
+    list_push(cache, e);
+    unsigned b = bucket_of(cache, hash);
+    entry->hash_next = cache->buckets[b];
+    cache->buckets[b] = e;
+    return &entry->quads;
+}
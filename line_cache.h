@@ -0,0 +1,67 @@
+#ifndef LINE_CACHE_H
+#define LINE_CACHE_H
+
+#include "glyph_atlas.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// LRU cache of laid-out lines. Each entry holds the glyph quads of one line,
+// positioned relative to the line origin, keyed by the line's bytes, the wrap
+// width and the font. A viewport is then assembled by translating cached
+// quads, so scrolling lays out only the lines that come into view and an edit
+// only the lines it touched.
+//
+// Quads refer to atlas texture coordinates, so entries also remember the
+// atlas generation they were built against and miss once the atlas is reset.
+
+// Default number of lines kept
+#define LINE_CACHE_ENTRIES 256
+
+typedef struct {
+    uint64_t hits;
+    uint64_t misses;
+    uint64_t evictions;
+} LineCacheStats;
+
+typedef struct {
+    uint64_t hash;
+    char *text; // copy of the line bytes, compared on lookup
+    size_t len;
+    size_t text_capacity;
+    int max_width;
+    const TTF_Font *font;
+    uint32_t generation;
+    GlyphBatch quads; // relative to the line origin
+    int prev;      // towards the most recently used end
+    int next;      // towards the least recently used end
+    int hash_next; // next entry in the same hash bucket, -1 ends the chain
+} LineCacheEntry;
+
+typedef struct {
+    LineCacheEntry *entries;
+    int capacity;
+    int *buckets;
+    unsigned bucket_mask;
+    int head; // most recently used entry
+    int tail; // least recently used entry
+    int count;
+    LineCacheStats stats;
+} LineCache;
+
+// Non-positive capacity selects LINE_CACHE_ENTRIES
+LineCache *create_line_cache(int capacity);
+void destroy_line_cache(LineCache *cache);
+
+uint64_t line_cache_hash(const char *text, size_t len);
+
+// Cached quads for the line, or NULL. A hit becomes the most recently used.
+const GlyphBatch *line_cache_find(LineCache *cache, uint64_t hash, const char *text, size_t len,
+                                  int max_width, const TTF_Font *font, uint32_t generation);
+
+// Claim an entry for the line (evicting the least recently used one) and
+// return its cleared quad batch for the caller to fill, or NULL on failure
+GlyphBatch *line_cache_insert(LineCache *cache, uint64_t hash, const char *text, size_t len,
+                              int max_width, const TTF_Font *font, uint32_t generation);
+
+#endif // LINE_CACHE_H
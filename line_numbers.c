@@ -32,28 +32,22 @@ void cleanup_line_numbers(LineNumbers *line_nums)
     }
 }
 
-int count_lines(const char *text)
+int count_lines(const PieceTable *buffer)
 {
-    if (!text || !*text)
+    if (!buffer)
         return 1;
-
-    int lines = 1;
-    for (const char *p = text; *p; p++) {
-        if (*p == '\n')
-            lines++;
-    }
-    return lines;
+    return (int) piece_table_line_count(buffer);
 }
 
-void update_line_numbers(LineNumbers *line_nums, SDL_Renderer *renderer, const char *text,
-                         int first_visible_line, int visible_lines)
+void update_line_numbers(LineNumbers *line_nums, SDL_Renderer *renderer,
+                         const PieceTable *buffer, int first_visible_line, int visible_lines)
 {
     if (!line_nums->enabled) {
         line_nums->width = 0;
         return;
     }
 
-    int total_lines = count_lines(text);
+    int total_lines = count_lines(buffer);
 
     // Calculate required width based on number of digits in line count
     char max_line_str[32];
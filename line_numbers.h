@@ -1,6 +1,7 @@
 #ifndef LINE_NUMBERS_H
 #define LINE_NUMBERS_H
 
+#include "piece_table.h"
 #include "platform_sdl.h"
 #include <SDL.h>
 #include <SDL_ttf.h>
@@ -22,13 +23,13 @@ void init_line_numbers(LineNumbers *line_nums, SDL_Renderer *renderer, TTF_Font
 void cleanup_line_numbers(LineNumbers *line_nums);
 
 // Update and render
-void update_line_numbers(LineNumbers *line_nums, SDL_Renderer *renderer, const char *text,
-                         int first_visible_line, int visible_lines);
+void update_line_numbers(LineNumbers *line_nums, SDL_Renderer *renderer,
+                         const PieceTable *buffer, int first_visible_line, int visible_lines);
 void render_line_numbers(LineNumbers *line_nums, SDL_Renderer *renderer);
 void resize_line_numbers(LineNumbers *line_nums, int window_height);
 
 // Utility
-int count_lines(const char *text);
+int count_lines(const PieceTable *buffer);
 void toggle_line_numbers(LineNumbers *line_nums);
 bool line_numbers_enabled(const LineNumbers *line_nums);
 int get_line_numbers_width(const LineNumbers *line_nums);
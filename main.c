@@ -1,5 +1,7 @@
 #include "debug.h"
+#include "grapheme.h"
 #include "sdl_window.h"
+#include "text_renderer.h"
 #include "unicode_processor.h"
 #include <locale.h>
 #include <stdio.h>
@@ -75,15 +77,27 @@ int main(int argc, char *argv[])
 #endif
 
     // Parse command line arguments
+    int cluster_block_size = 0;
+    int cluster_cache_blocks = 0;
+    int max_combining = 0;
     for (int i = 1; i < argc; i++) {
         if (strcmp(argv[i], "--debug") == 0 || strcmp(argv[i], "-d") == 0) {
             debug_logging = 1;
             printf("Debug mode enabled\n");
+        } else if (strncmp(argv[i], "--cluster-block-size=", 21) == 0) {
+            cluster_block_size = atoi(argv[i] + 21);
+        } else if (strncmp(argv[i], "--cluster-cache-blocks=", 23) == 0) {
+            cluster_cache_blocks = atoi(argv[i] + 23);
+        } else if (strncmp(argv[i], "--max-combining=", 16) == 0) {
+            max_combining = atoi(argv[i] + 16);
         } else if (strcmp(argv[i], "--help") == 0 || strcmp(argv[i], "-h") == 0) {
             printf("RobusText Editor - Feature Complete Text Editor\n");
             printf("Usage: %s [options]\n", argv[0]);
             printf("Options:\n");
             printf("  --debug, -d    Enable debug output\n");
+            printf("  --cluster-block-size=N    Clusters per lazy layout cache block\n");
+            printf("  --cluster-cache-blocks=N  Lazy layout cache blocks kept resident\n");
+            printf("  --max-combining=N         Combining marks drawn per character\n");
             printf("  --help, -h     Show this help message\n");
             return 0;
         }
@@ -109,6 +123,8 @@ int main(int argc, char *argv[])
         initial_file = nonflags[0];
     }
 
+    set_cluster_cache_defaults(cluster_block_size, cluster_cache_blocks);
+    set_combining_mark_cap(max_combining);
     display_text_window(font_path, 28, initial_file);
 
     return 0;
@@ -0,0 +1,684 @@
+#include "piece_table.h"
+#include "debug.h"
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Minimum capacity of each add-buffer block. Blocks are never reallocated so
+// pieces can point straight into them.
+#define PIECE_BLOCK_SIZE (64 * 1024)
+
+// Pieces never exceed this length. Splitting a piece recounts the newlines on
+// one side of the cut, so the cap bounds that scan for large loaded files.
+#define PIECE_MAX_LENGTH (64 * 1024)
+
+struct PieceNode {
+    PieceNode *left;
+    PieceNode *right;
+    const char *data;        // first byte of this piece
+    size_t length;           // bytes in this piece
+    size_t newlines;         // '\n' bytes in this piece
+    size_t subtree_length;   // bytes in this piece and its descendants
+    size_t subtree_newlines; // '\n' bytes in this piece and its descendants
+    uint32_t priority;       // treap heap priority
+};
+
+typedef struct PieceBlock PieceBlock;
+
+struct PieceBlock {
+    PieceBlock *next;
+    size_t used;
+    size_t capacity;
+    char data[];
+};
+
+// Shared between a live table and its snapshots. Only the live table appends
+// to add_blocks, and only past the bytes any snapshot can reference.
+struct PieceStorage {
+    atomic_int refcount;
+    char *original;         // initial document text (owned, never modified)
+    PieceBlock *add_blocks; // append-only storage for inserted text
+};
+
+static uint32_t next_priority(PieceTable *pt)
+{
+    // xorshift32
+    uint32_t x = pt->seed;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    pt->seed = x;
+    return x;
+}
+
+static size_t subtree_length(const PieceNode *node)
+{
+    return node ? node->subtree_length : 0;
+}
+
+static size_t subtree_newlines(const PieceNode *node)
+{
+    return node ? node->subtree_newlines : 0;
+}
+
+static void update_node(PieceNode *node)
+{
+    node->subtree_length = subtree_length(node->left) + node->length + subtree_length(node->right);
+    node->subtree_newlines =
+        subtree_newlines(node->left) + node->newlines + subtree_newlines(node->right);
+}
+
+static size_t count_newlines(const char *data, size_t len)
+{
+    size_t count = 0;
+    const char *end = data + len;
+    while (data < end && (data = memchr(data, '\n', (size_t) (end - data))) != NULL) {
+        count++;
+        data++;
+    }
+    return count;
+}
+
+// Offset of the nth (1-based) newline in data; the caller guarantees it exists
+static size_t nth_newline(const char *data, size_t len, size_t n)
+{
+    const char *p = data;
+    const char *end = data + len;
+    for (;;) {
+        p = memchr(p, '\n', (size_t) (end - p));
+        if (--n == 0)
+            return (size_t) (p - data);
+        p++;
+    }
+}
+
+static PieceNode *new_node(PieceTable *pt, const char *data, size_t length)
+{
+    PieceNode *node = malloc(sizeof(PieceNode));
+    if (!node)
+        return NULL;
+    node->left = NULL;
+    node->right = NULL;
+    node->data = data;
+    node->length = length;
+    node->newlines = data ? count_newlines(data, length) : 0;
+    node->subtree_length = length;
+    node->subtree_newlines = node->newlines;
+    node->priority = next_priority(pt);
+    return node;
+}
+
+static void free_tree(PieceNode *node)
+{
+    while (node) {
+        free_tree(node->left);
+        PieceNode *right = node->right;
+        free(node);
+        node = right;
+    }
+}
+
+static void free_blocks(PieceBlock *block)
+{
+    while (block) {
+        PieceBlock *next = block->next;
+        free(block);
+        block = next;
+    }
+}
+
+static PieceStorage *new_storage(char *original)
+{
+    PieceStorage *storage = malloc(sizeof(PieceStorage));
+    if (!storage)
+        return NULL;
+    atomic_init(&storage->refcount, 1);
+    storage->original = original;
+    storage->add_blocks = NULL;
+    return storage;
+}
+
+static void release_storage(PieceStorage *storage)
+{
+    if (!storage || atomic_fetch_sub_explicit(&storage->refcount, 1, memory_order_acq_rel) != 1)
+        return;
+    free_blocks(storage->add_blocks);
+    free(storage->original);
+    free(storage);
+}
+
+static PieceNode *clone_tree(const PieceNode *node, bool *ok)
+{
+    if (!node || !*ok)
+        return NULL;
+    PieceNode *copy = malloc(sizeof(PieceNode));
+    if (!copy) {
+        *ok = false;
+        return NULL;
+    }
+    *copy = *node;
+    copy->left = clone_tree(node->left, ok);
+    copy->right = clone_tree(node->right, ok);
+    return copy;
+}
+
+// Split the tree into [0, pos) and [pos, end). A piece straddling pos is cut in
+// two; the tail node is taken from *spare so the split itself cannot fail.
+static void split(PieceNode *node, size_t pos, PieceNode **left, PieceNode **right,
+                  PieceNode **spare)
+{
+    if (!node) {
+        *left = *right = NULL;
+        return;
+    }
+
+    size_t left_len = subtree_length(node->left);
+    if (pos <= left_len) {
+        split(node->left, pos, left, &node->left, spare);
+        update_node(node);
+        *right = node;
+    } else if (pos >= left_len + node->length) {
+        split(node->right, pos - left_len - node->length, &node->right, right, spare);
+        update_node(node);
+        *left = node;
+    } else {
+        // Cut inside this piece. The tail inherits the right subtree and the
+        // node's priority, which keeps the heap property on both sides.
+        size_t cut = pos - left_len;
+        PieceNode *tail = *spare;
+        *spare = NULL;
+        tail->data = node->data + cut;
+        tail->length = node->length - cut;
+        // Recount whichever side of the cut is shorter
+        if (cut <= tail->length) {
+            size_t head_newlines = count_newlines(node->data, cut);
+            tail->newlines = node->newlines - head_newlines;
+            node->newlines = head_newlines;
+        } else {
+            tail->newlines = count_newlines(tail->data, tail->length);
+            node->newlines -= tail->newlines;
+        }
+        tail->priority = node->priority;
+        tail->left = NULL;
+        tail->right = node->right;
+        node->length = cut;
+        node->right = NULL;
+        update_node(tail);
+        update_node(node);
+        *left = node;
+        *right = tail;
+    }
+}
+
+static PieceNode *merge(PieceNode *a, PieceNode *b)
+{
+    if (!a)
+        return b;
+    if (!b)
+        return a;
+    if (a->priority >= b->priority) {
+        a->right = merge(a->right, b);
+        update_node(a);
+        return a;
+    }
+    b->left = merge(a, b->left);
+    update_node(b);
+    return b;
+}
+
+// Locate the piece containing pos. Returns NULL when pos is past the end;
+// otherwise *offset is pos relative to the start of the returned piece.
+static const PieceNode *find_piece(const PieceNode *node, size_t pos, size_t *offset)
+{
+    while (node) {
+        size_t left_len = subtree_length(node->left);
+        if (pos < left_len) {
+            node = node->left;
+        } else if (pos < left_len + node->length) {
+            *offset = pos - left_len;
+            return node;
+        } else {
+            pos -= left_len + node->length;
+            node = node->right;
+        }
+    }
+    return NULL;
+}
+
+// Copy text into the add buffer and return a stable pointer to it.
+static const char *store_text(PieceTable *pt, const char *text, size_t len)
+{
+    if (!pt->storage && !(pt->storage = new_storage(NULL)))
+        return NULL;
+
+    PieceBlock *block = pt->storage->add_blocks;
+    if (!block || block->capacity - block->used < len) {
+        size_t capacity = len > PIECE_BLOCK_SIZE ? len : PIECE_BLOCK_SIZE;
+        block = malloc(sizeof(PieceBlock) + capacity);
+        if (!block)
+            return NULL;
+        block->next = pt->storage->add_blocks;
+        block->used = 0;
+        block->capacity = capacity;
+        pt->storage->add_blocks = block;
+    }
+    char *dest = block->data + block->used;
+    memcpy(dest, text, len);
+    block->used += len;
+    return dest;
+}
+
+// Fast path for typing: if nothing else changed since the previous insert and
+// the new text lands right after it in the same add block, grow that piece in
+// place instead of adding a node.
+static bool try_extend_last_insert(PieceTable *pt, size_t pos, const char *text, size_t len)
+{
+    PieceNode *last = pt->last_insert;
+    PieceBlock *block = pt->storage ? pt->storage->add_blocks : NULL;
+    if (!last || pt->last_insert_version != pt->version || pos != pt->last_insert_end || !block)
+        return false;
+    if (last->data + last->length != block->data + block->used ||
+        block->capacity - block->used < len)
+        return false;
+
+    memcpy(block->data + block->used, text, len);
+    block->used += len;
+    size_t newlines = count_newlines(text, len);
+
+    // Walk down to the piece ending at pos, growing subtree counts on the way
+    PieceNode *node = pt->root;
+    size_t target = pos - 1;
+    while (node) {
+        node->subtree_length += len;
+        node->subtree_newlines += newlines;
+        size_t left_len = subtree_length(node->left);
+        if (target < left_len) {
+            node = node->left;
+        } else if (target < left_len + node->length) {
+            break;
+        } else {
+            target -= left_len + node->length;
+            node = node->right;
+        }
+    }
+    node->length += len;
+    node->newlines += newlines;
+    return true;
+}
+
+// Build a treap of pieces covering data, each at most PIECE_MAX_LENGTH bytes.
+// Returns false (and builds nothing) if any allocation fails.
+static bool build_pieces(PieceTable *pt, const char *data, size_t len, PieceNode **out)
+{
+    PieceNode *root = NULL;
+    for (size_t off = 0; off < len; off += PIECE_MAX_LENGTH) {
+        size_t chunk = len - off < PIECE_MAX_LENGTH ? len - off : PIECE_MAX_LENGTH;
+        PieceNode *node = new_node(pt, data + off, chunk);
+        if (!node) {
+            free_tree(root);
+            return false;
+        }
+        root = merge(root, node);
+    }
+    *out = root;
+    return true;
+}
+
+static void log_edit(PieceTable *pt, size_t pos, size_t removed, size_t inserted)
+{
+    PieceEdit *edit = &pt->edits[pt->version % PIECE_EDIT_LOG_SIZE];
+    edit->version = pt->version;
+    edit->pos = pos;
+    edit->removed = removed;
+    edit->inserted = inserted;
+}
+
+void init_piece_table(PieceTable *pt)
+{
+    memset(pt, 0, sizeof(PieceTable));
+    pt->seed = 0x9E3779B9u;
+}
+
+void cleanup_piece_table(PieceTable *pt)
+{
+    free_tree(pt->root);
+    release_storage(pt->storage);
+    free(pt->flat);
+    pt->root = NULL;
+    pt->storage = NULL;
+    pt->flat = NULL;
+    pt->flat_capacity = 0;
+    pt->length = 0;
+    pt->last_insert = NULL;
+}
+
+bool piece_table_load(PieceTable *pt, char *text, size_t len)
+{
+    if (pt->frozen)
+        return false;
+
+    PieceNode *node = NULL;
+    if (!build_pieces(pt, text, len, &node))
+        return false;
+    PieceStorage *storage = new_storage(text);
+    if (!storage) {
+        free_tree(node);
+        return false;
+    }
+
+    // Snapshots keep their own reference to the old storage
+    free_tree(pt->root);
+    release_storage(pt->storage);
+    pt->root = node;
+    pt->storage = storage;
+    pt->length = len;
+    pt->last_insert = NULL;
+    pt->version++;
+    return true;
+}
+
+bool piece_table_set_text(PieceTable *pt, const char *text)
+{
+    size_t len = text ? strlen(text) : 0;
+    char *copy = malloc(len + 1);
+    if (!copy)
+        return false;
+    if (len > 0)
+        memcpy(copy, text, len);
+    copy[len] = '\0';
+    if (!piece_table_load(pt, copy, len)) {
+        free(copy);
+        return false;
+    }
+    return true;
+}
+
+bool piece_table_snapshot(const PieceTable *pt, PieceTable *snapshot)
+{
+    init_piece_table(snapshot);
+    bool ok = true;
+    snapshot->root = clone_tree(pt->root, &ok);
+    if (!ok) {
+        free_tree(snapshot->root);
+        snapshot->root = NULL;
+        return false;
+    }
+    if (pt->storage)
+        atomic_fetch_add_explicit(&pt->storage->refcount, 1, memory_order_relaxed);
+    snapshot->storage = pt->storage;
+    snapshot->length = pt->length;
+    snapshot->version = pt->version;
+    memcpy(snapshot->edits, pt->edits, sizeof(pt->edits));
+    snapshot->frozen = true;
+    return true;
+}
+
+bool piece_table_insert(PieceTable *pt, size_t pos, const char *text, size_t len)
+{
+    if (pt->frozen)
+        return false;
+    if (!text || len == 0)
+        return true;
+    if (pos > pt->length)
+        pos = pt->length;
+
+    if (!try_extend_last_insert(pt, pos, text, len)) {
+        PieceNode *spare = new_node(pt, NULL, 0);
+        if (!spare)
+            return false;
+        const char *stored = store_text(pt, text, len);
+        PieceNode *node = NULL;
+        if (!stored || !build_pieces(pt, stored, len, &node)) {
+            free(spare);
+            return false;
+        }
+
+        PieceNode *left, *right;
+        split(pt->root, pos, &left, &right, &spare);
+        pt->root = merge(merge(left, node), right);
+        free(spare);
+        // Only a single-piece insert can be extended by the typing fast path
+        pt->last_insert = len <= PIECE_MAX_LENGTH ? node : NULL;
+    }
+
+    pt->length += len;
+    pt->version++;
+    log_edit(pt, pos, 0, len);
+    pt->last_insert_end = pos + len;
+    pt->last_insert_version = pt->version;
+    return true;
+}
+
+bool piece_table_delete(PieceTable *pt, size_t pos, size_t len)
+{
+    if (pt->frozen)
+        return false;
+    if (pos >= pt->length || len == 0)
+        return true;
+    if (len > pt->length - pos)
+        len = pt->length - pos;
+
+    PieceNode *spare_a = new_node(pt, NULL, 0);
+    PieceNode *spare_b = new_node(pt, NULL, 0);
+    if (!spare_a || !spare_b) {
+        free(spare_a);
+        free(spare_b);
+        return false;
+    }
+
+    PieceNode *left, *middle, *removed, *right;
+    split(pt->root, pos, &left, &middle, &spare_a);
+    split(middle, len, &removed, &right, &spare_b);
+    free_tree(removed);
+    free(spare_a);
+    free(spare_b);
+    pt->root = merge(left, right);
+
+    pt->length -= len;
+    pt->version++;
+    log_edit(pt, pos, len, 0);
+    pt->last_insert = NULL;
+    return true;
+}
+
+size_t piece_table_length(const PieceTable *pt)
+{
+    return pt->length;
+}
+
+uint64_t piece_table_version(const PieceTable *pt)
+{
+    return pt->version;
+}
+
+size_t piece_table_line_count(const PieceTable *pt)
+{
+    return subtree_newlines(pt->root) + 1;
+}
+
+size_t piece_table_line_at(const PieceTable *pt, size_t pos)
+{
+    // Count the newlines strictly before pos
+    size_t line = 0;
+    const PieceNode *node = pt->root;
+    while (node) {
+        size_t left_len = subtree_length(node->left);
+        if (pos <= left_len) {
+            node = node->left;
+        } else if (pos <= left_len + node->length) {
+            line += subtree_newlines(node->left) + count_newlines(node->data, pos - left_len);
+            break;
+        } else {
+            line += subtree_newlines(node->left) + node->newlines;
+            pos -= left_len + node->length;
+            node = node->right;
+        }
+    }
+    return line;
+}
+
+size_t piece_table_line_start(const PieceTable *pt, size_t line)
+{
+    if (line == 0)
+        return 0;
+    if (line > subtree_newlines(pt->root))
+        line = subtree_newlines(pt->root);
+
+    // Find the piece holding the line-th newline; the line starts right after it
+    size_t base = 0;
+    const PieceNode *node = pt->root;
+    while (node) {
+        size_t left_newlines = subtree_newlines(node->left);
+        if (line <= left_newlines) {
+            node = node->left;
+        } else if (line <= left_newlines + node->newlines) {
+            base += subtree_length(node->left);
+            return base + nth_newline(node->data, node->length, line - left_newlines) + 1;
+        } else {
+            line -= left_newlines + node->newlines;
+            base += subtree_length(node->left) + node->length;
+            node = node->right;
+        }
+    }
+    return 0;
+}
+
+size_t piece_table_line_end(const PieceTable *pt, size_t line)
+{
+    if (line + 1 >= piece_table_line_count(pt))
+        return pt->length;
+    return piece_table_line_start(pt, line + 1) - 1;
+}
+
+char piece_table_byte_at(const PieceTable *pt, size_t pos)
+{
+    size_t offset = 0;
+    const PieceNode *node = find_piece(pt->root, pos, &offset);
+    return node ? node->data[offset] : '\0';
+}
+
+size_t piece_table_copy(const PieceTable *pt, size_t pos, size_t len, char *out)
+{
+    if (pos >= pt->length)
+        return 0;
+    size_t end = len > pt->length - pos ? pt->length : pos + len;
+
+    PieceIterator it;
+    const char *chunk;
+    size_t chunk_len;
+    size_t copied = 0;
+    piece_iterator_init(&it, pt, pos, end);
+    while (piece_iterator_next(&it, &chunk, &chunk_len)) {
+        memcpy(out + copied, chunk, chunk_len);
+        copied += chunk_len;
+    }
+    return copied;
+}
+
+char *piece_table_slice(const PieceTable *pt, size_t pos, size_t len)
+{
+    if (pos > pt->length)
+        pos = pt->length;
+    if (len > pt->length - pos)
+        len = pt->length - pos;
+    char *out = malloc(len + 1);
+    if (!out)
+        return NULL;
+    size_t copied = piece_table_copy(pt, pos, len, out);
+    out[copied] = '\0';
+    return out;
+}
+
+static char *flatten(const PieceNode *node, char *out)
+{
+    while (node) {
+        out = flatten(node->left, out);
+        memcpy(out, node->data, node->length);
+        out += node->length;
+        node = node->right;
+    }
+    return out;
+}
+
+const char *piece_table_text(PieceTable *pt)
+{
+    if (pt->flat && pt->flat_version == pt->version)
+        return pt->flat;
+
+    if (!pt->flat || pt->flat_capacity < pt->length + 1) {
+        char *grown = realloc(pt->flat, pt->length + 1);
+        if (!grown) {
+            debug_print(L"[ERROR] Failed to allocate flat document view (%zu bytes)\n",
+                        pt->length + 1);
+            return "";
+        }
+        pt->flat = grown;
+        pt->flat_capacity = pt->length + 1;
+    }
+    char *end = flatten(pt->root, pt->flat);
+    *end = '\0';
+    pt->flat_version = pt->version;
+    return pt->flat;
+}
+
+bool piece_table_changes_since(const PieceTable *pt, uint64_t version, size_t *pos,
+                               size_t *removed, size_t *inserted)
+{
+    *pos = 0;
+    *removed = 0;
+    *inserted = 0;
+    if (version > pt->version || pt->version - version > PIECE_EDIT_LOG_SIZE)
+        return false;
+
+    // Merged range so far: old [lo, lo + old_len) is now [lo, lo + new_len)
+    bool any = false;
+    size_t lo = 0, old_len = 0, new_len = 0;
+    for (uint64_t v = version + 1; v <= pt->version; v++) {
+        const PieceEdit *edit = &pt->edits[v % PIECE_EDIT_LOG_SIZE];
+        if (edit->version != v)
+            return false;
+        if (!any) {
+            lo = edit->pos;
+            old_len = edit->removed;
+            new_len = edit->inserted;
+            any = true;
+            continue;
+        }
+        // Union of the merged range and this edit, in the current coordinates
+        size_t start = edit->pos < lo ? edit->pos : lo;
+        size_t end = lo + new_len;
+        if (edit->pos + edit->removed > end)
+            end = edit->pos + edit->removed;
+        old_len = end - start - new_len + old_len;
+        new_len = end - start - edit->removed + edit->inserted;
+        lo = start;
+    }
+    *pos = lo;
+    *removed = old_len;
+    *inserted = new_len;
+    return true;
+}
+
+void piece_iterator_init(PieceIterator *it, const PieceTable *pt, size_t start, size_t end)
+{
+    it->table = pt;
+    it->pos = start;
+    it->end = end < pt->length ? end : pt->length;
+}
+
+bool piece_iterator_next(PieceIterator *it, const char **data, size_t *len)
+{
+    if (it->pos >= it->end)
+        return false;
+    size_t offset = 0;
+    const PieceNode *node = find_piece(it->table->root, it->pos, &offset);
+    if (!node)
+        return false;
+    size_t avail = node->length - offset;
+    if (avail > it->end - it->pos)
+        avail = it->end - it->pos;
+    *data = node->data + offset;
+    *len = avail;
+    it->pos += avail;
+    return true;
+}
@@ -0,0 +1,114 @@
+#ifndef PIECE_TABLE_H
+#define PIECE_TABLE_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Piece-table document buffer. The document is a sequence of pieces, each
+// pointing into either the original (loaded) text or an append-only add
+// buffer. Pieces are kept in a treap ordered by document position and
+// augmented with subtree byte and newline counts, so insert, delete, offset
+// lookups and line lookups are O(log n) in the number of pieces instead of
+// O(document size).
+//
+// Text storage (the original text plus the add buffer) is reference counted
+// and shared with snapshots. Stored bytes are never modified, so a snapshot
+// is just a copy of the piece tree and stays valid while the live table keeps
+// changing.
+typedef struct PieceNode PieceNode;
+typedef struct PieceStorage PieceStorage;
+
+// Recent edits, so caches keyed on byte offsets can be patched instead of
+// rebuilt. Older history is dropped; callers then fall back to a rebuild.
+#define PIECE_EDIT_LOG_SIZE 64
+
+typedef struct {
+    uint64_t version; // buffer version this edit produced
+    size_t pos;       // byte offset of the edit
+    size_t removed;   // bytes removed at pos
+    size_t inserted;  // bytes inserted at pos
+} PieceEdit;
+
+typedef struct {
+    PieceNode *root;
+    PieceStorage *storage; // original text and add buffer (shared, refcounted)
+    size_t length;         // document length in bytes
+    uint64_t version;      // bumped on every modification
+    uint32_t seed;         // treap priority generator state
+    bool frozen;           // snapshot: edits are rejected
+
+    // Coalescing state: consecutive typing extends the last inserted piece
+    PieceNode *last_insert;
+    size_t last_insert_end;
+    uint64_t last_insert_version;
+
+    // Ring of recent edits, indexed by version % PIECE_EDIT_LOG_SIZE
+    PieceEdit edits[PIECE_EDIT_LOG_SIZE];
+
+    // Lazily built contiguous copy for consumers that need a flat string
+    char *flat;
+    size_t flat_capacity;
+    uint64_t flat_version;
+} PieceTable;
+
+// Read-only forward iterator over the document in contiguous chunks.
+typedef struct {
+    const PieceTable *table;
+    size_t pos;
+    size_t end;
+} PieceIterator;
+
+// Initialize and cleanup
+void init_piece_table(PieceTable *pt);
+void cleanup_piece_table(PieceTable *pt);
+
+// Replace the whole document. piece_table_load takes ownership of text, which
+// must have been allocated with malloc; piece_table_set_text copies it.
+bool piece_table_load(PieceTable *pt, char *text, size_t len);
+bool piece_table_set_text(PieceTable *pt, const char *text);
+
+// Initialize snapshot as a frozen, read-only copy of pt that shares its text
+// storage. Costs O(pieces), not O(bytes). The snapshot is independent of pt
+// afterwards: pt may be edited or cleaned up while the snapshot is in use.
+// Release it with cleanup_piece_table.
+bool piece_table_snapshot(const PieceTable *pt, PieceTable *snapshot);
+
+// Edits. Positions are byte offsets and are clamped to the document length.
+bool piece_table_insert(PieceTable *pt, size_t pos, const char *text, size_t len);
+bool piece_table_delete(PieceTable *pt, size_t pos, size_t len);
+
+// Queries
+size_t piece_table_length(const PieceTable *pt);
+uint64_t piece_table_version(const PieceTable *pt);
+// Line index. Lines are 0-based and end at '\n'; the text after the last
+// newline is the final line, so an empty document has one line.
+size_t piece_table_line_count(const PieceTable *pt);
+// Line containing byte offset pos (pos is clamped to the document)
+size_t piece_table_line_at(const PieceTable *pt, size_t pos);
+// Byte offset of the first byte of line (clamped to the last line)
+size_t piece_table_line_start(const PieceTable *pt, size_t line);
+// Byte offset of the '\n' ending line, or the document length for the last line
+size_t piece_table_line_end(const PieceTable *pt, size_t line);
+// Returns the byte at pos, or '\0' past the end (mirrors C string access)
+char piece_table_byte_at(const PieceTable *pt, size_t pos);
+// Copy up to len bytes starting at pos into out; returns bytes copied
+size_t piece_table_copy(const PieceTable *pt, size_t pos, size_t len, char *out);
+// Return a malloc'd NUL-terminated copy of [pos, pos + len); caller frees
+char *piece_table_slice(const PieceTable *pt, size_t pos, size_t len);
+// Contiguous NUL-terminated view of the whole document. The view is cached and
+// only rebuilt after the document changes; it is invalidated by the next edit.
+const char *piece_table_text(PieceTable *pt);
+
+// Summarize every edit after version as one replaced range: bytes
+// [*pos, *pos + *removed) of that version became [*pos, *pos + *inserted).
+// Returns false if the history is no longer available (too many edits, or
+// the document was reloaded); *removed and *inserted are 0 when unchanged.
+bool piece_table_changes_since(const PieceTable *pt, uint64_t version, size_t *pos,
+                               size_t *removed, size_t *inserted);
+
+// Iteration over [start, end)
+void piece_iterator_init(PieceIterator *it, const PieceTable *pt, size_t start, size_t end);
+bool piece_iterator_next(PieceIterator *it, const char **data, size_t *len);
+
+#endif // PIECE_TABLE_H
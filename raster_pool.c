@@ -0,0 +1,286 @@
+#include "raster_pool.h"
+#include "debug.h"
+#include <stdlib.h>
+
+#ifdef __EMSCRIPTEN__
+
+RasterPool *create_raster_pool(TTF_Font *font, const char *font_path, int font_size, int workers)
+{
+    (void) font;
+    (void) font_path;
+    (void) font_size;
+    (void) workers;
+    return NULL;
+}
+
+void destroy_raster_pool(RasterPool *pool)
+{
+    (void) pool;
+}
+
+TTF_Font *raster_pool_font(const RasterPool *pool)
+{
+    (void) pool;
+    return NULL;
+}
+
+bool raster_pool_submit(RasterPool *pool, uint32_t codepoint)
+{
+    (void) pool;
+    (void) codepoint;
+    return false;
+}
+
+int raster_pool_collect(RasterPool *pool, RasterResult *out, int max)
+{
+    (void) pool;
+    (void) out;
+    (void) max;
+    return 0;
+}
+
+bool raster_pool_ready(RasterPool *pool)
+{
+    (void) pool;
+    return false;
+}
+
+Uint32 raster_pool_event(const RasterPool *pool)
+{
+    (void) pool;
+    return 0;
+}
+
+#else
+
+#include <pthread.h>
+
+typedef struct {
+    RasterPool *pool;
+    TTF_Font *font; // this worker's own instance
+    pthread_t thread;
+} RasterWorker;
+
+struct RasterPool {
+    TTF_Font *font;
+    RasterWorker workers[RASTER_POOL_MAX_WORKERS];
+    int num_workers;
+    Uint32 event_type;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t cond; // signalled when requests arrive or the pool stops
+    bool stopping;
+    // Ring buffer of codepoints waiting for a worker
+    uint32_t *requests;
+    int request_head;
+    int request_count;
+    int request_capacity;
+    // Finished glyphs waiting for the main thread
+    RasterResult *results;
+    int result_count;
+    int result_capacity;
+    int reserved; // result slots held for submitted glyphs not yet collected
+};
+
+static void rasterize(TTF_Font *font, uint32_t codepoint, RasterResult *result)
+{
+    int miny = 0, maxy = 0;
+    result->codepoint = codepoint;
+    result->surface = NULL;
+    if (TTF_GlyphMetrics32(font, codepoint, &result->minx, &result->maxx, &miny, &maxy,
+                           &result->advance) != 0) {
+        result->minx = result->maxx = result->advance = 0;
+        return;
+    }
+    if (result->maxx <= result->minx)
+        return;
+    SDL_Color white = {255, 255, 255, 255};
+    SDL_Surface *surface = TTF_RenderGlyph32_Blended(font, codepoint, white);
+    if (surface && surface->format->format != SDL_PIXELFORMAT_ARGB8888) {
+        SDL_Surface *converted = SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_ARGB8888, 0);
+        SDL_FreeSurface(surface);
+        surface = converted;
+    }
+    result->surface = surface;
+}
+
+static void *worker_main(void *arg)
+{
+    RasterWorker *worker = arg;
+    RasterPool *pool = worker->pool;
+    pthread_mutex_lock(&pool->mutex);
+    for (;;) {
+        while (!pool->stopping && pool->request_count == 0)
+            pthread_cond_wait(&pool->cond, &pool->mutex);
+        if (pool->stopping)
+            break;
+        uint32_t codepoint = pool->requests[pool->request_head];
+        pool->request_head = (pool->request_head + 1) % pool->request_capacity;
+        pool->request_count--;
+        pthread_mutex_unlock(&pool->mutex);
+
+        RasterResult result;
+        rasterize(worker->font, codepoint, &result);
+
+        // raster_pool_submit reserved the slot, so the result is never lost
+        pthread_mutex_lock(&pool->mutex);
+        pool->results[pool->result_count++] = result;
+        if (pool->result_count == 1 && pool->event_type) {
+            SDL_Event event = {0};
+            event.type = pool->event_type;
+            SDL_PushEvent(&event);
+        }
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return NULL;
+}
+
+RasterPool *create_raster_pool(TTF_Font *font, const char *font_path, int font_size, int workers)
+{
+    if (!font || !font_path)
+        return NULL;
+    if (workers <= 0)
+        workers = SDL_GetCPUCount() - 1;
+    if (workers < 1)
+        workers = 1;
+    if (workers > RASTER_POOL_MAX_WORKERS)
+        workers = RASTER_POOL_MAX_WORKERS;
+
+    RasterPool *pool = calloc(1, sizeof(RasterPool));
+    if (!pool)
+        return NULL;
+    pool->font = font;
+    pthread_mutex_init(&pool->mutex, NULL);
+    pthread_cond_init(&pool->cond, NULL);
+    Uint32 event_type = SDL_RegisterEvents(1);
+    pool->event_type = event_type != (Uint32) -1 ? event_type : 0;
+
+    for (int i = 0; i < workers; i++) {
+        RasterWorker *worker = &pool->workers[pool->num_workers];
+        worker->pool = pool;
+        worker->font = TTF_OpenFont(font_path, font_size);
+        if (!worker->font) {
+            debug_print(L"[RASTER] Failed to open worker font: %hs\n", TTF_GetError());
+            break;
+        }
+        TTF_SetFontHinting(worker->font, TTF_GetFontHinting(font));
+        TTF_SetFontStyle(worker->font, TTF_GetFontStyle(font));
+        if (pthread_create(&worker->thread, NULL, worker_main, worker) != 0) {
+            TTF_CloseFont(worker->font);
+            break;
+        }
+        pool->num_workers++;
+    }
+    if (pool->num_workers == 0) {
+        destroy_raster_pool(pool);
+        return NULL;
+    }
+    debug_print(L"[RASTER] Started %d glyph workers\n", pool->num_workers);
+    return pool;
+}
+
+void destroy_raster_pool(RasterPool *pool)
+{
+    if (!pool)
+        return;
+    pthread_mutex_lock(&pool->mutex);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->cond);
+    pthread_mutex_unlock(&pool->mutex);
+    for (int i = 0; i < pool->num_workers; i++) {
+        pthread_join(pool->workers[i].thread, NULL);
+        TTF_CloseFont(pool->workers[i].font);
+    }
+    for (int i = 0; i < pool->result_count; i++)
+        SDL_FreeSurface(pool->results[i].surface);
+    free(pool->results);
+    free(pool->requests);
+    pthread_mutex_destroy(&pool->mutex);
+    pthread_cond_destroy(&pool->cond);
+    free(pool);
+}
+
+TTF_Font *raster_pool_font(const RasterPool *pool)
+{
+    return pool ? pool->font : NULL;
+}
+
+// Double the request ring, unwrapping it to start at index 0
+static bool grow_requests(RasterPool *pool)
+{
+    int capacity = pool->request_capacity ? pool->request_capacity * 2 : 256;
+    uint32_t *requests = malloc(capacity * sizeof(uint32_t));
+    if (!requests)
+        return false;
+    for (int i = 0; i < pool->request_count; i++)
+        requests[i] = pool->requests[(pool->request_head + i) % pool->request_capacity];
+    free(pool->requests);
+    pool->requests = requests;
+    pool->request_head = 0;
+    pool->request_capacity = capacity;
+    return true;
+}
+
+static bool grow_results(RasterPool *pool)
+{
+    int capacity = pool->result_capacity ? pool->result_capacity * 2 : 64;
+    RasterResult *results = realloc(pool->results, capacity * sizeof(RasterResult));
+    if (!results)
+        return false;
+    pool->results = results;
+    pool->result_capacity = capacity;
+    return true;
+}
+
+bool raster_pool_submit(RasterPool *pool, uint32_t codepoint)
+{
+    if (!pool)
+        return false;
+    pthread_mutex_lock(&pool->mutex);
+    // The result's slot is taken now: the atlas shows the glyph as pending
+    // until it is collected, so a worker must not fail to hand it over
+    bool queued = (pool->request_count < pool->request_capacity || grow_requests(pool)) &&
+                  (pool->reserved < pool->result_capacity || grow_results(pool));
+    if (queued) {
+        int tail = (pool->request_head + pool->request_count) % pool->request_capacity;
+        pool->requests[tail] = codepoint;
+        pool->request_count++;
+        pool->reserved++;
+        pthread_cond_signal(&pool->cond);
+    }
+    pthread_mutex_unlock(&pool->mutex);
+    return queued;
+}
+
+int raster_pool_collect(RasterPool *pool, RasterResult *out, int max)
+{
+    if (!pool || max <= 0)
+        return 0;
+    pthread_mutex_lock(&pool->mutex);
+    int n = pool->result_count < max ? pool->result_count : max;
+    for (int i = 0; i < n; i++)
+        out[i] = pool->results[i];
+    for (int i = n; i < pool->result_count; i++)
+        pool->results[i - n] = pool->results[i];
+    pool->result_count -= n;
+    pool->reserved -= n;
+    pthread_mutex_unlock(&pool->mutex);
+    return n;
+}
+
+bool raster_pool_ready(RasterPool *pool)
+{
+    if (!pool)
+        return false;
+    pthread_mutex_lock(&pool->mutex);
+    bool ready = pool->result_count > 0;
+    pthread_mutex_unlock(&pool->mutex);
+    return ready;
+}
+
+Uint32 raster_pool_event(const RasterPool *pool)
+{
+    return pool ? pool->event_type : 0;
+}
+
+#endif // __EMSCRIPTEN__
@@ -0,0 +1,55 @@
+#ifndef RASTER_POOL_H
+#define RASTER_POOL_H
+
+#include <SDL.h>
+#include <SDL_ttf.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Worker threads that rasterize glyphs off the main thread. SDL_ttf fonts are
+// not thread-safe, so every worker opens its own TTF_Font from the same file
+// and size as the main font. Workers render glyphs into SDL_Surfaces; the main
+// thread collects them and uploads them into the glyph atlas, drawing a
+// placeholder for a glyph until its surface arrives.
+//
+// Fonts are opened and closed on the creating thread, before the workers start
+// and after they have stopped, since FreeType shares one library instance
+// between fonts. Builds without threads (the web build) have no pool.
+
+// Most workers started; fewer when the machine has fewer cores
+#define RASTER_POOL_MAX_WORKERS 4
+
+typedef struct {
+    uint32_t codepoint;
+    int minx;             // glyph metrics from the worker's font
+    int maxx;
+    int advance;
+    SDL_Surface *surface; // ARGB8888 in white, NULL when the glyph has no pixels
+} RasterResult;
+
+typedef struct RasterPool RasterPool;
+
+// Start workers rasterizing for font, which was opened from font_path at
+// font_size; its hinting and style are copied. Non-positive workers picks one
+// per spare core. Returns NULL if no worker could be started.
+RasterPool *create_raster_pool(TTF_Font *font, const char *font_path, int font_size, int workers);
+// Stop the workers and free every queued request and uncollected result
+void destroy_raster_pool(RasterPool *pool);
+
+// The main thread font the pool rasterizes for
+TTF_Font *raster_pool_font(const RasterPool *pool);
+
+// Queue codepoint for rasterizing. Returns false if it could not be queued.
+bool raster_pool_submit(RasterPool *pool, uint32_t codepoint);
+
+// Take up to max finished glyphs without blocking; returns how many. The
+// caller frees each result's surface.
+int raster_pool_collect(RasterPool *pool, RasterResult *out, int max);
+// Whether finished glyphs are waiting to be collected
+bool raster_pool_ready(RasterPool *pool);
+
+// SDL event type pushed when results become ready after none were waiting, so
+// an idle event loop wakes up to collect them (0 if none was registered)
+Uint32 raster_pool_event(const RasterPool *pool);
+
+#endif // RASTER_POOL_H
@@ -0,0 +1,104 @@
+#!/usr/bin/env python3
+"""Generate case_fold_tables.h, the Unicode simple case folding ranges.
+
+Usage: scripts/gen_case_fold_tables.py > case_fold_tables.h
+
+Simple case folding (CaseFolding.txt statuses C and S) maps each codepoint to
+at most one codepoint. It is derived from Python's str methods: casefold()
+where that yields one character (status C), otherwise lower() where that
+yields a different single character (status S; e.g. U+1E9E and the Greek
+letters with prosgegrammeni). Full (F) and Turkic (T) foldings are left out.
+
+Mapped codepoints are grouped into ranges sharing a delta, either contiguous
+or every other codepoint (the alternating upper/lower runs of Latin Extended
+and Cyrillic). The generated header records the Unicode version it was built
+from. Re-run after a Python upgrade to pick up a newer Unicode version.
+"""
+
+import sys
+import unicodedata
+
+MAX_CODEPOINT = 0x110000
+
+
+def simple_fold(cp):
+    c = chr(cp)
+    folded = c.casefold()
+    if len(folded) == 1:
+        return ord(folded)
+    lower = c.lower()
+    if len(lower) == 1 and lower != c:
+        return ord(lower)
+    return cp
+
+
+def build_mapping():
+    mapping = {}
+    for cp in range(MAX_CODEPOINT):
+        if 0xD800 <= cp <= 0xDFFF:
+            continue
+        folded = simple_fold(cp)
+        if folded != cp:
+            mapping[cp] = folded
+    return mapping
+
+
+def build_ranges(mapping):
+    # [first, last, delta, stride]; stride 0 while a range has one member
+    ranges = []
+    for cp in sorted(mapping):
+        delta = mapping[cp] - cp
+        if ranges:
+            first, last, last_delta, stride = ranges[-1]
+            if last_delta == delta and stride in (0, 1) and cp == last + 1:
+                ranges[-1] = [first, cp, delta, 1]
+                continue
+            if last_delta == delta and stride in (0, 2) and cp == last + 2:
+                ranges[-1] = [first, cp, delta, 2]
+                continue
+        ranges.append([cp, cp, delta, 0])
+    for r in ranges:
+        r[3] = max(r[3], 1)
+    return ranges
+
+
+def check(mapping):
+    # text_search relies on these: folding is idempotent, and the only
+    # non-ASCII codepoints folding into ASCII are KELVIN SIGN and LONG S
+    if any(mapping.get(folded, folded) != folded for folded in mapping.values()):
+        sys.exit("simple folding is not idempotent")
+    into_ascii = sorted(cp for cp, folded in mapping.items() if cp >= 0x80 and folded < 0x80)
+    if into_ascii != [0x017F, 0x212A]:
+        sys.exit("unexpected folds into ASCII: %s" % [hex(cp) for cp in into_ascii])
+
+
+def main():
+    mapping = build_mapping()
+    check(mapping)
+    ranges = build_ranges(mapping)
+
+    out = sys.stdout
+    out.write("// Generated by scripts/gen_case_fold_tables.py from Unicode %s. Do not edit.\n"
+              % unicodedata.unidata_version)
+    out.write("#ifndef CASE_FOLD_TABLES_H\n#define CASE_FOLD_TABLES_H\n\n")
+    out.write("#include <stdint.h>\n\n")
+    out.write("#define CASE_FOLD_UNICODE_VERSION \"%s\"\n\n" % unicodedata.unidata_version)
+    out.write("// Codepoints first, first + stride, ..., last fold to themselves plus delta\n")
+    out.write("typedef struct {\n")
+    out.write("    uint32_t first;\n")
+    out.write("    uint32_t last;\n")
+    out.write("    int32_t delta;\n")
+    out.write("    uint32_t stride;\n")
+    out.write("} CaseFoldRange;\n\n")
+    out.write("// clang-format off\n")
+    out.write("// %d simple foldings, sorted by first\n" % len(mapping))
+    out.write("static const CaseFoldRange case_fold_ranges[%d] = {\n" % len(ranges))
+    for first, last, delta, stride in ranges:
+        out.write("    {0x%04X, 0x%04X, %d, %d},\n" % (first, last, delta, stride))
+    out.write("};\n")
+    out.write("// clang-format on\n")
+    out.write("\n#endif // CASE_FOLD_TABLES_H\n")
+
+
+if __name__ == "__main__":
+    main()
@@ -0,0 +1,195 @@
+#!/usr/bin/env python3
+"""Generate grapheme_tables.h, the two-stage Grapheme_Cluster_Break table.
+
+Usage: scripts/gen_grapheme_tables.py > grapheme_tables.h
+
+The property is derived from Python's unicodedata (general categories) plus
+the UAX #29 lists that unicodedata does not expose (Prepend, Hangul syllable
+types, Extended_Pictographic, Other_Grapheme_Extend). The generated header
+records the Unicode version it was built from. Re-run after a Python upgrade
+to pick up a newer Unicode version.
+"""
+
+import sys
+import unicodedata
+
+# Must match enum GraphemeBreak in grapheme.h
+OTHER, CR, LF, CONTROL, EXTEND, ZWJ, REGIONAL_INDICATOR, PREPEND, SPACING_MARK, \
+    L, V, T, LV, LVT, EXTENDED_PICTOGRAPHIC = range(15)
+
+MAX_CODEPOINT = 0x110000
+BLOCK_SHIFT = 8
+BLOCK_SIZE = 1 << BLOCK_SHIFT
+
+OTHER_GRAPHEME_EXTEND = [
+    (0x09BE, 0x09BE), (0x09D7, 0x09D7), (0x0B3E, 0x0B3E), (0x0B57, 0x0B57),
+    (0x0BBE, 0x0BBE), (0x0BD7, 0x0BD7), (0x0CC2, 0x0CC2), (0x0CD5, 0x0CD6),
+    (0x0D3E, 0x0D3E), (0x0D57, 0x0D57), (0x0DCF, 0x0DCF), (0x0DDF, 0x0DDF),
+    (0x1B35, 0x1B35), (0x200C, 0x200C), (0x302E, 0x302F), (0xFF9E, 0xFF9F),
+    (0x1133E, 0x1133E), (0x11357, 0x11357), (0x114B0, 0x114B0), (0x114BD, 0x114BD),
+    (0x115AF, 0x115AF), (0x11930, 0x11930), (0x1D165, 0x1D165), (0x1D16E, 0x1D172),
+    (0xE0020, 0xE007F),
+]
+
+EMOJI_MODIFIER = [(0x1F3FB, 0x1F3FF)]
+
+# Spacing combining marks that UAX #29 keeps out of SpacingMark
+SPACING_MARK_EXCEPTIONS = [
+    (0x102B, 0x102C), (0x1038, 0x1038), (0x1062, 0x1064), (0x1067, 0x106D),
+    (0x1083, 0x1083), (0x1087, 0x108C), (0x108F, 0x108F), (0x109A, 0x109C),
+    (0x1A61, 0x1A61), (0x1A63, 0x1A64), (0xAA7B, 0xAA7B), (0xAA7D, 0xAA7D),
+    (0x11720, 0x11721),
+]
+
+PREPENDED_CONCATENATION_MARK = [
+    (0x0600, 0x0605), (0x06DD, 0x06DD), (0x070F, 0x070F), (0x0890, 0x0891),
+    (0x08E2, 0x08E2), (0x110BD, 0x110BD), (0x110CD, 0x110CD),
+]
+
+# Indic_Syllabic_Category Consonant_Preceding_Repha and Consonant_Prefixed
+PREPEND_INDIC = [
+    (0x0D4E, 0x0D4E), (0x111C2, 0x111C3), (0x1193F, 0x1193F), (0x11941, 0x11941),
+    (0x11A3A, 0x11A3A), (0x11A84, 0x11A89), (0x11D46, 0x11D46),
+]
+
+# Default_Ignorable_Code_Point ranges; unassigned ones are Control
+DEFAULT_IGNORABLE = [
+    (0x00AD, 0x00AD), (0x034F, 0x034F), (0x061C, 0x061C), (0x115F, 0x1160),
+    (0x17B4, 0x17B5), (0x180B, 0x180F), (0x200B, 0x200F), (0x202A, 0x202E),
+    (0x2060, 0x206F), (0x3164, 0x3164), (0xFE00, 0xFE0F), (0xFEFF, 0xFEFF),
+    (0xFFA0, 0xFFA0), (0xFFF0, 0xFFF8), (0x1BCA0, 0x1BCA3), (0x1D173, 0x1D17A),
+    (0xE0000, 0xE0FFF),
+]
+
+HANGUL_L = [(0x1100, 0x115F), (0xA960, 0xA97C)]
+HANGUL_V = [(0x1160, 0x11A7), (0xD7B0, 0xD7C6)]
+HANGUL_T = [(0x11A8, 0x11FF), (0xD7CB, 0xD7FB)]
+HANGUL_SYLLABLES = (0xAC00, 0xD7A3)
+
+EXTENDED_PICTOGRAPHIC_RANGES = [
+    (0x00A9, 0x00A9), (0x00AE, 0x00AE), (0x203C, 0x203C), (0x2049, 0x2049),
+    (0x2122, 0x2122), (0x2139, 0x2139), (0x2194, 0x2199), (0x21A9, 0x21AA),
+    (0x231A, 0x231B), (0x2328, 0x2328), (0x2388, 0x2388), (0x23CF, 0x23CF),
+    (0x23E9, 0x23F3), (0x23F8, 0x23FA), (0x24C2, 0x24C2), (0x25AA, 0x25AB),
+    (0x25B6, 0x25B6), (0x25C0, 0x25C0), (0x25FB, 0x25FE), (0x2600, 0x2605),
+    (0x2607, 0x2612), (0x2614, 0x2685), (0x2690, 0x2705), (0x2708, 0x2712),
+    (0x2714, 0x2714), (0x2716, 0x2716), (0x271D, 0x271D), (0x2721, 0x2721),
+    (0x2728, 0x2728), (0x2733, 0x2734), (0x2744, 0x2744), (0x2747, 0x2747),
+    (0x274C, 0x274C), (0x274E, 0x274E), (0x2753, 0x2755), (0x2757, 0x2757),
+    (0x2763, 0x2767), (0x2795, 0x2797), (0x27A1, 0x27A1), (0x27B0, 0x27B0),
+    (0x27BF, 0x27BF), (0x2934, 0x2935), (0x2B05, 0x2B07), (0x2B1B, 0x2B1C),
+    (0x2B50, 0x2B50), (0x2B55, 0x2B55), (0x3030, 0x3030), (0x303D, 0x303D),
+    (0x3297, 0x3297), (0x3299, 0x3299), (0x1F000, 0x1F0FF), (0x1F10D, 0x1F10F),
+    (0x1F12F, 0x1F12F), (0x1F16C, 0x1F171), (0x1F17E, 0x1F17F), (0x1F18E, 0x1F18E),
+    (0x1F191, 0x1F19A), (0x1F1AD, 0x1F1E5), (0x1F201, 0x1F20F), (0x1F21A, 0x1F21A),
+    (0x1F22F, 0x1F22F), (0x1F232, 0x1F23A), (0x1F23C, 0x1F23F), (0x1F249, 0x1F3FA),
+    (0x1F400, 0x1F53D), (0x1F546, 0x1F64F), (0x1F680, 0x1F6FF), (0x1F774, 0x1F77F),
+    (0x1F7D5, 0x1F7FF), (0x1F80C, 0x1F80F), (0x1F848, 0x1F84F), (0x1F85A, 0x1F85F),
+    (0x1F888, 0x1F88F), (0x1F8AE, 0x1F8FF), (0x1F90C, 0x1F93A), (0x1F93C, 0x1F945),
+    (0x1F947, 0x1FAFF), (0x1FC00, 0x1FFFD),
+]
+
+
+def in_ranges(cp, ranges):
+    return any(lo <= cp <= hi for lo, hi in ranges)
+
+
+def make_set(*range_lists):
+    result = set()
+    for ranges in range_lists:
+        for lo, hi in ranges:
+            result.update(range(lo, hi + 1))
+    return result
+
+
+def build_property_table():
+    extend = make_set(OTHER_GRAPHEME_EXTEND, EMOJI_MODIFIER)
+    prepend = make_set(PREPENDED_CONCATENATION_MARK, PREPEND_INDIC)
+    ignorable = make_set(DEFAULT_IGNORABLE)
+    spacing_exceptions = make_set(SPACING_MARK_EXCEPTIONS)
+    pictographic = make_set(EXTENDED_PICTOGRAPHIC_RANGES)
+
+    props = [OTHER] * MAX_CODEPOINT
+    for cp in range(MAX_CODEPOINT):
+        category = unicodedata.category(chr(cp))
+        if cp == 0x0D:
+            prop = CR
+        elif cp == 0x0A:
+            prop = LF
+        elif cp == 0x200D:
+            prop = ZWJ
+        elif cp in prepend:
+            prop = PREPEND
+        elif category in ("Mn", "Me") or cp in extend:
+            prop = EXTEND
+        elif (category in ("Cc", "Cf", "Zl", "Zp") or
+              (category == "Cn" and cp in ignorable)):
+            prop = CONTROL
+        elif 0x1F1E6 <= cp <= 0x1F1FF:
+            prop = REGIONAL_INDICATOR
+        elif cp in (0x0E33, 0x0EB3) or (category == "Mc" and cp not in spacing_exceptions):
+            prop = SPACING_MARK
+        elif in_ranges(cp, HANGUL_L):
+            prop = L
+        elif in_ranges(cp, HANGUL_V):
+            prop = V
+        elif in_ranges(cp, HANGUL_T):
+            prop = T
+        elif HANGUL_SYLLABLES[0] <= cp <= HANGUL_SYLLABLES[1]:
+            prop = LV if (cp - HANGUL_SYLLABLES[0]) % 28 == 0 else LVT
+        elif cp in pictographic:
+            prop = EXTENDED_PICTOGRAPHIC
+        else:
+            prop = OTHER
+        props[cp] = prop
+    return props
+
+
+def build_stages(props):
+    blocks = {}
+    stage1 = []
+    stage2 = []
+    for start in range(0, MAX_CODEPOINT, BLOCK_SIZE):
+        block = tuple(props[start:start + BLOCK_SIZE])
+        index = blocks.get(block)
+        if index is None:
+            index = len(blocks)
+            blocks[block] = index
+            stage2.extend(block)
+        stage1.append(index)
+    return stage1, stage2
+
+
+def emit_array(out, ctype, name, values, per_line):
+    out.write("static const %s %s[%d] = {\n" % (ctype, name, len(values)))
+    for i in range(0, len(values), per_line):
+        row = ", ".join("%d" % v for v in values[i:i + per_line])
+        out.write("    %s,\n" % row)
+    out.write("};\n")
+
+
+def main():
+    props = build_property_table()
+    stage1, stage2 = build_stages(props)
+    if len(stage2) // BLOCK_SIZE > 256:
+        sys.exit("too many distinct blocks for a uint8_t stage 1 table")
+
+    out = sys.stdout
+    out.write("// Generated by scripts/gen_grapheme_tables.py from Unicode %s. Do not edit.\n"
+              % unicodedata.unidata_version)
+    out.write("#ifndef GRAPHEME_TABLES_H\n#define GRAPHEME_TABLES_H\n\n")
+    out.write("#include <stdint.h>\n\n")
+    out.write("#define GRAPHEME_UNICODE_VERSION \"%s\"\n" % unicodedata.unidata_version)
+    out.write("#define GRAPHEME_BLOCK_SHIFT %d\n" % BLOCK_SHIFT)
+    out.write("#define GRAPHEME_BLOCK_MASK %d\n\n" % (BLOCK_SIZE - 1))
+    out.write("// clang-format off\n")
+    out.write("// Stage 1: codepoint >> GRAPHEME_BLOCK_SHIFT -> block number\n")
+    emit_array(out, "uint8_t", "grapheme_stage1", stage1, 16)
+    out.write("\n// Stage 2: %d-entry blocks of GraphemeBreak values\n" % BLOCK_SIZE)
+    emit_array(out, "uint8_t", "grapheme_stage2", stage2, 24)
+    out.write("// clang-format on\n")
+    out.write("\n#endif // GRAPHEME_TABLES_H\n")
+
+
+if __name__ == "__main__":
+    main()
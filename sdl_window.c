@@ -1,10 +1,15 @@
 #include "sdl_window.h"
 #include "auto_save.h"
+#include "damage.h"
 #include "debug.h"
 #include "dialog.h"
+#include "document_snapshot.h"
 #include "file_operations.h"
+#include "grapheme.h"
 #include "line_numbers.h"
+#include "raster_pool.h"
 #include "search_system.h"
+#include "selection.h"
 #include "status_bar.h"
 #include "text_renderer.h"
 #include "undo_system.h"
@@ -13,13 +18,12 @@
 #include <ctype.h>
 #include <limits.h> // Add this for INT_MAX
 #include <pthread.h>
+#include <stdatomic.h>
 #include <stdbool.h> // Added for bool, true, false
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
-#define MAX_COMBINING_PER_CLUSTER 5 // limit combining marks per cluster
-
 // Continuous resize support structures
 typedef struct {
     SDL_Event event;
@@ -39,6 +43,37 @@ typedef struct {
 static EventQueue g_event_queue = {0};
 static pthread_t g_render_thread;
 static bool g_continuous_resize_active = false;
+// Document versions published by the main thread for the render thread
+static SnapshotManager g_snapshots;
+
+// What the last drawn frame showed. Whatever differs now is a part of the
+// window that has to be drawn again.
+typedef struct {
+    bool drawn;
+    int window_width;
+    int window_height;
+    int text_area_x;
+    int text_area_width;
+    bool line_numbers;
+    uint64_t version;
+    int scroll_y;
+    int selection_start;
+    int selection_end;
+    bool search_active;
+    int search_matches;
+    int search_current;
+    SDL_Rect cursor;
+} FrameState;
+
+// Kept from frame to frame by the thread that draws
+typedef struct {
+    WindowDamage damage;
+    FrameState last_frame;
+    // Selection and search match rectangles of the frame being drawn
+    SelectionGeometry selection;
+    SelectionGeometry search_matches;
+    SelectionGeometry search_current;
+} FrameDraw;
 
 // Rendering context shared between threads
 typedef struct {
@@ -46,7 +81,7 @@ typedef struct {
     TTF_Font *font;
     TTF_Font *status_font;
     SDL_Window *window;
-    char **editorText;
+    PieceTable *text_buffer;
     int *cursorPos;
     int *selectionStart;
     int *selectionEnd;
@@ -69,14 +104,28 @@ typedef struct {
     int *text_area_height;
     int *text_area_x;
     int *text_area_y;
+    // Viewport top in continuous resize mode. The main thread scrolls it and
+    // the render thread, which draws with a RenderData of its own, follows
+    // the cursor with it.
+    atomic_int scroll_y;
+    // Only one thread draws: the render thread in continuous resize mode,
+    // the browser callback under Emscripten and the main loop otherwise
+    FrameDraw draw;
 } RenderContext;
 
-static RenderContext g_render_context = {0};
+static RenderContext g_render_context = {.draw.damage.all = true};
 /* Flag to indicate the render context is ready for the emscripten callback. */
 static volatile int g_emscripten_ready = 0;
 
+
 // Forward declarations
-static void render_frame(RenderContext *ctx);
+static void render_frame(RenderContext *ctx, PieceTable *text_buffer);
+static int move_cursor_line_start(const PieceTable *buffer, int cursor_pos);
+static int move_cursor_line_end(const PieceTable *buffer, int cursor_pos);
+static int move_cursor_cluster_left(PieceTable *buffer, int cursor_pos);
+static int move_cursor_cluster_right(PieceTable *buffer, int cursor_pos);
+static bool selection_byte_range(PieceTable *buffer, int selection_start, int selection_end,
+                                 RenderData *rd, int *start_byte, int *end_byte);
 
 #ifdef __EMSCRIPTEN__
 #include <emscripten.h>
@@ -87,6 +136,7 @@ static void emscripten_frame_callback(void *arg)
     if (!g_emscripten_ready)
         return;
     RenderContext *ctx = (RenderContext *) arg;
+    FrameDraw *draw = &ctx->draw;
     SDL_Event event;
 
     /* Removed noisy per-frame logs - uncomment to debug frame callback */
@@ -114,6 +164,12 @@ static void emscripten_frame_callback(void *arg)
             SDL_SetTextInputRect(&(SDL_Rect){0, 0, new_w, new_h});
         }
 
+        // Render targets lost their contents: redraw glyphs and tiles
+        if (event.type == SDL_RENDER_TARGETS_RESET || event.type == SDL_RENDER_DEVICE_RESET) {
+            reset_render_textures(ctx->rd);
+            damage_all(&draw->damage);
+        }
+
         /* Log and HANDLE keyboard events */
         if (event.type == SDL_TEXTINPUT) {
             printf("[SDL] TEXTINPUT: %s\n", event.text.text);
@@ -121,32 +177,19 @@ static void emscripten_frame_callback(void *arg)
             EM_ASM({ console.log('[SDL] TEXTINPUT:', UTF8ToString($0)); }, event.text.text);
             
             // Actually handle the text input - insert it into the editor
-            if (ctx->editorText && ctx->cursorPos) {
-                char *text = *ctx->editorText;
+            if (ctx->text_buffer && ctx->cursorPos) {
+                PieceTable *buffer = ctx->text_buffer;
                 int cursorPos = *ctx->cursorPos;
+                int insertLen = strlen(event.text.text);
                 
                 // Record undo action
                 if (ctx->undo) {
                     record_insert_action(ctx->undo, cursorPos, event.text.text, cursorPos,
-                                       cursorPos + strlen(event.text.text));
-                }
-                
-                // Invalidate cache if using lazy mode
-                if (ctx->rd && ctx->rd->lazy_mode) {
-                    int cluster_at_cursor = get_cluster_index_at_cursor(text, cursorPos, ctx->rd);
-                    invalidate_cluster_blocks_after(ctx->rd, cluster_at_cursor);
+                                       cursorPos + insertLen);
                 }
                 
                 // Insert the text
-                int textLen = strlen(text);
-                int insertLen = strlen(event.text.text);
-                char *newText = malloc(textLen + insertLen + 1);
-                if (newText) {
-                    memcpy(newText, text, cursorPos);
-                    memcpy(newText + cursorPos, event.text.text, insertLen);
-                    memcpy(newText + cursorPos + insertLen, text + cursorPos, textLen - cursorPos + 1);
-                    free(text);
-                    *ctx->editorText = newText;
+                if (piece_table_insert(buffer, cursorPos, event.text.text, insertLen)) {
                     *ctx->cursorPos = cursorPos + insertLen;
                     
                     // Mark document as modified
@@ -156,12 +199,12 @@ static void emscripten_frame_callback(void *arg)
                     
                     // Update render data to reflect the new text
                     if (ctx->renderer && ctx->font && ctx->text_area_x && ctx->text_area_y && ctx->maxTextWidth) {
-                        update_render_data(ctx->renderer, ctx->font, *ctx->editorText,
+                        update_render_data(ctx->renderer, ctx->font, buffer,
                                          *ctx->text_area_x, *ctx->text_area_y, *ctx->maxTextWidth, ctx->rd);
                         if (ctx->rd->lazy_mode && ctx->text_area_height) {
                             printf("[DEBUG] Calling prepare_visible_texture: text_area_height=%d scrollY=%d\n",
                                    *ctx->text_area_height, ctx->rd->scrollY);
-                            prepare_visible_texture(ctx->renderer, ctx->font, *ctx->editorText,
+                            prepare_visible_texture(ctx->renderer, ctx->font, buffer,
                                                   *ctx->text_area_x, *ctx->text_area_y, *ctx->maxTextWidth,
                                                   ctx->rd, ctx->rd->scrollY, *ctx->text_area_height);
                         }
@@ -177,22 +220,22 @@ static void emscripten_frame_callback(void *arg)
             EM_ASM({ console.log('[SDL] KEYDOWN: sym=', $0); }, event.key.keysym.sym);
             
             // Handle special keys (backspace, arrows, etc.)
-            if (ctx->editorText && ctx->cursorPos) {
-                char *text = *ctx->editorText;
+            if (ctx->text_buffer && ctx->cursorPos) {
+                PieceTable *buffer = ctx->text_buffer;
                 int cursorPos = *ctx->cursorPos;
-                int textLen = strlen(text);
+                int textLen = (int) piece_table_length(buffer);
                 bool needsUpdate = false;
                 
                 // Backspace
                 if (event.key.keysym.sym == SDLK_BACKSPACE && cursorPos > 0) {
                     // Record undo
                     if (ctx->undo) {
-                        char deleted_char[2] = {text[cursorPos - 1], '\0'};
+                        char deleted_char[2] = {piece_table_byte_at(buffer, cursorPos - 1), '\0'};
                         record_delete_action(ctx->undo, cursorPos - 1, deleted_char, cursorPos, cursorPos - 1);
                     }
                     
                     // Delete character before cursor
-                    memmove(text + cursorPos - 1, text + cursorPos, textLen - cursorPos + 1);
+                    piece_table_delete(buffer, cursorPos - 1, 1);
                     *ctx->cursorPos = cursorPos - 1;
                     needsUpdate = true;
                     
@@ -202,54 +245,28 @@ static void emscripten_frame_callback(void *arg)
                 // Delete key
                 else if (event.key.keysym.sym == SDLK_DELETE && cursorPos < textLen) {
                     if (ctx->undo) {
-                        char deleted_char[2] = {text[cursorPos], '\0'};
+                        char deleted_char[2] = {piece_table_byte_at(buffer, cursorPos), '\0'};
                         record_delete_action(ctx->undo, cursorPos, deleted_char, cursorPos, cursorPos);
                     }
                     
-                    memmove(text + cursorPos, text + cursorPos + 1, textLen - cursorPos);
+                    piece_table_delete(buffer, cursorPos, 1);
                     needsUpdate = true;
                     
                     if (ctx->document) mark_document_modified(ctx->document, true);
                 }
                 // Arrow keys
                 else if (event.key.keysym.sym == SDLK_LEFT && cursorPos > 0) {
-                    *ctx->cursorPos = cursorPos - 1;
+                    *ctx->cursorPos = move_cursor_cluster_left(buffer, cursorPos);
                 }
                 else if (event.key.keysym.sym == SDLK_RIGHT && cursorPos < textLen) {
-                    *ctx->cursorPos = cursorPos + 1;
+                    *ctx->cursorPos = move_cursor_cluster_right(buffer, cursorPos);
                 }
                 else if (event.key.keysym.sym == SDLK_UP) {
-                    // Find start of current line
-                    int line_start = cursorPos;
-                    while (line_start > 0 && text[line_start - 1] != '\n') line_start--;
-                    
-                    if (line_start > 0) {
-                        // Find start of previous line
-                        int prev_line_start = line_start - 1;
-                        while (prev_line_start > 0 && text[prev_line_start - 1] != '\n') prev_line_start--;
-                        
-                        int col = cursorPos - line_start;
-                        int prev_line_len = line_start - 1 - prev_line_start;
-                        *ctx->cursorPos = prev_line_start + (col < prev_line_len ? col : prev_line_len);
-                    }
+                    // Previous visual line, so wrapped lines are stepped through
+                    *ctx->cursorPos = move_cursor_visual_lines(ctx->rd, buffer, cursorPos, -1);
                 }
                 else if (event.key.keysym.sym == SDLK_DOWN) {
-                    // Find start and end of current line
-                    int line_start = cursorPos;
-                    while (line_start > 0 && text[line_start - 1] != '\n') line_start--;
-                    
-                    int line_end = cursorPos;
-                    while (line_end < textLen && text[line_end] != '\n') line_end++;
-                    
-                    if (line_end < textLen) {
-                        int next_line_start = line_end + 1;
-                        int next_line_end = next_line_start;
-                        while (next_line_end < textLen && text[next_line_end] != '\n') next_line_end++;
-                        
-                        int col = cursorPos - line_start;
-                        int next_line_len = next_line_end - next_line_start;
-                        *ctx->cursorPos = next_line_start + (col < next_line_len ? col : next_line_len);
-                    }
+                    *ctx->cursorPos = move_cursor_visual_lines(ctx->rd, buffer, cursorPos, 1);
                 }
                 // Enter/Return
                 else if (event.key.keysym.sym == SDLK_RETURN) {
@@ -257,13 +274,7 @@ static void emscripten_frame_callback(void *arg)
                         record_insert_action(ctx->undo, cursorPos, "\n", cursorPos, cursorPos + 1);
                     }
                     
-                    char *newText = malloc(textLen + 2);
-                    if (newText) {
-                        memcpy(newText, text, cursorPos);
-                        newText[cursorPos] = '\n';
-                        memcpy(newText + cursorPos + 1, text + cursorPos, textLen - cursorPos + 1);
-                        free(text);
-                        *ctx->editorText = newText;
+                    if (piece_table_insert(buffer, cursorPos, "\n", 1)) {
                         *ctx->cursorPos = cursorPos + 1;
                         needsUpdate = true;
                         
@@ -274,10 +285,10 @@ static void emscripten_frame_callback(void *arg)
                 // Update render if needed
                 if (needsUpdate && ctx->renderer && ctx->font && ctx->text_area_x && 
                     ctx->text_area_y && ctx->maxTextWidth) {
-                    update_render_data(ctx->renderer, ctx->font, *ctx->editorText,
+                    update_render_data(ctx->renderer, ctx->font, buffer,
                                      *ctx->text_area_x, *ctx->text_area_y, *ctx->maxTextWidth, ctx->rd);
                     if (ctx->rd->lazy_mode && ctx->text_area_height) {
-                        prepare_visible_texture(ctx->renderer, ctx->font, *ctx->editorText,
+                        prepare_visible_texture(ctx->renderer, ctx->font, buffer,
                                               *ctx->text_area_x, *ctx->text_area_y, *ctx->maxTextWidth,
                                               ctx->rd, ctx->rd->scrollY, *ctx->text_area_height);
                     }
@@ -287,7 +298,7 @@ static void emscripten_frame_callback(void *arg)
         }
     }
 
-    render_frame(ctx);
+    render_frame(ctx, ctx->text_buffer);
 }
 #endif
 
@@ -320,14 +331,11 @@ static void push_event(EventQueue *queue, const SDL_Event *event)
     pthread_mutex_unlock(&queue->mutex);
 }
 
+// Take the next queued event without waiting, so the caller can draw between
 static bool pop_event(EventQueue *queue, SDL_Event *event)
 {
     pthread_mutex_lock(&queue->mutex);
 
-    while (queue->read_pos == queue->write_pos && !queue->should_exit) {
-        pthread_cond_wait(&queue->cond, &queue->mutex);
-    }
-
     if (queue->should_exit) {
         pthread_mutex_unlock(&queue->mutex);
         return false;
@@ -372,8 +380,13 @@ static int event_watch_callback(void *userdata, SDL_Event *event)
 static void *render_thread_func(void *arg)
 {
     RenderContext *ctx = (RenderContext *) arg;
+    FrameDraw *draw = &ctx->draw;
     SDL_Event event;
 
+    // The main thread keeps editing ctx->text_buffer; this thread only reads
+    // published snapshots of it.
+    int reader = register_snapshot_reader(&g_snapshots);
+
     debug_print(L"Render thread started\n");
 
     while (*ctx->running) {
@@ -412,36 +425,102 @@ static void *render_thread_func(void *arg)
 
                     ctx->status_bar->needs_update = true;
                 }
-            } else if (event.type == SDL_MOUSEWHEEL) {
-                // Handle wheel events in render thread as well (continuous resize mode)
-                int line_h = TTF_FontLineSkip(ctx->font);
-                ctx->rd->scrollY -= event.wheel.y * line_h * 3;
-                if (ctx->rd->scrollY < 0)
-                    ctx->rd->scrollY = 0;
-                if (ctx->rd->textH > 0 &&
-                    ctx->rd->scrollY > ctx->rd->textH - *ctx->text_area_height)
-                    ctx->rd->scrollY = ctx->rd->textH - *ctx->text_area_height;
-                if (ctx->rd->lazy_mode)
-                    prepare_visible_texture(ctx->renderer, ctx->font, *ctx->editorText,
-                                            *ctx->text_area_x, *ctx->text_area_y,
-                                            *ctx->maxTextWidth, ctx->rd, ctx->rd->scrollY,
-                                            *ctx->text_area_height);
+            } else if (event.type == SDL_RENDER_TARGETS_RESET ||
+                       event.type == SDL_RENDER_DEVICE_RESET) {
+                // Render targets lost their contents: redraw glyphs, tiles and the window
+                reset_render_textures(ctx->rd);
+                damage_all(&draw->damage);
             }
         }
 
-        // Always render frame to maintain smooth updates during resize
-        render_frame(ctx);
+        // Always render frame to maintain smooth updates during resize. The
+        // main thread scrolls (wheel, page keys) through ctx->scroll_y.
+        DocumentSnapshot *snapshot = acquire_document_snapshot(&g_snapshots, reader);
+        if (snapshot) {
+            int scroll_y = atomic_load(&ctx->scroll_y);
+            ctx->rd->scrollY = scroll_y;
+            render_frame(ctx, &snapshot->text);
+            // A scroll the main thread made meanwhile wins over cursor following
+            atomic_compare_exchange_strong(&ctx->scroll_y, &scroll_y, ctx->rd->scrollY);
+        }
+        release_document_snapshot(&g_snapshots, reader);
 
         // Cap frame rate - shorter delay when processing events for responsiveness
         SDL_Delay(events_processed ? 8 : 16); // Higher FPS when actively resizing
     }
 
+    unregister_snapshot_reader(&g_snapshots, reader);
     debug_print(L"Render thread exiting\n");
     return NULL;
 }
 
+// Record in draw->damage what changed since the last frame. The caller adds
+// the status bar and line numbers when their textures were re-rendered.
+static void damage_frame_changes(FrameDraw *draw, const FrameState *now, SDL_Rect text_area,
+                                 SDL_Rect gutter)
+{
+    FrameState *last = &draw->last_frame;
+    bool covered = dialog_covered_window();
+    if (covered || !last->drawn || now->window_width != last->window_width ||
+        now->window_height != last->window_height || now->text_area_x != last->text_area_x ||
+        now->text_area_width != last->text_area_width || now->line_numbers != last->line_numbers) {
+        damage_all(&draw->damage);
+    } else {
+        if (now->version != last->version || now->scroll_y != last->scroll_y ||
+            now->selection_start != last->selection_start ||
+            now->selection_end != last->selection_end ||
+            now->search_active != last->search_active ||
+            now->search_matches != last->search_matches ||
+            now->search_current != last->search_current)
+            damage_rect(&draw->damage, text_area);
+        if (now->version != last->version)
+            damage_rect(&draw->damage, gutter);
+        if (memcmp(&now->cursor, &last->cursor, sizeof(SDL_Rect)) != 0) {
+            damage_rect(&draw->damage, last->cursor);
+            damage_rect(&draw->damage, now->cursor);
+        }
+    }
+    *last = *now;
+    last->drawn = true;
+}
+
+// Rectangles of the search matches inside the viewport: a binary search finds
+// the first visible match and the walk stops at the last visible byte
+static void build_search_highlights(FrameDraw *draw, RenderData *rd, TTF_Font *font,
+                                    PieceTable *buffer, const SearchState *search, int x_offset,
+                                    int y_offset, int viewportY, int viewportHeight)
+{
+    draw->search_matches.count = 0;
+    draw->search_current.count = 0;
+    int line_h = TTF_FontLineSkip(font);
+    if (!search->is_active || !has_matches(search) || line_h <= 0)
+        return;
+
+    int num_lines = get_visual_line_count(rd, buffer);
+    int first_line = viewportY > 0 ? viewportY / line_h : 0;
+    int last_line = (viewportY + viewportHeight) / line_h + 1;
+    if (first_line >= num_lines)
+        return;
+    int visible_start = (int) get_visual_line_start(rd, buffer, first_line);
+    size_t length = piece_table_length(buffer);
+    int visible_end = last_line < num_lines ? (int) get_visual_line_start(rd, buffer, last_line)
+                                            : (int) length;
+
+    for (int i = first_match_ending_after(search, visible_start);
+         i < search->num_matches && search->match_positions[i] < visible_end; i++) {
+        size_t start = (size_t) search->match_positions[i];
+        size_t end = start + (size_t) search->match_lengths[i];
+        if (end > length)
+            break; // stale after an edit
+        SelectionGeometry *geometry =
+            i == search->current_match ? &draw->search_current : &draw->search_matches;
+        add_selection_geometry(geometry, rd, font, buffer, start, end, x_offset, y_offset,
+                               viewportY, viewportHeight);
+    }
+}
+
 // Render a single frame
-static void render_frame(RenderContext *ctx)
+static void render_frame(RenderContext *ctx, PieceTable *text_buffer)
 {
     /* Removed noisy per-frame logs - uncomment to debug rendering */
     // EM_ASM({ console.log('[EMSCRIPTEN] render_frame start'); });
@@ -450,27 +529,24 @@ static void render_frame(RenderContext *ctx)
     SDL_Renderer *renderer = ctx->renderer;
     TTF_Font *font = ctx->font;
     RenderData *rd = ctx->rd;
+    FrameDraw *draw = &ctx->draw;
     int cursorPos = *ctx->cursorPos;
     int selectionStart = *ctx->selectionStart;
     int selectionEnd = *ctx->selectionEnd;
-    char *editorText = *ctx->editorText;
     SearchState *search = ctx->search;
 
-    // Update content hash for change detection
-    static uint32_t last_content_hash = 0;
+    // Track the buffer version for change detection (no per-frame re-hash)
+    static uint64_t last_version = 0;
     static int last_width = 0;
     static int last_cursor_pos = -1;
     static int last_selection_start = -1;
     static int last_selection_end = -1;
     static bool needs_update = true;
 
-    uint32_t content_hash = 0;
-    for (const char *p = editorText; *p; p++) {
-        content_hash = ((content_hash << 5) + content_hash) + *p;
-    }
+    uint64_t version = piece_table_version(text_buffer);
 
     // Check for any changes that require re-rendering
-    bool content_changed = (content_hash != last_content_hash);
+    bool content_changed = (version != last_version);
     bool layout_changed = (*ctx->windowWidth != last_width);
     bool cursor_changed = (*ctx->cursorPos != last_cursor_pos);
     bool selection_changed =
@@ -483,21 +559,15 @@ static void render_frame(RenderContext *ctx)
         // printf("[EMSCRIPTEN] about to update_render_data\n");
 
         if (content_changed || layout_changed) {
-            update_render_data(renderer, font, editorText, *ctx->text_area_x, *ctx->text_area_y,
+            update_render_data(renderer, font, text_buffer, *ctx->text_area_x, *ctx->text_area_y,
                                *ctx->maxTextWidth, rd);
             /* Removed noisy render logs */
             // EM_ASM({ console.log('[EMSCRIPTEN] update_render_data returned'); });
             // printf("[EMSCRIPTEN] update_render_data returned\n");
-
-            if (rd->lazy_mode) {
-                prepare_visible_texture(renderer, font, editorText, *ctx->text_area_x,
-                                        *ctx->text_area_y, *ctx->maxTextWidth, rd, rd->scrollY,
-                                        *ctx->text_area_height);
-            }
         }
 
         // Update tracking variables
-        last_content_hash = content_hash;
+        last_version = version;
         last_width = *ctx->windowWidth;
         last_cursor_pos = *ctx->cursorPos;
         last_selection_start = *ctx->selectionStart;
@@ -505,36 +575,25 @@ static void render_frame(RenderContext *ctx)
         needs_update = false;
     }
 
-    // Update status bar
-    update_status_bar(ctx->status_bar, renderer, ctx->document, search, cursorPos, editorText,
+    // Update status bar. The main thread collects background search results
+    // and may be changing the matches meanwhile.
+    bool status_changed = ctx->status_bar->needs_update;
+    lock_search_state(search);
+    update_status_bar(ctx->status_bar, renderer, ctx->document, search, cursorPos, text_buffer,
                       *ctx->windowWidth);
+    unlock_search_state(search);
 
     // Update line numbers
     int font_height = TTF_FontLineSkip(font);
     int line_numbers_area_height = *ctx->windowHeight - ctx->status_bar->height;
     int visible_lines = line_numbers_area_height / font_height;
-    update_line_numbers(ctx->line_numbers, renderer, editorText, 1, visible_lines);
+    bool gutter_changed = ctx->line_numbers->needs_update;
+    update_line_numbers(ctx->line_numbers, renderer, text_buffer, 1, visible_lines);
     ctx->line_numbers->rect.y = 0;
 
-    // Clear screen
-    /* Removed noisy render logs */
-    // EM_ASM({ console.log('[EMSCRIPTEN] clearing screen'); });
-    // printf("[EMSCRIPTEN] clearing screen\n");
-
-    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
-    SDL_SetRenderDrawColor(renderer, 22, 24, 32, 255);
-    SDL_RenderClear(renderer);
-
     // Calculate cursor line early so we can ensure it is visible (adjust scrollY)
     int cursor_font_height = TTF_FontLineSkip(font);
-    int cursor_line = 0;
-    int line_start_pos = 0;
-    for (int i = 0; i < cursorPos && editorText[i]; i++) {
-        if (editorText[i] == '\n') {
-            cursor_line++;
-            line_start_pos = i + 1;
-        }
-    }
+    int cursor_line = get_visual_line_at(rd, text_buffer, (size_t) cursorPos);
 
     // Ensure scrollY is within valid bounds
     if (rd->scrollY < 0)
@@ -562,117 +621,168 @@ static void render_frame(RenderContext *ctx)
         rd->scrollY = desired;
     }
 
-    // Render text using floating-point positioning for macOS-like precision
-    if (rd && rd->textTexture && rd->textRect.w > 0 && rd->textRect.h > 0 && rd->textRect.x >= 0 &&
-        rd->textRect.y >= 0) {
-        /* Removed noisy render logs */
-        // EM_ASM({ console.log('[EMSCRIPTEN] about to render texture'); });
-        // printf("[EMSCRIPTEN] about to render texture\n");
-
-        // Source rect selects the visible portion of the texture based on scrollY
-        // Use the actual texture height, not viewport height, to avoid stretching
-        int src_h = rd->textRect.h < *ctx->text_area_height ? rd->textRect.h : *ctx->text_area_height;
-        SDL_Rect src = {0, rd->scrollY, rd->textRect.w, src_h};
-        SDL_FRect dst = {(float) rd->textRect.x, (float) rd->textRect.y, (float) rd->textRect.w,
-                         (float) src_h};
-#ifdef __EMSCRIPTEN__
-        // Debug: log render dimensions to diagnose stretching
-        static int log_count = 0;
-        if (log_count++ < 3) {
-            printf("[DEBUG] Render: src={%d,%d,%d,%d} dst={%.0f,%.0f,%.0f,%.0f} tex={%d,%d}\n",
-                   src.x, src.y, src.w, src.h, dst.x, dst.y, dst.w, dst.h, rd->textRect.w, rd->textRect.h);
-        }
-#endif
-        SDL_RenderCopyF(renderer, rd->textTexture, &src, &dst);
-    }
+    // Cursor x from the prefix advances of its line
+    int cursorX = rd->textRect.x + get_visual_line_x(rd, font, text_buffer, (size_t) cursorPos);
 
-    // Render selection highlight
-    if (selectionStart >= 0 && selectionEnd >= 0 && selectionStart != selectionEnd) {
-        /* Removed noisy selection render logs */
-        // EM_ASM({ console.log('[EMSCRIPTEN] rendering selection start=%d end=%d', $0, $1); }, selectionStart, selectionEnd);
-        // printf("[EMSCRIPTEN] rendering selection start=%d end=%d\n", selectionStart, selectionEnd);
-
-        int startIdx = selectionStart < selectionEnd ? selectionStart : selectionEnd;
-        int endIdx = selectionStart < selectionEnd ? selectionEnd : selectionStart;
-        if (startIdx < rd->numClusters && endIdx < rd->numClusters) {
-            int start_x = 0, end_x = 0;
-            if (rd->glyphOffsets && startIdx < rd->numGlyphs)
-                start_x = rd->glyphOffsets[startIdx];
-            else if (rd->clusterRects)
-                start_x = rd->clusterRects[startIdx].x;
-            if (rd->glyphOffsets && endIdx < rd->numGlyphs)
-                end_x = rd->glyphOffsets[endIdx];
-            else if (rd->clusterRects)
-                end_x = rd->clusterRects[endIdx].x + rd->clusterRects[endIdx].w;
-
-            SDL_Rect hl = {rd->textRect.x + start_x, rd->textRect.y, end_x - start_x,
-                           rd->textRect.h};
-            SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
-            SDL_SetRenderDrawColor(renderer, 200, 200, 180, 128);
-            SDL_RenderFillRect(renderer, &hl);
-        }
-    }
+    int cursorY = rd->textRect.y + (cursor_line * cursor_font_height);
+
+    // Work out which parts of the window changed since the last frame
+    int gutter_width = get_line_numbers_width(ctx->line_numbers);
+    lock_search_state(search);
+    FrameState now = {
+        .window_width = *ctx->windowWidth,
+        .window_height = *ctx->windowHeight,
+        .text_area_x = *ctx->text_area_x,
+        .text_area_width = *ctx->maxTextWidth,
+        .line_numbers = ctx->line_numbers->enabled,
+        .version = version,
+        .scroll_y = rd->scrollY,
+        .selection_start = selectionStart,
+        .selection_end = selectionEnd,
+        .search_active = search->is_active,
+        .search_matches = search->num_matches,
+        .search_current = search->current_match,
+        .cursor = {cursorX, cursorY, 1, cursor_font_height + 1},
+    };
+    unlock_search_state(search);
+    SDL_Rect text_area = {gutter_width, 0, *ctx->windowWidth - gutter_width,
+                          ctx->status_bar->rect.y};
+    SDL_Rect gutter = {0, 0, gutter_width, ctx->status_bar->rect.y};
+    damage_frame_changes(draw, &now, text_area, gutter);
+    if (gutter_changed)
+        damage_rect(&draw->damage, gutter);
+    if (status_changed)
+        damage_rect(&draw->damage, ctx->status_bar->rect);
+    // Glyphs finished by the raster workers replace their placeholders
+    if (raster_pool_ready(rd->raster_pool))
+        damage_rect(&draw->damage, text_area);
+
+    // Nothing changed: leave the window as it is and skip the present
+    if (!begin_damage_frame(&draw->damage, renderer, *ctx->windowWidth, *ctx->windowHeight))
+        return;
 
-    // Render search highlights
-    if (search->is_active && has_matches(search)) {
+    // Selection rectangles of the visible lines
+    int selection_start_byte = 0, selection_end_byte = 0;
+    draw->selection.count = 0;
+    if (selection_byte_range(text_buffer, selectionStart, selectionEnd, rd, &selection_start_byte,
+                             &selection_end_byte))
+        build_selection_geometry(&draw->selection, rd, font, text_buffer,
+                                 (size_t) selection_start_byte, (size_t) selection_end_byte,
+                                 *ctx->text_area_x, *ctx->text_area_y, rd->scrollY,
+                                 *ctx->text_area_height);
+    lock_search_state(search);
+    build_search_highlights(draw, rd, font, text_buffer, search, *ctx->text_area_x,
+                            *ctx->text_area_y, rd->scrollY, *ctx->text_area_height);
+    unlock_search_state(search);
+
+    for (int d = 0; d < draw->damage.count; d++) {
+        SDL_Rect *dirty = &draw->damage.rects[d];
+        SDL_RenderSetClipRect(renderer, dirty);
+
+        // Clear the damaged area
+        SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
+        SDL_SetRenderDrawColor(renderer, 22, 24, 32, 255);
+        SDL_RenderFillRect(renderer, dirty);
+
+        // Draw the visible lines from the glyph atlas
+        render_visible_text(renderer, font, text_buffer, *ctx->text_area_x, *ctx->text_area_y,
+                            *ctx->maxTextWidth, rd, rd->scrollY, *ctx->text_area_height);
+
+        // Render selection highlight, one rectangle per selected visible line
         SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
-        for (int i = 0; i < search->num_matches; i++) {
-            int match_pos = search->match_positions[i];
-            int cluster_idx = get_cluster_index_at_cursor(editorText, match_pos, rd);
-
-            if (cluster_idx < rd->numClusters) {
-                SDL_Rect search_hl = {rd->textRect.x + rd->glyphOffsets[cluster_idx],
-                                      rd->textRect.y,
-                                      search->match_lengths[i] * 8, // Approximate width
-                                      rd->textRect.h};
-
-                if (i == search->current_match) {
-                    SDL_SetRenderDrawColor(renderer, 255, 255, 0, 100); // Yellow for current match
-                } else {
-                    SDL_SetRenderDrawColor(renderer, 255, 200, 0, 80); // Orange for other matches
-                }
-                SDL_RenderFillRect(renderer, &search_hl);
-            }
-        }
-    }
+        SDL_SetRenderDrawColor(renderer, 200, 200, 180, 128);
+        draw_selection_geometry(renderer, &draw->selection);
+
+        // Render search highlights of the visible matches
+        SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+        SDL_SetRenderDrawColor(renderer, 255, 200, 0, 80); // Orange for other matches
+        draw_selection_geometry(renderer, &draw->search_matches);
+        SDL_SetRenderDrawColor(renderer, 255, 255, 0, 100); // Yellow for current match
+        draw_selection_geometry(renderer, &draw->search_current);
+
+        // Render cursor
+        SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+        SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+        SDL_RenderDrawLine(renderer, cursorX, cursorY, cursorX, cursorY + cursor_font_height);
 
-    // Render cursor (cursor_line and line_start_pos were computed earlier)
-    // Calculate cursor position on the current line
-    int cursor_pos_in_line = cursorPos - line_start_pos;
-
-    // Get the width of text from line start to cursor
-    char temp_line[1024] = {0};
-    int copy_len = cursor_pos_in_line;
-    if (copy_len > 1023)
-        copy_len = 1023;
-    memcpy(temp_line, editorText + line_start_pos, copy_len);
-
-    int cursorX = rd->textRect.x;
-    if (strlen(temp_line) > 0) {
-        int text_width;
-        TTF_SizeUTF8(font, temp_line, &text_width, NULL);
-        cursorX += text_width;
+        // Render line numbers
+        ctx->line_numbers->rect.y = 0; // Line numbers go all the way to the top
+        render_line_numbers(ctx->line_numbers, renderer);
+
+        // Render status bar
+        render_status_bar(ctx->status_bar, renderer);
     }
 
-    int cursorY = rd->textRect.y + (cursor_line * cursor_font_height);
+    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
+    end_damage_frame(&draw->damage, renderer);
+}
 
-    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
-    SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
-    SDL_RenderDrawLine(renderer, cursorX, cursorY, cursorX, cursorY + cursor_font_height);
+// Milliseconds the main loop may sleep waiting for input before timed work is
+// due, or -1 to sleep until the next event
+static int next_wake_timeout(const AutoSave *auto_save, const DocumentState *document)
+{
+    uint32_t wait = auto_save_wait(auto_save, document->is_modified);
+    if (wait == UINT32_MAX)
+        return -1;
+    return wait > INT_MAX ? INT_MAX : (int) wait;
+}
 
-    // Render line numbers
-    ctx->line_numbers->rect.y = 0; // Line numbers go all the way to the top
-    render_line_numbers(ctx->line_numbers, renderer);
+// Bytes read around the cursor to find the neighbouring cluster boundary.
+// Clusters never cross a newline, so the window stops at the line; a longer
+// cluster is read again with a doubled window.
+#define CURSOR_CONTEXT_BYTES 256
 
-    // Render status bar
-    render_status_bar(ctx->status_bar, renderer);
+// Move cursor to the previous grapheme cluster boundary
+static int move_cursor_cluster_left(PieceTable *buffer, int cursor_pos)
+{
+    if (cursor_pos <= 0)
+        return 0;
+    size_t pos = (size_t) cursor_pos;
+    size_t line_start = piece_table_line_start(buffer, piece_table_line_at(buffer, pos - 1));
+    for (size_t window = CURSOR_CONTEXT_BYTES;; window *= 2) {
+        size_t start = pos - line_start > window ? pos - window : line_start;
+        char *text = piece_table_slice(buffer, start, pos - start);
+        if (!text)
+            return cursor_pos - 1;
+        // Segmenting is only exact from a boundary found inside the window,
+        // which starts at a whole character
+        size_t skip = 0, len = pos - start;
+        while (skip < len && ((unsigned char) text[skip] & 0xC0) == 0x80)
+            skip++;
+        bool anchored =
+            start == line_start || grapheme_anchor(text + skip, len - skip, len - skip) > 0;
+        size_t prev = grapheme_prev_break(text + skip, len - skip, len - skip);
+        free(text);
+        if (anchored)
+            return (int) (start + skip + prev);
+    }
+}
 
-    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
-    SDL_RenderPresent(renderer);
+// Move cursor to the next grapheme cluster boundary
+static int move_cursor_cluster_right(PieceTable *buffer, int cursor_pos)
+{
+    size_t text_len = piece_table_length(buffer);
+    if ((size_t) cursor_pos >= text_len)
+        return (int) text_len;
+    size_t pos = (size_t) cursor_pos;
+    // The line's last cluster ends with its '\n'
+    size_t line_end = piece_table_line_end(buffer, piece_table_line_at(buffer, pos));
+    size_t limit = line_end < text_len ? line_end + 1 : text_len;
+    for (size_t window = CURSOR_CONTEXT_BYTES;; window *= 2) {
+        size_t end = limit - pos > window ? pos + window : limit;
+        char *text = piece_table_slice(buffer, pos, end - pos);
+        if (!text)
+            return cursor_pos + 1;
+        size_t next = grapheme_next_break(text, end - pos, 0);
+        free(text);
+        // The break is only certain if the whole character after it was read
+        if (end == limit || next + 4 <= end - pos)
+            return (int) (pos + next);
+    }
 }
 
 // Move cursor to previous word
-static int move_cursor_word_left(const char *text, int cursor_pos)
+static int move_cursor_word_left(const PieceTable *buffer, int cursor_pos)
 {
     if (cursor_pos <= 0)
         return 0;
@@ -680,17 +790,17 @@ static int move_cursor_word_left(const char *text, int cursor_pos)
     int pos = cursor_pos - 1;
 
     // Skip whitespace
-    while (pos > 0 && isspace(text[pos])) {
+    while (pos > 0 && isspace((unsigned char) piece_table_byte_at(buffer, pos))) {
         pos--;
     }
 
     // Skip non-whitespace
-    while (pos > 0 && !isspace(text[pos])) {
+    while (pos > 0 && !isspace((unsigned char) piece_table_byte_at(buffer, pos))) {
         pos--;
     }
 
     // If we stopped on whitespace, move forward one
-    if (pos > 0 && isspace(text[pos])) {
+    if (pos > 0 && isspace((unsigned char) piece_table_byte_at(buffer, pos))) {
         pos++;
     }
 
@@ -698,21 +808,21 @@ static int move_cursor_word_left(const char *text, int cursor_pos)
 }
 
 // Move cursor to next word
-static int move_cursor_word_right(const char *text, int cursor_pos)
+static int move_cursor_word_right(const PieceTable *buffer, int cursor_pos)
 {
-    int text_len = strlen(text);
+    int text_len = (int) piece_table_length(buffer);
     if (cursor_pos >= text_len)
         return text_len;
 
     int pos = cursor_pos;
 
     // Skip non-whitespace
-    while (pos < text_len && !isspace(text[pos])) {
+    while (pos < text_len && !isspace((unsigned char) piece_table_byte_at(buffer, pos))) {
         pos++;
     }
 
     // Skip whitespace
-    while (pos < text_len && isspace(text[pos])) {
+    while (pos < text_len && isspace((unsigned char) piece_table_byte_at(buffer, pos))) {
         pos++;
     }
 
@@ -720,90 +830,52 @@ static int move_cursor_word_right(const char *text, int cursor_pos)
 }
 
 // Move cursor to beginning of line
-static int move_cursor_line_start(const char *text, int cursor_pos)
+static int move_cursor_line_start(const PieceTable *buffer, int cursor_pos)
 {
-    int pos = cursor_pos;
-    while (pos > 0 && text[pos - 1] != '\n') {
-        pos--;
-    }
-    return pos;
+    return (int) piece_table_line_start(buffer, piece_table_line_at(buffer, cursor_pos));
 }
 
 // Move cursor to end of line
-static int move_cursor_line_end(const char *text, int cursor_pos)
+static int move_cursor_line_end(const PieceTable *buffer, int cursor_pos)
 {
-    int text_len = strlen(text);
-    int pos = cursor_pos;
-    while (pos < text_len && text[pos] != '\n') {
-        pos++;
-    }
-    return pos;
+    return (int) piece_table_line_end(buffer, piece_table_line_at(buffer, cursor_pos));
 }
 
-// Delete selected text and return new cursor position
-static int delete_selection(char **text, int selection_start, int selection_end,
-                            const int *cluster_byte_indices, int num_clusters)
+// Resolve a cluster selection to a byte range [*start_byte, *end_byte). Works
+// with RenderData in lazy mode (no full cluster byte index array required).
+static bool selection_byte_range(PieceTable *buffer, int selection_start, int selection_end,
+                                 RenderData *rd, int *start_byte, int *end_byte)
 {
+    if (!rd || !buffer)
+        return false;
     if (selection_start < 0 || selection_end < 0 || selection_start == selection_end) {
-        return -1; // No selection
+        return false; // No selection
     }
 
     int start_idx = selection_start < selection_end ? selection_start : selection_end;
     int end_idx = selection_start < selection_end ? selection_end : selection_start;
 
-    if (start_idx >= num_clusters || end_idx >= num_clusters) {
-        return -1;
-    }
-
-    int start_byte = cluster_byte_indices[start_idx];
-    int end_byte = (end_idx + 1 < num_clusters) ? cluster_byte_indices[end_idx + 1] : strlen(*text);
-
-    int text_len = strlen(*text);
-    char *new_text = malloc(text_len - (end_byte - start_byte) + 1);
-    if (!new_text)
-        return -1;
-
-    memcpy(new_text, *text, start_byte);
-    memcpy(new_text + start_byte, *text + end_byte, text_len - end_byte + 1);
-
-    free(*text);
-    *text = new_text;
-
-    return start_byte;
+    *start_byte = get_cluster_byte_offset(rd, buffer, start_idx);
+    *end_byte = get_cluster_byte_offset(rd, buffer, end_idx + 1);
+    if (*start_byte < 0)
+        return false;
+    if (*end_byte < 0)
+        *end_byte = (int) piece_table_length(buffer);
+    return true;
 }
 
 // Lazy deletion helper that works with RenderData (does not require a full cluster
 // byte indices array to be present). Returns new cursor byte offset or -1.
-static int delete_selection_lazy(char **text, int selection_start, int selection_end,
+static int delete_selection_lazy(PieceTable *buffer, int selection_start, int selection_end,
                                  RenderData *rd)
 {
-    if (!rd || !text)
-        return -1;
-    if (selection_start < 0 || selection_end < 0 || selection_start == selection_end) {
-        return -1; // No selection
-    }
-
-    int start_idx = selection_start < selection_end ? selection_start : selection_end;
-    int end_idx = selection_start < selection_end ? selection_end : selection_start;
-
-    int start_byte = get_cluster_byte_offset(rd, *text, start_idx);
-    int end_byte = get_cluster_byte_offset(rd, *text, end_idx + 1);
-    if (start_byte < 0)
+    int start_byte, end_byte;
+    if (!selection_byte_range(buffer, selection_start, selection_end, rd, &start_byte, &end_byte))
         return -1;
-    if (end_byte < 0)
-        end_byte = strlen(*text);
 
-    int text_len = strlen(*text);
-    char *new_text = malloc(text_len - (end_byte - start_byte) + 1);
-    if (!new_text)
+    if (!piece_table_delete(buffer, start_byte, end_byte - start_byte))
         return -1;
 
-    memcpy(new_text, *text, start_byte);
-    memcpy(new_text + start_byte, *text + end_byte, text_len - end_byte + 1);
-
-    free(*text);
-    *text = new_text;
-
     return start_byte;
 }
 
@@ -964,22 +1036,19 @@ void display_text_window(const char *font_path, int font_size, const char *initi
 
     RenderData rd = {0};
 
-    // Use a dynamic buffer for editable text. Start with empty text or load initial file
-    char *editorText = NULL;
+    // Piece-table buffer for editable text. Start with empty text or load initial file
+    PieceTable text_buffer;
+    init_piece_table(&text_buffer);
+    bool loaded = false;
     if (initial_file) {
-        char *content = NULL;
-        if (open_file((char *) initial_file, &content)) {
-            editorText = content;
-            set_document_filename(&document, strdup(initial_file));
+        if (open_file(initial_file, &text_buffer)) {
+            set_document_filename(&document, initial_file);
             mark_document_modified(&document, false);
-        } else {
-            // Fall back to empty text if open failed
-            editorText = strdup("");
+            loaded = true;
         }
-    } else {
-        editorText = strdup("");
     }
-    if (!editorText) { /* error handling */
+    // Fall back to empty text if there was no file or open failed
+    if (!loaded && !piece_table_set_text(&text_buffer, "")) { /* error handling */
         return;
     }
     int cursorPos = 0;
@@ -1016,9 +1085,10 @@ void display_text_window(const char *font_path, int font_size, const char *initi
     printf("[DEBUG] Before update_render_data: text_area_height=%d windowHeight=%d\n", 
            text_area_height, windowHeight);
 #endif
-    if (update_render_data(renderer, font, editorText, text_area_x, text_area_y, maxTextWidth,
+    if (update_render_data(renderer, font, &text_buffer, text_area_x, text_area_y, maxTextWidth,
                            &rd) != 0) {
-        free(editorText);
+        cleanup_render_data(&rd);
+        cleanup_piece_table(&text_buffer);
         cleanup_document_state(&document);
         cleanup_undo_system(&undo);
         cleanup_search_state(&search);
@@ -1037,11 +1107,10 @@ void display_text_window(const char *font_path, int font_size, const char *initi
     SDL_Event event;
     int lastWidth = windowWidth;
     int lastHeight = windowHeight; // ADDED: To track last processed window height
-    char *lastText = NULL;
 
     static struct {
         uint32_t last_render;
-        uint32_t last_content_hash;
+        uint64_t last_version;
         int last_width;
         bool needs_update;
     } state = {0, 0, 0, true};
@@ -1054,6 +1123,7 @@ void display_text_window(const char *font_path, int font_size, const char *initi
 
     // Initialize continuous resize system
     init_event_queue(&g_event_queue);
+    init_snapshot_manager(&g_snapshots);
 
     // Set up render context with all necessary pointers
 #ifdef __EMSCRIPTEN__
@@ -1068,7 +1138,7 @@ void display_text_window(const char *font_path, int font_size, const char *initi
         StatusBar status_bar;
         LineNumbers line_numbers;
         AutoSave auto_save;
-        char *editorText;
+        PieceTable text_buffer;
         int cursorPos;
         int selectionStart;
         int selectionEnd;
@@ -1094,7 +1164,7 @@ void display_text_window(const char *font_path, int font_size, const char *initi
         heap->status_bar = status_bar;
         heap->line_numbers = line_numbers;
         heap->auto_save = auto_save;
-        heap->editorText = editorText;
+        heap->text_buffer = text_buffer;
         heap->cursorPos = cursorPos;
         heap->selectionStart = selectionStart;
         heap->selectionEnd = selectionEnd;
@@ -1113,7 +1183,7 @@ void display_text_window(const char *font_path, int font_size, const char *initi
         g_render_context.font = font;
         g_render_context.status_font = status_font;
         g_render_context.window = window;
-        g_render_context.editorText = &heap->editorText;
+        g_render_context.text_buffer = &heap->text_buffer;
         g_render_context.cursorPos = &heap->cursorPos;
         g_render_context.selectionStart = &heap->selectionStart;
         g_render_context.selectionEnd = &heap->selectionEnd;
@@ -1144,7 +1214,7 @@ void display_text_window(const char *font_path, int font_size, const char *initi
         g_render_context.font = font;
         g_render_context.status_font = status_font;
         g_render_context.window = window;
-        g_render_context.editorText = &editorText;
+        g_render_context.text_buffer = &text_buffer;
         g_render_context.cursorPos = &cursorPos;
         g_render_context.selectionStart = &selectionStart;
         g_render_context.selectionEnd = &selectionEnd;
@@ -1173,7 +1243,7 @@ void display_text_window(const char *font_path, int font_size, const char *initi
     g_render_context.font = font;
     g_render_context.status_font = status_font;
     g_render_context.window = window;
-    g_render_context.editorText = &editorText;
+    g_render_context.text_buffer = &text_buffer;
     g_render_context.cursorPos = &cursorPos;
     g_render_context.selectionStart = &selectionStart;
     g_render_context.selectionEnd = &selectionEnd;
@@ -1210,14 +1280,37 @@ void display_text_window(const char *font_path, int font_size, const char *initi
 #endif
 #endif
 
+    // The render thread draws from a RenderData and font of its own. rd stays
+    // with the main thread for cursor movement and hit testing, and SDL_ttf
+    // fonts must not be used from two threads.
+    RenderData render_rd = {0};
+    TTF_Font *render_font = NULL;
+
     // Start render thread (native only). Under Emscripten the browser-driven
     // main loop will handle rendering so we must not create threads or enter
     // the blocking while loop below.
 #ifndef __EMSCRIPTEN__
-    g_continuous_resize_active = true;
-    if (pthread_create(&g_render_thread, NULL, render_thread_func, &g_render_context) != 0) {
+    render_font = TTF_OpenFont(font_path, font_size);
+    if (render_font) {
+        TTF_SetFontHinting(render_font, TTF_GetFontHinting(font));
+        TTF_SetFontStyle(render_font, TTF_GetFontStyle(font));
+        g_render_context.font = render_font;
+        g_render_context.rd = &render_rd;
+        line_numbers.font = render_font;
+        start_raster_workers(&render_rd, render_font, font_path, font_size);
+        g_continuous_resize_active = true;
+    }
+    if (!render_font || !publish_document_snapshot(&g_snapshots, &text_buffer) ||
+        pthread_create(&g_render_thread, NULL, render_thread_func, &g_render_context) != 0) {
         debug_print(L"Failed to create render thread\n");
         g_continuous_resize_active = false;
+        g_render_context.font = font;
+        g_render_context.rd = &rd;
+        line_numbers.font = font;
+        cleanup_render_data(&render_rd);
+        if (render_font)
+            TTF_CloseFont(render_font);
+        render_font = NULL;
     } else {
         // Add event watch for continuous resize
         SDL_AddEventWatch(event_watch_callback, NULL);
@@ -1229,6 +1322,11 @@ void display_text_window(const char *font_path, int font_size, const char *initi
 
     // If continuous resize failed, fall back to regular mode
     bool use_continuous_resize = g_continuous_resize_active;
+    // Drawn into by this loop only in regular mode
+    FrameDraw *draw = &g_render_context.draw;
+    // Rasterize new glyphs on worker threads so big pastes do not stall input
+    if (!use_continuous_resize)
+        start_raster_workers(&rd, font, font_path, font_size);
 
 #ifdef __EMSCRIPTEN__
     /* Under Emscripten we must not block the main thread. The emscripten
@@ -1242,12 +1340,13 @@ void display_text_window(const char *font_path, int font_size, const char *initi
 #endif
 
     while (running) {
-        uint32_t frame_start = SDL_GetTicks();
+        // Sleep until input arrives or the next deadline is due. Background
+        // threads (the glyph raster workers) push an event to wake the loop.
+        bool waited = SDL_WaitEventTimeout(&event, next_wake_timeout(&auto_save, &document));
 
         if (use_continuous_resize) {
-            // In continuous resize mode, use SDL_WaitEvent to pump events
-            // The render thread handles rendering and resize events
-            if (SDL_WaitEvent(&event)) {
+            // In continuous resize mode the render thread handles rendering and resize events
+            if (waited) {
                 // Process quit events specially
                 if (event.type == SDL_QUIT) {
                     if (document.is_modified) {
@@ -1269,13 +1368,18 @@ void display_text_window(const char *font_path, int font_size, const char *initi
                 }
 
                 // Process all other events normally (text input, keyboard, mouse, etc.)
+                // Hit testing needs the viewport the render thread shows
+                rd.scrollY = atomic_load(&g_render_context.scroll_y);
                 goto handle_normal_event;
             }
-            // In continuous resize mode, skip the normal rendering - render thread handles it
+            // Woken by a deadline: run the timed work, the render thread draws
+            if (should_auto_save(&auto_save, document.is_modified)) {
+                perform_auto_save(&auto_save, &document, &text_buffer);
+            }
             continue;
         } else {
-            // Regular mode - process events normally
-            while (SDL_PollEvent(&event)) {
+            // Regular mode - handle the event that ended the wait, then the rest of the queue
+            for (; waited || SDL_PollEvent(&event); waited = false) {
             handle_normal_event:
                 // Mouse wheel: scroll viewport
                 if (event.type == SDL_MOUSEWHEEL) {
@@ -1285,13 +1389,26 @@ void display_text_window(const char *font_path, int font_size, const char *initi
                         rd.scrollY = 0;
                     if (rd.textH > 0 && rd.scrollY > rd.textH - text_area_height)
                         rd.scrollY = rd.textH - text_area_height;
-                    if (rd.lazy_mode)
-                        prepare_visible_texture(renderer, font, editorText, text_area_x,
+                    if (use_continuous_resize)
+                        atomic_store(&g_render_context.scroll_y, rd.scrollY);
+                    else if (rd.lazy_mode)
+                        prepare_visible_texture(renderer, font, &text_buffer, text_area_x,
                                                 text_area_y, maxTextWidth, &rd, rd.scrollY,
                                                 text_area_height);
                     continue;
                 }
 
+                // Render targets lost their contents: redraw glyphs and tiles. The
+                // render thread owns the renderer in continuous resize mode.
+                if (event.type == SDL_RENDER_TARGETS_RESET ||
+                    event.type == SDL_RENDER_DEVICE_RESET) {
+                    if (!use_continuous_resize) {
+                        reset_render_textures(&rd);
+                        damage_all(&draw->damage);
+                    }
+                    continue;
+                }
+
                 if (event.type == SDL_QUIT) {
                     if (document.is_modified) {
                         debug_print(L"Warning: Closing with unsaved changes\n");
@@ -1322,8 +1439,8 @@ void display_text_window(const char *font_path, int font_size, const char *initi
                             status_bar.rect.y = windowHeight - status_bar.height;
 
                             SDL_RenderSetLogicalSize(renderer, windowWidth, windowHeight);
-                            update_render_data(renderer, font, editorText, text_area_x, text_area_y,
-                                               maxTextWidth, &rd);
+                            update_render_data(renderer, font, &text_buffer, text_area_x,
+                                               text_area_y, maxTextWidth, &rd);
 
                             lastWidth = windowWidth;   // Update last known width
                             lastHeight = windowHeight; // Update last known height
@@ -1348,46 +1465,24 @@ void display_text_window(const char *font_path, int font_size, const char *initi
                     record_insert_action(&undo, cursorPos, event.text.text, cursorPos,
                                          cursorPos + strlen(event.text.text));
 
-                    // Invalidate cached blocks after insertion point (conservative for affected
-                    // blocks)
-                    if (rd.lazy_mode) {
-                        int cluster_at_cursor =
-                            get_cluster_index_at_cursor(editorText, cursorPos, &rd);
-                        invalidate_cluster_blocks_after(&rd, cluster_at_cursor);
-                    }
-
                     // Delete selection if any
                     if (selectionStart >= 0 && selectionEnd >= 0 &&
                         selectionStart != selectionEnd) {
                         int new_cursor =
-                            delete_selection_lazy(&editorText, selectionStart, selectionEnd, &rd);
+                            delete_selection_lazy(&text_buffer, selectionStart, selectionEnd, &rd);
                         if (new_cursor >= 0) {
                             cursorPos = new_cursor;
-                            // Invalidate cached blocks starting at deletion start
-                            if (rd.lazy_mode) {
-                                int startIdx =
-                                    selectionStart < selectionEnd ? selectionStart : selectionEnd;
-                                invalidate_cluster_blocks_after(&rd, startIdx);
-                            }
                             selectionStart = selectionEnd = -1;
                         }
                     }
 
                     int insertLen = (int) strlen(event.text.text);
-                    int curLen = (int) strlen(editorText);
-                    char *newText = malloc(curLen + insertLen + 1);
-                    if (!newText)
+                    if (!piece_table_insert(&text_buffer, cursorPos, event.text.text, insertLen))
                         continue;
-                    memcpy(newText, editorText, cursorPos);
-                    memcpy(newText + cursorPos, event.text.text, insertLen);
-                    memcpy(newText + cursorPos + insertLen, editorText + cursorPos,
-                           curLen - cursorPos + 1);
-                    free(editorText);
-                    editorText = newText;
                     cursorPos += insertLen;
 
                     mark_document_modified(&document, true);
-                    update_render_data(renderer, font, editorText, text_area_x, text_area_y,
+                    update_render_data(renderer, font, &text_buffer, text_area_x, text_area_y,
                                        maxTextWidth, &rd);
                     status_bar.needs_update = true;
                 } else if (event.type == SDL_TEXTINPUT && search_mode) {
@@ -1399,7 +1494,7 @@ void display_text_window(const char *font_path, int font_size, const char *initi
                         search_buffer[search_buffer_pos] = '\0';
 
                         // Set search term and perform search
-                        perform_search(&search, editorText, search_buffer);
+                        perform_search(&search, &text_buffer, search_buffer);
                         if (search.replace_mode) {
                             // For now, use the search term as replace term too (will be enhanced
                             // later)
@@ -1426,20 +1521,23 @@ void display_text_window(const char *font_path, int font_size, const char *initi
                             if (search.replace_mode && has_matches(&search)) {
                                 // In replace mode, Enter performs replace on current match
                                 if (search.replace_term) {
-                                    char *new_text = replace_current_match(&search, editorText);
-                                    if (new_text) {
-                                        record_delete_action(
-                                            &undo, get_current_match_position(&search),
-                                            editorText + get_current_match_position(&search),
-                                            cursorPos, cursorPos);
-                                        free(editorText);
-                                        editorText = new_text;
+                                    int match_pos = get_current_match_position(&search);
+                                    char *matched_text = piece_table_slice(
+                                        &text_buffer, match_pos, get_current_match_length(&search));
+                                    if (matched_text &&
+                                        replace_current_match(&search, &text_buffer)) {
+                                        record_delete_action(&undo, match_pos, matched_text,
+                                                             cursorPos, cursorPos);
+                                        record_insert_action(&undo, match_pos, search.replace_term,
+                                                             cursorPos, cursorPos);
                                         mark_document_modified(&document, true);
-                                        // Re-search to update positions
-                                        perform_search(&search, editorText, search_buffer);
-                                        update_render_data(renderer, font, editorText, text_area_x,
-                                                           text_area_y, maxTextWidth, &rd);
+                                        // Re-search around the replacement
+                                        sync_search(&search, &text_buffer);
+                                        update_render_data(renderer, font, &text_buffer,
+                                                           text_area_x, text_area_y, maxTextWidth,
+                                                           &rd);
                                     }
+                                    free(matched_text);
                                 }
                             } else if (has_matches(&search)) {
                                 // Regular search mode, Enter finds next
@@ -1452,7 +1550,7 @@ void display_text_window(const char *font_path, int font_size, const char *initi
                         } else if (key == SDLK_BACKSPACE && search_buffer_pos > 0) {
                             search_buffer_pos--;
                             search_buffer[search_buffer_pos] = '\0';
-                            perform_search(&search, editorText, search_buffer);
+                            perform_search(&search, &text_buffer, search_buffer);
                             status_bar.needs_update = true;
                         }
                         continue; // Skip other key handling in search mode
@@ -1467,7 +1565,7 @@ void display_text_window(const char *font_path, int font_size, const char *initi
                             if (result == DIALOG_YES) {
                                 // Save first
                                 if (document.filename) {
-                                    if (!save_file(document.filename, editorText)) {
+                                    if (!save_file(document.filename, &text_buffer)) {
                                         show_error_dialog("Save Error", "Failed to save file");
                                         proceed = false;
                                     }
@@ -1475,7 +1573,7 @@ void display_text_window(const char *font_path, int font_size, const char *initi
                                     // Use Save As dialog for new files
                                     char *save_as_filename = get_file_dialog(true);
                                     if (save_as_filename) {
-                                        if (save_file(save_as_filename, editorText)) {
+                                        if (save_file(save_as_filename, &text_buffer)) {
                                             set_document_filename(&document, save_as_filename);
                                             mark_document_modified(&document, false);
                                         } else {
@@ -1494,16 +1592,15 @@ void display_text_window(const char *font_path, int font_size, const char *initi
                         }
 
                         if (proceed) {
-                            free(editorText);
-                            editorText = strdup("");
+                            piece_table_set_text(&text_buffer, "");
                             cursorPos = 0;
                             selectionStart = selectionEnd = -1;
                             cleanup_document_state(&document);
                             init_document_state(&document);
                             cleanup_undo_system(&undo);
                             init_undo_system(&undo, 100);
-                            update_render_data(renderer, font, editorText, text_area_x, text_area_y,
-                                               maxTextWidth, &rd);
+                            update_render_data(renderer, font, &text_buffer, text_area_x,
+                                               text_area_y, maxTextWidth, &rd);
                             status_bar.needs_update = true;
                         }
                     } else if (key == SDLK_o && (mod & KMOD_GUI)) {
@@ -1514,7 +1611,7 @@ void display_text_window(const char *font_path, int font_size, const char *initi
                             if (result == DIALOG_YES) {
                                 // Save first
                                 if (document.filename) {
-                                    if (!save_file(document.filename, editorText)) {
+                                    if (!save_file(document.filename, &text_buffer)) {
                                         show_error_dialog("Save Error", "Failed to save file");
                                         proceed = false;
                                     }
@@ -1522,7 +1619,7 @@ void display_text_window(const char *font_path, int font_size, const char *initi
                                     // Use Save As dialog for new files
                                     char *save_as_filename = get_file_dialog(true);
                                     if (save_as_filename) {
-                                        if (save_file(save_as_filename, editorText)) {
+                                        if (save_file(save_as_filename, &text_buffer)) {
                                             set_document_filename(&document, save_as_filename);
                                             mark_document_modified(&document, false);
                                         } else {
@@ -1542,20 +1639,15 @@ void display_text_window(const char *font_path, int font_size, const char *initi
                         if (proceed) {
                             char *filename = simple_file_picker(false);
                             if (filename) {
-                                char *content = NULL;
-                                if (open_file(filename, &content)) {
-                                    free(editorText);
-                                    editorText = content;
+                                if (open_file(filename, &text_buffer)) {
                                     cursorPos = 0;
                                     selectionStart = selectionEnd = -1;
                                     set_document_filename(&document, filename);
                                     mark_document_modified(&document, false);
                                     cleanup_undo_system(&undo);
                                     init_undo_system(&undo, 100);
-                                    update_render_data(renderer, font, editorText, text_area_x,
+                                    update_render_data(renderer, font, &text_buffer, text_area_x,
                                                        text_area_y, maxTextWidth, &rd);
-                                    if (rd.lazy_mode)
-                                        invalidate_cluster_blocks_after(&rd, 0);
 
                                     // Update window title
                                     snprintf(window_title, sizeof(window_title),
@@ -1572,7 +1664,7 @@ void display_text_window(const char *font_path, int font_size, const char *initi
                             // Save As
                             char *filename = simple_file_picker(true);
                             if (filename) {
-                                if (save_file(filename, editorText)) {
+                                if (save_file(filename, &text_buffer)) {
                                     set_document_filename(&document, filename);
                                     mark_document_modified(&document, false);
 
@@ -1585,7 +1677,7 @@ void display_text_window(const char *font_path, int font_size, const char *initi
                             }
                         } else {
                             // Save existing file
-                            if (save_file(document.filepath, editorText)) {
+                            if (save_file(document.filepath, &text_buffer)) {
                                 mark_document_modified(&document, false);
                             }
                         }
@@ -1594,21 +1686,21 @@ void display_text_window(const char *font_path, int font_size, const char *initi
                     // Undo/Redo
                     else if (key == SDLK_z && (mod & KMOD_GUI) && !(mod & KMOD_SHIFT)) {
                         // Undo
-                        if (perform_undo(&undo, &editorText, &cursorPos)) {
+                        if (perform_undo(&undo, &text_buffer, &cursorPos)) {
                             mark_document_modified(&document, true);
                             selectionStart = selectionEnd = -1;
-                            update_render_data(renderer, font, editorText, text_area_x, text_area_y,
-                                               maxTextWidth, &rd);
+                            update_render_data(renderer, font, &text_buffer, text_area_x,
+                                               text_area_y, maxTextWidth, &rd);
                             status_bar.needs_update = true;
                         }
                     } else if ((key == SDLK_z && (mod & KMOD_GUI) && (mod & KMOD_SHIFT)) ||
                                (key == SDLK_y && (mod & KMOD_GUI))) {
                         // Redo
-                        if (perform_redo(&undo, &editorText, &cursorPos)) {
+                        if (perform_redo(&undo, &text_buffer, &cursorPos)) {
                             mark_document_modified(&document, true);
                             selectionStart = selectionEnd = -1;
-                            update_render_data(renderer, font, editorText, text_area_x, text_area_y,
-                                               maxTextWidth, &rd);
+                            update_render_data(renderer, font, &text_buffer, text_area_x,
+                                               text_area_y, maxTextWidth, &rd);
                             status_bar.needs_update = true;
                         }
                     }
@@ -1637,7 +1729,7 @@ void display_text_window(const char *font_path, int font_size, const char *initi
                         int line_numbers_width = get_line_numbers_width(&line_numbers);
                         maxTextWidth = windowWidth - (2 * margin) - line_numbers_width;
                         text_area_x = line_numbers_width + margin;
-                        update_render_data(renderer, font, editorText, text_area_x, text_area_y,
+                        update_render_data(renderer, font, &text_buffer, text_area_x, text_area_y,
                                            maxTextWidth, &rd);
                         status_bar.needs_update = true;
                     }
@@ -1651,7 +1743,7 @@ void display_text_window(const char *font_path, int font_size, const char *initi
                     else if (key == SDLK_a && (mod & KMOD_GUI) && (mod & KMOD_SHIFT)) {
                         char *save_as_filename = get_file_dialog(true);
                         if (save_as_filename) {
-                            if (save_file(save_as_filename, editorText)) {
+                            if (save_file(save_as_filename, &text_buffer)) {
                                 set_document_filename(&document, save_as_filename);
                                 mark_document_modified(&document, false);
 
@@ -1682,40 +1774,27 @@ void display_text_window(const char *font_path, int font_size, const char *initi
                             int endIdx =
                                 selectionStart < selectionEnd ? selectionEnd : selectionStart;
 
-                            if (startIdx < rd.numClusters && endIdx < rd.numClusters) {
-                                int startByte = get_cluster_byte_offset(&rd, editorText, startIdx);
-                                int endByte = get_cluster_byte_offset(&rd, editorText, endIdx + 1);
-                                if (startByte < 0)
-                                    startByte = 0;
-                                if (endByte < 0)
-                                    endByte = strlen(editorText);
-
-                                int selectionLen = endByte - startByte;
-                                char *selectedText = malloc(selectionLen + 1);
+                            int startByte, endByte;
+                            if (startIdx < rd.numClusters && endIdx < rd.numClusters &&
+                                selection_byte_range(&text_buffer, selectionStart, selectionEnd,
+                                                     &rd, &startByte, &endByte)) {
+                                char *selectedText =
+                                    piece_table_slice(&text_buffer, startByte, endByte - startByte);
                                 if (selectedText) {
-                                    memcpy(selectedText, editorText + startByte, selectionLen);
-                                    selectedText[selectionLen] = '\0';
-
                                     record_delete_action(&undo, startByte, selectedText, cursorPos,
                                                          startByte);
                                     SDL_SetClipboardText(selectedText);
 
                                     // Delete selection
                                     int new_cursor = delete_selection_lazy(
-                                        &editorText, selectionStart, selectionEnd, &rd);
+                                        &text_buffer, selectionStart, selectionEnd, &rd);
                                     if (new_cursor >= 0) {
                                         cursorPos = new_cursor;
-                                        // Invalidate cached blocks beginning at deletion start
-                                        if (rd.lazy_mode) {
-                                            int startIdx = selectionStart < selectionEnd
-                                                               ? selectionStart
-                                                               : selectionEnd;
-                                            invalidate_cluster_blocks_after(&rd, startIdx);
-                                        }
                                         selectionStart = selectionEnd = -1;
                                         mark_document_modified(&document, true);
-                                        update_render_data(renderer, font, editorText, text_area_x,
-                                                           text_area_y, maxTextWidth, &rd);
+                                        update_render_data(renderer, font, &text_buffer,
+                                                           text_area_x, text_area_y, maxTextWidth,
+                                                           &rd);
                                     }
 
                                     free(selectedText);
@@ -1728,46 +1807,37 @@ void display_text_window(const char *font_path, int font_size, const char *initi
                     else if (key == SDLK_LEFT) {
                         if (mod & KMOD_GUI) {
                             // Move to beginning of line
-                            cursorPos = move_cursor_line_start(editorText, cursorPos);
+                            cursorPos = move_cursor_line_start(&text_buffer, cursorPos);
                         } else if (mod & KMOD_ALT) {
                             // Move to previous word
-                            cursorPos = move_cursor_word_left(editorText, cursorPos);
+                            cursorPos = move_cursor_word_left(&text_buffer, cursorPos);
                         } else {
                             // Move one character left
-                            if (cursorPos > 0) {
-                                int pos = cursorPos - 1;
-                                while (pos > 0 &&
-                                       ((unsigned char) editorText[pos] & 0xC0) == 0x80) {
-                                    pos--;
-                                }
-                                cursorPos = pos;
-                            }
+                            cursorPos = move_cursor_cluster_left(&text_buffer, cursorPos);
                         }
                         selectionStart = selectionEnd = -1;
                         status_bar.needs_update = true;
                     } else if (key == SDLK_RIGHT) {
-                        int curLen = strlen(editorText);
                         if (mod & KMOD_GUI) {
                             // Move to end of line
-                            cursorPos = move_cursor_line_end(editorText, cursorPos);
+                            cursorPos = move_cursor_line_end(&text_buffer, cursorPos);
                         } else if (mod & KMOD_ALT) {
                             // Move to next word
-                            cursorPos = move_cursor_word_right(editorText, cursorPos);
+                            cursorPos = move_cursor_word_right(&text_buffer, cursorPos);
                         } else {
                             // Move one character right
-                            if (cursorPos < curLen) {
-                                int pos = cursorPos + 1;
-                                while (pos < curLen &&
-                                       ((unsigned char) editorText[pos] & 0xC0) == 0x80) {
-                                    pos++;
-                                }
-                                cursorPos = pos;
-                            }
+                            cursorPos = move_cursor_cluster_right(&text_buffer, cursorPos);
                         }
                         selectionStart = selectionEnd = -1;
                         status_bar.needs_update = true;
+                    } else if (key == SDLK_UP || key == SDLK_DOWN) {
+                        // Step through visual lines, so wrapped lines are visited
+                        cursorPos = move_cursor_visual_lines(&rd, &text_buffer, cursorPos,
+                                                             key == SDLK_UP ? -1 : 1);
+                        selectionStart = selectionEnd = -1;
+                        status_bar.needs_update = true;
                     } else if (key == SDLK_HOME) {
-                        cursorPos = move_cursor_line_start(editorText, cursorPos);
+                        cursorPos = move_cursor_line_start(&text_buffer, cursorPos);
                         selectionStart = selectionEnd = -1;
                         status_bar.needs_update = true;
                     } else if (key == SDLK_PAGEUP) {
@@ -1775,8 +1845,10 @@ void display_text_window(const char *font_path, int font_size, const char *initi
                         rd.scrollY -= text_area_height;
                         if (rd.scrollY < 0)
                             rd.scrollY = 0;
-                        if (rd.lazy_mode)
-                            prepare_visible_texture(renderer, font, editorText, text_area_x,
+                        if (use_continuous_resize)
+                            atomic_store(&g_render_context.scroll_y, rd.scrollY);
+                        else if (rd.lazy_mode)
+                            prepare_visible_texture(renderer, font, &text_buffer, text_area_x,
                                                     text_area_y, maxTextWidth, &rd, rd.scrollY,
                                                     text_area_height);
                         status_bar.needs_update = true;
@@ -1785,13 +1857,15 @@ void display_text_window(const char *font_path, int font_size, const char *initi
                         rd.scrollY += text_area_height;
                         if (rd.textH > 0 && rd.scrollY > rd.textH - text_area_height)
                             rd.scrollY = rd.textH - text_area_height;
-                        if (rd.lazy_mode)
-                            prepare_visible_texture(renderer, font, editorText, text_area_x,
+                        if (use_continuous_resize)
+                            atomic_store(&g_render_context.scroll_y, rd.scrollY);
+                        else if (rd.lazy_mode)
+                            prepare_visible_texture(renderer, font, &text_buffer, text_area_x,
                                                     text_area_y, maxTextWidth, &rd, rd.scrollY,
                                                     text_area_height);
                         status_bar.needs_update = true;
                     } else if (key == SDLK_END) {
-                        cursorPos = move_cursor_line_end(editorText, cursorPos);
+                        cursorPos = move_cursor_line_end(&text_buffer, cursorPos);
                         selectionStart = selectionEnd = -1;
                         status_bar.needs_update = true;
                     } else if (key == SDLK_BACKSPACE) {
@@ -1803,77 +1877,48 @@ void display_text_window(const char *font_path, int font_size, const char *initi
                             int endIdx =
                                 selectionStart < selectionEnd ? selectionEnd : selectionStart;
 
-                            int startByte = get_cluster_byte_offset(&rd, editorText, startIdx);
-                            int endByte = get_cluster_byte_offset(&rd, editorText, endIdx + 1);
-                            if (startByte < 0)
-                                startByte = 0;
-                            if (endByte < 0)
-                                endByte = strlen(editorText);
-
-                            char *deleted_text = malloc(endByte - startByte + 1);
-                            if (deleted_text) {
-                                memcpy(deleted_text, editorText + startByte, endByte - startByte);
-                                deleted_text[endByte - startByte] = '\0';
-                                record_delete_action(&undo, startByte, deleted_text, cursorPos,
-                                                     startByte);
-                                free(deleted_text);
+                            int startByte, endByte;
+                            if (selection_byte_range(&text_buffer, startIdx, endIdx, &rd,
+                                                     &startByte, &endByte)) {
+                                char *deleted_text = piece_table_slice(&text_buffer, startByte,
+                                                                       endByte - startByte);
+                                if (deleted_text) {
+                                    record_delete_action(&undo, startByte, deleted_text,
+                                                         cursorPos, startByte);
+                                    free(deleted_text);
+                                }
                             }
 
-                            int new_cursor = delete_selection_lazy(&editorText, selectionStart,
+                            int new_cursor = delete_selection_lazy(&text_buffer, selectionStart,
                                                                    selectionEnd, &rd);
                             if (new_cursor >= 0) {
                                 cursorPos = new_cursor;
-                                if (rd.lazy_mode) {
-                                    int startIdx = selectionStart < selectionEnd ? selectionStart
-                                                                                 : selectionEnd;
-                                    invalidate_cluster_blocks_after(&rd, startIdx);
-                                }
                                 selectionStart = selectionEnd = -1;
                             }
                         } else if (cursorPos > 0) {
                             // Regular backspace
                             int prevPos = cursorPos - 1;
                             while (prevPos > 0 &&
-                                   ((unsigned char) editorText[prevPos] & 0xC0) == 0x80) {
+                                   ((unsigned char) piece_table_byte_at(&text_buffer, prevPos) &
+                                    0xC0) == 0x80) {
                                 prevPos--;
                             }
                             int rem = cursorPos - prevPos;
                             if (rem > 0) {
-                                char *deleted_text = malloc(rem + 1);
+                                char *deleted_text = piece_table_slice(&text_buffer, prevPos, rem);
                                 if (deleted_text) {
-                                    memcpy(deleted_text, editorText + prevPos, rem);
-                                    deleted_text[rem] = '\0';
                                     record_delete_action(&undo, prevPos, deleted_text, cursorPos,
                                                          prevPos);
                                     free(deleted_text);
                                 }
 
-                                // Compute cluster index at prevPos before modifying text
-                                int cluster_before = -1;
-                                if (rd.lazy_mode) {
-                                    cluster_before =
-                                        get_cluster_index_at_cursor(editorText, prevPos, &rd);
-                                }
-
-                                int curLen = (int) strlen(editorText);
-                                char *newText = malloc(curLen - rem + 1);
-                                if (!newText)
+                                if (!piece_table_delete(&text_buffer, prevPos, rem))
                                     continue;
-                                if (prevPos > 0) {
-                                    memcpy(newText, editorText, prevPos);
-                                }
-                                memcpy(newText + prevPos, editorText + cursorPos,
-                                       curLen - cursorPos + 1);
-                                free(editorText);
-                                editorText = newText;
                                 cursorPos = prevPos;
-                                if (rd.lazy_mode && cluster_before >= 0) {
-                                    invalidate_cluster_blocks_after(&rd, cluster_before);
-                                }
                             }
                         }
                         mark_document_modified(&document, true);
-                        update_render_data(renderer, font, editorText, text_area_x, text_area_y,
+                        update_render_data(renderer, font, &text_buffer, text_area_x, text_area_y,
                                            maxTextWidth, &rd);
                         status_bar.needs_update = true;
                     } else if (key == SDLK_RETURN || key == SDLK_KP_ENTER) {
@@ -1883,7 +1928,7 @@ void display_text_window(const char *font_path, int font_size, const char *initi
                         // Delete selection if any
                         if (selectionStart >= 0 && selectionEnd >= 0 &&
                             selectionStart != selectionEnd) {
-                            int new_cursor = delete_selection_lazy(&editorText, selectionStart,
+                            int new_cursor = delete_selection_lazy(&text_buffer, selectionStart,
                                                                    selectionEnd, &rd);
                             if (new_cursor >= 0) {
                                 cursorPos = new_cursor;
@@ -1892,21 +1937,12 @@ void display_text_window(const char *font_path, int font_size, const char *initi
                         }
 
                         // Insert newline
-                        int curLen = (int) strlen(editorText);
-                        char *newText =
-                            malloc(curLen + 2); // +1 for newline, +1 for null terminator
-                        if (newText) {
-                            memcpy(newText, editorText, cursorPos);
-                            newText[cursorPos] = '\n';
-                            memcpy(newText + cursorPos + 1, editorText + cursorPos,
-                                   curLen - cursorPos + 1);
-                            free(editorText);
-                            editorText = newText;
+                        if (piece_table_insert(&text_buffer, cursorPos, "\n", 1)) {
                             cursorPos += 1;
 
                             mark_document_modified(&document, true);
-                            update_render_data(renderer, font, editorText, text_area_x, text_area_y,
-                                               maxTextWidth, &rd);
+                            update_render_data(renderer, font, &text_buffer, text_area_x,
+                                               text_area_y, maxTextWidth, &rd);
                             status_bar.needs_update = true;
                         }
                     } else if (key == SDLK_ESCAPE) {
@@ -1924,19 +1960,13 @@ void display_text_window(const char *font_path, int font_size, const char *initi
                             int endIdx =
                                 selectionStart < selectionEnd ? selectionEnd : selectionStart;
 
-                            if (startIdx < rd.numClusters && endIdx < rd.numClusters) {
-                                int startByte = get_cluster_byte_offset(&rd, editorText, startIdx);
-                                int endByte = get_cluster_byte_offset(&rd, editorText, endIdx + 1);
-                                if (startByte < 0)
-                                    startByte = 0;
-                                if (endByte < 0)
-                                    endByte = strlen(editorText);
-
-                                int selectionLen = endByte - startByte;
-                                char *selectedText = malloc(selectionLen + 1);
+                            int startByte, endByte;
+                            if (startIdx < rd.numClusters && endIdx < rd.numClusters &&
+                                selection_byte_range(&text_buffer, selectionStart, selectionEnd,
+                                                     &rd, &startByte, &endByte)) {
+                                char *selectedText =
+                                    piece_table_slice(&text_buffer, startByte, endByte - startByte);
                                 if (selectedText) {
-                                    memcpy(selectedText, editorText + startByte, selectionLen);
-                                    selectedText[selectionLen] = '\0';
                                     SDL_SetClipboardText(selectedText);
                                     free(selectedText);
                                 }
@@ -1953,7 +1983,7 @@ void display_text_window(const char *font_path, int font_size, const char *initi
                             // Delete selection if any
                             if (selectionStart >= 0 && selectionEnd >= 0 &&
                                 selectionStart != selectionEnd) {
-                                int new_cursor = delete_selection_lazy(&editorText, selectionStart,
+                                int new_cursor = delete_selection_lazy(&text_buffer, selectionStart,
                                                                        selectionEnd, &rd);
                                 if (new_cursor >= 0) {
                                     cursorPos = new_cursor;
@@ -1962,18 +1992,11 @@ void display_text_window(const char *font_path, int font_size, const char *initi
                             }
 
                             int pasteLen = (int) strlen(clipboard_text);
-                            int curLen = (int) strlen(editorText);
-                            char *newText = malloc(curLen + pasteLen + 1);
-                            if (newText) {
-                                memcpy(newText, editorText, cursorPos);
-                                memcpy(newText + cursorPos, clipboard_text, pasteLen);
-                                memcpy(newText + cursorPos + pasteLen, editorText + cursorPos,
-                                       curLen - cursorPos + 1);
-                                free(editorText);
-                                editorText = newText;
+                            if (piece_table_insert(&text_buffer, cursorPos, clipboard_text,
+                                                   pasteLen)) {
                                 cursorPos += pasteLen;
                                 mark_document_modified(&document, true);
-                                update_render_data(renderer, font, editorText, text_area_x,
+                                update_render_data(renderer, font, &text_buffer, text_area_x,
                                                    text_area_y, maxTextWidth, &rd);
                             }
                             SDL_free(clipboard_text);
@@ -1987,110 +2010,69 @@ void display_text_window(const char *font_path, int font_size, const char *initi
                         SDL_PointInRect(&(SDL_Point){event.button.x, event.button.y},
                                         &rd.textRect)) {
                         int relativeX = event.button.x - rd.textRect.x;
-                        int nearestCluster = 0;
-                        int minDist = INT_MAX;
-                        if (rd.numClusters > 0) {
-                            for (int i = 0; i < rd.numClusters; i++) {
-                                int clusterX = 0;
-                                bool havePos = false;
-                                if (rd.glyphOffsets && i < rd.numGlyphs) {
-                                    clusterX = rd.glyphOffsets[i];
-                                    havePos = true;
-                                } else if (rd.clusterRects) {
-                                    clusterX = rd.clusterRects[i].x;
-                                    havePos = true;
-                                }
-                                if (!havePos)
-                                    continue;
-                                int dist = abs(clusterX - relativeX);
-                                if (dist < minDist) {
-                                    minDist = dist;
-                                    nearestCluster = i;
-                                }
-                            }
-                            selectionStart = nearestCluster;
-                            if (nearestCluster < rd.numClusters) {
-                                int off = get_cluster_byte_offset(&rd, editorText, nearestCluster);
-                                if (off >= 0)
-                                    cursorPos = off;
-                            }
-                            mouseSelecting = 1;
-                        }
+                        int relativeY = event.button.y - rd.textRect.y + rd.scrollY;
+                        int cluster = 0;
+                        cursorPos =
+                            hit_test_text(&rd, &text_buffer, relativeX, relativeY, &cluster);
+                        selectionStart = cluster;
+                        selectionEnd = cluster;
+                        mouseSelecting = 1;
                         status_bar.needs_update = true;
                     }
                 } else if (event.type == SDL_MOUSEMOTION && mouseSelecting) {
                     if (event.motion.y < text_area_height) {
                         int relativeX = event.motion.x - rd.textRect.x;
-                        int nearestCluster = 0;
-                        int minDist = INT_MAX;
-                        for (int i = 0; i < rd.numClusters; i++) {
-                            int clusterX = 0;
-                            bool havePos = false;
-                            if (rd.glyphOffsets && i < rd.numGlyphs) {
-                                clusterX = rd.glyphOffsets[i];
-                                havePos = true;
-                            } else if (rd.clusterRects) {
-                                clusterX = rd.clusterRects[i].x;
-                                havePos = true;
-                            }
-                            if (!havePos)
-                                continue;
-                            int dist = abs(clusterX - relativeX);
-                            if (dist < minDist) {
-                                minDist = dist;
-                                nearestCluster = i;
-                            }
-                        }
-                        selectionEnd = nearestCluster;
-                        {
-                            int off = get_cluster_byte_offset(&rd, editorText, nearestCluster);
-                            if (off >= 0)
-                                cursorPos = off;
-                        }
+                        int relativeY = event.motion.y - rd.textRect.y + rd.scrollY;
+                        int cluster = 0;
+                        cursorPos =
+                            hit_test_text(&rd, &text_buffer, relativeX, relativeY, &cluster);
+                        selectionEnd = cluster;
                         status_bar.needs_update = true;
                     }
                 } else if (event.type == SDL_MOUSEBUTTONUP &&
                            event.button.button == SDL_BUTTON_LEFT) {
                     mouseSelecting = 0;
                     if (selectionStart >= 0) {
-                        selectionEnd = get_cluster_index_at_cursor(editorText, cursorPos, &rd);
+                        selectionEnd = get_cluster_index_at_cursor(&text_buffer, cursorPos, &rd);
                     }
                 }
             } // End event poll
 
+            // Hand the render thread the edited document
+            if (use_continuous_resize)
+                publish_document_snapshot(&g_snapshots, &text_buffer);
+
             // Regular mode rendering (when not using continuous resize)
             // Check for auto-save
             if (should_auto_save(&auto_save, document.is_modified)) {
-                perform_auto_save(&auto_save, &document, editorText);
+                perform_auto_save(&auto_save, &document, &text_buffer);
             }
 
-            // Update content hash for change detection
-            if (lastText) {
-                uint32_t content_hash = 0;
-                for (const char *p = editorText; *p; p++) {
-                    content_hash = ((content_hash << 5) + content_hash) + *p;
-                }
-                if (content_hash != state.last_content_hash || windowWidth != state.last_width) {
-                    state.needs_update = true;
-                    state.last_content_hash = content_hash;
-                    state.last_width = windowWidth;
-                }
+            // Detect content or width changes
+            uint64_t version = piece_table_version(&text_buffer);
+            if (version != state.last_version || windowWidth != state.last_width) {
+                state.needs_update = true;
+                state.last_version = version;
+                state.last_width = windowWidth;
             }
 
             if (state.needs_update) {
-                update_render_data(renderer, font, editorText, text_area_x, text_area_y,
+                update_render_data(renderer, font, &text_buffer, text_area_x, text_area_y,
                                    maxTextWidth, &rd);
                 state.needs_update = false;
             }
 
-            // If in lazy mode, prepare an on-demand viewport texture
-            if (rd.lazy_mode) {
-                prepare_visible_texture(renderer, font, editorText, text_area_x, text_area_y,
-                                        maxTextWidth, &rd, rd.scrollY, text_area_height);
-            }
+            // Take the matches a background search found since the last frame
+            if (collect_search_results(&search))
+                status_bar.needs_update = true;
+
+            // The render thread is the only one drawing in continuous resize mode
+            if (use_continuous_resize)
+                continue;
 
             // Update status bar
-            update_status_bar(&status_bar, renderer, &document, &search, cursorPos, editorText,
+            bool status_changed = status_bar.needs_update;
+            update_status_bar(&status_bar, renderer, &document, &search, cursorPos, &text_buffer,
                               windowWidth);
 
             // Update line numbers
@@ -2098,24 +2080,13 @@ void display_text_window(const char *font_path, int font_size, const char *initi
             int line_numbers_area_height =
                 windowHeight - status_bar.height; // Full height minus status bar
             int visible_lines = line_numbers_area_height / font_height;
-            update_line_numbers(&line_numbers, renderer, editorText, 1, visible_lines);
+            bool gutter_changed = line_numbers.needs_update;
+            update_line_numbers(&line_numbers, renderer, &text_buffer, 1, visible_lines);
             line_numbers.rect.y = 0; // Line numbers go all the way to the top
 
-            // Render everything
-            SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
-            SDL_SetRenderDrawColor(renderer, 22, 24, 32, 255);
-            SDL_RenderClear(renderer);
-
             // Compute cursor line to keep it visible in regular mode
             int cursor_font_height = TTF_FontLineSkip(font);
-            int cursor_line = 0;
-            int line_start_pos = 0;
-            for (int i = 0; i < cursorPos && editorText[i]; i++) {
-                if (editorText[i] == '\n') {
-                    cursor_line++;
-                    line_start_pos = i + 1;
-                }
-            }
+            int cursor_line = get_visual_line_at(&rd, &text_buffer, (size_t) cursorPos);
 
             // Ensure scrollY is within valid bounds for regular mode as well
             if (rd.scrollY < 0)
@@ -2126,92 +2097,96 @@ void display_text_window(const char *font_path, int font_size, const char *initi
             // Leave scrollY controlled by user (mouse wheel, PageUp/PageDown, etc.)
             // Only ensure scrollY stays within bounds (clamping already done above).
 
-            // Render text using floating-point positioning for macOS-like precision
-            if (rd.textTexture && rd.textRect.w > 0 && rd.textRect.h > 0 && rd.textRect.x >= 0 &&
-                rd.textRect.y >= 0) {
-                SDL_Rect src = {0, rd.scrollY, rd.textRect.w, text_area_height};
-                SDL_FRect dst = {(float) rd.textRect.x, (float) rd.textRect.y,
-                                 (float) rd.textRect.w, (float) text_area_height};
-                SDL_RenderCopyF(renderer, rd.textTexture, &src, &dst);
-            }
-
-            // Render selection highlight
-            if (selectionStart >= 0 && selectionEnd >= 0 && selectionStart != selectionEnd) {
-                int startIdx = selectionStart < selectionEnd ? selectionStart : selectionEnd;
-                int endIdx = selectionStart < selectionEnd ? selectionEnd : selectionStart;
-                if (startIdx < rd.numClusters && endIdx < rd.numClusters) {
-                    SDL_Rect hl = {rd.textRect.x + rd.glyphOffsets[startIdx], rd.textRect.y,
-                                   rd.glyphOffsets[endIdx] - rd.glyphOffsets[startIdx] +
-                                       rd.clusterRects[endIdx].w,
-                                   rd.textRect.h};
-                    SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
-                    SDL_SetRenderDrawColor(renderer, 200, 200, 180, 128);
-                    SDL_RenderFillRect(renderer, &hl);
-                }
-            }
-
-            // Render search highlights
-            if (search.is_active && has_matches(&search)) {
-                SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
-                for (int i = 0; i < search.num_matches; i++) {
-                    int match_pos = search.match_positions[i];
-                    int cluster_idx = get_cluster_index_at_cursor(editorText, match_pos, &rd);
-
-                    if (cluster_idx < rd.numClusters) {
-                        SDL_Rect search_hl = {rd.textRect.x + rd.glyphOffsets[cluster_idx],
-                                              rd.textRect.y,
-                                              search.match_lengths[i] * 8, // Approximate width
-                                              rd.textRect.h};
-
-                        if (i == search.current_match) {
-                            SDL_SetRenderDrawColor(renderer, 255, 255, 0,
-                                                   100); // Yellow for current match
-                        } else {
-                            SDL_SetRenderDrawColor(renderer, 255, 200, 0,
-                                                   80); // Orange for other matches
-                        }
-                        SDL_RenderFillRect(renderer, &search_hl);
-                    }
-                }
-            }
-
-            // Render cursor (cursor_line and line_start_pos were computed earlier in this block)
-            // Calculate cursor position on the current line
-            int cursor_pos_in_line = cursorPos - line_start_pos;
-
-            // Get the width of text from line start to cursor
-            char temp_line[1024] = {0};
-            int copy_len = cursor_pos_in_line;
-            if (copy_len > 1023)
-                copy_len = 1023;
-            memcpy(temp_line, editorText + line_start_pos, copy_len);
-
-            int cursorX = rd.textRect.x;
-            if (strlen(temp_line) > 0) {
-                int text_width;
-                TTF_SizeUTF8(font, temp_line, &text_width, NULL);
-                cursorX += text_width;
-            }
+            // Cursor x from the prefix advances of its line
+            int cursorX =
+                rd.textRect.x + get_visual_line_x(&rd, font, &text_buffer, (size_t) cursorPos);
 
             int cursorY = rd.textRect.y + (cursor_line * cursor_font_height);
 
-            SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
-            SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
-            SDL_RenderDrawLine(renderer, cursorX, cursorY, cursorX, cursorY + cursor_font_height);
+            // Work out which parts of the window changed since the last frame
+            int gutter_width = get_line_numbers_width(&line_numbers);
+            FrameState now = {
+                .window_width = windowWidth,
+                .window_height = windowHeight,
+                .text_area_x = text_area_x,
+                .text_area_width = maxTextWidth,
+                .line_numbers = line_numbers.enabled,
+                .version = version,
+                .scroll_y = rd.scrollY,
+                .selection_start = selectionStart,
+                .selection_end = selectionEnd,
+                .search_active = search.is_active,
+                .search_matches = search.num_matches,
+                .search_current = search.current_match,
+                .cursor = {cursorX, cursorY, 1, cursor_font_height + 1},
+            };
+            SDL_Rect text_area = {gutter_width, 0, windowWidth - gutter_width, status_bar.rect.y};
+            SDL_Rect gutter = {0, 0, gutter_width, status_bar.rect.y};
+            damage_frame_changes(draw, &now, text_area, gutter);
+            if (gutter_changed)
+                damage_rect(&draw->damage, gutter);
+            if (status_changed)
+                damage_rect(&draw->damage, status_bar.rect);
+            if (raster_pool_ready(rd.raster_pool))
+                damage_rect(&draw->damage, text_area);
+
+            // Draw only the damaged parts; with nothing damaged there is no present
+            int damaged = begin_damage_frame(&draw->damage, renderer, windowWidth, windowHeight)
+                              ? draw->damage.count
+                              : 0;
+
+            // Selection rectangles of the visible lines
+            int selection_start_byte = 0, selection_end_byte = 0;
+            draw->selection.count = 0;
+            if (damaged && selection_byte_range(&text_buffer, selectionStart, selectionEnd, &rd,
+                                                &selection_start_byte, &selection_end_byte))
+                build_selection_geometry(&draw->selection, &rd, font, &text_buffer,
+                                         (size_t) selection_start_byte,
+                                         (size_t) selection_end_byte, text_area_x, text_area_y,
+                                         rd.scrollY, text_area_height);
+            if (damaged)
+                build_search_highlights(draw, &rd, font, &text_buffer, &search, text_area_x,
+                                        text_area_y, rd.scrollY, text_area_height);
+            for (int d = 0; d < damaged; d++) {
+                SDL_Rect *dirty = &draw->damage.rects[d];
+                SDL_RenderSetClipRect(renderer, dirty);
+
+                // Clear the damaged area
+                SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
+                SDL_SetRenderDrawColor(renderer, 22, 24, 32, 255);
+                SDL_RenderFillRect(renderer, dirty);
+
+                // Draw the visible lines from the glyph atlas
+                render_visible_text(renderer, font, &text_buffer, text_area_x, text_area_y,
+                                    maxTextWidth, &rd, rd.scrollY, text_area_height);
+
+                // Render selection highlight, one rectangle per selected visible line
+                SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+                SDL_SetRenderDrawColor(renderer, 200, 200, 180, 128);
+                draw_selection_geometry(renderer, &draw->selection);
 
-            // Render line numbers
-            line_numbers.rect.y = 0; // Line numbers go all the way to the top
-            render_line_numbers(&line_numbers, renderer);
+                // Render search highlights of the visible matches
+                SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+                SDL_SetRenderDrawColor(renderer, 255, 200, 0, 80); // Orange for other matches
+                draw_selection_geometry(renderer, &draw->search_matches);
+                SDL_SetRenderDrawColor(renderer, 255, 255, 0, 100); // Yellow for current match
+                draw_selection_geometry(renderer, &draw->search_current);
 
-            // Render status bar
-            render_status_bar(&status_bar, renderer);
+                // Render cursor
+                SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_BLEND);
+                SDL_SetRenderDrawColor(renderer, 255, 255, 255, 255);
+                SDL_RenderDrawLine(renderer, cursorX, cursorY, cursorX,
+                                   cursorY + cursor_font_height);
 
-            SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
-            SDL_RenderPresent(renderer);
+                // Render line numbers
+                render_line_numbers(&line_numbers, renderer);
 
-            uint32_t frame_time = SDL_GetTicks() - frame_start;
-            if (frame_time < 16) {
-                SDL_Delay(16 - frame_time);
+                // Render status bar
+                render_status_bar(&status_bar, renderer);
+            }
+            if (damaged) {
+                SDL_SetRenderDrawBlendMode(renderer, SDL_BLENDMODE_NONE);
+                end_damage_frame(&draw->damage, renderer);
             }
         } // End regular mode
     }     // End main loop
@@ -2231,6 +2206,8 @@ void display_text_window(const char *font_path, int font_size, const char *initi
 
         // Wait for render thread to finish
         pthread_join(g_render_thread, NULL);
+        cleanup_render_data(&render_rd);
+        TTF_CloseFont(render_font);
 
         // Cleanup event queue
         cleanup_event_queue(&g_event_queue);
@@ -2239,13 +2216,13 @@ void display_text_window(const char *font_path, int font_size, const char *initi
     }
 
     // Cleanup
-    if (lastText) {
-        free(lastText);
-    }
+    cleanup_selection_geometry(&draw->selection);
+    cleanup_selection_geometry(&draw->search_matches);
+    cleanup_selection_geometry(&draw->search_current);
+    cleanup_window_damage(&draw->damage);
+    cleanup_snapshot_manager(&g_snapshots);
     cleanup_render_data(&rd);
-    if (editorText) {
-        free(editorText);
-    }
+    cleanup_piece_table(&text_buffer);
     cleanup_document_state(&document);
     cleanup_undo_system(&undo);
     cleanup_search_state(&search);
@@ -0,0 +1,301 @@
+#include "search_job.h"
+#include "debug.h"
+#include <stdlib.h>
+
+#ifdef __EMSCRIPTEN__
+
+SearchJob *create_search_job(void)
+{
+    return NULL;
+}
+
+void destroy_search_job(SearchJob *job)
+{
+    (void) job;
+}
+
+bool search_job_start(SearchJob *job, const PieceTable *buffer, const char *term,
+                      bool case_sensitive, bool whole_word)
+{
+    (void) job;
+    (void) buffer;
+    (void) term;
+    (void) case_sensitive;
+    (void) whole_word;
+    return false;
+}
+
+void search_job_cancel(SearchJob *job)
+{
+    (void) job;
+}
+
+int search_job_collect(SearchJob *job, int *positions, int *lengths, int max, bool *finished)
+{
+    (void) job;
+    (void) positions;
+    (void) lengths;
+    (void) max;
+    *finished = true;
+    return 0;
+}
+
+#else
+
+#include "text_search.h"
+#include <SDL.h>
+#include <pthread.h>
+#include <string.h>
+
+typedef struct {
+    PieceTable snapshot; // frozen copy of the document
+    char *term;
+    bool case_sensitive;
+    bool whole_word;
+} SearchRequest;
+
+typedef struct {
+    int *positions;
+    int *lengths;
+    int count;
+    int capacity;
+} MatchList;
+
+struct SearchJob {
+    pthread_t thread;
+    Uint32 event_type;
+
+    pthread_mutex_t mutex;
+    pthread_cond_t cond; // signalled when a request arrives or the job stops
+    bool stopping;
+    uint64_t generation; // bumped by every start and cancel
+    // Next search for the worker
+    SearchRequest request;
+    bool has_request;
+    // Matches of the current generation not yet collected, from index taken on
+    MatchList found;
+    int taken;
+    bool finished; // the current generation has been searched to the end
+};
+
+static void free_request(SearchRequest *request)
+{
+    cleanup_piece_table(&request->snapshot);
+    free(request->term);
+    request->term = NULL;
+}
+
+static bool add_found(MatchList *list, int pos, int length)
+{
+    if (list->count == list->capacity) {
+        int capacity = list->capacity ? list->capacity * 2 : 256;
+        int *positions = realloc(list->positions, capacity * sizeof(int));
+        if (!positions)
+            return false;
+        list->positions = positions;
+        int *lengths = realloc(list->lengths, capacity * sizeof(int));
+        if (!lengths)
+            return false;
+        list->lengths = lengths;
+        list->capacity = capacity;
+    }
+    list->positions[list->count] = pos;
+    list->lengths[list->count] = length;
+    list->count++;
+    return true;
+}
+
+static void notify(SearchJob *job)
+{
+    if (!job->event_type)
+        return;
+    SDL_Event event = {0};
+    event.type = job->event_type;
+    SDL_PushEvent(&event);
+}
+
+// Hand a step's matches to the main thread. Returns false once the search
+// has been replaced or cancelled. Called with the mutex held.
+static bool publish(SearchJob *job, uint64_t generation, const MatchList *step)
+{
+    if (job->stopping || job->generation != generation)
+        return false;
+    bool was_empty = job->taken == job->found.count;
+    for (int i = 0; i < step->count; i++) {
+        if (!add_found(&job->found, step->positions[i], step->lengths[i])) {
+            debug_print(L"[SEARCH] Out of memory after %d matches\n", job->found.count);
+            return false;
+        }
+    }
+    if (was_empty && step->count > 0)
+        notify(job);
+    return true;
+}
+
+static void run_search(SearchJob *job, SearchRequest *request, uint64_t generation)
+{
+    PieceTable *snapshot = &request->snapshot;
+    const char *text = piece_table_text(snapshot);
+    size_t text_len = piece_table_length(snapshot);
+    if (!text)
+        return;
+    TextSearcher searcher;
+    init_text_searcher(&searcher, request->term, strlen(request->term), !request->case_sensitive);
+
+    // A match starting in a step lies within the step plus the longest match
+    size_t span = text_search_max_match(&searcher);
+    MatchList step = {0};
+    bool ok = true;
+    for (size_t start = 0; ok && start < text_len; start += SEARCH_JOB_CHUNK) {
+        size_t end = text_len - start > SEARCH_JOB_CHUNK ? start + SEARCH_JOB_CHUNK : text_len;
+        size_t reach = text_len - end > span ? end + span : text_len;
+        size_t at = start, length = 0;
+        step.count = 0;
+        while ((at = text_search_next(&searcher, text, reach, at, &length)) < end) {
+            size_t match = at++;
+            if (request->whole_word && !text_search_whole_word(text, text_len, match, length))
+                continue;
+            if (!(ok = add_found(&step, (int) match, (int) length)))
+                break;
+        }
+
+        pthread_mutex_lock(&job->mutex);
+        ok = publish(job, generation, &step) && ok;
+        pthread_mutex_unlock(&job->mutex);
+    }
+    free(step.positions);
+    free(step.lengths);
+}
+
+static void *worker_main(void *arg)
+{
+    SearchJob *job = arg;
+    pthread_mutex_lock(&job->mutex);
+    for (;;) {
+        while (!job->stopping && !job->has_request)
+            pthread_cond_wait(&job->cond, &job->mutex);
+        if (job->stopping)
+            break;
+        SearchRequest request = job->request;
+        uint64_t generation = job->generation;
+        job->has_request = false;
+        pthread_mutex_unlock(&job->mutex);
+
+        run_search(job, &request, generation);
+        free_request(&request);
+
+        pthread_mutex_lock(&job->mutex);
+        if (!job->stopping && job->generation == generation) {
+            job->finished = true;
+            notify(job);
+        }
+    }
+    pthread_mutex_unlock(&job->mutex);
+    return NULL;
+}
+
+SearchJob *create_search_job(void)
+{
+    SearchJob *job = calloc(1, sizeof(SearchJob));
+    if (!job)
+        return NULL;
+    pthread_mutex_init(&job->mutex, NULL);
+    pthread_cond_init(&job->cond, NULL);
+    Uint32 event_type = SDL_RegisterEvents(1);
+    job->event_type = event_type != (Uint32) -1 ? event_type : 0;
+    if (pthread_create(&job->thread, NULL, worker_main, job) != 0) {
+        debug_print(L"[SEARCH] Failed to start the search worker\n");
+        pthread_mutex_destroy(&job->mutex);
+        pthread_cond_destroy(&job->cond);
+        free(job);
+        return NULL;
+    }
+    return job;
+}
+
+void destroy_search_job(SearchJob *job)
+{
+    if (!job)
+        return;
+    pthread_mutex_lock(&job->mutex);
+    job->stopping = true;
+    pthread_cond_broadcast(&job->cond);
+    pthread_mutex_unlock(&job->mutex);
+    pthread_join(job->thread, NULL);
+    if (job->has_request)
+        free_request(&job->request);
+    free(job->found.positions);
+    free(job->found.lengths);
+    pthread_mutex_destroy(&job->mutex);
+    pthread_cond_destroy(&job->cond);
+    free(job);
+}
+
+// Forget the current search. Called with the mutex held.
+static void reset(SearchJob *job)
+{
+    job->generation++;
+    if (job->has_request)
+        free_request(&job->request);
+    job->has_request = false;
+    job->found.count = 0;
+    job->taken = 0;
+    job->finished = false;
+}
+
+bool search_job_start(SearchJob *job, const PieceTable *buffer, const char *term,
+                      bool case_sensitive, bool whole_word)
+{
+    if (!job || !buffer || !term)
+        return false;
+    SearchRequest request = {.case_sensitive = case_sensitive, .whole_word = whole_word};
+    request.term = strdup(term);
+    if (!request.term)
+        return false;
+    if (!piece_table_snapshot(buffer, &request.snapshot)) {
+        free(request.term);
+        return false;
+    }
+
+    pthread_mutex_lock(&job->mutex);
+    reset(job);
+    job->request = request;
+    job->has_request = true;
+    pthread_cond_signal(&job->cond);
+    pthread_mutex_unlock(&job->mutex);
+    return true;
+}
+
+void search_job_cancel(SearchJob *job)
+{
+    if (!job)
+        return;
+    pthread_mutex_lock(&job->mutex);
+    reset(job);
+    pthread_mutex_unlock(&job->mutex);
+}
+
+int search_job_collect(SearchJob *job, int *positions, int *lengths, int max, bool *finished)
+{
+    *finished = false;
+    if (!job || max <= 0)
+        return 0;
+    pthread_mutex_lock(&job->mutex);
+    int n = job->found.count - job->taken;
+    if (n > max)
+        n = max;
+    if (n > 0) {
+        memcpy(positions, job->found.positions + job->taken, n * sizeof(int));
+        memcpy(lengths, job->found.lengths + job->taken, n * sizeof(int));
+        job->taken += n;
+    }
+    if (job->taken == job->found.count) {
+        job->found.count = 0;
+        job->taken = 0;
+        *finished = job->finished;
+    }
+    pthread_mutex_unlock(&job->mutex);
+    return n;
+}
+
+#endif // __EMSCRIPTEN__
@@ -0,0 +1,36 @@
+#ifndef SEARCH_JOB_H
+#define SEARCH_JOB_H
+
+#include "piece_table.h"
+#include <stdbool.h>
+
+// A worker thread that searches a snapshot of the document, so a search over
+// a large file does not block input and drawing. The snapshot is flattened
+// and scanned on the worker in SEARCH_JOB_CHUNK byte steps; the matches of
+// each step are handed to the main thread as soon as it completes, and an SDL
+// event is pushed to wake an idle event loop. Starting a new search or
+// cancelling drops the current one at its next step, along with any matches
+// not yet collected. Builds without threads (the web build) have no job.
+
+#define SEARCH_JOB_CHUNK (1 << 20)
+
+typedef struct SearchJob SearchJob;
+
+// Start the worker. Returns NULL if it could not be started.
+SearchJob *create_search_job(void);
+// Stop the worker and free the current search
+void destroy_search_job(SearchJob *job);
+
+// Search a snapshot of buffer for term with the given options, replacing the
+// current search. Returns false if the search could not be started.
+bool search_job_start(SearchJob *job, const PieceTable *buffer, const char *term,
+                      bool case_sensitive, bool whole_word);
+// Abandon the current search and its uncollected matches
+void search_job_cancel(SearchJob *job);
+
+// Take up to max matches found since the last call, in document order;
+// returns how many. *finished is set once the search has completed and every
+// match has been taken.
+int search_job_collect(SearchJob *job, int *positions, int *lengths, int max, bool *finished);
+
+#endif // SEARCH_JOB_H
@@ -1,9 +1,12 @@
 #include "search_system.h"
 #include "debug.h"
-#include <ctype.h>
+#include "text_search.h"
 #include <stdlib.h>
 #include <string.h>
 
+// Bytes of the document read at once by the searches run on the main thread
+#define SEARCH_SCAN_CHUNK (1 << 20)
+
 void init_search_state(SearchState *search)
 {
     search->search_term = NULL;
@@ -11,19 +14,41 @@ void init_search_state(SearchState *search)
     search->match_positions = NULL;
     search->match_lengths = NULL;
     search->num_matches = 0;
+    search->match_capacity = 0;
     search->current_match = -1;
     search->case_sensitive = false;
     search->whole_word = false;
     search->is_active = false;
     search->replace_mode = false; // Initialize new field
+    search->searched_buffer = NULL;
+    search->searched_version = 0;
+    search->searched_case_sensitive = false;
+    search->searched_whole_word = false;
+    search->job = NULL;
+    search->searching = false;
+    pthread_mutex_init(&search->lock, NULL);
 }
 
 void cleanup_search_state(SearchState *search)
 {
     clear_search(search);
+    destroy_search_job(search->job);
+    search->job = NULL;
+    pthread_mutex_destroy(&search->lock);
 }
 
-void clear_search(SearchState *search)
+void lock_search_state(SearchState *search)
+{
+    pthread_mutex_lock(&search->lock);
+}
+
+void unlock_search_state(SearchState *search)
+{
+    pthread_mutex_unlock(&search->lock);
+}
+
+// Forget the term and its matches. Called with the lock held.
+static void reset_search(SearchState *search)
 {
     if (search->search_term) {
         free(search->search_term);
@@ -42,138 +67,406 @@ void clear_search(SearchState *search)
         search->match_lengths = NULL;
     }
     search->num_matches = 0;
+    search->match_capacity = 0;
     search->current_match = -1;
     search->is_active = false;
+    search->searched_buffer = NULL;
+    if (search->searching)
+        search_job_cancel(search->job);
+    search->searching = false;
 }
 
-static bool is_word_boundary(const char *text, int pos, int text_len)
+void clear_search(SearchState *search)
 {
-    if (pos <= 0 || pos >= text_len)
-        return true;
+    lock_search_state(search);
+    reset_search(search);
+    unlock_search_state(search);
+}
 
-    bool prev_is_word = isalnum(text[pos - 1]) || text[pos - 1] == '_';
-    bool curr_is_word = isalnum(text[pos]) || text[pos] == '_';
+// Append a match, growing the arrays geometrically
+static bool add_match(SearchState *search, int pos, int length)
+{
+    if (search->num_matches == search->match_capacity) {
+        int capacity = search->match_capacity ? search->match_capacity * 2 : 64;
+        int *positions = realloc(search->match_positions, capacity * sizeof(int));
+        if (!positions)
+            return false;
+        search->match_positions = positions;
+        int *lengths = realloc(search->match_lengths, capacity * sizeof(int));
+        if (!lengths)
+            return false;
+        search->match_lengths = lengths;
+        search->match_capacity = capacity;
+    }
+    search->match_positions[search->num_matches] = pos;
+    search->match_lengths[search->num_matches] = length;
+    search->num_matches++;
+    return true;
+}
 
-    return prev_is_word != curr_is_word;
+// Drop every match, keeping the search term
+static void drop_matches(SearchState *search)
+{
+    free(search->match_positions);
+    free(search->match_lengths);
+    search->match_positions = NULL;
+    search->match_lengths = NULL;
+    search->num_matches = 0;
+    search->match_capacity = 0;
+    search->current_match = -1;
 }
 
-static char *to_lowercase(const char *str)
+// Whether the match at text[pos, pos + length) passes the whole word option
+static bool match_allowed(const SearchState *search, const char *text, int text_len, int pos,
+                          int length)
 {
-    int len = strlen(str);
-    char *lower = malloc(len + 1);
-    if (!lower)
-        return NULL;
+    return !search->whole_word || text_search_whole_word(text, text_len, pos, length);
+}
 
-    for (int i = 0; i < len; i++) {
-        lower[i] = tolower(str[i]);
-    }
-    lower[len] = '\0';
-    return lower;
+static void remember_search(SearchState *search, PieceTable *buffer)
+{
+    search->searched_buffer = buffer;
+    search->searched_version = piece_table_version(buffer);
+    search->searched_case_sensitive = search->case_sensitive;
+    search->searched_whole_word = search->whole_word;
 }
 
-void perform_search(SearchState *search, const char *text, const char *search_term)
+// Whether the matches were found in this buffer with the current options
+static bool same_search(const SearchState *search, const PieceTable *buffer)
 {
-    clear_search(search);
+    return search->searched_buffer == buffer &&
+           search->searched_case_sensitive == search->case_sensitive &&
+           search->searched_whole_word == search->whole_word;
+}
 
-    if (!text || !search_term || strlen(search_term) == 0) {
-        return;
+// Add to found the matches starting in [first, last] that end at or after
+// min_end. The text they can reach is read as one slice, with a byte of
+// context on each side for the word boundary test.
+static bool find_in_range(const SearchState *search, const TextSearcher *searcher,
+                          const PieceTable *buffer, size_t first, size_t last, size_t min_end,
+                          SearchState *found)
+{
+    size_t doc_len = piece_table_length(buffer);
+    size_t span = text_search_max_match(searcher);
+    size_t end = last + span < doc_len ? last + span : doc_len;
+    size_t base = first > 0 ? first - 1 : 0;
+    size_t window_len = (end < doc_len ? end + 1 : doc_len) - base;
+    char *window = piece_table_slice(buffer, base, window_len);
+    if (!window)
+        return false;
+
+    size_t at = first - base, length = 0;
+    bool ok = true;
+    while ((at = text_search_next(searcher, window, window_len, at, &length)) !=
+           TEXT_SEARCH_NONE) {
+        size_t match = base + at++;
+        if (match > last)
+            break;
+        if (match + length < min_end ||
+            !match_allowed(search, window, (int) window_len, (int) (match - base), (int) length))
+            continue;
+        if (!(ok = add_match(found, (int) match, (int) length)))
+            break;
     }
+    free(window);
+    return ok;
+}
 
-    search->search_term = strdup(search_term);
-    search->is_active = true;
+// Find every match of search_term in the whole document, reading it
+// SEARCH_SCAN_CHUNK bytes at a time. Case is ignored inside the matcher, so
+// the text is never folded.
+static bool search_all(SearchState *search, PieceTable *buffer)
+{
+    search->num_matches = 0;
+    TextSearcher searcher;
+    init_text_searcher(&searcher, search->search_term, strlen(search->search_term),
+                       !search->case_sensitive);
+
+    // Every occurrence is kept, including overlapping ones
+    size_t doc_len = piece_table_length(buffer);
+    for (size_t first = 0; first < doc_len; first += SEARCH_SCAN_CHUNK) {
+        size_t last = doc_len - first > SEARCH_SCAN_CHUNK ? first + SEARCH_SCAN_CHUNK : doc_len;
+        if (!find_in_range(search, &searcher, buffer, first, last - 1, 0, search)) {
+            drop_matches(search);
+            return false;
+        }
+    }
+    return true;
+}
 
-    const char *haystack = text;
-    const char *needle = search_term;
-    char *haystack_lower = NULL;
-    char *needle_lower = NULL;
-
-    // Convert to lowercase if case insensitive
-    if (!search->case_sensitive) {
-        haystack_lower = to_lowercase(text);
-        needle_lower = to_lowercase(search_term);
-        if (!haystack_lower || !needle_lower) {
-            free(haystack_lower);
-            free(needle_lower);
+// Search the whole document, on the search job when it is large enough to
+// stall the event loop. Its matches then arrive through
+// collect_search_results.
+static void search_document(SearchState *search, PieceTable *buffer)
+{
+    search->num_matches = 0;
+    search->current_match = -1;
+    remember_search(search, buffer);
+    if (piece_table_length(buffer) >= SEARCH_BACKGROUND_MIN_BYTES) {
+        if (!search->job)
+            search->job = create_search_job();
+        if (search_job_start(search->job, buffer, search->search_term, search->case_sensitive,
+                             search->whole_word)) {
+            search->searching = true;
             return;
         }
-        haystack = haystack_lower;
-        needle = needle_lower;
     }
+    if (search->searching)
+        search_job_cancel(search->job);
+    search->searching = false;
+    if (search_all(search, buffer))
+        search->current_match = search->num_matches > 0 ? 0 : -1;
+}
 
-    int text_len = strlen(text);
-    int needle_len = strlen(search_term);
-
-    // Count matches first
-    int match_count = 0;
-    const char *pos = haystack;
-    while ((pos = strstr(pos, needle)) != NULL) {
-        int byte_pos = pos - haystack;
-
-        // Check word boundary if whole word option is enabled
-        if (search->whole_word) {
-            if (!is_word_boundary(text, byte_pos, text_len) ||
-                !is_word_boundary(text, byte_pos + needle_len, text_len)) {
-                pos++;
-                continue;
-            }
+// Keep the matches of the previous term where the extended term also
+// matches. Every match of the longer term starts with a match of the shorter
+// one, so the document itself is not scanned again; the matches ascend, so
+// the text after them is read forward a chunk at a time.
+static bool narrow_matches(SearchState *search, PieceTable *buffer)
+{
+    TextSearcher searcher;
+    init_text_searcher(&searcher, search->search_term, strlen(search->search_term),
+                       !search->case_sensitive);
+    size_t doc_len = piece_table_length(buffer);
+    size_t span = text_search_max_match(&searcher);
+    char *window = malloc(SEARCH_SCAN_CHUNK + span);
+    if (!window)
+        return false;
+
+    size_t base = 0, window_len = 0;
+    int kept = 0;
+    for (int i = 0; i < search->num_matches; i++) {
+        size_t pos = (size_t) search->match_positions[i];
+        if (i == 0 || (pos + span > base + window_len && base + window_len < doc_len)) {
+            base = pos;
+            window_len = piece_table_copy(buffer, base, SEARCH_SCAN_CHUNK + span, window);
+        }
+        size_t length = text_search_match_at(&searcher, window, window_len, pos - base);
+        if (length == 0)
+            continue;
+        search->match_positions[kept] = (int) pos;
+        search->match_lengths[kept] = (int) length;
+        kept++;
+    }
+    free(window);
+    search->num_matches = kept;
+    return true;
+}
+
+// Whether the matches for the current term can be narrowed to those of term
+static bool can_narrow(const SearchState *search, const PieceTable *buffer, const char *term)
+{
+    // The whole word test depends on where a match ends, so a longer term
+    // can match where the shorter one was rejected
+    if (!search->is_active || !search->search_term || search->whole_word ||
+        search->searching || !same_search(search, buffer))
+        return false;
+    size_t old_len = strlen(search->search_term);
+    if (strlen(term) <= old_len || strncmp(term, search->search_term, old_len) != 0)
+        return false;
+    // Folded terms compare whole characters; the old term must not end in the
+    // middle of one
+    return search->case_sensitive || ((unsigned char) term[old_len] & 0xC0) != 0x80;
+}
+
+// Bring the matches up to date after bytes [pos, pos + removed) of the
+// searched text became [pos, pos + inserted). Only matches whose text or
+// word boundaries touch the edit can change: they are dropped, the rest are
+// shifted, and the edited window is searched again.
+static bool patch_matches(SearchState *search, PieceTable *buffer, size_t pos, size_t removed,
+                          size_t inserted)
+{
+    TextSearcher searcher;
+    init_text_searcher(&searcher, search->search_term, strlen(search->search_term),
+                       !search->case_sensitive);
+
+    // Matches starting in [lo, pos + inserted] can touch the edit
+    size_t span = text_search_max_match(&searcher);
+    size_t lo = pos > span ? pos - span : 0;
+    SearchState found;
+    init_search_state(&found);
+    bool ok = find_in_range(search, &searcher, buffer, lo, pos + inserted, pos, &found);
+
+    // Merge the untouched matches, shifted past the edit, with the new ones
+    int capacity = search->num_matches + found.num_matches;
+    int *positions = ok ? malloc((capacity ? capacity : 1) * sizeof(int)) : NULL;
+    int *lengths = ok ? malloc((capacity ? capacity : 1) * sizeof(int)) : NULL;
+    if (!positions || !lengths) {
+        free(positions);
+        free(lengths);
+        cleanup_search_state(&found);
+        return false;
+    }
+    int count = 0, j = 0;
+    for (int i = 0; i < search->num_matches; i++) {
+        size_t match = (size_t) search->match_positions[i];
+        int match_len = search->match_lengths[i];
+        if (match > pos + removed)
+            match = match - removed + inserted;
+        else if (match + match_len >= pos)
+            continue;
+        while (j < found.num_matches && found.match_positions[j] < (int) match) {
+            positions[count] = found.match_positions[j];
+            lengths[count++] = found.match_lengths[j++];
         }
+        positions[count] = (int) match;
+        lengths[count++] = match_len;
+    }
+    for (; j < found.num_matches; j++) {
+        positions[count] = found.match_positions[j];
+        lengths[count++] = found.match_lengths[j];
+    }
+    cleanup_search_state(&found);
+
+    free(search->match_positions);
+    free(search->match_lengths);
+    search->match_positions = positions;
+    search->match_lengths = lengths;
+    search->num_matches = count;
+    search->match_capacity = capacity;
+    return true;
+}
 
-        match_count++;
-        pos++;
+// Index of the first match starting at or after pos, wrapping to the first
+static int match_from(const SearchState *search, int pos)
+{
+    if (search->num_matches == 0)
+        return -1;
+    int lo = 0, hi = search->num_matches;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (search->match_positions[mid] < pos)
+            lo = mid + 1;
+        else
+            hi = mid;
     }
+    return lo < search->num_matches ? lo : 0;
+}
 
-    if (match_count == 0) {
-        free(haystack_lower);
-        free(needle_lower);
-        return;
+// sync_search with the lock held
+static bool update_matches(SearchState *search, PieceTable *buffer)
+{
+    if (!search->is_active || !search->search_term || !buffer)
+        return false;
+    uint64_t version = piece_table_version(buffer);
+    if (same_search(search, buffer) && search->searched_version == version)
+        return false;
+
+    // A search still running on the job is restarted on the edited text
+    size_t pos, removed, inserted;
+    if (!search->searching && same_search(search, buffer) &&
+        piece_table_changes_since(buffer, search->searched_version, &pos, &removed, &inserted)) {
+        // Keep the current match, or move to the next one if it was edited
+        int current = has_matches(search) ? search->match_positions[search->current_match] : 0;
+        if ((size_t) current >= pos + removed)
+            current = (int) (current - removed + inserted);
+        else if ((size_t) current >= pos)
+            current = (int) (pos + inserted);
+        if (patch_matches(search, buffer, pos, removed, inserted)) {
+            search->current_match = match_from(search, current);
+            remember_search(search, buffer);
+            return true;
+        }
     }
 
-    // Allocate arrays for matches
-    search->match_positions = malloc(match_count * sizeof(int));
-    search->match_lengths = malloc(match_count * sizeof(int));
-    if (!search->match_positions || !search->match_lengths) {
-        free(haystack_lower);
-        free(needle_lower);
-        clear_search(search);
-        return;
+    search_document(search, buffer);
+    return true;
+}
+
+bool sync_search(SearchState *search, PieceTable *buffer)
+{
+    lock_search_state(search);
+    bool changed = update_matches(search, buffer);
+    unlock_search_state(search);
+    return changed;
+}
+
+bool collect_search_results(SearchState *search)
+{
+    if (!search->searching)
+        return false;
+    lock_search_state(search);
+
+    int positions[256], lengths[256];
+    int before = search->num_matches;
+    bool finished = false;
+    int n;
+    while ((n = search_job_collect(search->job, positions, lengths, 256, &finished)) > 0) {
+        for (int i = 0; i < n; i++) {
+            if (!add_match(search, positions[i], lengths[i])) {
+                // Keep what fits rather than showing nothing
+                search_job_cancel(search->job);
+                finished = true;
+                break;
+            }
+        }
+        if (finished)
+            break;
+    }
+    if (search->current_match < 0 && search->num_matches > 0)
+        search->current_match = 0;
+    if (finished) {
+        search->searching = false;
+        debug_print(L"Search found %d matches for '%s'\n", search->num_matches,
+                    search->search_term);
     }
+    bool changed = finished || search->num_matches != before;
+    unlock_search_state(search);
+    return changed;
+}
 
-    // Find all matches
-    int match_index = 0;
-    pos = haystack;
-    while ((pos = strstr(pos, needle)) != NULL && match_index < match_count) {
-        int byte_pos = pos - haystack;
-
-        // Check word boundary if whole word option is enabled
-        if (search->whole_word) {
-            if (!is_word_boundary(text, byte_pos, text_len) ||
-                !is_word_boundary(text, byte_pos + needle_len, text_len)) {
-                pos++;
-                continue;
+// perform_search with the lock held
+static void start_search(SearchState *search, PieceTable *buffer, const char *search_term)
+{
+    if (buffer && search_term && can_narrow(search, buffer, search_term)) {
+        // Extending the term while typing: catch up with any edits, then filter
+        char *term = strdup(search_term);
+        if (term) {
+            update_matches(search, buffer);
+            free(search->search_term);
+            search->search_term = term;
+            if (narrow_matches(search, buffer)) {
+                search->current_match = search->num_matches > 0 ? 0 : -1;
+                debug_print(L"Search narrowed to %d matches for '%s'\n", search->num_matches,
+                            search_term);
+                return;
             }
         }
+    }
+
+    reset_search(search);
 
-        search->match_positions[match_index] = byte_pos;
-        search->match_lengths[match_index] = needle_len;
-        match_index++;
-        pos++;
+    if (!buffer || !search_term || strlen(search_term) == 0) {
+        return;
     }
 
-    search->num_matches = match_index;
-    search->current_match = search->num_matches > 0 ? 0 : -1;
+    search->search_term = strdup(search_term);
+    if (!search->search_term)
+        return;
+    search->is_active = true;
 
-    free(haystack_lower);
-    free(needle_lower);
+    search_document(search, buffer);
+    if (search->searching)
+        return;
 
     debug_print(L"Search found %d matches for '%s'\n", search->num_matches, search_term);
 }
 
+void perform_search(SearchState *search, PieceTable *buffer, const char *search_term)
+{
+    lock_search_state(search);
+    start_search(search, buffer, search_term);
+    unlock_search_state(search);
+}
+
 void find_next(SearchState *search)
 {
     if (!has_matches(search))
         return;
 
+    lock_search_state(search);
     search->current_match = (search->current_match + 1) % search->num_matches;
+    unlock_search_state(search);
     debug_print(L"Moved to next match: %d/%d\n", search->current_match + 1, search->num_matches);
 }
 
@@ -182,7 +475,9 @@ void find_previous(SearchState *search)
     if (!has_matches(search))
         return;
 
+    lock_search_state(search);
     search->current_match = (search->current_match - 1 + search->num_matches) % search->num_matches;
+    unlock_search_state(search);
     debug_print(L"Moved to previous match: %d/%d\n", search->current_match + 1,
                 search->num_matches);
 }
@@ -203,12 +498,16 @@ int get_current_match_length(SearchState *search)
 
 void set_case_sensitive(SearchState *search, bool sensitive)
 {
+    lock_search_state(search);
     search->case_sensitive = sensitive;
+    unlock_search_state(search);
 }
 
 void set_whole_word(SearchState *search, bool whole_word)
 {
+    lock_search_state(search);
     search->whole_word = whole_word;
+    unlock_search_state(search);
 }
 
 bool has_matches(const SearchState *search)
@@ -216,84 +515,68 @@ bool has_matches(const SearchState *search)
     return search->num_matches > 0 && search->current_match >= 0;
 }
 
+int first_match_ending_after(const SearchState *search, int pos)
+{
+    // Matches are found left to right, so positions ascend
+    int lo = 0, hi = search->num_matches;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (search->match_positions[mid] < pos)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    // Matches starting just before pos may still reach past it
+    while (lo > 0 && search->match_positions[lo - 1] + search->match_lengths[lo - 1] > pos)
+        lo--;
+    return lo;
+}
+
 // Replace operations
 void set_replace_term(SearchState *search, const char *replace_term)
 {
+    lock_search_state(search);
     if (search->replace_term) {
         free(search->replace_term);
     }
     search->replace_term = strdup(replace_term);
+    unlock_search_state(search);
 }
 
-char *replace_current_match(SearchState *search, const char *text)
+bool replace_current_match(SearchState *search, PieceTable *buffer)
 {
-    if (!has_matches(search) || !search->replace_term) {
-        return strdup(text); // Return copy of original text
-    }
+    if (!has_matches(search) || !search->replace_term)
+        return false;
 
     int match_pos = search->match_positions[search->current_match];
     int match_len = search->match_lengths[search->current_match];
-    int text_len = strlen(text);
     int replace_len = strlen(search->replace_term);
 
-    // Calculate new text length
-    int new_len = text_len - match_len + replace_len;
-    char *new_text = malloc(new_len + 1);
-
-    // Copy text before match
-    strncpy(new_text, text, match_pos);
-
-    // Copy replacement text
-    strcpy(new_text + match_pos, search->replace_term);
-
-    // Copy text after match
-    strcpy(new_text + match_pos + replace_len, text + match_pos + match_len);
-
-    return new_text;
+    if (!piece_table_delete(buffer, match_pos, match_len))
+        return false;
+    return piece_table_insert(buffer, match_pos, search->replace_term, replace_len);
 }
 
-char *replace_all_matches(SearchState *search, const char *text)
+bool replace_all_matches(SearchState *search, PieceTable *buffer)
 {
-    if (!has_matches(search) || !search->replace_term) {
-        return strdup(text); // Return copy of original text
-    }
+    if (!has_matches(search) || !search->replace_term)
+        return false;
 
-    int text_len = strlen(text);
     int replace_len = strlen(search->replace_term);
-    int total_match_len = 0;
-
-    // Calculate total length of all matches
-    for (int i = 0; i < search->num_matches; i++) {
-        total_match_len += search->match_lengths[i];
-    }
-
-    // Calculate new text length
-    int new_len = text_len - total_match_len + (search->num_matches * replace_len);
-    char *new_text = malloc(new_len + 1);
 
-    int src_pos = 0;
-    int dst_pos = 0;
-
-    // Process each match in order
-    for (int i = 0; i < search->num_matches; i++) {
+    // Process matches back to front so earlier positions stay valid. Overlapping
+    // matches (e.g. "aa" in "aaa") are skipped once their text has been replaced.
+    int limit = (int) piece_table_length(buffer);
+    for (int i = search->num_matches - 1; i >= 0; i--) {
         int match_pos = search->match_positions[i];
         int match_len = search->match_lengths[i];
-
-        // Copy text before this match
-        int copy_len = match_pos - src_pos;
-        strncpy(new_text + dst_pos, text + src_pos, copy_len);
-        dst_pos += copy_len;
-
-        // Copy replacement text
-        strcpy(new_text + dst_pos, search->replace_term);
-        dst_pos += replace_len;
-
-        // Move source position past the match
-        src_pos = match_pos + match_len;
+        if (match_pos + match_len > limit)
+            continue;
+        limit = match_pos;
+        if (!piece_table_delete(buffer, match_pos, match_len) ||
+            !piece_table_insert(buffer, match_pos, search->replace_term, replace_len))
+            return false;
     }
 
-    // Copy remaining text after last match
-    strcpy(new_text + dst_pos, text + src_pos);
-
-    return new_text;
+    return true;
 }
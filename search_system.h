@@ -1,19 +1,40 @@
 #ifndef SEARCH_SYSTEM_H
 #define SEARCH_SYSTEM_H
 
+#include "piece_table.h"
+#include "search_job.h"
+#include <pthread.h>
 #include <stdbool.h>
 
+// Documents at least this long are searched on a background SearchJob
+#define SEARCH_BACKGROUND_MIN_BYTES (4 << 20)
+
 typedef struct {
     char *search_term;
     char *replace_term; // New field for replace functionality
     int *match_positions;
     int *match_lengths;
     int num_matches;
+    int match_capacity; // allocated length of the match arrays
     int current_match;
     bool case_sensitive;
     bool whole_word;
     bool is_active;
     bool replace_mode; // New field to track if in replace mode
+
+    // What the matches were found in, so edits and a longer term can update
+    // them without searching the whole document again
+    const PieceTable *searched_buffer;
+    uint64_t searched_version;
+    bool searched_case_sensitive;
+    bool searched_whole_word;
+
+    SearchJob *job; // created on the first background search
+    bool searching; // the job is still finding matches for search_term
+
+    // Only the main thread changes the state, holding lock while it does; the
+    // render thread holds it while reading the matches to draw them
+    pthread_mutex_t lock;
 } SearchState;
 
 // Initialize and cleanup
@@ -21,7 +42,17 @@ void init_search_state(SearchState *search);
 void cleanup_search_state(SearchState *search);
 
 // Search operations
-void perform_search(SearchState *search, const char *text, const char *search_term);
+// Extending the previous term only filters the previous matches. Large
+// documents are searched in the background: the call returns at once with
+// searching set, and the matches arrive through collect_search_results.
+void perform_search(SearchState *search, PieceTable *buffer, const char *search_term);
+// Update the matches after the buffer was edited, searching only around the
+// edits when the buffer's edit history allows. Returns true if they changed.
+bool sync_search(SearchState *search, PieceTable *buffer);
+// Append the matches the background search has found so far; clears
+// searching when it is done. Returns true if anything changed. Call it on the
+// main thread, which the job wakes when it has matches.
+bool collect_search_results(SearchState *search);
 void find_next(SearchState *search);
 void find_previous(SearchState *search);
 int get_current_match_position(SearchState *search);
@@ -29,16 +60,25 @@ int get_current_match_length(SearchState *search);
 
 // Replace operations
 void set_replace_term(SearchState *search, const char *replace_term);
-char *replace_current_match(SearchState *search, const char *text);
-char *replace_all_matches(SearchState *search, const char *text);
+// Replacements edit the buffer in place; call sync_search afterwards
+bool replace_current_match(SearchState *search, PieceTable *buffer);
+bool replace_all_matches(SearchState *search, PieceTable *buffer);
 
 // Search options
 void set_case_sensitive(SearchState *search, bool sensitive);
 void set_whole_word(SearchState *search, bool whole_word);
 
+// Hold the matches still while reading them from another thread than the
+// main one
+void lock_search_state(SearchState *search);
+void unlock_search_state(SearchState *search);
+
 // Utility
 bool has_matches(const SearchState *search);
 int get_match_count(const SearchState *search);
+// Index of the first match ending after byte offset pos (num_matches if
+// none); a binary search over the sorted match positions
+int first_match_ending_after(const SearchState *search, int pos);
 void clear_search(SearchState *search);
 
 #endif // SEARCH_SYSTEM_H
@@ -0,0 +1,90 @@
+#include "selection.h"
+#include <stdlib.h>
+
+void init_selection_geometry(SelectionGeometry *geometry)
+{
+    *geometry = (SelectionGeometry){0};
+}
+
+void cleanup_selection_geometry(SelectionGeometry *geometry)
+{
+    free(geometry->rects);
+    init_selection_geometry(geometry);
+}
+
+static bool add_rect(SelectionGeometry *geometry, SDL_Rect rect)
+{
+    if (geometry->count == geometry->capacity) {
+        int capacity = geometry->capacity ? geometry->capacity * 2 : 64;
+        SDL_Rect *rects = realloc(geometry->rects, capacity * sizeof(SDL_Rect));
+        if (!rects)
+            return false;
+        geometry->rects = rects;
+        geometry->capacity = capacity;
+    }
+    geometry->rects[geometry->count++] = rect;
+    return true;
+}
+
+bool add_selection_geometry(SelectionGeometry *geometry, RenderData *rd, TTF_Font *font,
+                            PieceTable *buffer, size_t start, size_t end, int x_offset,
+                            int y_offset, int viewportY, int viewportHeight)
+{
+    int line_h = font ? TTF_FontLineSkip(font) : 0;
+    if (start >= end || line_h <= 0 || viewportHeight <= 0)
+        return true;
+
+    // Selected lines that are also visible
+    int num_lines = get_visual_line_count(rd, buffer);
+    int first = get_visual_line_at(rd, buffer, start);
+    int last = get_visual_line_at(rd, buffer, end);
+    int top = viewportY > 0 ? viewportY / line_h : 0;
+    int bottom = (viewportY + viewportHeight - 1) / line_h;
+    if (first < top)
+        first = top;
+    if (last > bottom)
+        last = bottom;
+    if (last >= num_lines)
+        last = num_lines - 1;
+
+    int newline_width = 0;
+    for (int line = first; line <= last; line++) {
+        size_t line_start = get_visual_line_start(rd, buffer, line);
+        size_t line_end = get_visual_line_end(rd, buffer, line);
+        int x0 = start > line_start ? get_visual_line_x_in(rd, font, buffer, line, start) : 0;
+        int x1 = get_visual_line_x_in(rd, font, buffer, line, end < line_end ? end : line_end);
+
+        // A line ending in a break, rather than wrapping, shows the break as selected
+        if (end > line_end && line + 1 < num_lines &&
+            get_visual_line_start(rd, buffer, line + 1) > line_end) {
+            if (newline_width == 0)
+                newline_width = get_glyph_width(font, " ", 1);
+            x1 += newline_width;
+        }
+        if (x1 <= x0)
+            continue;
+        SDL_Rect rect = {x_offset + x0, y_offset + line * line_h - viewportY, x1 - x0, line_h};
+        if (!add_rect(geometry, rect))
+            return false;
+    }
+    return true;
+}
+
+bool build_selection_geometry(SelectionGeometry *geometry, RenderData *rd, TTF_Font *font,
+                              PieceTable *buffer, size_t start, size_t end, int x_offset,
+                              int y_offset, int viewportY, int viewportHeight)
+{
+    geometry->count = 0;
+    if (add_selection_geometry(geometry, rd, font, buffer, start, end, x_offset, y_offset,
+                               viewportY, viewportHeight))
+        return true;
+    geometry->count = 0;
+    return false;
+}
+
+int draw_selection_geometry(SDL_Renderer *renderer, const SelectionGeometry *geometry)
+{
+    if (geometry->count == 0)
+        return 0;
+    return SDL_RenderFillRects(renderer, geometry->rects, geometry->count);
+}
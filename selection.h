@@ -0,0 +1,44 @@
+#ifndef SELECTION_H
+#define SELECTION_H
+
+#include "piece_table.h"
+#include "platform_sdl.h"
+#include "text_renderer.h"
+#include <SDL.h>
+#include <SDL_ttf.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+// Geometry of the selection highlight. A selected byte range becomes one
+// rectangle per visual line it touches, measured with the same prefix
+// advances the cursor and hit tests use. Only the visual lines inside the
+// viewport are visited, so a selection spanning a huge file costs what is on
+// screen, and the rectangles are filled with a single draw call.
+
+typedef struct {
+    SDL_Rect *rects;
+    int count;
+    int capacity;
+} SelectionGeometry;
+
+void init_selection_geometry(SelectionGeometry *geometry);
+void cleanup_selection_geometry(SelectionGeometry *geometry);
+
+// Rectangles covering bytes [start, end) of buffer on the visual lines in
+// [viewportY, viewportY + viewportHeight) document pixels, for text drawn at
+// (x_offset, y_offset). A selected line break shows as a space-wide strip
+// after its line. Returns false if memory runs out (geometry is left empty).
+bool build_selection_geometry(SelectionGeometry *geometry, RenderData *rd, TTF_Font *font,
+                              PieceTable *buffer, size_t start, size_t end, int x_offset,
+                              int y_offset, int viewportY, int viewportHeight);
+// The same, adding to the rectangles already in geometry, so several ranges
+// (such as search matches) are drawn with one call. Returns false if memory
+// runs out, keeping the rectangles added before.
+bool add_selection_geometry(SelectionGeometry *geometry, RenderData *rd, TTF_Font *font,
+                            PieceTable *buffer, size_t start, size_t end, int x_offset,
+                            int y_offset, int viewportY, int viewportHeight);
+
+// Fill the rectangles with the renderer's draw color and blend mode
+int draw_selection_geometry(SDL_Renderer *renderer, const SelectionGeometry *geometry);
+
+#endif // SELECTION_H
@@ -28,23 +28,20 @@ void cleanup_status_bar(StatusBar *status)
     }
 }
 
-void get_line_column_from_position(const char *text, int pos, int *line, int *column)
+void get_line_column_from_position(const PieceTable *buffer, int pos, int *line, int *column)
 {
-    *line = 1;
-    *column = 1;
-
-    for (int i = 0; i < pos && text[i]; i++) {
-        if (text[i] == '\n') {
-            (*line)++;
-            *column = 1;
-        } else {
-            (*column)++;
-        }
-    }
+    size_t offset = pos > 0 ? (size_t) pos : 0;
+    if (offset > piece_table_length(buffer))
+        offset = piece_table_length(buffer);
+
+    // Both lookups go through the buffer's line index, O(log n)
+    size_t line_idx = piece_table_line_at(buffer, offset);
+    *line = (int) line_idx + 1;
+    *column = (int) (offset - piece_table_line_start(buffer, line_idx)) + 1;
 }
 
 void update_status_bar(StatusBar *status, SDL_Renderer *renderer, const DocumentState *doc,
-                       const SearchState *search, int cursor_pos, const char *text,
+                       const SearchState *search, int cursor_pos, const PieceTable *buffer,
                        int window_width)
 {
     // Update rect width for window resizing
@@ -61,14 +58,18 @@ void update_status_bar(StatusBar *status, SDL_Renderer *renderer, const Document
 
     // Get cursor line and column
     int line, column;
-    get_line_column_from_position(text, cursor_pos, &line, &column);
+    get_line_column_from_position(buffer, cursor_pos, &line, &column);
 
     // Build status text
     char status_text[512];
     const char *filename = doc->filename ? doc->filename : "Untitled";
     const char *modified = doc->is_modified ? "*" : "";
 
-    if (search->is_active && search->replace_mode && has_matches(search)) {
+    if (search->is_active && search->searching) {
+        snprintf(status_text, sizeof(status_text),
+                 "%s%s | Ln %d, Col %d | %s: searching\u2026 %d so far", filename, modified, line,
+                 column, search->replace_mode ? "Replace" : "Search", search->num_matches);
+    } else if (search->is_active && search->replace_mode && has_matches(search)) {
         snprintf(status_text, sizeof(status_text), "%s%s | Ln %d, Col %d | Replace: %d/%d matches",
                  filename, modified, line, column, search->current_match + 1, search->num_matches);
     } else if (search->is_active && search->replace_mode) {
@@ -89,7 +90,7 @@ void update_status_bar(StatusBar *status, SDL_Renderer *renderer, const Document
     SDL_Color text_color = {200, 200, 200, 255};
     SDL_Color bg_color = {40, 42, 50, 255};
 
-    SDL_Surface *text_surface = TTF_RenderText_Blended(status->font, status_text, text_color);
+    SDL_Surface *text_surface = TTF_RenderUTF8_Blended(status->font, status_text, text_color);
     if (!text_surface) {
         debug_print(L"Failed to create status bar text surface\n");
         return;
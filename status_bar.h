@@ -22,13 +22,13 @@ void cleanup_status_bar(StatusBar *status);
 
 // Update status bar content
 void update_status_bar(StatusBar *status, SDL_Renderer *renderer, const DocumentState *doc,
-                       const SearchState *search, int cursor_pos, const char *text,
+                       const SearchState *search, int cursor_pos, const PieceTable *buffer,
                        int window_width);
 
 // Render status bar
 void render_status_bar(StatusBar *status, SDL_Renderer *renderer);
 
 // Utility functions
-void get_line_column_from_position(const char *text, int pos, int *line, int *column);
+void get_line_column_from_position(const PieceTable *buffer, int pos, int *line, int *column);
 
 #endif // STATUS_BAR_H
@@ -0,0 +1,533 @@
+#include "text_layout.h"
+#include "debug.h"
+#include "grapheme.h"
+#include <stdlib.h>
+#include <string.h>
+
+TextLayout *create_text_layout(void)
+{
+    return calloc(1, sizeof(TextLayout));
+}
+
+static void free_paragraphs(TextLayout *layout, int first, int count)
+{
+    for (int i = first; i < first + count; i++) {
+        // The cluster and row arrays share the cluster_offsets allocation
+        free(layout->paragraphs[i].cluster_offsets);
+        layout->paragraphs[i].cluster_offsets = NULL;
+    }
+}
+
+void destroy_text_layout(TextLayout *layout)
+{
+    if (!layout)
+        return;
+    free_paragraphs(layout, 0, layout->num_paragraphs);
+    free(layout->paragraphs);
+    free(layout->scratch);
+    free(layout->row_scratch);
+    free(layout);
+}
+
+void text_layout_invalidate(TextLayout *layout)
+{
+    if (layout)
+        layout->synced = false;
+}
+
+int text_layout_paragraph_at(const TextLayout *layout, size_t pos)
+{
+    int lo = 0, hi = layout->num_paragraphs - 1;
+    if (hi < 0)
+        return 0;
+    // Last paragraph starting at or before pos
+    while (lo < hi) {
+        int mid = lo + (hi - lo + 1) / 2;
+        if (layout->paragraphs[mid].start <= pos)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return lo;
+}
+
+static bool ensure_paragraph_capacity(TextLayout *layout, int count)
+{
+    if (count <= layout->capacity)
+        return true;
+    int capacity = layout->capacity ? layout->capacity : 64;
+    while (capacity < count)
+        capacity *= 2;
+    LayoutParagraph *grown = realloc(layout->paragraphs, capacity * sizeof(LayoutParagraph));
+    if (!grown)
+        return false;
+    layout->paragraphs = grown;
+    layout->capacity = capacity;
+    return true;
+}
+
+static bool is_wrap_space(const char *text, int offset)
+{
+    return text[offset] == ' ' || text[offset] == '\t';
+}
+
+static bool push_row(TextLayout *layout, int *num_rows, int start, int width)
+{
+    if (2 * (*num_rows + 1) > layout->row_scratch_capacity) {
+        int capacity = layout->row_scratch_capacity ? layout->row_scratch_capacity * 2 : 64;
+        int *grown = realloc(layout->row_scratch, capacity * sizeof(int));
+        if (!grown)
+            return false;
+        layout->row_scratch = grown;
+        layout->row_scratch_capacity = capacity;
+    }
+    layout->row_scratch[2 * *num_rows] = start;
+    layout->row_scratch[2 * *num_rows + 1] = width;
+    (*num_rows)++;
+    return true;
+}
+
+// Word-wrap the measured clusters of para into layout->row_scratch as
+// (first cluster, width) pairs; returns the row count or -1
+static int wrap_paragraph(TextLayout *layout, const char *text, const LayoutParagraph *para)
+{
+    int num_rows = 0;
+    int row_start = 0, row_width = 0;
+    int break_at = -1, width_at_break = 0; // row may end before cluster break_at
+    for (int i = 0; i < para->num_clusters; i++) {
+        int w = para->cluster_widths[i];
+        bool space = is_wrap_space(text, para->cluster_offsets[i]);
+        // Whitespace hangs and zero-width clusters (the newline) never wrap
+        while (!space && w > 0 && layout->max_width > 0 && row_width + w > layout->max_width &&
+               i > row_start) {
+            if (break_at > row_start) {
+                // End the row after the last whitespace that fitted
+                if (!push_row(layout, &num_rows, row_start, width_at_break))
+                    return -1;
+                row_width -= width_at_break;
+                row_start = break_at;
+            } else {
+                // A word wider than the row is broken between clusters
+                if (!push_row(layout, &num_rows, row_start, row_width))
+                    return -1;
+                row_width = 0;
+                row_start = i;
+            }
+            break_at = -1;
+        }
+        row_width += w;
+        if (space) {
+            break_at = i + 1;
+            width_at_break = row_width;
+        }
+    }
+    if (!push_row(layout, &num_rows, row_start, row_width))
+        return -1;
+    return num_rows;
+}
+
+// Segment, measure and wrap paragraph line of buffer into para (first_row
+// and y are left alone)
+static bool layout_paragraph(TextLayout *layout, PieceTable *buffer, size_t line, size_t num_lines,
+                             LayoutParagraph *para)
+{
+    size_t start = piece_table_line_start(buffer, line);
+    size_t end = piece_table_line_end(buffer, line);
+    if (line + 1 < num_lines)
+        end++; // the '\n' belongs to the paragraph it ends
+    size_t len = end - start;
+
+    if (len + 1 > layout->scratch_capacity) {
+        char *grown = realloc(layout->scratch, len + 1);
+        if (!grown)
+            return false;
+        layout->scratch = grown;
+        layout->scratch_capacity = len + 1;
+    }
+    const char *text = layout->scratch;
+    len = piece_table_copy(buffer, start, len, layout->scratch);
+
+    // A '\n' always ends a cluster, so segmenting one paragraph at a time
+    // gives the same clusters as segmenting the whole document
+    int count = (int) grapheme_count(text, len);
+    int *arrays = malloc((3 * (size_t) count + 2) * sizeof(int));
+    if (!arrays)
+        return false;
+
+    para->start = start;
+    para->length = len;
+    para->num_clusters = count;
+    para->cluster_offsets = arrays;
+    para->cluster_widths = arrays + count;
+    size_t pos = 0;
+    uint32_t prev = 0;
+    for (int i = 0; i < count; i++) {
+        size_t next = grapheme_next_break(text, len, pos);
+        // Measured as drawn: without marks past the cap, kerned against the
+        // previous cluster
+        size_t visible = grapheme_visible_length(text + pos, next - pos);
+        para->cluster_offsets[i] = (int) pos;
+        para->cluster_widths[i] = font_metrics_measure(layout->metrics, text + pos, visible, &prev);
+        pos = next;
+    }
+
+    int rows = wrap_paragraph(layout, text, para);
+    int *grown = rows > 0 ? realloc(arrays, (3 * (size_t) count + 2 * rows) * sizeof(int)) : NULL;
+    if (!grown) {
+        free(arrays);
+        para->cluster_offsets = para->cluster_widths = NULL;
+        return false;
+    }
+    // One allocation: cluster offsets, widths and x, then row starts and widths
+    para->cluster_offsets = grown;
+    para->cluster_widths = grown + count;
+    para->cluster_x = grown + 2 * count;
+    para->row_starts = grown + 3 * count;
+    para->row_widths = grown + 3 * count + rows;
+    para->num_rows = rows;
+    para->width = 0;
+    for (int r = 0; r < rows; r++) {
+        para->row_starts[r] = layout->row_scratch[2 * r];
+        para->row_widths[r] = layout->row_scratch[2 * r + 1];
+        if (para->row_widths[r] > para->width)
+            para->width = para->row_widths[r];
+        int end = r + 1 < rows ? layout->row_scratch[2 * (r + 1)] : count;
+        int x = 0;
+        for (int i = para->row_starts[r]; i < end; i++) {
+            para->cluster_x[i] = x;
+            x += para->cluster_widths[i];
+        }
+    }
+    para->height = rows * layout->line_height;
+    layout->paragraphs_laid_out++;
+    return true;
+}
+
+static bool relayout_all(TextLayout *layout, PieceTable *buffer)
+{
+    free_paragraphs(layout, 0, layout->num_paragraphs);
+    layout->num_paragraphs = 0;
+    layout->num_clusters = 0;
+    layout->num_rows = 0;
+    layout->height = 0;
+
+    size_t num_lines = piece_table_line_count(buffer);
+    if (!ensure_paragraph_capacity(layout, (int) num_lines))
+        return false;
+    for (size_t line = 0; line < num_lines; line++) {
+        LayoutParagraph *para = &layout->paragraphs[line];
+        if (!layout_paragraph(layout, buffer, line, num_lines, para))
+            return false;
+        para->first_row = layout->num_rows;
+        para->first_cluster = layout->num_clusters;
+        para->y = layout->height;
+        layout->num_rows += para->num_rows;
+        layout->height += para->height;
+        layout->num_clusters += para->num_clusters;
+        layout->num_paragraphs++;
+    }
+    return true;
+}
+
+// Replace the paragraphs touched by bytes [pos, pos + removed), which now
+// read [pos, pos + inserted), and shift the ones after them
+static bool relayout_edit(TextLayout *layout, PieceTable *buffer, size_t pos, size_t removed,
+                          size_t inserted)
+{
+    int first = text_layout_paragraph_at(layout, pos);
+    int last = text_layout_paragraph_at(layout, pos + removed);
+    int old_count = last - first + 1;
+
+    // Paragraphs outside [first, last] keep their count, so the line count
+    // of the new text says how many paragraphs the edited range became
+    size_t num_lines = piece_table_line_count(buffer);
+    int new_count = (int) num_lines - (layout->num_paragraphs - old_count);
+    if (new_count < 1 || !ensure_paragraph_capacity(layout, (int) num_lines))
+        return false;
+
+    int old_height = 0, old_rows = 0, old_clusters = 0;
+    for (int i = first; i <= last; i++) {
+        old_height += layout->paragraphs[i].height;
+        old_rows += layout->paragraphs[i].num_rows;
+        old_clusters += layout->paragraphs[i].num_clusters;
+    }
+    layout->num_clusters -= old_clusters;
+    int y = layout->paragraphs[first].y;
+    int row = layout->paragraphs[first].first_row;
+    int cluster = layout->paragraphs[first].first_cluster;
+    free_paragraphs(layout, first, old_count);
+
+    int tail = layout->num_paragraphs - (last + 1);
+    memmove(&layout->paragraphs[first + new_count], &layout->paragraphs[last + 1],
+            (size_t) tail * sizeof(LayoutParagraph));
+    layout->num_paragraphs = (int) num_lines;
+
+    int new_height = 0, new_rows = 0, new_clusters = 0;
+    for (int i = first; i < first + new_count; i++) {
+        LayoutParagraph *para = &layout->paragraphs[i];
+        if (!layout_paragraph(layout, buffer, (size_t) i, num_lines, para)) {
+            // Leave no dangling arrays behind for the full relayout
+            for (int j = i; j < first + new_count; j++)
+                para[j - i].cluster_offsets = NULL;
+            return false;
+        }
+        para->first_row = row + new_rows;
+        para->first_cluster = cluster + new_clusters;
+        para->y = y + new_height;
+        new_rows += para->num_rows;
+        new_clusters += para->num_clusters;
+        new_height += para->height;
+        layout->num_clusters += para->num_clusters;
+    }
+
+    // The paragraphs after the edit only move
+    long long byte_delta = (long long) inserted - (long long) removed;
+    int y_delta = new_height - old_height;
+    int row_delta = new_rows - old_rows;
+    int cluster_delta = new_clusters - old_clusters;
+    for (int i = first + new_count; i < layout->num_paragraphs; i++) {
+        LayoutParagraph *para = &layout->paragraphs[i];
+        para->start = (size_t) ((long long) para->start + byte_delta);
+        para->first_row += row_delta;
+        para->first_cluster += cluster_delta;
+        para->y += y_delta;
+    }
+    layout->num_rows += row_delta;
+    layout->height += y_delta;
+    debug_print(L"[LAYOUT] Edit at %u: %d paragraph(s) replaced by %d\n", (unsigned) pos,
+                old_count, new_count);
+    return true;
+}
+
+bool text_layout_sync(TextLayout *layout, PieceTable *buffer, FontMetrics *metrics,
+                      int max_width)
+{
+    if (!layout || !buffer || !metrics)
+        return false;
+    TTF_Font *font = metrics->font;
+    int line_height = TTF_FontLineSkip(font);
+    uint64_t version = piece_table_version(buffer);
+
+    size_t pos, removed, inserted;
+    bool patched = false;
+    if (layout->synced && layout->font == font && layout->max_width == max_width &&
+        layout->line_height == line_height) {
+        // Going back to an older snapshot would only be undone by the next sync
+        if (version < layout->version)
+            return true;
+        if (piece_table_changes_since(buffer, layout->version, &pos, &removed, &inserted))
+            patched =
+                (!removed && !inserted) || relayout_edit(layout, buffer, pos, removed, inserted);
+    }
+
+    layout->metrics = metrics;
+    if (!patched) {
+        layout->font = font;
+        layout->max_width = max_width;
+        layout->line_height = line_height;
+        if (!relayout_all(layout, buffer)) {
+            debug_print(L"[LAYOUT] Out of memory laying out %u paragraphs\n",
+                        (unsigned) piece_table_line_count(buffer));
+            layout->synced = false;
+            return false;
+        }
+        debug_print(L"[LAYOUT] Laid out %d paragraphs\n", layout->num_paragraphs);
+    }
+
+    layout->version = version;
+    layout->synced = true;
+    return true;
+}
+
+int text_layout_paragraph_of_row(const TextLayout *layout, int row)
+{
+    int lo = 0, hi = layout->num_paragraphs - 1;
+    if (hi < 0)
+        return 0;
+    // Last paragraph whose first row is at or before row
+    while (lo < hi) {
+        int mid = lo + (hi - lo + 1) / 2;
+        if (layout->paragraphs[mid].first_row <= row)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return lo;
+}
+
+// Last index in sorted values[0, count) whose value is <= key (0 if none)
+static int last_at_or_before(const int *values, int count, int key)
+{
+    int lo = 0, hi = count - 1;
+    while (lo < hi) {
+        int mid = lo + (hi - lo + 1) / 2;
+        if (values[mid] <= key)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return lo;
+}
+
+// Cluster of para holding byte offset pos; num_clusters at the very end
+static int cluster_in_paragraph(const LayoutParagraph *para, size_t pos)
+{
+    if (para->num_clusters == 0 || pos >= para->start + para->length)
+        return para->num_clusters;
+    int local = pos > para->start ? (int) (pos - para->start) : 0;
+    return last_at_or_before(para->cluster_offsets, para->num_clusters, local);
+}
+
+// First cluster after row r of para, not counting a terminating newline
+static int row_end_cluster(const TextLayout *layout, const LayoutParagraph *para, int r)
+{
+    if (r + 1 < para->num_rows)
+        return para->row_starts[r + 1];
+    bool has_newline = para != &layout->paragraphs[layout->num_paragraphs - 1];
+    return has_newline && para->num_clusters > 0 ? para->num_clusters - 1 : para->num_clusters;
+}
+
+static size_t cluster_start(const LayoutParagraph *para, int cluster)
+{
+    if (cluster >= para->num_clusters)
+        return para->start + para->length;
+    return para->start + (size_t) para->cluster_offsets[cluster];
+}
+
+// Index of the paragraph holding document-wide cluster
+static int paragraph_of_cluster(const TextLayout *layout, int cluster)
+{
+    int lo = 0, hi = layout->num_paragraphs - 1;
+    while (lo < hi) {
+        int mid = lo + (hi - lo + 1) / 2;
+        if (layout->paragraphs[mid].first_cluster <= cluster)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return lo;
+}
+
+int text_layout_cluster_at(const TextLayout *layout, size_t pos)
+{
+    if (layout->num_paragraphs == 0)
+        return 0;
+    const LayoutParagraph *para = &layout->paragraphs[text_layout_paragraph_at(layout, pos)];
+    return para->first_cluster + cluster_in_paragraph(para, pos);
+}
+
+long long text_layout_cluster_start(const TextLayout *layout, int cluster)
+{
+    if (cluster < 0 || cluster > layout->num_clusters)
+        return -1;
+    if (layout->num_paragraphs == 0)
+        return 0;
+    const LayoutParagraph *para = &layout->paragraphs[paragraph_of_cluster(layout, cluster)];
+    return (long long) cluster_start(para, cluster - para->first_cluster);
+}
+
+// Row r of para clamped to its rows
+static int clamp_row(const LayoutParagraph *para, int r)
+{
+    if (r < 0)
+        return 0;
+    return r < para->num_rows ? r : para->num_rows - 1;
+}
+
+int text_layout_row_at(const TextLayout *layout, size_t pos)
+{
+    if (layout->num_paragraphs == 0)
+        return 0;
+    const LayoutParagraph *para = &layout->paragraphs[text_layout_paragraph_at(layout, pos)];
+    int cluster = cluster_in_paragraph(para, pos);
+    return para->first_row + last_at_or_before(para->row_starts, para->num_rows, cluster);
+}
+
+size_t text_layout_row_start(const TextLayout *layout, int row)
+{
+    if (layout->num_paragraphs == 0)
+        return 0;
+    const LayoutParagraph *para = &layout->paragraphs[text_layout_paragraph_of_row(layout, row)];
+    return cluster_start(para, para->row_starts[clamp_row(para, row - para->first_row)]);
+}
+
+size_t text_layout_row_end(const TextLayout *layout, int row)
+{
+    if (layout->num_paragraphs == 0)
+        return 0;
+    const LayoutParagraph *para = &layout->paragraphs[text_layout_paragraph_of_row(layout, row)];
+    int r = clamp_row(para, row - para->first_row);
+    return cluster_start(para, row_end_cluster(layout, para, r));
+}
+
+// x of cluster within row r of para; clusters past the row end at its width
+static int cluster_left(const LayoutParagraph *para, int r, int cluster)
+{
+    int next_row = r + 1 < para->num_rows ? para->row_starts[r + 1] : para->num_clusters;
+    return cluster < next_row ? para->cluster_x[cluster] : para->row_widths[r];
+}
+
+// Cluster boundary in row r of para nearest to x: binary search of the
+// row's prefix advances, then snap to the nearer edge of the cluster hit
+static int cluster_at_x(const TextLayout *layout, const LayoutParagraph *para, int r, int x)
+{
+    int first = para->row_starts[r];
+    int end = row_end_cluster(layout, para, r);
+    if (end <= first || x <= 0)
+        return first;
+    int c = first + last_at_or_before(para->cluster_x + first, end - first, x);
+    if (2 * (x - para->cluster_x[c]) >= para->cluster_widths[c])
+        c++;
+    // The end of a wrapped row is the start of the next one: stay on this row
+    if (c == end && r + 1 < para->num_rows)
+        c--;
+    return c;
+}
+
+int text_layout_x_at(const TextLayout *layout, size_t pos)
+{
+    if (layout->num_paragraphs == 0)
+        return 0;
+    const LayoutParagraph *para = &layout->paragraphs[text_layout_paragraph_at(layout, pos)];
+    int cluster = cluster_in_paragraph(para, pos);
+    int r = last_at_or_before(para->row_starts, para->num_rows, cluster);
+    return cluster_left(para, r, cluster);
+}
+
+int text_layout_x_in_row(const TextLayout *layout, int row, size_t pos)
+{
+    if (layout->num_paragraphs == 0)
+        return 0;
+    const LayoutParagraph *para = &layout->paragraphs[text_layout_paragraph_of_row(layout, row)];
+    int r = clamp_row(para, row - para->first_row);
+    int cluster = cluster_in_paragraph(para, pos);
+    if (pos < para->start || cluster < para->row_starts[r])
+        return 0;
+    return cluster_left(para, r, cluster);
+}
+
+size_t text_layout_pos_at_x(const TextLayout *layout, int row, int x)
+{
+    if (layout->num_paragraphs == 0)
+        return 0;
+    const LayoutParagraph *para = &layout->paragraphs[text_layout_paragraph_of_row(layout, row)];
+    int r = clamp_row(para, row - para->first_row);
+    return cluster_start(para, cluster_at_x(layout, para, r, x));
+}
+
+size_t text_layout_hit_test(const TextLayout *layout, int x, int y, int *cluster)
+{
+    if (cluster)
+        *cluster = 0;
+    if (layout->num_paragraphs == 0 || layout->line_height <= 0)
+        return 0;
+    // Rows share one height, so the row under y is a division away
+    int row = y > 0 ? y / layout->line_height : 0;
+    if (row >= layout->num_rows)
+        row = layout->num_rows - 1;
+    const LayoutParagraph *para = &layout->paragraphs[text_layout_paragraph_of_row(layout, row)];
+    int c = cluster_at_x(layout, para, clamp_row(para, row - para->first_row), x);
+    if (cluster)
+        *cluster = para->first_cluster + c;
+    return cluster_start(para, c);
+}
@@ -0,0 +1,122 @@
+#ifndef TEXT_LAYOUT_H
+#define TEXT_LAYOUT_H
+
+#include "font_metrics.h"
+#include "piece_table.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Paragraph-level layout. The document is split into paragraphs (the lines
+// of the piece table, each including its '\n') and every paragraph keeps its
+// own cluster segmentation, measurements and soft-wrapped rows.
+//
+// After an edit only the paragraphs the edit touched are segmented and
+// measured again; the paragraphs after them keep their layout and just have
+// their byte offsets, first row and y positions shifted. Measuring is what
+// dominates layout time, so the cost of a keystroke no longer grows with the
+// document. Widths come from a FontMetrics cache and match what the glyph
+// atlas draws: advances plus kerning, kerning included across clusters.
+//
+// Paragraphs wider than the wrap width are word-wrapped into rows (visual
+// lines): a row ends after the last space or tab that fits, or inside a word
+// that is wider than the whole row. Trailing whitespace may hang past the
+// wrap width. Rows are numbered across the document; row <-> byte offset
+// lookups binary search the paragraphs, then the rows of one paragraph, and
+// x lookups binary search the row's prefix advances.
+
+typedef struct {
+    size_t start;         // byte offset of the first byte
+    size_t length;        // bytes including the terminating '\n', if any
+    int y;                // top in document pixels
+    int height;           // rows * line height
+    int width;            // widest row in pixels
+    int first_row;        // document-wide index of the first row
+    int num_rows;         // soft-wrapped rows, at least one
+    int *row_starts;      // first cluster of each row
+    int *row_widths;      // width of each row in pixels
+    int first_cluster;    // document-wide index of the first cluster
+    int num_clusters;     // grapheme clusters, including the '\n'
+    int *cluster_offsets; // byte offset of each cluster from start
+    int *cluster_widths;  // measured width of each cluster
+    int *cluster_x;       // prefix advance: x of each cluster from its row start
+} LayoutParagraph;
+
+typedef struct {
+    LayoutParagraph *paragraphs;
+    int num_paragraphs;
+    int capacity;
+    int num_clusters; // sum over all paragraphs
+    int num_rows;     // sum over all paragraphs
+    int height;       // sum of paragraph heights
+
+    // What the paragraphs were laid out for. Snapshots carry the version and
+    // edit log of the buffer they were taken from, so the version alone says
+    // which text this is, whichever copy of the document is passed in.
+    uint64_t version;
+    FontMetrics *metrics;
+    TTF_Font *font;
+    int max_width; // wrap width; non-positive disables wrapping
+    int line_height;
+    bool synced;
+
+    char *scratch; // bytes of the paragraph being laid out
+    size_t scratch_capacity;
+    int *row_scratch; // row starts and widths while wrapping
+    int row_scratch_capacity;
+
+    uint64_t paragraphs_laid_out; // paragraphs measured since creation
+} TextLayout;
+
+TextLayout *create_text_layout(void);
+void destroy_text_layout(TextLayout *layout);
+
+// Bring the layout up to date with buffer, measuring with metrics and
+// wrapping at max_width. Edits found in the buffer's edit log re-lay out only
+// the paragraphs they touched; a different font or width, or lost history (a
+// reload), lays out everything. A buffer older than the laid-out version (a
+// snapshot still held by the render thread) leaves the layout as it is.
+// Returns false if memory runs out, leaving the layout unsynced.
+bool text_layout_sync(TextLayout *layout, PieceTable *buffer, FontMetrics *metrics,
+                      int max_width);
+
+// Forget everything so the next sync lays out from scratch
+void text_layout_invalidate(TextLayout *layout);
+
+// Index of the paragraph containing byte offset pos (the last one at the end)
+int text_layout_paragraph_at(const TextLayout *layout, size_t pos);
+
+// Index of the paragraph holding row (clamped to the document)
+int text_layout_paragraph_of_row(const TextLayout *layout, int row);
+
+// Document-wide index of the cluster holding byte offset pos, or
+// num_clusters at the end of the document
+int text_layout_cluster_at(const TextLayout *layout, size_t pos);
+// Byte offset where cluster starts: the document length for num_clusters,
+// -1 past it
+long long text_layout_cluster_start(const TextLayout *layout, int cluster);
+
+// Row containing byte offset pos. A position where a row wraps belongs to
+// the row it starts.
+int text_layout_row_at(const TextLayout *layout, size_t pos);
+
+// Byte range of row, clamped to the document: [start, end) excludes the '\n'
+size_t text_layout_row_start(const TextLayout *layout, int row);
+size_t text_layout_row_end(const TextLayout *layout, int row);
+
+// Distance in pixels from the start of its row to byte offset pos
+int text_layout_x_at(const TextLayout *layout, size_t pos);
+// Distance of pos from the start of row, clamped to the row: 0 before it and
+// the row's width after it (where it wraps, or at its '\n')
+int text_layout_x_in_row(const TextLayout *layout, int row, size_t pos);
+
+// Cluster boundary in row closest to x pixels from the row start
+size_t text_layout_pos_at_x(const TextLayout *layout, int row, int x);
+
+// Cluster boundary closest to the point (x, y), in pixels from the top left
+// of the document. Points above or below the text hit the first or last row.
+// *cluster (if not NULL) receives the document-wide index of the cluster
+// starting there (num_clusters at the very end).
+size_t text_layout_hit_test(const TextLayout *layout, int x, int y, int *cluster);
+
+#endif // TEXT_LAYOUT_H
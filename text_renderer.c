@@ -1,5 +1,7 @@
 #include "text_renderer.h"
 #include "debug.h"
+#include "grapheme.h"
+#include "utf8_simd.h"
 #include <SDL.h>
 #include <SDL_ttf.h>
 #ifndef __EMSCRIPTEN__
@@ -21,6 +23,7 @@ static char **backtrace_symbols(void *const *buffer, int size)
     return NULL;
 }
 #endif
+#include <limits.h>
 #include <math.h>
 #include <stdbool.h>
 #include <stdlib.h>
@@ -29,353 +32,733 @@ static char **backtrace_symbols(void *const *buffer, int size)
 #include <wchar.h>
 
 // Forward declarations for functions defined later in this file
-static int utf8_char_length(const char *s);
-int get_cluster_index_from_array(const char *text, int byte_cursor, const int *clusterByteIndices,
-                                 int numClusters);
-
-// Maximum number of combining marks allowed per base character.
-#define MAX_COMBINING_PER_CLUSTER 5
-// Lazy block size: number of clusters per block for cached cluster byte indices
-#define CLUSTER_BLOCK_SIZE 1024
-// Number of blocks to keep cached at once
-#define CLUSTER_CACHE_BLOCKS 8
-
-// Block cache entry
-typedef struct {
-    int block_index; // which block (0..)
-    int *offsets;    // array of size CLUSTER_BLOCK_SIZE for cluster byte offsets
-    bool valid;
-    uint64_t last_used; // LRU timestamp
-} ClusterBlock;
-
-typedef struct {
-    int block_size;
-    int num_blocks_cached;
-    ClusterBlock *blocks;   // array of size num_blocks_cached
-    uint64_t usage_counter; // monotonic counter for LRU
-} ClusterBlockCache;
-
-// Ensure rd has block cache storage allocated
-static void ensure_block_cache(RenderData *rd)
+static const TextLayout *current_layout(const RenderData *rd, const PieceTable *buffer);
+
+// Block cache geometry for RenderData that does not set its own
+static int default_cluster_block_size = CLUSTER_BLOCK_SIZE;
+static int default_cluster_cache_blocks = CLUSTER_CACHE_BLOCKS;
+
+void set_cluster_cache_defaults(int block_size, int num_blocks)
+{
+    default_cluster_block_size = block_size > 0 ? block_size : CLUSTER_BLOCK_SIZE;
+    default_cluster_cache_blocks = num_blocks > 0 ? num_blocks : CLUSTER_CACHE_BLOCKS;
+}
+
+// Ensure rd has block cache storage allocated with its current geometry
+static ClusterBlockCache *ensure_block_cache(RenderData *rd)
 {
     if (!rd)
-        return;
-    if (!rd->cluster_block_cache) {
-        ClusterBlockCache *cache = malloc(sizeof(ClusterBlockCache));
-        cache->block_size =
-            rd->cluster_block_size > 0 ? rd->cluster_block_size : CLUSTER_BLOCK_SIZE;
-        cache->num_blocks_cached =
-            rd->cluster_cache_blocks > 0 ? rd->cluster_cache_blocks : CLUSTER_CACHE_BLOCKS;
-        cache->blocks = calloc(cache->num_blocks_cached, sizeof(ClusterBlock));
-        cache->usage_counter = 1;
+        return NULL;
+    if (rd->cluster_block_size <= 0)
+        rd->cluster_block_size = default_cluster_block_size;
+    if (rd->cluster_cache_blocks <= 0)
+        rd->cluster_cache_blocks = default_cluster_cache_blocks;
+    ClusterBlockCache *cache = (ClusterBlockCache *) rd->cluster_block_cache;
+    if (!cache) {
+        cache = create_cluster_block_cache(rd->cluster_block_size, rd->cluster_cache_blocks);
         rd->cluster_block_cache = cache;
+    } else if (!cluster_cache_configure(cache, rd->cluster_block_size,
+                                        rd->cluster_cache_blocks)) {
+        // Keep running with the geometry that is still allocated
+        rd->cluster_block_size = cache->block_size;
+        rd->cluster_cache_blocks = cache->num_blocks_cached;
     }
+    return cache;
+}
+
+bool set_cluster_cache_size(RenderData *rd, int block_size, int num_blocks)
+{
+    if (!rd)
+        return false;
+    rd->cluster_block_size = block_size;
+    rd->cluster_cache_blocks = num_blocks;
+    if (!rd->cluster_block_cache)
+        return true;
+    ClusterBlockCache *cache = ensure_block_cache(rd);
+    return cache->block_size == rd->cluster_block_size &&
+           cache->num_blocks_cached == rd->cluster_cache_blocks;
+}
+
+ClusterCacheStats get_cluster_cache_stats(const RenderData *rd)
+{
+    ClusterCacheStats stats = {0};
+    if (rd && rd->cluster_block_cache)
+        stats = ((const ClusterBlockCache *) rd->cluster_block_cache)->stats;
+    return stats;
 }
 
-// Find existing block or allocate/evict one using LRU. Returns pointer to block.
-static ClusterBlock *get_or_create_block(ClusterBlockCache *cache, int block_idx, const char *text)
+// Bring the checkpoint table up to date with buffer, patching it from the edit
+// log when possible and rebuilding it otherwise
+static void sync_block_cache(RenderData *rd, PieceTable *buffer)
 {
+    ClusterBlockCache *cache = ensure_block_cache(rd);
     if (!cache)
+        return;
+    uint64_t version = piece_table_version(buffer);
+    // Going back to an older snapshot would only be undone by the next sync
+    if (cache->synced && version < rd->cluster_cache_version)
+        return;
+    size_t pos, removed, inserted;
+    if (cache->synced &&
+        piece_table_changes_since(buffer, rd->cluster_cache_version, &pos, &removed, &inserted)) {
+        if (removed || inserted)
+            cluster_cache_apply_edit(cache, buffer, pos, removed, inserted);
+    } else {
+        cluster_cache_reset(cache, buffer);
+    }
+    rd->cluster_cache_version = piece_table_version(buffer);
+}
+
+// The block cache, if it describes buffer's text. Snapshots carry the version
+// of the document they were taken from, so the version identifies the text
+// whether buffer is the live document or a snapshot of it. Between an edit
+// and the next update_render_data, which patches the cache from the edit log,
+// and for older snapshots, lookups scan the text they were given instead.
+static ClusterBlockCache *current_block_cache(const RenderData *rd, const PieceTable *buffer)
+{
+    ClusterBlockCache *cache = (ClusterBlockCache *) rd->cluster_block_cache;
+    if (!rd->lazy_mode || !cache || !cache->synced ||
+        piece_table_version(buffer) != rd->cluster_cache_version)
         return NULL;
-    // Search for existing block
-    for (int i = 0; i < cache->num_blocks_cached; i++) {
-        ClusterBlock *b = &cache->blocks[i];
-        if (b->valid && b->block_index == block_idx) {
-            b->last_used = ++cache->usage_counter;
-            return b;
-        }
+    return cache;
+}
+
+// Fetch byte offset for a clusterIndex. The paragraph layout answers with two
+// binary searches; in lazy mode the block containing it is computed on demand
+// and cached.
+int get_cluster_byte_offset(RenderData *rd, PieceTable *buffer, int clusterIndex)
+{
+    if (!rd || !buffer || clusterIndex < 0)
+        return -1;
+
+    const TextLayout *layout = current_layout(rd, buffer);
+    if (layout)
+        return (int) text_layout_cluster_start(layout, clusterIndex);
+
+    // In lazy mode, blocks are filled from the nearest checkpoint
+    ClusterBlockCache *cache = current_block_cache(rd, buffer);
+    if (cache)
+        return cluster_cache_byte_offset(cache, buffer, clusterIndex);
+
+    // Fallback: if no clusters known (shouldn't happen) seek from start
+    size_t len = piece_table_length(buffer);
+    size_t pos = codepoint_offset_in(buffer, 0, len, (size_t) clusterIndex);
+    if (pos < len || count_codepoints_in(buffer, 0, len) == (size_t) clusterIndex)
+        return (int) pos;
+    return -1;
+}
+
+// Text color; glyphs in the atlas are white and tinted per vertex
+static const SDL_Color text_color = {198, 194, 199, 255};
+
+// Bytes of a single line considered for drawing. Lines are not wrapped and
+// are clipped at the text area edge, so a longer tail is never visible.
+#define LINE_DRAW_LIMIT 65536
+
+// Drop atlas, quads and tiles (e.g. when drawing moves to another renderer)
+static void release_glyph_atlas(RenderData *rd)
+{
+    destroy_glyph_atlas(rd->glyph_atlas);
+    rd->glyph_atlas = NULL;
+    cleanup_glyph_batch(&rd->glyph_batch);
+    rd->glyph_batch_valid = false;
+    if (rd->tile_cache) {
+        debug_print(L"[TILES] %llu hits, %llu misses, %llu evictions\n",
+                    (unsigned long long) rd->tile_cache->stats.hits,
+                    (unsigned long long) rd->tile_cache->stats.misses,
+                    (unsigned long long) rd->tile_cache->stats.evictions);
+        destroy_tile_cache(rd->tile_cache);
+        rd->tile_cache = NULL;
+    }
+    rd->tiles_unsupported = false;
+    if (rd->line_cache) {
+        debug_print(L"[LINECACHE] %llu hits, %llu misses, %llu evictions\n",
+                    (unsigned long long) rd->line_cache->stats.hits,
+                    (unsigned long long) rd->line_cache->stats.misses,
+                    (unsigned long long) rd->line_cache->stats.evictions);
+        destroy_line_cache(rd->line_cache);
+        rd->line_cache = NULL;
     }
+}
 
-    // Find an unused slot first
-    int lru_index = -1;
-    uint64_t lru_value = (uint64_t) -1;
-    for (int i = 0; i < cache->num_blocks_cached; i++) {
-        ClusterBlock *b = &cache->blocks[i];
-        if (!b->valid) {
-            lru_index = i;
-            break;
-        }
-        if (b->last_used < lru_value) {
-            lru_value = b->last_used;
-            lru_index = i;
+static GlyphAtlas *ensure_glyph_atlas(RenderData *rd, SDL_Renderer *renderer)
+{
+    if (rd->glyph_atlas && rd->glyph_atlas->renderer != renderer)
+        release_glyph_atlas(rd);
+    if (!rd->glyph_atlas) {
+        rd->glyph_atlas = create_glyph_atlas(renderer);
+        if (rd->glyph_atlas)
+            rd->glyph_atlas->pool = rd->raster_pool;
+    }
+    // Without a line cache every line is laid out on each build
+    if (rd->glyph_atlas && !rd->line_cache)
+        rd->line_cache = create_line_cache(0);
+    return rd->glyph_atlas;
+}
+
+// Metrics cache for font, replaced when the font changes
+static FontMetrics *ensure_font_metrics(RenderData *rd, TTF_Font *font)
+{
+    if (rd->font_metrics && rd->font_metrics->font != font) {
+        destroy_font_metrics(rd->font_metrics);
+        rd->font_metrics = NULL;
+    }
+    if (!rd->font_metrics)
+        rd->font_metrics = create_font_metrics(font);
+    return rd->font_metrics;
+}
+
+// Queue the glyphs of one line, pen starting at (x, y). Marks past the
+// combining mark cap are skipped, and so is everything right of max_x.
+static void add_line_glyphs(GlyphBatch *batch, GlyphAtlas *atlas, FontMetrics *metrics,
+                            const char *text, size_t len, float x, float y, int max_x)
+{
+    int pen = 0;
+    uint32_t prev = 0;
+    size_t pos = 0;
+    while (pos < len && pen <= max_x) {
+        size_t next = grapheme_next_break(text, len, pos);
+        size_t visible = pos + grapheme_visible_length(text + pos, next - pos);
+        size_t i = pos;
+        while (i < visible) {
+            uint32_t cp;
+            i += grapheme_decode(text + i, visible - i, &cp);
+            if (cp == '\n' || cp == '\r')
+                continue;
+            pen += font_metrics_kerning(metrics, prev, cp);
+            const AtlasGlyph *glyph = glyph_atlas_get(atlas, metrics->font, cp);
+            if (!glyph)
+                continue;
+            glyph_batch_add(batch, atlas, glyph, x + (float) pen, y, text_color);
+            pen += glyph->advance;
+            prev = cp;
         }
+        pos = next;
     }
+}
 
-    if (lru_index < 0)
+// The paragraph layout, if it describes buffer as it is now. The live buffer
+// and its snapshots share versions, so either may be asked about.
+static const TextLayout *current_layout(const RenderData *rd, const PieceTable *buffer)
+{
+    const TextLayout *layout = rd->layout;
+    if (rd->lazy_mode || !layout || !layout->synced ||
+        layout->version != piece_table_version(buffer))
         return NULL;
-    ClusterBlock *dest = &cache->blocks[lru_index];
-    // Evict if necessary
-    if (dest->offsets) {
-        free(dest->offsets);
-        dest->offsets = NULL;
-    }
-    dest->offsets = NULL;
-    dest->block_index = block_idx;
-    dest->valid = true;
-    dest->last_used = ++cache->usage_counter;
-    return dest;
+    return layout;
 }
 
-// Fetch byte offset for a clusterIndex by computing which block it's in and
-// computing offsets within that block lazily. For simplicity implement a
-// straightforward on-demand scan from start-of-block to fill offsets.
-int get_cluster_byte_offset(RenderData *rd, const char *text, int clusterIndex)
+int get_visual_line_count(const RenderData *rd, const PieceTable *buffer)
 {
-    if (!rd || !text || clusterIndex < 0)
-        return -1;
+    const TextLayout *layout = current_layout(rd, buffer);
+    return layout ? layout->num_rows : (int) piece_table_line_count(buffer);
+}
 
-    // If the full clusterByteIndices array exists (legacy), use it directly
-    if (rd->clusterByteIndices) {
-        if (clusterIndex < rd->numClusters)
-            return rd->clusterByteIndices[clusterIndex];
-        return -1;
-    }
+int get_visual_line_at(const RenderData *rd, const PieceTable *buffer, size_t pos)
+{
+    const TextLayout *layout = current_layout(rd, buffer);
+    return layout ? text_layout_row_at(layout, pos) : (int) piece_table_line_at(buffer, pos);
+}
 
-    // If lazy-mode and a block cache exists, try to use it
-    if (rd->lazy_mode) {
-        ensure_block_cache(rd);
-        ClusterBlockCache *cache = (ClusterBlockCache *) rd->cluster_block_cache;
-        int bs = cache->block_size;
-        int block_idx = clusterIndex / bs;
-        int within = clusterIndex % bs;
-
-        // Find if block is cached
-        for (int i = 0; i < cache->num_blocks_cached; i++) {
-            ClusterBlock *b = &cache->blocks[i];
-            if (b->valid && b->block_index == block_idx) {
-                if (within < bs && b->offsets && b->offsets[within] >= 0)
-                    return b->offsets[within];
-                break;
-            }
-        }
+size_t get_visual_line_start(const RenderData *rd, const PieceTable *buffer, int line)
+{
+    const TextLayout *layout = current_layout(rd, buffer);
+    if (line < 0)
+        line = 0;
+    return layout ? text_layout_row_start(layout, line)
+                  : piece_table_line_start(buffer, (size_t) line);
+}
 
-        // Not cached: populate a block (evict oldest)
-        ClusterBlock *dest = get_or_create_block(cache, block_idx, text);
-        if (!dest)
-            return -1;
-        dest->offsets = malloc(bs * sizeof(int));
-        if (!dest->offsets)
-            return -1;
-        for (int k = 0; k < bs; k++)
-            dest->offsets[k] = -1;
-
-        // Scan forward from beginning of block to fill offsets
-        int target_start_cluster = block_idx * bs;
-        int pos = 0;
-        int cidx = 0;
-        // Fast-forward by scanning until target_start_cluster
-        while (text[pos] && cidx < target_start_cluster) {
-            pos += utf8_char_length(text + pos);
-            cidx++;
-        }
-        // Fill offsets for this block
-        for (int k = 0; k < bs; k++) {
-            if (!text[pos]) {
-                dest->offsets[k] = -1;
-            } else {
-                dest->offsets[k] = pos;
-                pos += utf8_char_length(text + pos);
-                cidx++;
+size_t get_visual_line_end(const RenderData *rd, const PieceTable *buffer, int line)
+{
+    const TextLayout *layout = current_layout(rd, buffer);
+    if (line < 0)
+        line = 0;
+    return layout ? text_layout_row_end(layout, line) : piece_table_line_end(buffer, (size_t) line);
+}
+
+int move_cursor_visual_lines(const RenderData *rd, const PieceTable *buffer, int cursor_pos,
+                             int lines)
+{
+    size_t pos = cursor_pos > 0 ? (size_t) cursor_pos : 0;
+    int line = get_visual_line_at(rd, buffer, pos);
+    int target = line + lines;
+    int count = get_visual_line_count(rd, buffer);
+    if (target < 0)
+        target = 0;
+    if (target >= count)
+        target = count - 1;
+    if (target == line)
+        return cursor_pos;
+
+    const TextLayout *layout = current_layout(rd, buffer);
+    if (layout)
+        return (int) text_layout_pos_at_x(layout, target, text_layout_x_at(layout, pos));
+
+    // Without a layout, keep the byte column
+    size_t column = pos - piece_table_line_start(buffer, (size_t) line);
+    size_t start = piece_table_line_start(buffer, (size_t) target);
+    size_t end = piece_table_line_end(buffer, (size_t) target);
+    return (int) (start + column < end ? start + column : end);
+}
+
+// Measure logical line into rd->line_x unless it already holds it. There is
+// one entry per cluster boundary, the last at the end of the drawn part.
+static bool measure_lazy_line(RenderData *rd, PieceTable *buffer, size_t line)
+{
+    FontMetrics *metrics = rd->font_metrics;
+    if (!metrics)
+        return false;
+    uint64_t version = piece_table_version(buffer);
+    size_t start = piece_table_line_start(buffer, line);
+    if (rd->line_x_count > 0 && rd->line_x_buffer == buffer && rd->line_x_version == version &&
+        rd->line_x_font == metrics->font && rd->line_x_start == start)
+        return true;
+
+    rd->line_x_count = 0;
+    size_t end = piece_table_line_end(buffer, line);
+    size_t len = end - start < LINE_DRAW_LIMIT ? end - start : LINE_DRAW_LIMIT;
+    char *text = len > 0 ? piece_table_slice(buffer, start, len) : NULL;
+    if (len > 0 && !text)
+        return false;
+
+    int count = 0, x = 0;
+    uint32_t prev = 0;
+    size_t i = 0;
+    for (;;) {
+        if (count == rd->line_x_capacity) {
+            int capacity = rd->line_x_capacity ? rd->line_x_capacity * 2 : 256;
+            int *offsets = realloc(rd->line_x_offsets, capacity * sizeof(int));
+            if (offsets)
+                rd->line_x_offsets = offsets;
+            int *xs = offsets ? realloc(rd->line_x, capacity * sizeof(int)) : NULL;
+            if (!xs) {
+                free(text);
+                return false;
             }
+            rd->line_x = xs;
+            rd->line_x_capacity = capacity;
         }
+        rd->line_x_offsets[count] = (int) i;
+        rd->line_x[count] = x;
+        count++;
+        if (i >= len)
+            break;
+        size_t next = grapheme_next_break(text, len, i);
+        size_t visible = grapheme_visible_length(text + i, next - i);
+        x += font_metrics_measure(metrics, text + i, visible, &prev);
+        i = next;
+    }
+    free(text);
+
+    rd->line_x_buffer = buffer;
+    rd->line_x_version = version;
+    rd->line_x_font = metrics->font;
+    rd->line_x_start = start;
+    rd->line_x_count = count;
+    return true;
+}
 
-        // Return requested offset if within block
-        if (within < bs) {
-            int off = dest->offsets[within];
-            if (off >= 0)
-                return off;
-        }
+// Last boundary of the measured line at or before offset bytes into it
+static int lazy_line_boundary(const RenderData *rd, size_t offset)
+{
+    int lo = 0, hi = rd->line_x_count - 1;
+    while (lo < hi) {
+        int mid = lo + (hi - lo + 1) / 2;
+        if ((size_t) rd->line_x_offsets[mid] <= offset)
+            lo = mid;
+        else
+            hi = mid - 1;
+    }
+    return lo;
+}
 
-        // As fallback, scan from block end until we reach clusterIndex
-        pos = dest->offsets[bs - 1] >= 0 ? dest->offsets[bs - 1] : pos;
-        int idx = block_idx * bs + bs - 1;
-        while (text[pos] && idx < clusterIndex) {
-            pos += utf8_char_length(text + pos);
-            idx++;
+int hit_test_text(RenderData *rd, PieceTable *buffer, int x, int y, int *cluster)
+{
+    const TextLayout *layout = current_layout(rd, buffer);
+    if (layout)
+        return (int) text_layout_hit_test(layout, x, y, cluster);
+
+    // Lazy mode: find the logical line, then search its prefix advances
+    int line_h = rd->lineHeight > 0 ? rd->lineHeight : 1;
+    size_t line = y > 0 ? (size_t) (y / line_h) : 0;
+    size_t pos = piece_table_line_start(buffer, line);
+    if (x > 0 && measure_lazy_line(rd, buffer, line)) {
+        // Last boundary left of x, or the next one if x is past the middle of its cluster
+        int lo = 0, hi = rd->line_x_count - 1;
+        while (lo < hi) {
+            int mid = lo + (hi - lo + 1) / 2;
+            if (rd->line_x[mid] <= x)
+                lo = mid;
+            else
+                hi = mid - 1;
         }
-        if (idx == clusterIndex)
-            return pos;
-        return -1;
-    }
+        if (lo + 1 < rd->line_x_count &&
+            2 * (x - rd->line_x[lo]) >= rd->line_x[lo + 1] - rd->line_x[lo])
+            lo++;
+        pos = rd->line_x_start + rd->line_x_offsets[lo];
+    }
+    if (cluster)
+        *cluster = get_cluster_index_at_cursor(buffer, (int) pos, rd);
+    return (int) pos;
+}
 
-    // Fallback: if no clusters known (shouldn't happen) scan from start
-    int pos = 0;
-    int idx = 0;
-    while (text[pos] && idx <= clusterIndex) {
-        if (idx == clusterIndex)
-            return pos;
-        int len = utf8_char_length(text + pos);
-        pos += len;
-        idx++;
-    }
-    if (idx == clusterIndex)
-        return pos;
-    return -1;
+int get_visual_line_x(RenderData *rd, TTF_Font *font, PieceTable *buffer, size_t pos)
+{
+    const TextLayout *layout = current_layout(rd, buffer);
+    if (layout)
+        return text_layout_x_at(layout, pos);
+    if (!font || !ensure_font_metrics(rd, font))
+        return 0;
+    size_t line = piece_table_line_at(buffer, pos);
+    if (!measure_lazy_line(rd, buffer, line))
+        return 0;
+    return rd->line_x[lazy_line_boundary(rd, pos - rd->line_x_start)];
 }
 
-// Invalidate cached blocks after a given cluster index (used after edits)
-static void invalidate_blocks_after(RenderData *rd, int clusterIndex)
+int get_visual_line_x_in(RenderData *rd, TTF_Font *font, PieceTable *buffer, int line, size_t pos)
 {
-    if (!rd || !rd->cluster_block_cache)
+    const TextLayout *layout = current_layout(rd, buffer);
+    if (layout)
+        return text_layout_x_in_row(layout, line, pos);
+    if (!font || !ensure_font_metrics(rd, font) || line < 0 ||
+        !measure_lazy_line(rd, buffer, (size_t) line) || pos <= rd->line_x_start)
+        return 0;
+    return rd->line_x[lazy_line_boundary(rd, pos - rd->line_x_start)];
+}
+
+static void build_visible_batch(TTF_Font *font, PieceTable *buffer, int x_offset, int y_offset,
+                                int maxWidth, RenderData *rd, int viewportY, int viewportHeight)
+{
+    GlyphBatch *batch = &rd->glyph_batch;
+    GlyphAtlas *atlas = rd->glyph_atlas;
+    FontMetrics *metrics = rd->font_metrics;
+    glyph_batch_clear(batch);
+
+    int line_h = TTF_FontLineSkip(font);
+    if (line_h <= 0)
         return;
-    ClusterBlockCache *cache = (ClusterBlockCache *) rd->cluster_block_cache;
-    int bs = cache->block_size;
-    int cutoff = clusterIndex / bs;
-    for (int i = 0; i < cache->num_blocks_cached; i++) {
-        ClusterBlock *b = &cache->blocks[i];
-        if (!b->valid)
+    // Visual lines: the soft-wrapped rows when the layout is current
+    int num_lines = get_visual_line_count(rd, buffer);
+    int first_line = viewportY > 0 ? viewportY / line_h : 0;
+    int last_line = (viewportY + viewportHeight) / line_h;
+
+    char *linebuf = NULL;
+    size_t linebuf_size = 0;
+    for (int line = first_line; line <= last_line && line < num_lines; line++) {
+        size_t start = get_visual_line_start(rd, buffer, line);
+        size_t len = get_visual_line_end(rd, buffer, line) - start;
+        if (len > LINE_DRAW_LIMIT)
+            len = LINE_DRAW_LIMIT;
+        if (len == 0)
+            continue;
+        if (len > linebuf_size) {
+            char *grown = realloc(linebuf, len);
+            if (!grown)
+                break;
+            linebuf = grown;
+            linebuf_size = len;
+        }
+        len = piece_table_copy(buffer, start, len, linebuf);
+        float y = (float) y_offset + (float) ((long long) line * line_h - viewportY);
+        if (!rd->line_cache) {
+            add_line_glyphs(batch, atlas, metrics, linebuf, len, (float) x_offset, y, maxWidth);
             continue;
-        if (b->block_index >= cutoff) {
-            free(b->offsets);
-            b->offsets = NULL;
-            b->valid = false;
         }
+
+        // Lines already laid out at this width are only translated into place
+        uint64_t hash = line_cache_hash(linebuf, len);
+        const GlyphBatch *quads = line_cache_find(rd->line_cache, hash, linebuf, len, maxWidth,
+                                                  font, atlas->generation);
+        if (!quads) {
+            uint32_t generation = atlas->generation;
+            GlyphBatch *fresh = line_cache_insert(rd->line_cache, hash, linebuf, len, maxWidth,
+                                                  font, generation);
+            if (!fresh) {
+                add_line_glyphs(batch, atlas, metrics, linebuf, len, (float) x_offset, y,
+                                maxWidth);
+                continue;
+            }
+            add_line_glyphs(fresh, atlas, metrics, linebuf, len, 0, 0, maxWidth);
+            quads = fresh;
+        }
+        glyph_batch_append(batch, quads, (float) x_offset, y);
     }
+    free(linebuf);
 }
 
-void invalidate_cluster_blocks_after(RenderData *rd, int clusterIndex)
+// Build the quads of the viewport into rd->glyph_batch. A full atlas is
+// cleared while glyphs are added, which leaves the quads built before that
+// pointing at stale texture areas: build once more.
+static void build_batch(TTF_Font *font, PieceTable *buffer, int x_offset, int y_offset,
+                        int maxWidth, RenderData *rd, int viewportY, int viewportHeight)
 {
-    invalidate_blocks_after(rd, clusterIndex);
+    GlyphAtlas *atlas = rd->glyph_atlas;
+    for (int attempt = 0; attempt < 2; attempt++) {
+        uint32_t generation = atlas->generation;
+        build_visible_batch(font, buffer, x_offset, y_offset, maxWidth, rd, viewportY,
+                            viewportHeight);
+        if (atlas->generation == generation)
+            break;
+    }
+    rd->glyph_batch_valid = false;
 }
 
-// Prepare a texture containing only the visible lines (lazy rendering). This
-// renders line-by-line into a surface then converts to a texture.
-int prepare_visible_texture(SDL_Renderer *renderer, TTF_Font *font, const char *utf8_text,
-                            int x_offset, int y_offset, int maxWidth, RenderData *rd, int viewportY,
-                            int viewportHeight)
+static TileCache *ensure_tile_cache(RenderData *rd, SDL_Renderer *renderer)
 {
-    if (!renderer || !font || !utf8_text || !rd)
-        return -1;
-    // Create an empty surface sized to viewportWidth x viewportHeight
-
-    int surf_w = rd->maxLineWidth ? rd->maxLineWidth : maxWidth;
-    int surf_h = viewportHeight;
-    SDL_Surface *surface = SDL_CreateRGBSurface(0, surf_w, surf_h, 32, 0, 0, 0, 0);
-    if (!surface)
-        return -1;
-#ifdef __EMSCRIPTEN__
-    printf("[DEBUG] Created surface: w=%d h=%d pitch=%d bpp=%d\n", surface->w, surface->h, surface->pitch, surface->format->BytesPerPixel);
-#endif
+    if (!rd->tile_cache && !rd->tiles_unsupported) {
+        rd->tile_cache = create_tile_cache(renderer, 0);
+        rd->tiles_unsupported = !rd->tile_cache;
+    }
+    return rd->tile_cache;
+}
 
-    // Clear background
-    SDL_FillRect(surface, NULL, SDL_MapRGB(surface->format, 22, 24, 32));
+// Give up on tiles for this renderer and draw quads directly from now on
+static void disable_tiles(RenderData *rd)
+{
+    debug_print(L"[TILES] Falling back to drawing glyph quads directly\n");
+    destroy_tile_cache(rd->tile_cache);
+    rd->tile_cache = NULL;
+    rd->tiles_unsupported = true;
+}
 
-    // Determine first visible cluster/line from viewportY using lineHeight
+// Mark the tiles an edit changed as stale. An edit inside one paragraph that
+// keeps the number of rows only changes that paragraph's rows; anything else
+// shifts the text below it as well. Tiles are drawn with a line of margin,
+// so the damage grows by a line on each side. The live buffer and its
+// snapshots share versions and edit log, so tiles drawn from one stay valid
+// for the other; only lost history (or an older snapshot) clears them.
+static void sync_tiles(RenderData *rd, PieceTable *buffer, TTF_Font *font, int maxWidth)
+{
+    TileCache *tiles = rd->tile_cache;
+    const TextLayout *layout = current_layout(rd, buffer);
+    uint64_t version = piece_table_version(buffer);
     int line_h = TTF_FontLineSkip(font);
-    int first_line = viewportY / line_h;
-    int last_line = (viewportY + viewportHeight) / line_h + 1;
-
-    // Scan text to render lines in [first_line, last_line]
-    int cur_line = 0;
-    int pos = 0;
-    int text_len = strlen(utf8_text);
-    while (pos < text_len && cur_line <= last_line) {
-        // Extract next logical line (until \n or end)
-        int line_start = pos;
-        while (pos < text_len && utf8_text[pos] != '\n')
-            pos++;
-        int line_end = pos; // points at '\n' or end
-
-        if (cur_line >= first_line && cur_line <= last_line) {
-            int chunk_len = line_end - line_start;
-            char *linebuf = malloc(chunk_len + 1);
-            if (linebuf) {
-                memcpy(linebuf, utf8_text + line_start, chunk_len);
-                linebuf[chunk_len] = '\0';
-
-                SDL_Color textColor = {198, 194, 199, 255};
-                SDL_Surface *textSurf =
-                    TTF_RenderUTF8_Blended_Wrapped(font, linebuf, textColor, maxWidth);
-                if (textSurf) {
-                    SDL_Rect dst = {0, (cur_line - first_line) * line_h, textSurf->w, textSurf->h};
-                    SDL_BlitSurface(textSurf, NULL, surface, &dst);
-                    SDL_FreeSurface(textSurf);
-                }
-                free(linebuf);
-            }
+    int lines = get_visual_line_count(rd, buffer);
+    size_t paragraphs = piece_table_line_count(buffer);
+    size_t pos, removed, inserted;
+
+    if (rd->tiles_font != font || rd->tiles_width != maxWidth ||
+        rd->tiles_line_height != line_h || rd->tiles_wrapped != (layout != NULL) ||
+        !piece_table_changes_since(buffer, rd->tiles_version, &pos, &removed, &inserted)) {
+        tile_cache_clear(tiles);
+    } else if (version != rd->tiles_version) {
+        bool same_rows = lines == rd->tiles_lines && paragraphs == rd->tiles_paragraphs;
+        long long top, bottom = INT_MAX;
+        if (layout) {
+            int p = text_layout_paragraph_at(layout, pos);
+            const LayoutParagraph *para = &layout->paragraphs[p];
+            top = para->y;
+            if (same_rows && text_layout_paragraph_at(layout, pos + inserted) == p)
+                bottom = (long long) para->y + para->height;
+        } else {
+            size_t line = piece_table_line_at(buffer, pos);
+            top = (long long) line * line_h;
+            if (same_rows && piece_table_line_at(buffer, pos + inserted) == line)
+                bottom = top + line_h;
         }
+        bottom = bottom < INT_MAX - line_h ? bottom + line_h : INT_MAX;
+        top = top > line_h ? top - line_h : 0;
+        tile_cache_invalidate(tiles, (int) top, (int) bottom);
+    }
+
+    rd->tiles_version = version;
+    rd->tiles_font = font;
+    rd->tiles_width = maxWidth;
+    rd->tiles_line_height = line_h;
+    rd->tiles_lines = lines;
+    rd->tiles_paragraphs = paragraphs;
+    rd->tiles_wrapped = layout != NULL;
+}
 
-        if (pos < text_len && utf8_text[pos] == '\n')
-            pos++;
-        cur_line++;
-    }
+// Draw a tile's text into its texture. The lines just outside the tile are
+// included so glyphs overhanging their line are not cut at the tile edge.
+static bool render_tile(SDL_Renderer *renderer, TTF_Font *font, PieceTable *buffer, int maxWidth,
+                        RenderData *rd, TileCacheEntry *tile)
+{
+    int line_h = TTF_FontLineSkip(font);
+    int top = tile->row * TILE_HEIGHT;
+    build_batch(font, buffer, -tile->column * TILE_WIDTH, -line_h, maxWidth, rd, top - line_h,
+                TILE_HEIGHT + 2 * line_h);
+
+    SDL_Texture *target = SDL_GetRenderTarget(renderer);
+    if (SDL_SetRenderTarget(renderer, tile->texture) != 0)
+        return false;
+    Uint8 r, g, b, a;
+    SDL_GetRenderDrawColor(renderer, &r, &g, &b, &a);
+    SDL_SetRenderDrawColor(renderer, 0, 0, 0, 0);
+    SDL_RenderClear(renderer);
+    SDL_SetRenderDrawColor(renderer, r, g, b, a);
+    int rc = glyph_batch_draw(renderer, rd->glyph_atlas, &rd->glyph_batch);
+    SDL_SetRenderTarget(renderer, target);
+    tile->valid = rc == 0;
+    tile->incomplete = rd->glyph_batch.placeholders > 0;
+    return tile->valid;
+}
+
+// Tiles covering the viewport, in units of TILE_WIDTH / TILE_HEIGHT
+static void visible_tiles(int maxWidth, int viewportY, int viewportHeight, int *first_row,
+                          int *last_row, int *columns)
+{
+    if (viewportY < 0)
+        viewportY = 0;
+    *first_row = viewportY / TILE_HEIGHT;
+    *last_row = (viewportY + (viewportHeight > 0 ? viewportHeight - 1 : 0)) / TILE_HEIGHT;
+    *columns = maxWidth > 0 ? (maxWidth + TILE_WIDTH - 1) / TILE_WIDTH : 1;
+}
 
-    // Create texture from surface and store in rd
-    if (rd->textTexture) {
-        SDL_DestroyTexture(rd->textTexture);
-        rd->textTexture = NULL;
+// Render the missing and stale tiles of the viewport; false if tiles cannot
+// be used
+static bool prepare_tiles(SDL_Renderer *renderer, TTF_Font *font, PieceTable *buffer,
+                          int maxWidth, RenderData *rd, int viewportY, int viewportHeight)
+{
+    TileCache *tiles = rd->tile_cache;
+    int first_row, last_row, columns;
+    visible_tiles(maxWidth, viewportY, viewportHeight, &first_row, &last_row, &columns);
+    if (!tile_cache_reserve(tiles, (last_row - first_row + 1) * columns))
+        return false;
+    sync_tiles(rd, buffer, font, maxWidth);
+    for (int row = first_row; row <= last_row; row++) {
+        for (int column = 0; column < columns; column++) {
+            TileCacheEntry *tile = tile_cache_get(tiles, column, row);
+            if (!tile)
+                return false;
+            if (!tile->valid && !render_tile(renderer, font, buffer, maxWidth, rd, tile))
+                return false;
+        }
     }
-    rd->textTexture = SDL_CreateTextureFromSurface(renderer, surface);
-    if (!rd->textTexture) {
-        SDL_FreeSurface(surface);
+    return true;
+}
+
+int prepare_visible_texture(SDL_Renderer *renderer, TTF_Font *font, PieceTable *buffer,
+                            int x_offset, int y_offset, int maxWidth, RenderData *rd, int viewportY,
+                            int viewportHeight)
+{
+    if (!renderer || !font || !buffer || !rd)
         return -1;
+    GlyphAtlas *atlas = ensure_glyph_atlas(rd, renderer);
+    if (!atlas || !ensure_font_metrics(rd, font))
+        return -1;
+    // Glyphs the workers finished replace their placeholders
+    if (glyph_atlas_collect(atlas) > 0 && rd->tile_cache)
+        tile_cache_invalidate_incomplete(rd->tile_cache);
+
+    if (ensure_tile_cache(rd, renderer)) {
+        if (prepare_tiles(renderer, font, buffer, maxWidth, rd, viewportY, viewportHeight))
+            return 0;
+        disable_tiles(rd);
     }
-#ifdef __EMSCRIPTEN__
-    int tex_w = 0, tex_h = 0;
-    SDL_QueryTexture(rd->textTexture, NULL, NULL, &tex_w, &tex_h);
-    printf("[DEBUG] Created texture: w=%d h=%d\n", tex_w, tex_h);
-#endif
-    // Update rd->textRect to describe viewport-sized texture
-    rd->textRect.x = x_offset;
-    rd->textRect.y = y_offset;
-    rd->textRect.w = surface->w;
-    rd->textRect.h = surface->h;
 
-    SDL_FreeSurface(surface);
+    uint64_t version = piece_table_version(buffer);
+    SDL_Rect area = {x_offset, y_offset, maxWidth, viewportHeight};
+    if (rd->glyph_batch_valid && rd->glyph_batch_version == version &&
+        rd->glyph_batch_generation == atlas->generation && rd->glyph_batch_scroll == viewportY &&
+        memcmp(&rd->glyph_batch_area, &area, sizeof(area)) == 0)
+        return 0;
+
+    build_batch(font, buffer, x_offset, y_offset, maxWidth, rd, viewportY, viewportHeight);
+    rd->glyph_batch_valid = true;
+    rd->glyph_batch_version = version;
+    rd->glyph_batch_generation = atlas->generation;
+    rd->glyph_batch_area = area;
+    rd->glyph_batch_scroll = viewportY;
     return 0;
 }
 
-// New cluster index accessor that uses RenderData (placeholder lazy behavior).
-int get_cluster_index_at_cursor(const char *text, int byte_cursor, RenderData *rd)
+int render_visible_text(SDL_Renderer *renderer, TTF_Font *font, PieceTable *buffer, int x_offset,
+                        int y_offset, int maxWidth, RenderData *rd, int viewportY,
+                        int viewportHeight)
 {
-    // If legacy full index exists, use old behavior
-    if (rd && rd->clusterByteIndices) {
-        return get_cluster_index_from_array(text, byte_cursor, rd->clusterByteIndices,
-                                            rd->numClusters);
+    // Drawing tiles switches render targets, which drops the caller's clip
+    SDL_Rect caller_clip = {0};
+    bool clipped = SDL_RenderIsClipEnabled(renderer);
+    if (clipped)
+        SDL_RenderGetClipRect(renderer, &caller_clip);
+    if (prepare_visible_texture(renderer, font, buffer, x_offset, y_offset, maxWidth, rd,
+                                viewportY, viewportHeight) != 0) {
+        SDL_RenderSetClipRect(renderer, clipped ? &caller_clip : NULL);
+        return -1;
     }
-
-    // Otherwise fallback to scanning — but do not allocate large arrays here
-    if (!text)
+    SDL_Rect clip = {x_offset, y_offset, maxWidth, viewportHeight};
+    if (clipped && !SDL_IntersectRect(&clip, &caller_clip, &clip)) {
+        SDL_RenderSetClipRect(renderer, &caller_clip);
         return 0;
-    if (byte_cursor > 0 && (size_t) byte_cursor == strlen(text)) {
-        return rd ? rd->numClusters : 0;
     }
-
-    int pos = 0;
-    int cluster = 0;
-    while (text[pos]) {
-        int next = pos + utf8_char_length(text + pos);
-        if (byte_cursor >= pos && byte_cursor < next)
-            return cluster;
-        pos = next;
-        cluster++;
+    SDL_RenderSetClipRect(renderer, &clip);
+    int rc = 0;
+    if (rd->tile_cache) {
+        int first_row, last_row, columns;
+        visible_tiles(maxWidth, viewportY, viewportHeight, &first_row, &last_row, &columns);
+        for (int row = first_row; row <= last_row; row++) {
+            for (int column = 0; column < columns; column++) {
+                const TileCacheEntry *tile = tile_cache_find(rd->tile_cache, column, row);
+                if (!tile)
+                    continue;
+                SDL_Rect dst = {x_offset + column * TILE_WIDTH,
+                                y_offset + row * TILE_HEIGHT - viewportY, TILE_WIDTH,
+                                TILE_HEIGHT};
+                if (SDL_RenderCopy(renderer, tile->texture, NULL, &dst) != 0)
+                    rc = -1;
+            }
+        }
+    } else {
+        rc = glyph_batch_draw(renderer, rd->glyph_atlas, &rd->glyph_batch);
     }
+    SDL_RenderSetClipRect(renderer, clipped ? &caller_clip : NULL);
+    return rc;
+}
+
+bool start_raster_workers(RenderData *rd, TTF_Font *font, const char *font_path, int font_size)
+{
+    if (rd->raster_pool)
+        return true;
+    rd->raster_pool = create_raster_pool(font, font_path, font_size, 0);
+    if (rd->glyph_atlas)
+        rd->glyph_atlas->pool = rd->raster_pool;
+    return rd->raster_pool != NULL;
+}
 
-    // Cursor at end
-    return cluster;
+void reset_render_textures(RenderData *rd)
+{
+    release_glyph_atlas(rd);
 }
 
-// Helper: determine the byte length of next UTF-8 character.
-static int utf8_char_length(const char *s)
+// Cluster index accessor that uses RenderData: the paragraph layout, or the
+// lazy blocks
+int get_cluster_index_at_cursor(PieceTable *buffer, int byte_cursor, RenderData *rd)
 {
-    unsigned char c = (unsigned char) s[0];
-    if (c < 0x80)
-        return 1;
-    else if ((c >> 5) == 0x6)
-        return 2;
-    else if ((c >> 4) == 0xE)
-        return 3;
-    else if ((c >> 3) == 0x1E)
-        return 4;
-    return 1;
+    if (!buffer)
+        return 0;
+    const TextLayout *layout = rd ? current_layout(rd, buffer) : NULL;
+    if (layout)
+        return text_layout_cluster_at(layout, byte_cursor > 0 ? (size_t) byte_cursor : 0);
+
+    // Otherwise count codepoints up to the cursor — but do not allocate large arrays here
+    ClusterBlockCache *cache = rd ? current_block_cache(rd, buffer) : NULL;
+    if (cache && byte_cursor >= 0)
+        return cluster_cache_cluster_at(cache, buffer, (size_t) byte_cursor);
+    size_t text_len = piece_table_length(buffer);
+    if (byte_cursor > 0 && (size_t) byte_cursor == text_len) {
+        return rd ? rd->numClusters : 0;
+    }
+    if (byte_cursor < 0 || (size_t) byte_cursor >= text_len) {
+        // Cursor at end
+        return (int) count_codepoints_in(buffer, 0, text_len);
+    }
+
+    // The cluster containing byte_cursor is the last one starting at or before it
+    return (int) count_codepoints_in(buffer, 0, (size_t) byte_cursor + 1) - 1;
 }
 
 int get_glyph_width(TTF_Font *font, const char *utf8_seq, int len)
 {
-    wchar_t wc;
-    mbtowc(&wc, utf8_seq, len);
+    if (len <= 0)
+        return 0;
+    // Decode the whole codepoint: glyphs outside the BMP need 32-bit metrics
+    uint32_t cp;
+    grapheme_decode(utf8_seq, (size_t) len, &cp);
     int minx, maxx, miny, maxy, advance;
-    if (TTF_GlyphMetrics(font, (Uint16) wc, &minx, &maxx, &miny, &maxy, &advance) == 0)
+    if (TTF_GlyphMetrics32(font, cp, &minx, &maxx, &miny, &maxy, &advance) == 0)
         return advance;
     int w, h;
     TTF_SizeUTF8(font, utf8_seq, &w, &h);
@@ -384,124 +767,42 @@ int get_glyph_width(TTF_Font *font, const char *utf8_seq, int len)
 
 int get_glyph_index_at_cursor(const char *text, int byte_cursor)
 {
-    int idx = 0, pos = 0;
-    while (text[pos] && pos < byte_cursor) {
-        int len = utf8_char_length(text + pos);
-        pos += len;
-        idx++;
-    }
-    return idx;
-}
-
-int get_cluster_index_from_array(const char *text, int byte_cursor, const int *clusterByteIndices,
-                                 int numClusters)
-{
-    // Handle empty text or invalid input
-    if (!text || numClusters == 0) {
-        debug_print(L"Empty text or no clusters, returning 0\n");
+    if (byte_cursor <= 0)
         return 0;
-    }
-    // If cursor is at the very end of the text
-    if (byte_cursor > 0 && (size_t) byte_cursor == strlen(text)) {
-        debug_print(L"Cursor at end of text, returning numClusters\n");
-        return numClusters; // Indicate position after the last cluster
-    }
-
-    debug_print(L"Finding cluster for byte_cursor: %d\n", byte_cursor);
-
-    // Find the exact cluster that contains the cursor
-    for (int i = 0; i < numClusters; i++) {
-        int nextOffset = (i + 1 < numClusters) ? clusterByteIndices[i + 1] : strlen(text);
-
-        if (byte_cursor >= clusterByteIndices[i] && byte_cursor < nextOffset) {
-            debug_print(L"Found cursor in cluster %d\n", i);
-            return i;
-        }
-    }
-
-    // Fallback if byte_cursor is 0 (start of text) and not caught by loop (e.g. empty string was
-    // handled)
-    if (byte_cursor == 0) {
-        debug_print(L"Cursor at beginning of text (byte_cursor 0)\n");
-        return 0;
-    }
-
-    // This case should ideally not be reached if logic above is complete.
-    // It implies cursor is beyond text but not caught by the specific end-of-text check,
-    // or some other unhandled scenario. Defaulting to last cluster or numClusters might be
-    // context-dependent.
-    debug_print(
-        L"Cursor position %d not resolved cleanly, returning numClusters -1 (last cluster)\n",
-        byte_cursor);
-    return numClusters - 1;
+    return (int) utf8_count_codepoints(text, strnlen(text, (size_t) byte_cursor));
 }
 
-int update_render_data(SDL_Renderer *renderer, TTF_Font *font, const char *utf8_text, int x_offset,
+int update_render_data(SDL_Renderer *renderer, TTF_Font *font, PieceTable *buffer, int x_offset,
                        int y_offset, int maxWidth, RenderData *rd)
 {
-    static uint32_t last_update_time = 0;
-    static uint32_t update_count = 0;
-    update_count++;
+    uint32_t update_count = ++rd->update_count;
     uint32_t current_time = SDL_GetTicks();
 
-    // Throttling and state tracking.
-    static uint32_t update_hash = 0;
-    uint32_t new_hash = 0;
-    for (const char *p = utf8_text; *p; p++) {
-        new_hash = ((new_hash << 5) + new_hash) + *p;
-    }
-    new_hash ^= maxWidth;
-    debug_print(L"[UPDATE %d] Computed hash: %u (prev: %u)\n", update_count, new_hash, update_hash);
-
-    if (current_time - last_update_time < 16 && new_hash == update_hash) {
-        debug_print(L"[THROTTLE] Skipping redundant update (hash: %u)\n", new_hash);
+    // Throttling and state tracking. The buffer version changes on every edit,
+    // and snapshots keep the version of the document they were taken from, so
+    // there is no need to re-hash the whole document to detect changes.
+    uint64_t new_version = piece_table_version(buffer);
+    debug_print(L"[UPDATE %d] Buffer version: %llu (prev: %llu)\n", update_count,
+                (unsigned long long) new_version, (unsigned long long) rd->update_version);
+
+    if (update_count > 1 && current_time - rd->update_time < 16 &&
+        new_version == rd->update_version && maxWidth == rd->update_width) {
+        debug_print(L"[THROTTLE] Skipping redundant update (version: %llu)\n",
+                    (unsigned long long) new_version);
         return 0;
     }
-    update_hash = new_hash;
-    last_update_time = current_time;
+    rd->update_version = new_version;
+    rd->update_width = maxWidth;
+    rd->update_time = current_time;
 
-    // Log text length and content.
-    size_t text_len = strlen(utf8_text);
-    debug_print(L"[UPDATE %d] Received text of length %u: \"%hs\"\n", update_count,
-                (unsigned) text_len, utf8_text);
-    // Check if text is empty
-    if (!utf8_text || !*utf8_text) {
-        debug_print(L"[UPDATE %d] Text is empty. Cleaning up and skipping layout.\n", update_count);
-
-        // Clean up any existing allocations
-        if (rd->textTexture) {
-            SDL_DestroyTexture(rd->textTexture);
-            rd->textTexture = NULL;
-        }
-        if (rd->glyphOffsets) {
-            free(rd->glyphOffsets);
-            rd->glyphOffsets = NULL;
-        }
-        if (rd->clusterByteIndices) {
-            free(rd->clusterByteIndices);
-            rd->clusterByteIndices = NULL;
-        }
-        if (rd->glyphRects) {
-            free(rd->glyphRects);
-            rd->glyphRects = NULL;
-        }
-        if (rd->clusterRects) {
-            free(rd->clusterRects);
-            rd->clusterRects = NULL;
-        }
-        if (rd->lineBreaks) {
-            free(rd->lineBreaks);
-            rd->lineBreaks = NULL;
-        }
-        if (rd->lineWidths) {
-            free(rd->lineWidths);
-            rd->lineWidths = NULL;
-        }
-        if (rd->glyphByteOffsets) {
-            free(rd->glyphByteOffsets);
-            rd->glyphByteOffsets = NULL;
-        }
+    // Nothing is rasterized here; render_visible_text draws from the atlas
+    (void) renderer;
 
+    size_t text_len = piece_table_length(buffer);
+    debug_print(L"[UPDATE %d] Received text of length %u\n", update_count, (unsigned) text_len);
+    // Check if text is empty
+    if (text_len == 0) {
+        debug_print(L"[UPDATE %d] Text is empty. Skipping layout.\n", update_count);
         rd->numGlyphs = 0;
         rd->numClusters = 0;
         rd->numLines = 0;
@@ -511,56 +812,37 @@ int update_render_data(SDL_Renderer *renderer, TTF_Font *font, const char *utf8_
         rd->textRect.y = y_offset;
         rd->textRect.w = 0;
         rd->textRect.h = rd->textH;
-        debug_print(L"[UPDATE %d] Skipping texture creation due to empty text.\n", update_count);
+        debug_print(L"[UPDATE %d] Skipping layout due to empty text.\n", update_count);
         return 0;
     }
 
-    // Create the text surface.
-    SDL_Color textColor = {198, 194, 199, 255};
-    SDL_Surface *textSurface = TTF_RenderUTF8_Blended_Wrapped(font, utf8_text, textColor, maxWidth);
-    if (!textSurface) {
-        debug_print(L"[ERROR] Failed to create text surface: %s\n", TTF_GetError());
-        return -1;
-    }
-
-    // Right after surface creation, update maxLineWidth for wrapping logic
+    // Start from one row per logical line. Lazy mode stays unwrapped; the
+    // paragraph layout below refines this with soft-wrapped rows.
     rd->maxLineWidth = maxWidth;
-
-    debug_print(L"[UPDATE %d] Surface created - W: %d, H: %d (Font height: %d)\n", update_count,
-                textSurface->w, textSurface->h, TTF_FontHeight(font));
-
-    // Right after confirming textSurface is valid but before creating texture:
-    rd->textW = textSurface->w;
-    rd->textH = textSurface->h;
+    int line_skip = TTF_FontLineSkip(font);
+    size_t num_lines = piece_table_line_count(buffer);
+    rd->numLines = (int) num_lines;
+    rd->lineHeight = line_skip;
+    rd->baselineSkip = line_skip;
+    rd->textW = maxWidth;
+    rd->textH = num_lines * (size_t) line_skip > INT_MAX ? INT_MAX : (int) num_lines * line_skip;
     rd->textRect.x = x_offset;
     rd->textRect.y = y_offset;
-    rd->textRect.w = textSurface->w;
-    rd->textRect.h = textSurface->h;
+    rd->textRect.w = rd->textW;
+    rd->textRect.h = rd->textH;
+    debug_print(L"[UPDATE %d] Document extent - W: %d, H: %d (%u lines)\n", update_count,
+                rd->textW, rd->textH, (unsigned) num_lines);
     // Initialize scroll position to top when layout changes
     rd->scrollY = 0;
-    // Heuristic: enable lazy mode if surface or text is very large
+    // Heuristic: enable lazy mode if the text is too large to keep a layout of
+    // every paragraph. The document height does not matter: text is drawn in
+    // tiles.
     rd->lazy_mode = 0;
-    rd->cluster_block_size = CLUSTER_BLOCK_SIZE;
-    rd->cluster_cache_blocks = CLUSTER_CACHE_BLOCKS;
-    if (rd->textH > 16384 || strlen(utf8_text) > 100000) {
+    if (text_len > 100000) {
         rd->lazy_mode = 1;
-        // Free full arrays to avoid huge memory usage; cache will be used lazily
-        if (rd->clusterByteIndices) {
-            free(rd->clusterByteIndices);
-            rd->clusterByteIndices = NULL;
-        }
-        if (rd->glyphOffsets) {
-            free(rd->glyphOffsets);
-            rd->glyphOffsets = NULL;
-        }
-        if (rd->glyphRects) {
-            free(rd->glyphRects);
-            rd->glyphRects = NULL;
-        }
-        if (rd->clusterRects) {
-            free(rd->clusterRects);
-            rd->clusterRects = NULL;
-        }
+        // Free the paragraph layout to avoid huge memory usage; cache will be used lazily
+        destroy_text_layout(rd->layout);
+        rd->layout = NULL;
     }
     debug_print(L"[UPDATE %d] Updated textRect to (%d, %d, %d, %d)\n", update_count, rd->textRect.x,
                 rd->textRect.y, rd->textRect.w, rd->textRect.h);
@@ -570,109 +852,42 @@ int update_render_data(SDL_Renderer *renderer, TTF_Font *font, const char *utf8_
     // Debug: log that we are about to compute glyph metrics.
     debug_print(L"[UPDATE %d] Starting layout computations...\n", update_count);
 
-    // Compute glyph and cluster layout (legacy/full mode only)
-    int utf8_len = strlen(utf8_text);
-
-    // Count UTF-8 characters first
-    int char_count = 0;
-    int pos = 0;
-    while (pos < utf8_len) {
-        int char_len = utf8_char_length(utf8_text + pos);
-        pos += char_len;
-        char_count++;
-    }
-
-    // If lazy_mode is enabled, avoid allocating large arrays and avoid creating
-    // a full texture. We will render only visible portions on demand.
+    // If lazy_mode is enabled, avoid allocating large arrays; positions are
+    // found through the cluster block cache on demand.
     if (rd->lazy_mode) {
+        // The checkpoint table is patched from the edit log, and also yields
+        // the cluster count without a rescan
+        sync_block_cache(rd, buffer);
+        ClusterBlockCache *cache = current_block_cache(rd, buffer);
+        int char_count = cache ? cache->num_clusters
+                               : (int) count_codepoints_in(buffer, 0, text_len);
         rd->numGlyphs = char_count;
         rd->numClusters = char_count;
-        // Free the big surface to avoid memory blowup
-        SDL_FreeSurface(textSurface);
-        // Ensure block cache exists (lazy allocations will populate on demand)
-        ensure_block_cache(rd);
         debug_print(L"[UPDATE %d] Lazy mode enabled - skipping full layout (chars=%d)\n",
                     update_count, char_count);
+        ClusterCacheStats stats = get_cluster_cache_stats(rd);
+        debug_print(L"[UPDATE %d] Cluster cache: %llu hits, %llu misses (%llu ghost), %llu "
+                    L"evictions\n",
+                    update_count, (unsigned long long) stats.hits,
+                    (unsigned long long) stats.misses, (unsigned long long) stats.ghost_hits,
+                    (unsigned long long) stats.evictions);
         return 0;
     }
 
-    // Free old allocations if they exist
-    if (rd->textTexture) {
-        SDL_DestroyTexture(rd->textTexture);
-        rd->textTexture = NULL;
-    }
-    if (rd->glyphOffsets) {
-        free(rd->glyphOffsets);
-        rd->glyphOffsets = NULL;
-    }
-    if (rd->clusterByteIndices) {
-        free(rd->clusterByteIndices);
-        rd->clusterByteIndices = NULL;
-    }
-    if (rd->glyphRects) {
-        free(rd->glyphRects);
-        rd->glyphRects = NULL;
-    }
-    if (rd->clusterRects) {
-        free(rd->clusterRects);
-        rd->clusterRects = NULL;
-    }
-    if (rd->glyphByteOffsets) {
-        free(rd->glyphByteOffsets);
-        rd->glyphByteOffsets = NULL;
-    }
-    if (rd->lineBreaks) {
-        free(rd->lineBreaks);
-        rd->lineBreaks = NULL;
-    }
-    if (rd->lineWidths) {
-        free(rd->lineWidths);
-        rd->lineWidths = NULL;
-    }
-
-    rd->glyphOffsets = malloc(char_count * sizeof(int));
-    rd->clusterByteIndices = malloc(char_count * sizeof(int));
-    rd->glyphRects = malloc(char_count * sizeof(SDL_Rect));
-    rd->clusterRects = malloc(char_count * sizeof(SDL_Rect));
-
-    if (!rd->glyphOffsets || !rd->clusterByteIndices || !rd->glyphRects || !rd->clusterRects) {
-        debug_print(L"[ERROR] Failed to allocate glyph/cluster arrays\n");
+    // Segment and measure only the paragraphs changed since the last update
+    if (!rd->layout)
+        rd->layout = create_text_layout();
+    if (!text_layout_sync(rd->layout, buffer, ensure_font_metrics(rd, font), maxWidth)) {
+        debug_print(L"[ERROR] Failed to lay out text\n");
         return -1;
     }
-
-    // Compute positions for each character
-    pos = 0;
-    int current_x = 0;
-    int font_height = TTF_FontHeight(font);
-
-    for (int i = 0; i < char_count; i++) {
-        int char_len = utf8_char_length(utf8_text + pos);
-
-        // Store byte index for this cluster
-        rd->clusterByteIndices[i] = pos;
-
-        // Store x offset for this glyph
-        rd->glyphOffsets[i] = current_x;
-
-        // Get character width
-        char temp_char[5] = {0};
-        memcpy(temp_char, utf8_text + pos, char_len);
-
-        int char_width, char_height;
-        if (TTF_SizeUTF8(font, temp_char, &char_width, &char_height) == 0) {
-            // Create glyph and cluster rectangles
-            rd->glyphRects[i] = (SDL_Rect){current_x, 0, char_width, font_height};
-            rd->clusterRects[i] = (SDL_Rect){current_x, 0, char_width, font_height};
-            current_x += char_width;
-        } else {
-            // Fallback for problematic characters
-            rd->glyphRects[i] = (SDL_Rect){current_x, 0, 10, font_height};
-            rd->clusterRects[i] = (SDL_Rect){current_x, 0, 10, font_height};
-            current_x += 10;
-        }
-
-        pos += char_len;
-    }
+    // Cluster and line queries are answered from the layout itself
+    const TextLayout *layout = rd->layout;
+    rd->numGlyphs = layout->num_clusters;
+    rd->numClusters = layout->num_clusters;
+    rd->numLines = layout->num_rows;
+    rd->textH = layout->height;
+    rd->textRect.h = rd->textH;
 
     debug_print(L"[UPDATE %d] Intermediate: computed glyph count = %d\n", update_count,
                 rd->numGlyphs);
@@ -685,75 +900,27 @@ int update_render_data(SDL_Renderer *renderer, TTF_Font *font, const char *utf8_
         L"[UPDATE %d] Final layout - TextW: %d, TextH: %d, NumGlyphs: %d, NumClusters: %d\n",
         update_count, rd->textW, rd->textH, rd->numGlyphs, rd->numClusters);
 
-    // Create texture from the surface.
-    SDL_Texture *texture = SDL_CreateTextureFromSurface(renderer, textSurface);
-    if (!texture) {
-        debug_print(L"[ERROR] Failed to create texture: %s\n", SDL_GetError());
-        SDL_FreeSurface(textSurface);
-        return -1;
-    }
-#ifdef __EMSCRIPTEN__
-    printf("[DEBUG] update_render_data created texture from surface w=%d h=%d\n", 
-           textSurface->w, textSurface->h);
-#endif
-
-    // Verify texture dimensions are reasonable
-    int tex_w, tex_h;
-    if (SDL_QueryTexture(texture, NULL, NULL, &tex_w, &tex_h) == 0) {
-#ifdef __EMSCRIPTEN__
-        printf("[DEBUG] Texture query result: w=%d h=%d\n", tex_w, tex_h);
-#endif
-        if (tex_w <= 0 || tex_h <= 0) {
-            debug_print(L"[ERROR] Invalid texture dimensions: %d x %d\n", tex_w, tex_h);
-            SDL_DestroyTexture(texture);
-            SDL_FreeSurface(textSurface);
-            return -1;
-        }
-        debug_print(L"[UPDATE %d] Created texture: %d x %d\n", update_count, tex_w, tex_h);
-    }
-
-    rd->textTexture = texture;
-    SDL_FreeSurface(textSurface);
-
     return 0;
 }
 
 void cleanup_render_data(RenderData *rd)
 {
-    if (rd->textTexture) {
-        SDL_DestroyTexture(rd->textTexture);
-        rd->textTexture = NULL;
-    }
-    if (rd->glyphOffsets) {
-        free(rd->glyphOffsets);
-        rd->glyphOffsets = NULL;
-    }
-    if (rd->clusterByteIndices) {
-        free(rd->clusterByteIndices);
-        rd->clusterByteIndices = NULL;
-    }
-    if (rd->glyphRects) {
-        free(rd->glyphRects);
-        rd->glyphRects = NULL;
-    }
-    if (rd->clusterRects) {
-        free(rd->clusterRects);
-        rd->clusterRects = NULL;
-    }
+    release_glyph_atlas(rd);
+    destroy_raster_pool(rd->raster_pool);
+    rd->raster_pool = NULL;
     rd->numGlyphs = 0;
     rd->numClusters = 0;
+    rd->numLines = 0;
+    destroy_text_layout(rd->layout);
+    rd->layout = NULL;
+    destroy_font_metrics(rd->font_metrics);
+    rd->font_metrics = NULL;
+    free(rd->line_x_offsets);
+    free(rd->line_x);
+    rd->line_x_offsets = rd->line_x = NULL;
+    rd->line_x_count = rd->line_x_capacity = 0;
 
     // Free cluster block cache if present
-    if (rd->cluster_block_cache) {
-        ClusterBlockCache *cache = (ClusterBlockCache *) rd->cluster_block_cache;
-        if (cache->blocks) {
-            for (int i = 0; i < cache->num_blocks_cached; i++) {
-                if (cache->blocks[i].offsets)
-                    free(cache->blocks[i].offsets);
-            }
-            free(cache->blocks);
-        }
-        free(cache);
-        rd->cluster_block_cache = NULL;
-    }
+    destroy_cluster_block_cache((ClusterBlockCache *) rd->cluster_block_cache);
+    rd->cluster_block_cache = NULL;
 }
@@ -1,58 +1,151 @@
 #ifndef TEXT_RENDERER_H
 #define TEXT_RENDERER_H
 
+#include "cluster_cache.h"
+#include "font_metrics.h"
+#include "glyph_atlas.h"
+#include "line_cache.h"
+#include "piece_table.h"
 #include "platform_sdl.h"
+#include "text_layout.h"
+#include "tile_cache.h"
 #include <SDL.h>
 #include <SDL_ttf.h>
 
 // RenderData holds precomputed text geometry.
 typedef struct {
-    SDL_Texture *textTexture;
     SDL_Rect textRect;
-    SDL_Rect *glyphRects; // per-glyph rectangles
-    int *glyphOffsets;    // relative x offsets per glyph
     int numGlyphs;
-    SDL_Rect *clusterRects; // merged clusters for highlighting
     int numClusters;
     int textW;
     int textH;
-    int *glyphByteOffsets;   // starting byte offset for each glyph
-    int *clusterByteIndices; // starting byte offset for each cluster
 
     // Line wrapping data
-    int *lineBreaks;  // Index of first cluster in each line
-    int *lineWidths;  // Width of each line
     int numLines;     // Number of lines after wrapping
     int lineHeight;   // Height of each line
     int maxLineWidth; // Maximum allowed line width
     int baselineSkip; // Distance between baselines of successive lines
     int scrollY;      // Vertical scroll offset in pixels (for viewport culling)
+    TextLayout *layout;        // per-paragraph cluster layout (not used in lazy mode)
+    FontMetrics *font_metrics; // advance and kerning cache for the current font
     // Lazy layout / cache
-    int lazy_mode;             // non-zero if using lazy per-viewport layout
-    int cluster_block_size;    // clusters per block
-    int cluster_cache_blocks;  // number of blocks to cache
-    void *cluster_block_cache; // opaque pointer to block cache (allocated by implementation)
+    int lazy_mode;                  // non-zero if using lazy per-viewport layout
+    int cluster_block_size;         // clusters per block (0 selects the default)
+    int cluster_cache_blocks;       // number of blocks to cache (0 selects the default)
+    void *cluster_block_cache;      // opaque pointer to block cache (allocated by implementation)
+    uint64_t cluster_cache_version; // buffer version the block cache describes
+    // Glyph atlas drawing
+    GlyphAtlas *glyph_atlas;         // glyphs rasterized for this RenderData's renderer
+    GlyphBatch glyph_batch;          // quads for the viewport last prepared
+    bool glyph_batch_valid;          // the fields below describe glyph_batch
+    uint64_t glyph_batch_version;    // buffer version the quads were built from
+    uint32_t glyph_batch_generation; // atlas generation the quads refer to
+    SDL_Rect glyph_batch_area;       // text origin, max width and viewport height
+    int glyph_batch_scroll;          // viewport top in document pixels
+    LineCache *line_cache;           // laid-out quads of recently drawn lines
+    // Tiled text surface; without one the viewport's quads are drawn directly
+    TileCache *tile_cache;          // rendered tiles of the document
+    bool tiles_unsupported;         // the renderer cannot render into tiles
+    uint64_t tiles_version;         // the fields below describe the resident tiles
+    const TTF_Font *tiles_font;
+    int tiles_width;
+    int tiles_line_height;
+    int tiles_lines;         // visual lines
+    size_t tiles_paragraphs; // logical lines
+    bool tiles_wrapped;      // rows came from the soft-wrapped layout
+    RasterPool *raster_pool; // glyph workers for the text font, or NULL
+    // Prefix advances of the logical line last measured without a layout
+    const PieceTable *line_x_buffer; // the fields below describe this buffer
+    uint64_t line_x_version;
+    const TTF_Font *line_x_font;
+    size_t line_x_start; // first byte of the line
+    int line_x_count;    // cluster boundaries, including the line start
+    int line_x_capacity;
+    int *line_x_offsets; // byte offset of each boundary from line_x_start
+    int *line_x;         // x of each boundary from the line start
+    // Last update_render_data, so repeats within a frame are skipped
+    uint32_t update_count; // calls so far, numbering the debug log
+    uint32_t update_time;  // SDL_GetTicks of the last update
+    uint64_t update_version;
+    int update_width;
 } RenderData;
 
 // Add line wrapping parameter
-int update_render_data(SDL_Renderer *renderer, TTF_Font *font, const char *utf8_text, int x_offset,
+int update_render_data(SDL_Renderer *renderer, TTF_Font *font, PieceTable *buffer, int x_offset,
                        int y_offset, int maxWidth, RenderData *rd);
 int get_glyph_index_at_cursor(const char *text, int byte_cursor);
+// Advance of the first codepoint of utf8_seq[0, len)
+int get_glyph_width(TTF_Font *font, const char *utf8_seq, int len);
 
-// New lazy cluster accessor: returns the cluster index containing byte_cursor
-// Uses RenderData's lazy blocks; prefers to be called when rd is available.
-int get_cluster_index_at_cursor(const char *text, int byte_cursor, RenderData *rd);
+// Cluster index containing byte_cursor (numClusters at the end). Answered by
+// the paragraph layout when it is current, by the lazy blocks otherwise.
+int get_cluster_index_at_cursor(PieceTable *buffer, int byte_cursor, RenderData *rd);
 
-// Return byte offset for a given cluster index; ensures the block containing
-// the cluster is resident (lazy evaluation). Returns -1 on error.
-int get_cluster_byte_offset(RenderData *rd, const char *text, int clusterIndex);
-// Ensure the visible viewport texture is prepared in lazy mode. Returns 0 on success.
-int prepare_visible_texture(SDL_Renderer *renderer, TTF_Font *font, const char *utf8_text,
+// Visual (soft-wrapped) lines. Without an up-to-date layout (lazy mode, or an
+// edit not yet passed to update_render_data) each logical line is one visual
+// line. Lookups are O(log n) in the number of lines.
+int get_visual_line_count(const RenderData *rd, const PieceTable *buffer);
+int get_visual_line_at(const RenderData *rd, const PieceTable *buffer, size_t pos);
+// Byte range of a visual line; the end excludes the '\n'
+size_t get_visual_line_start(const RenderData *rd, const PieceTable *buffer, int line);
+size_t get_visual_line_end(const RenderData *rd, const PieceTable *buffer, int line);
+// Cursor moved by lines visual lines (negative moves up). The x position is
+// kept where the layout is known, the byte column otherwise.
+int move_cursor_visual_lines(const RenderData *rd, const PieceTable *buffer, int cursor_pos,
+                             int lines);
+// Byte offset of the cluster boundary nearest to (x, y), given in pixels
+// from the top left of the document (add the scroll offset to window
+// coordinates). *cluster (if not NULL) receives the cluster index there. With
+// a current layout this is two binary searches: paragraph by row, then the
+// row's prefix advances by x.
+int hit_test_text(RenderData *rd, PieceTable *buffer, int x, int y, int *cluster);
+// Distance in pixels from the start of its visual line to byte offset pos: a
+// lookup in the layout's prefix advances, or without a layout in those kept
+// for pos's logical line, which are measured once per line and edit. Long
+// lines are measured as far as they are drawn.
+int get_visual_line_x(RenderData *rd, TTF_Font *font, PieceTable *buffer, size_t pos);
+// The same measured within visual line: 0 for positions before it and the
+// line's width for positions after it
+int get_visual_line_x_in(RenderData *rd, TTF_Font *font, PieceTable *buffer, int line, size_t pos);
+
+// Return byte offset for a given cluster index (the document length for
+// numClusters): from the paragraph layout when it is current, otherwise
+// through the block containing the cluster, made resident on demand (lazy
+// evaluation). Returns -1 on error.
+int get_cluster_byte_offset(RenderData *rd, PieceTable *buffer, int clusterIndex);
+// Make the text visible in [viewportY, viewportY + viewportHeight) ready to
+// draw: render the tiles covering it that are missing or stale, or, where the
+// renderer has no render targets, build the viewport's glyph quads. Only
+// glyphs the atlas does not hold yet are rasterized. Returns 0 on success.
+int prepare_visible_texture(SDL_Renderer *renderer, TTF_Font *font, PieceTable *buffer,
                             int x_offset, int y_offset, int maxWidth, RenderData *rd, int viewportY,
                             int viewportHeight);
+// Prepare the viewport as above and draw it, clipped to the text area, by
+// compositing its tiles (or with one SDL_RenderGeometry call). Returns 0 on
+// success.
+int render_visible_text(SDL_Renderer *renderer, TTF_Font *font, PieceTable *buffer, int x_offset,
+                        int y_offset, int maxWidth, RenderData *rd, int viewportY,
+                        int viewportHeight);
+
+// Lazy block cache geometry. set_cluster_cache_defaults applies to RenderData
+// that leaves cluster_block_size / cluster_cache_blocks at 0;
+// set_cluster_cache_size resizes one RenderData's cache now. Returns false if
+// the new size could not be allocated (the old one stays in use).
+void set_cluster_cache_defaults(int block_size, int num_blocks);
+bool set_cluster_cache_size(RenderData *rd, int block_size, int num_blocks);
+
+// Hit/miss/eviction counters of the lazy block cache (zero before first use)
+ClusterCacheStats get_cluster_cache_stats(const RenderData *rd);
+
+// Rasterize glyphs of font on worker threads from now on; font_path and
+// font_size must be what font was opened with. Glyphs show as placeholders
+// until their pixels arrive. Returns false (drawing stays synchronous) if no
+// worker could be started.
+bool start_raster_workers(RenderData *rd, TTF_Font *font, const char *font_path, int font_size);
 
-// Invalidate cache blocks after a cluster index (call after edits)
-void invalidate_cluster_blocks_after(RenderData *rd, int clusterIndex);
+// Drop every texture drawn for rd (glyph atlas and tiles); they are rebuilt
+// on the next draw. Needed when the renderer loses its render targets.
+void reset_render_textures(RenderData *rd);
 
 // Cleanup function to free RenderData allocated memory
 void cleanup_render_data(RenderData *rd);
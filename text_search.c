@@ -0,0 +1,444 @@
+#include "text_search.h"
+#include "case_fold_tables.h"
+#include "grapheme.h"
+#include <ctype.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#endif
+
+// Rough frequency rank of a byte in source code and prose; only the order
+// matters. The prefilter keys on the needle's least common bytes so that few
+// haystack positions survive to the memcmp.
+static int byte_rank(unsigned char c)
+{
+    switch (c) {
+    case ' ':
+    case 'e':
+    case 't':
+    case 'a':
+    case 'o':
+        return 8;
+    case 'i':
+    case 'n':
+    case 's':
+    case 'r':
+    case 'h':
+    case 'l':
+        return 7;
+    case '\n':
+    case '\t':
+    case '.':
+    case ',':
+    case '_':
+    case '(':
+    case ')':
+    case ';':
+        return 6;
+    }
+    if (c >= 'a' && c <= 'z')
+        return 6;
+    if (c >= 0x80 && c <= 0xBF) // UTF-8 continuation bytes
+        return 5;
+    if ((c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9'))
+        return 4;
+    if (c >= 0xC0 || (c >= 0x20 && c < 0x7F))
+        return 3;
+    return 1;
+}
+
+static inline unsigned char ascii_fold(unsigned char c)
+{
+    return (unsigned char) (c - 'A') < 26 ? c | 0x20 : c;
+}
+
+static inline bool is_ascii_letter(unsigned char c)
+{
+    return (unsigned char) ((c | 0x20) - 'a') < 26;
+}
+
+uint32_t case_fold_codepoint(uint32_t cp)
+{
+    if (cp < 0x80)
+        return ascii_fold((unsigned char) cp);
+
+    // First range ending at or after cp
+    int count = (int) (sizeof(case_fold_ranges) / sizeof(case_fold_ranges[0]));
+    int lo = 0, hi = count;
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2;
+        if (case_fold_ranges[mid].last < cp)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo < count) {
+        const CaseFoldRange *range = &case_fold_ranges[lo];
+        if (cp >= range->first && (cp - range->first) % range->stride == 0)
+            return (uint32_t) ((int32_t) cp + range->delta);
+    }
+    return cp;
+}
+
+static unsigned char utf8_lead_byte(uint32_t cp)
+{
+    if (cp < 0x80)
+        return (unsigned char) cp;
+    if (cp < 0x800)
+        return (unsigned char) (0xC0 | (cp >> 6));
+    if (cp < 0x10000)
+        return (unsigned char) (0xE0 | (cp >> 12));
+    return (unsigned char) (0xF0 | (cp >> 18));
+}
+
+// Mark the first byte of every codepoint that folds to target
+static void mark_fold_class(bool *starts, uint32_t target)
+{
+    starts[utf8_lead_byte(target)] = true;
+    size_t count = sizeof(case_fold_ranges) / sizeof(case_fold_ranges[0]);
+    for (size_t i = 0; i < count; i++) {
+        const CaseFoldRange *range = &case_fold_ranges[i];
+        uint32_t cp = (uint32_t) ((int32_t) target - range->delta);
+        if (cp >= range->first && cp <= range->last && (cp - range->first) % range->stride == 0)
+            starts[utf8_lead_byte(cp)] = true;
+    }
+}
+
+// Length of the text at h[i] that equals the needle under simple case
+// folding, or 0. Malformed bytes only match themselves.
+static size_t match_folded(const TextSearcher *searcher, const unsigned char *h, size_t len,
+                           size_t i)
+{
+    const unsigned char *n = searcher->needle;
+    size_t m = searcher->length;
+    size_t a = 0, b = i;
+    while (a < m) {
+        if (b >= len)
+            return 0;
+        unsigned char x = n[a], y = h[b];
+        if (x < 0x80 && y < 0x80) {
+            if (ascii_fold(x) != ascii_fold(y))
+                return 0;
+            a++;
+            b++;
+            continue;
+        }
+
+        uint32_t cx, cy;
+        size_t lx = grapheme_decode((const char *) n + a, m - a, &cx);
+        size_t ly = grapheme_decode((const char *) h + b, len - b, &cy);
+        if ((lx == 1 && x >= 0x80) || (ly == 1 && y >= 0x80)) {
+            if (x != y)
+                return 0;
+            lx = ly = 1;
+        } else if (case_fold_codepoint(cx) != case_fold_codepoint(cy)) {
+            return 0;
+        }
+        a += lx;
+        b += ly;
+    }
+    return b - i;
+}
+
+void init_text_searcher(TextSearcher *searcher, const char *needle, size_t length, bool fold)
+{
+    const unsigned char *n = (const unsigned char *) needle;
+    searcher->needle = n;
+    searcher->length = length;
+    searcher->fold = fold;
+    searcher->rare1 = 0;
+    searcher->rare2 = 0;
+    searcher->reach = 0;
+    searcher->mask1 = 0;
+    searcher->mask2 = 0;
+    searcher->scan_starts = false;
+    if (length == 0)
+        return;
+
+    if (!fold && length > TEXT_SEARCH_SHORT_MAX) {
+        // Horspool: shift by the distance from the last occurrence of the
+        // byte under the needle's end to the end of the needle
+        for (int c = 0; c < 256; c++)
+            searcher->shift[c] = length;
+        for (size_t i = 0; i + 1 < length; i++)
+            searcher->shift[n[i]] = length - 1 - i;
+        return;
+    }
+
+    // Candidate key bytes. In a folded match the needle's leading ASCII
+    // characters other than k and s (which KELVIN SIGN and LONG S fold to)
+    // can only be themselves or their other case, so they keep their offsets.
+    size_t span = length;
+    if (fold) {
+        span = 0;
+        while (span < length && n[span] < 0x80 && (n[span] | 0x20) != 'k' &&
+               (n[span] | 0x20) != 's')
+            span++;
+        if (span == 0) {
+            searcher->scan_starts = true;
+            memset(searcher->starts, 0, sizeof(searcher->starts));
+            uint32_t cp;
+            if (grapheme_decode(needle, length, &cp) == 1 && n[0] >= 0x80)
+                searcher->starts[n[0]] = true;
+            else
+                mark_fold_class(searcher->starts, case_fold_codepoint(cp));
+            return;
+        }
+        if (span > TEXT_SEARCH_SHORT_MAX)
+            span = TEXT_SEARCH_SHORT_MAX;
+    }
+
+    // The two rarest bytes at different offsets; ties keep the earlier one
+    size_t rare1 = 0, rare2;
+    for (size_t i = 1; i < span; i++) {
+        if (byte_rank(ascii_fold(n[i])) < byte_rank(ascii_fold(n[rare1])))
+            rare1 = i;
+    }
+    rare2 = rare1 == 0 && span > 1 ? 1 : 0;
+    for (size_t i = 0; i < span; i++) {
+        if (i != rare1 && byte_rank(ascii_fold(n[i])) < byte_rank(ascii_fold(n[rare2])))
+            rare2 = i;
+    }
+
+    searcher->rare1 = rare1;
+    searcher->rare2 = rare2;
+    searcher->reach = rare1 > rare2 ? rare1 : rare2;
+    searcher->key1 = n[rare1];
+    searcher->key2 = n[rare2];
+    if (fold && is_ascii_letter(n[rare1])) {
+        searcher->key1 |= 0x20;
+        searcher->mask1 = 0x20;
+    }
+    if (fold && is_ascii_letter(n[rare2])) {
+        searcher->key2 |= 0x20;
+        searcher->mask2 = 0x20;
+    }
+}
+
+// Length of the match at h[i], or 0
+static inline size_t match_at(const TextSearcher *searcher, const unsigned char *h, size_t len,
+                              size_t i)
+{
+    if (searcher->fold)
+        return match_folded(searcher, h, len, i);
+    size_t m = searcher->length;
+    return i + m <= len && memcmp(h + i, searcher->needle, m) == 0 ? m : 0;
+}
+
+// Portable fallback: test the key bytes at each position, letting memchr
+// skip ahead when the first key is compared exactly
+static size_t find_keyed_scalar(const TextSearcher *searcher, const unsigned char *h, size_t len,
+                                size_t i, size_t *match_length)
+{
+    size_t reach = searcher->reach;
+    for (; i + reach < len; i++) {
+        if (searcher->mask1 == 0) {
+            const unsigned char *p =
+                memchr(h + i + searcher->rare1, searcher->key1, len - reach - i);
+            if (!p)
+                break;
+            i = (size_t) (p - h) - searcher->rare1;
+        } else if ((h[i + searcher->rare1] | searcher->mask1) != searcher->key1) {
+            continue;
+        }
+        if ((h[i + searcher->rare2] | searcher->mask2) != searcher->key2)
+            continue;
+        size_t n = match_at(searcher, h, len, i);
+        if (n) {
+            *match_length = n;
+            return i;
+        }
+    }
+    return TEXT_SEARCH_NONE;
+}
+
+// The block loops test W candidate starts at once while every load stays
+// inside the haystack; match_at bounds the candidates themselves
+#if defined(__AVX2__)
+
+static size_t find_keyed(const TextSearcher *searcher, const unsigned char *h, size_t len,
+                         size_t i, size_t *match_length)
+{
+    const unsigned char *p1 = h + searcher->rare1;
+    const unsigned char *p2 = h + searcher->rare2;
+    const __m256i k1 = _mm256_set1_epi8((char) searcher->key1);
+    const __m256i k2 = _mm256_set1_epi8((char) searcher->key2);
+    const __m256i m1 = _mm256_set1_epi8((char) searcher->mask1);
+    const __m256i m2 = _mm256_set1_epi8((char) searcher->mask2);
+    for (; i + 32 + searcher->reach <= len; i += 32) {
+        __m256i v1 = _mm256_or_si256(_mm256_loadu_si256((const __m256i *) (p1 + i)), m1);
+        __m256i v2 = _mm256_or_si256(_mm256_loadu_si256((const __m256i *) (p2 + i)), m2);
+        uint32_t mask = (uint32_t) _mm256_movemask_epi8(
+            _mm256_and_si256(_mm256_cmpeq_epi8(v1, k1), _mm256_cmpeq_epi8(v2, k2)));
+        for (; mask; mask &= mask - 1) {
+            size_t at = i + (size_t) __builtin_ctz(mask);
+            size_t n = match_at(searcher, h, len, at);
+            if (n) {
+                *match_length = n;
+                return at;
+            }
+        }
+    }
+    return find_keyed_scalar(searcher, h, len, i, match_length);
+}
+
+#elif defined(__SSE2__)
+
+static size_t find_keyed(const TextSearcher *searcher, const unsigned char *h, size_t len,
+                         size_t i, size_t *match_length)
+{
+    const unsigned char *p1 = h + searcher->rare1;
+    const unsigned char *p2 = h + searcher->rare2;
+    const __m128i k1 = _mm_set1_epi8((char) searcher->key1);
+    const __m128i k2 = _mm_set1_epi8((char) searcher->key2);
+    const __m128i m1 = _mm_set1_epi8((char) searcher->mask1);
+    const __m128i m2 = _mm_set1_epi8((char) searcher->mask2);
+    for (; i + 16 + searcher->reach <= len; i += 16) {
+        __m128i v1 = _mm_or_si128(_mm_loadu_si128((const __m128i *) (p1 + i)), m1);
+        __m128i v2 = _mm_or_si128(_mm_loadu_si128((const __m128i *) (p2 + i)), m2);
+        uint32_t mask = (uint32_t) _mm_movemask_epi8(
+            _mm_and_si128(_mm_cmpeq_epi8(v1, k1), _mm_cmpeq_epi8(v2, k2)));
+        for (; mask; mask &= mask - 1) {
+            size_t at = i + (size_t) __builtin_ctz(mask);
+            size_t n = match_at(searcher, h, len, at);
+            if (n) {
+                *match_length = n;
+                return at;
+            }
+        }
+    }
+    return find_keyed_scalar(searcher, h, len, i, match_length);
+}
+
+#elif defined(__wasm_simd128__)
+
+static size_t find_keyed(const TextSearcher *searcher, const unsigned char *h, size_t len,
+                         size_t i, size_t *match_length)
+{
+    const unsigned char *p1 = h + searcher->rare1;
+    const unsigned char *p2 = h + searcher->rare2;
+    const v128_t k1 = wasm_i8x16_splat((int8_t) searcher->key1);
+    const v128_t k2 = wasm_i8x16_splat((int8_t) searcher->key2);
+    const v128_t m1 = wasm_i8x16_splat((int8_t) searcher->mask1);
+    const v128_t m2 = wasm_i8x16_splat((int8_t) searcher->mask2);
+    for (; i + 16 + searcher->reach <= len; i += 16) {
+        v128_t v1 = wasm_v128_or(wasm_v128_load(p1 + i), m1);
+        v128_t v2 = wasm_v128_or(wasm_v128_load(p2 + i), m2);
+        uint32_t mask =
+            wasm_i8x16_bitmask(wasm_v128_and(wasm_i8x16_eq(v1, k1), wasm_i8x16_eq(v2, k2)));
+        for (; mask; mask &= mask - 1) {
+            size_t at = i + (size_t) __builtin_ctz(mask);
+            size_t n = match_at(searcher, h, len, at);
+            if (n) {
+                *match_length = n;
+                return at;
+            }
+        }
+    }
+    return find_keyed_scalar(searcher, h, len, i, match_length);
+}
+
+#else
+
+static size_t find_keyed(const TextSearcher *searcher, const unsigned char *h, size_t len,
+                         size_t i, size_t *match_length)
+{
+    return find_keyed_scalar(searcher, h, len, i, match_length);
+}
+
+#endif
+
+// Folded needles without a fixed-offset key
+static size_t find_starts(const TextSearcher *searcher, const unsigned char *h, size_t len,
+                          size_t i, size_t *match_length)
+{
+    for (; i < len; i++) {
+        if (!searcher->starts[h[i]])
+            continue;
+        size_t n = match_folded(searcher, h, len, i);
+        if (n) {
+            *match_length = n;
+            return i;
+        }
+    }
+    return TEXT_SEARCH_NONE;
+}
+
+// Boyer-Moore-Horspool. The shift never passes an occurrence, so overlapping
+// matches are still found one call at a time.
+static size_t find_long(const TextSearcher *searcher, const unsigned char *h, size_t len,
+                        size_t i)
+{
+    size_t m = searcher->length;
+    unsigned char last = searcher->needle[m - 1];
+    while (i + m <= len) {
+        unsigned char c = h[i + m - 1];
+        if (c == last && memcmp(h + i, searcher->needle, m - 1) == 0)
+            return i;
+        i += searcher->shift[c];
+    }
+    return TEXT_SEARCH_NONE;
+}
+
+size_t text_search_next(const TextSearcher *searcher, const char *haystack, size_t length,
+                        size_t from, size_t *match_length)
+{
+    size_t m = searcher->length;
+    if (m == 0 || !haystack || from >= length)
+        return TEXT_SEARCH_NONE;
+
+    const unsigned char *h = (const unsigned char *) haystack;
+    if (searcher->fold) {
+        if (searcher->scan_starts)
+            return find_starts(searcher, h, length, from, match_length);
+        return find_keyed(searcher, h, length, from, match_length);
+    }
+
+    // Exact matches are as long as the needle
+    if (length - from < m)
+        return TEXT_SEARCH_NONE;
+    *match_length = m;
+    if (m == 1) {
+        const unsigned char *p = memchr(h + from, searcher->needle[0], length - from);
+        return p ? (size_t) (p - h) : TEXT_SEARCH_NONE;
+    }
+    if (m > TEXT_SEARCH_SHORT_MAX)
+        return find_long(searcher, h, length, from);
+    return find_keyed(searcher, h, length, from, match_length);
+}
+
+size_t text_search_match_at(const TextSearcher *searcher, const char *haystack, size_t length,
+                            size_t pos)
+{
+    if (searcher->length == 0 || !haystack || pos >= length)
+        return 0;
+    return match_at(searcher, (const unsigned char *) haystack, length, pos);
+}
+
+size_t text_search_max_match(const TextSearcher *searcher)
+{
+    // A folded needle character can match one of up to four bytes
+    return searcher->fold ? 4 * searcher->length : searcher->length;
+}
+
+static bool is_word_boundary(const char *text, size_t length, size_t pos)
+{
+    if (pos == 0 || pos >= length)
+        return true;
+
+    bool prev_is_word = isalnum((unsigned char) text[pos - 1]) || text[pos - 1] == '_';
+    bool curr_is_word = isalnum((unsigned char) text[pos]) || text[pos] == '_';
+
+    return prev_is_word != curr_is_word;
+}
+
+bool text_search_whole_word(const char *text, size_t length, size_t pos, size_t match_length)
+{
+    return is_word_boundary(text, length, pos) &&
+           is_word_boundary(text, length, pos + match_length);
+}
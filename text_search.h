@@ -0,0 +1,70 @@
+#ifndef TEXT_SEARCH_H
+#define TEXT_SEARCH_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// Substring search over a contiguous haystack. Short needles are found with
+// a two-byte prefilter: the two bytes of the needle least likely to occur in
+// text are compared against whole blocks of the haystack at once, and only
+// the positions where both agree are checked with memcmp. The block compare
+// is picked at compile time like utf8_simd: AVX2, SSE2, wasm simd128, or a
+// memchr loop on the rarest byte. Needles longer than TEXT_SEARCH_SHORT_MAX
+// use Boyer-Moore-Horspool, which skips ahead by up to the needle length.
+//
+// Case-insensitive searches compare under Unicode simple case folding,
+// decoding both sides as they go, so nothing is copied or allocated. The
+// prefilter still applies, with ASCII letters compared as (byte | 0x20); it
+// keys on the needle's leading ASCII bytes, since those sit at the same
+// offsets in every match. A match may differ from the needle in length
+// (KELVIN SIGN matches "k").
+//
+// Every occurrence is reported, including overlapping ones.
+
+#define TEXT_SEARCH_SHORT_MAX 32
+
+// Returned when there is no further match
+#define TEXT_SEARCH_NONE ((size_t) -1)
+
+typedef struct {
+    const unsigned char *needle; // not copied; must outlive the searcher
+    size_t length;
+    bool fold;    // compare under simple case folding
+    size_t rare1; // offsets of the two prefilter bytes in the needle
+    size_t rare2;
+    size_t reach; // the larger of rare1 and rare2
+    // Prefilter bytes, compared as (byte | mask) == key
+    unsigned char key1, key2;
+    unsigned char mask1, mask2;
+    // Folded needles opening with a non-ASCII character, 'k' or 's' have no
+    // fixed-offset key; every byte that can begin a match is tried instead
+    bool scan_starts;
+    bool starts[256];
+    size_t shift[256]; // Horspool shifts, for long exact needles only
+} TextSearcher;
+
+// Prepare to search for needle[0, length), ignoring case if fold is set
+void init_text_searcher(TextSearcher *searcher, const char *needle, size_t length, bool fold);
+
+// Offset of the first match starting at or after from in haystack[0, length),
+// or TEXT_SEARCH_NONE. The match's length in bytes is stored in match_length.
+// An empty needle matches nowhere.
+size_t text_search_next(const TextSearcher *searcher, const char *haystack, size_t length,
+                        size_t from, size_t *match_length);
+
+// Length of the match starting exactly at pos, or 0 if there is none
+size_t text_search_match_at(const TextSearcher *searcher, const char *haystack, size_t length,
+                            size_t pos);
+
+// Whether text[pos, pos + match_length) starts and ends on word boundaries,
+// words being runs of ASCII letters, digits and underscores
+bool text_search_whole_word(const char *text, size_t length, size_t pos, size_t match_length);
+
+// Upper bound on the length in bytes of any match
+size_t text_search_max_match(const TextSearcher *searcher);
+
+// Simple case folding of one codepoint
+uint32_t case_fold_codepoint(uint32_t cp);
+
+#endif // TEXT_SEARCH_H
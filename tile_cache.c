@@ -0,0 +1,167 @@
+#include "tile_cache.h"
+#include "debug.h"
+#include <stdlib.h>
+
+static void list_remove(TileCache *cache, int e)
+{
+    TileCacheEntry *entry = &cache->entries[e];
+    if (entry->prev >= 0)
+        cache->entries[entry->prev].next = entry->next;
+    else
+        cache->head = entry->next;
+    if (entry->next >= 0)
+        cache->entries[entry->next].prev = entry->prev;
+    else
+        cache->tail = entry->prev;
+}
+
+static void list_push(TileCache *cache, int e)
+{
+    TileCacheEntry *entry = &cache->entries[e];
+    entry->prev = -1;
+    entry->next = cache->head;
+    if (entry->next >= 0)
+        cache->entries[entry->next].prev = e;
+    else
+        cache->tail = e;
+    cache->head = e;
+}
+
+// Glyphs are blended into a transparent tile, which leaves its color
+// premultiplied by alpha; compositing must not multiply by alpha again
+static SDL_Texture *create_tile_texture(SDL_Renderer *renderer)
+{
+    SDL_Texture *texture = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888,
+                                             SDL_TEXTUREACCESS_TARGET, TILE_WIDTH, TILE_HEIGHT);
+    if (!texture) {
+        debug_print(L"[TILES] Failed to create %dx%d tile: %hs\n", TILE_WIDTH, TILE_HEIGHT,
+                    SDL_GetError());
+        return NULL;
+    }
+    SDL_BlendMode premultiplied = SDL_ComposeCustomBlendMode(
+        SDL_BLENDFACTOR_ONE, SDL_BLENDFACTOR_ONE_MINUS_SRC_ALPHA, SDL_BLENDOPERATION_ADD,
+        SDL_BLENDFACTOR_ONE, SDL_BLENDFACTOR_ONE_MINUS_SRC_ALPHA, SDL_BLENDOPERATION_ADD);
+    if (SDL_SetTextureBlendMode(texture, premultiplied) != 0) {
+        debug_print(L"[TILES] Premultiplied blending unsupported: %hs\n", SDL_GetError());
+        SDL_DestroyTexture(texture);
+        return NULL;
+    }
+    return texture;
+}
+
+TileCache *create_tile_cache(SDL_Renderer *renderer, int capacity)
+{
+    if (!renderer || !SDL_RenderTargetSupported(renderer))
+        return NULL;
+    if (capacity <= 0)
+        capacity = TILE_CACHE_TILES;
+    TileCache *cache = calloc(1, sizeof(TileCache));
+    if (!cache)
+        return NULL;
+    cache->entries = calloc(capacity, sizeof(TileCacheEntry));
+    if (!cache->entries) {
+        free(cache);
+        return NULL;
+    }
+    cache->renderer = renderer;
+    cache->capacity = capacity;
+    cache->head = cache->tail = -1;
+    return cache;
+}
+
+void destroy_tile_cache(TileCache *cache)
+{
+    if (!cache)
+        return;
+    for (int i = 0; i < cache->count; i++)
+        SDL_DestroyTexture(cache->entries[i].texture);
+    free(cache->entries);
+    free(cache);
+}
+
+bool tile_cache_reserve(TileCache *cache, int tiles)
+{
+    if (tiles <= cache->capacity)
+        return true;
+    TileCacheEntry *entries = realloc(cache->entries, tiles * sizeof(TileCacheEntry));
+    if (!entries)
+        return false;
+    cache->entries = entries;
+    cache->capacity = tiles;
+    return true;
+}
+
+// A viewport needs a handful of tiles, so a linear scan beats keeping an index
+static int find_entry(const TileCache *cache, int column, int row)
+{
+    for (int i = 0; i < cache->count; i++)
+        if (cache->entries[i].column == column && cache->entries[i].row == row)
+            return i;
+    return -1;
+}
+
+TileCacheEntry *tile_cache_get(TileCache *cache, int column, int row)
+{
+    int e = find_entry(cache, column, row);
+    if (e >= 0) {
+        if (cache->entries[e].valid)
+            cache->stats.hits++;
+        else
+            cache->stats.misses++;
+        if (cache->head != e) {
+            list_remove(cache, e);
+            list_push(cache, e);
+        }
+        return &cache->entries[e];
+    }
+
+    // Use a fresh texture while there is room, then the least recently used one
+    if (cache->count < cache->capacity) {
+        SDL_Texture *texture = create_tile_texture(cache->renderer);
+        if (!texture)
+            return NULL;
+        e = cache->count++;
+        cache->entries[e].texture = texture;
+    } else {
+        e = cache->tail;
+        list_remove(cache, e);
+        cache->stats.evictions++;
+    }
+    cache->stats.misses++;
+
+    TileCacheEntry *entry = &cache->entries[e];
+    entry->column = column;
+    entry->row = row;
+    entry->valid = false;
+    entry->incomplete = false;
+    list_push(cache, e);
+    return entry;
+}
+
+const TileCacheEntry *tile_cache_find(const TileCache *cache, int column, int row)
+{
+    int e = find_entry(cache, column, row);
+    return e >= 0 && cache->entries[e].valid ? &cache->entries[e] : NULL;
+}
+
+void tile_cache_invalidate(TileCache *cache, int top, int bottom)
+{
+    for (int i = 0; i < cache->count; i++) {
+        long long tile_top = (long long) cache->entries[i].row * TILE_HEIGHT;
+        if (tile_top < bottom && tile_top + TILE_HEIGHT > top)
+            cache->entries[i].valid = false;
+    }
+}
+
+void tile_cache_invalidate_incomplete(TileCache *cache)
+{
+    for (int i = 0; i < cache->count; i++)
+        if (cache->entries[i].incomplete)
+            cache->entries[i].valid = false;
+}
+
+void tile_cache_clear(TileCache *cache)
+{
+    for (int i = 0; i < cache->count; i++)
+        cache->entries[i].valid = false;
+}
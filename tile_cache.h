@@ -0,0 +1,77 @@
+#ifndef TILE_CACHE_H
+#define TILE_CACHE_H
+
+#include <SDL.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+// Tiled virtual surface for the text area. The document is cut into
+// TILE_WIDTH x TILE_HEIGHT tiles in document coordinates, and each tile is
+// rendered into its own target texture the first time it becomes visible.
+// Rendered tiles are kept in an LRU of textures: scrolling composites the
+// resident tiles and renders only the ones that come into view. No texture is
+// ever the size of the document, so its height is not bounded by the largest
+// texture the renderer can create.
+//
+// Tiles hold finished pixels, so they stay valid when the glyph atlas is
+// cleared. The owner marks the document rows an edit changed as invalid and
+// only those tiles are rendered again.
+
+#define TILE_WIDTH 1024
+#define TILE_HEIGHT 512
+
+// Default number of tile textures kept (4 MB each at 32 bits per pixel)
+#define TILE_CACHE_TILES 24
+
+typedef struct {
+    uint64_t hits;      // tiles found with valid pixels
+    uint64_t misses;    // tiles that had to be rendered
+    uint64_t evictions; // textures taken over by another tile
+} TileCacheStats;
+
+typedef struct {
+    SDL_Texture *texture;
+    int column; // tile position in units of TILE_WIDTH / TILE_HEIGHT
+    int row;
+    bool valid;      // texture holds the current pixels of the tile
+    bool incomplete; // drawn with placeholders for glyphs still being rasterized
+    int prev;        // towards the most recently used end
+    int next;        // towards the least recently used end
+} TileCacheEntry;
+
+typedef struct {
+    SDL_Renderer *renderer;
+    TileCacheEntry *entries;
+    int capacity;
+    int count;
+    int head; // most recently used entry
+    int tail; // least recently used entry
+    TileCacheStats stats;
+} TileCache;
+
+// Returns NULL if the renderer cannot render to textures. Non-positive
+// capacity selects TILE_CACHE_TILES.
+TileCache *create_tile_cache(SDL_Renderer *renderer, int capacity);
+void destroy_tile_cache(TileCache *cache);
+
+// Make room for at least tiles textures, so a whole viewport stays resident
+// while it is drawn. Returns false if the entries cannot be allocated.
+bool tile_cache_reserve(TileCache *cache, int tiles);
+
+// Entry of the tile, which becomes the most recently used. A tile that is not
+// resident takes over a fresh texture or the least recently used one, and
+// comes back with valid == false: the caller renders it and sets valid.
+// Returns NULL if no texture could be created.
+TileCacheEntry *tile_cache_get(TileCache *cache, int column, int row);
+
+// Resident tile with valid pixels, or NULL. Does not change the LRU order.
+const TileCacheEntry *tile_cache_find(const TileCache *cache, int column, int row);
+
+// Mark the tiles overlapping document rows [top, bottom) pixels as stale
+void tile_cache_invalidate(TileCache *cache, int top, int bottom);
+// Mark the tiles drawn with placeholder glyphs as stale
+void tile_cache_invalidate_incomplete(TileCache *cache);
+// Mark every tile as stale, keeping the textures for reuse
+void tile_cache_clear(TileCache *cache);
+
+#endif // TILE_CACHE_H
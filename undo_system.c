@@ -106,51 +106,27 @@ bool can_redo(UndoSystem *undo)
     return undo->current && undo->current->next;
 }
 
-bool perform_undo(UndoSystem *undo, char **text, int *cursor_pos)
+bool perform_undo(UndoSystem *undo, PieceTable *buffer, int *cursor_pos)
 {
     if (!can_undo(undo))
         return false;
 
     UndoAction *action = undo->current;
-    int text_len = strlen(*text);
 
     switch (action->type) {
-        case UNDO_INSERT: {
+        case UNDO_INSERT:
             // Remove the inserted text
-            int new_len = text_len - action->length;
-            char *new_text = malloc(new_len + 1);
-            if (!new_text)
+            if (!piece_table_delete(buffer, action->position, action->length))
                 return false;
-
-            memcpy(new_text, *text, action->position);
-            memcpy(new_text + action->position, *text + action->position + action->length,
-                   text_len - action->position - action->length);
-            new_text[new_len] = '\0';
-
-            free(*text);
-            *text = new_text;
             *cursor_pos = action->cursor_before;
             break;
-        }
 
-        case UNDO_DELETE: {
+        case UNDO_DELETE:
             // Restore the deleted text
-            int new_len = text_len + action->length;
-            char *new_text = malloc(new_len + 1);
-            if (!new_text)
+            if (!piece_table_insert(buffer, action->position, action->text, action->length))
                 return false;
-
-            memcpy(new_text, *text, action->position);
-            memcpy(new_text + action->position, action->text, action->length);
-            memcpy(new_text + action->position + action->length, *text + action->position,
-                   text_len - action->position);
-            new_text[new_len] = '\0';
-
-            free(*text);
-            *text = new_text;
             *cursor_pos = action->cursor_before;
             break;
-        }
 
         default:
             return false;
@@ -161,7 +137,7 @@ bool perform_undo(UndoSystem *undo, char **text, int *cursor_pos)
     return true;
 }
 
-bool perform_redo(UndoSystem *undo, char **text, int *cursor_pos)
+bool perform_redo(UndoSystem *undo, PieceTable *buffer, int *cursor_pos)
 {
     if (!can_redo(undo))
         return false;
@@ -170,45 +146,20 @@ bool perform_redo(UndoSystem *undo, char **text, int *cursor_pos)
     if (!action)
         return false;
 
-    int text_len = strlen(*text);
-
     switch (action->type) {
-        case UNDO_INSERT: {
+        case UNDO_INSERT:
             // Re-insert the text
-            int new_len = text_len + action->length;
-            char *new_text = malloc(new_len + 1);
-            if (!new_text)
+            if (!piece_table_insert(buffer, action->position, action->text, action->length))
                 return false;
-
-            memcpy(new_text, *text, action->position);
-            memcpy(new_text + action->position, action->text, action->length);
-            memcpy(new_text + action->position + action->length, *text + action->position,
-                   text_len - action->position);
-            new_text[new_len] = '\0';
-
-            free(*text);
-            *text = new_text;
             *cursor_pos = action->cursor_after;
             break;
-        }
 
-        case UNDO_DELETE: {
+        case UNDO_DELETE:
             // Re-delete the text
-            int new_len = text_len - action->length;
-            char *new_text = malloc(new_len + 1);
-            if (!new_text)
+            if (!piece_table_delete(buffer, action->position, action->length))
                 return false;
-
-            memcpy(new_text, *text, action->position);
-            memcpy(new_text + action->position, *text + action->position + action->length,
-                   text_len - action->position - action->length);
-            new_text[new_len] = '\0';
-
-            free(*text);
-            *text = new_text;
             *cursor_pos = action->cursor_after;
             break;
-        }
 
         default:
             return false;
@@ -1,6 +1,7 @@
 #ifndef UNDO_SYSTEM_H
 #define UNDO_SYSTEM_H
 
+#include "piece_table.h"
 #include <stdbool.h>
 
 typedef enum { UNDO_INSERT, UNDO_DELETE, UNDO_REPLACE } UndoType;
@@ -36,8 +37,8 @@ void record_delete_action(UndoSystem *undo, int position, const char *deleted_te
 // Undo/Redo operations
 bool can_undo(UndoSystem *undo);
 bool can_redo(UndoSystem *undo);
-bool perform_undo(UndoSystem *undo, char **text, int *cursor_pos);
-bool perform_redo(UndoSystem *undo, char **text, int *cursor_pos);
+bool perform_undo(UndoSystem *undo, PieceTable *buffer, int *cursor_pos);
+bool perform_redo(UndoSystem *undo, PieceTable *buffer, int *cursor_pos);
 
 // Utility
 void clear_redo_history(UndoSystem *undo);
@@ -0,0 +1,207 @@
+#include "utf8_simd.h"
+#include <stdint.h>
+#include <string.h>
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#elif defined(__wasm_simd128__)
+#include <wasm_simd128.h>
+#endif
+
+// Lead bytes are everything except 0x80..0xBF, i.e. signed bytes > -65
+#define UTF8_CONTINUATION_MAX ((int8_t) 0xBF)
+
+static inline int is_lead_byte(unsigned char c)
+{
+    return (c & 0xC0) != 0x80;
+}
+
+// Portable fallback: eight bytes per step. A byte is a continuation byte when
+// bit 7 is set and bit 6 is clear.
+static inline uint64_t continuation_bits(uint64_t w)
+{
+    return w & ~(w << 1) & 0x8080808080808080ull;
+}
+
+static size_t count_leads_scalar(const unsigned char *p, size_t len)
+{
+    size_t count = 0;
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t w;
+        memcpy(&w, p + i, sizeof(w));
+        count += 8 - (size_t) __builtin_popcountll(continuation_bits(w));
+    }
+    for (; i < len; i++)
+        count += is_lead_byte(p[i]);
+    return count;
+}
+
+// Offset of lead byte k (0-based) in p[0, len), or len if there are not enough
+static size_t find_lead_scalar(const unsigned char *p, size_t len, size_t k)
+{
+    size_t i = 0;
+    for (; i + 8 <= len; i += 8) {
+        uint64_t w;
+        memcpy(&w, p + i, sizeof(w));
+        size_t leads = 8 - (size_t) __builtin_popcountll(continuation_bits(w));
+        if (k < leads)
+            break;
+        k -= leads;
+    }
+    for (; i < len; i++) {
+        if (is_lead_byte(p[i])) {
+            if (k == 0)
+                return i;
+            k--;
+        }
+    }
+    return len;
+}
+
+// Index of set bit k (0-based) in mask; the caller guarantees it exists
+static inline size_t nth_set_bit(uint32_t mask, size_t k)
+{
+    while (k--)
+        mask &= mask - 1;
+    return (size_t) __builtin_ctz(mask);
+}
+
+#if defined(__AVX2__)
+
+static size_t count_leads(const unsigned char *p, size_t len)
+{
+    const __m256i limit = _mm256_set1_epi8(UTF8_CONTINUATION_MAX);
+    size_t count = 0;
+    size_t i = 0;
+    while (i + 32 <= len) {
+        // Accumulate per-byte counts for up to 255 chunks, then widen with SAD
+        __m256i acc = _mm256_setzero_si256();
+        size_t chunks = (len - i) / 32;
+        if (chunks > 255)
+            chunks = 255;
+        for (size_t c = 0; c < chunks; c++, i += 32) {
+            __m256i v = _mm256_loadu_si256((const __m256i *) (p + i));
+            acc = _mm256_sub_epi8(acc, _mm256_cmpgt_epi8(v, limit));
+        }
+        __m256i sums = _mm256_sad_epu8(acc, _mm256_setzero_si256());
+        count += (size_t) _mm256_extract_epi64(sums, 0) + (size_t) _mm256_extract_epi64(sums, 1) +
+                 (size_t) _mm256_extract_epi64(sums, 2) + (size_t) _mm256_extract_epi64(sums, 3);
+    }
+    return count + count_leads_scalar(p + i, len - i);
+}
+
+static size_t find_lead(const unsigned char *p, size_t len, size_t k)
+{
+    const __m256i limit = _mm256_set1_epi8(UTF8_CONTINUATION_MAX);
+    size_t i = 0;
+    for (; i + 32 <= len; i += 32) {
+        __m256i v = _mm256_loadu_si256((const __m256i *) (p + i));
+        uint32_t mask = (uint32_t) _mm256_movemask_epi8(_mm256_cmpgt_epi8(v, limit));
+        size_t leads = (size_t) __builtin_popcount(mask);
+        if (k < leads)
+            return i + nth_set_bit(mask, k);
+        k -= leads;
+    }
+    return i + find_lead_scalar(p + i, len - i, k);
+}
+
+#elif defined(__SSE2__)
+
+static size_t count_leads(const unsigned char *p, size_t len)
+{
+    const __m128i limit = _mm_set1_epi8(UTF8_CONTINUATION_MAX);
+    size_t count = 0;
+    size_t i = 0;
+    while (i + 16 <= len) {
+        __m128i acc = _mm_setzero_si128();
+        size_t chunks = (len - i) / 16;
+        if (chunks > 255)
+            chunks = 255;
+        for (size_t c = 0; c < chunks; c++, i += 16) {
+            __m128i v = _mm_loadu_si128((const __m128i *) (p + i));
+            acc = _mm_sub_epi8(acc, _mm_cmpgt_epi8(v, limit));
+        }
+        __m128i sums = _mm_sad_epu8(acc, _mm_setzero_si128());
+        count += (size_t) _mm_cvtsi128_si32(sums) +
+                 (size_t) _mm_cvtsi128_si32(_mm_srli_si128(sums, 8));
+    }
+    return count + count_leads_scalar(p + i, len - i);
+}
+
+static size_t find_lead(const unsigned char *p, size_t len, size_t k)
+{
+    const __m128i limit = _mm_set1_epi8(UTF8_CONTINUATION_MAX);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        __m128i v = _mm_loadu_si128((const __m128i *) (p + i));
+        uint32_t mask = (uint32_t) _mm_movemask_epi8(_mm_cmpgt_epi8(v, limit));
+        size_t leads = (size_t) __builtin_popcount(mask);
+        if (k < leads)
+            return i + nth_set_bit(mask, k);
+        k -= leads;
+    }
+    return i + find_lead_scalar(p + i, len - i, k);
+}
+
+#elif defined(__wasm_simd128__)
+
+static size_t count_leads(const unsigned char *p, size_t len)
+{
+    const v128_t limit = wasm_i8x16_splat(UTF8_CONTINUATION_MAX);
+    size_t count = 0;
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        v128_t v = wasm_v128_load(p + i);
+        count += (size_t) __builtin_popcount(wasm_i8x16_bitmask(wasm_i8x16_gt(v, limit)));
+    }
+    return count + count_leads_scalar(p + i, len - i);
+}
+
+static size_t find_lead(const unsigned char *p, size_t len, size_t k)
+{
+    const v128_t limit = wasm_i8x16_splat(UTF8_CONTINUATION_MAX);
+    size_t i = 0;
+    for (; i + 16 <= len; i += 16) {
+        v128_t v = wasm_v128_load(p + i);
+        uint32_t mask = wasm_i8x16_bitmask(wasm_i8x16_gt(v, limit));
+        size_t leads = (size_t) __builtin_popcount(mask);
+        if (k < leads)
+            return i + nth_set_bit(mask, k);
+        k -= leads;
+    }
+    return i + find_lead_scalar(p + i, len - i, k);
+}
+
+#else
+
+static size_t count_leads(const unsigned char *p, size_t len)
+{
+    return count_leads_scalar(p, len);
+}
+
+static size_t find_lead(const unsigned char *p, size_t len, size_t k)
+{
+    return find_lead_scalar(p, len, k);
+}
+
+#endif
+
+size_t utf8_count_codepoints(const char *s, size_t len)
+{
+    if (!s || len == 0)
+        return 0;
+    // The first byte always starts a codepoint, even a stray continuation byte
+    return 1 + count_leads((const unsigned char *) s + 1, len - 1);
+}
+
+size_t utf8_codepoint_offset(const char *s, size_t len, size_t n)
+{
+    if (!s || len == 0)
+        return 0;
+    if (n == 0)
+        return 0;
+    return 1 + find_lead((const unsigned char *) s + 1, len - 1, n - 1);
+}
@@ -0,0 +1,19 @@
+#ifndef UTF8_SIMD_H
+#define UTF8_SIMD_H
+
+#include <stddef.h>
+
+// Vectorized UTF-8 codepoint counting and seeking. A codepoint starts at the
+// first byte of a range and at every byte that is not a continuation byte
+// (10xxxxxx). For valid UTF-8 this is exactly the codepoint count; malformed
+// input is never over-read. The path is picked at compile time: AVX2, SSE2,
+// wasm simd128, or a portable 8-bytes-at-a-time fallback.
+
+// Number of codepoints in s[0, len)
+size_t utf8_count_codepoints(const char *s, size_t len);
+
+// Byte offset of codepoint n (0-based) in s[0, len), or len if s holds n or
+// fewer codepoints
+size_t utf8_codepoint_offset(const char *s, size_t len, size_t n);
+
+#endif // UTF8_SIMD_H